@@ -0,0 +1,20 @@
+#version 150
+
+uniform sampler2D atlasMap;     // impostor atlas
+
+in vec2 texCoord_;              // fragment texture coordinate
+
+out vec4 fragColor;             // fragment color
+
+void main()
+{
+    vec4 color = texture(atlasMap, texCoord_);
+
+    // the atlas is cleared to zero alpha around the captured nodes
+    if (color.a < 0.5)
+    {
+        discard;
+    }
+
+    fragColor = vec4(color.rgb, 1.0);
+}
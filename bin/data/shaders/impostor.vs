@@ -0,0 +1,29 @@
+#version 150
+
+layout(std140) uniform Camera
+{
+    mat4 viewMatrix;            // world to view transform
+    mat4 projectionMatrix;      // projection transform
+};
+
+in vec3 instanceCenter;         // quad center in world space per instance
+in vec3 instanceRight;          // quad right half axis in world space
+in vec3 instanceUp;             // quad up half axis in world space
+in vec4 instanceTexRect;        // atlas texture coordinate rectangle
+
+out vec2 texCoord_;             // fragment texture coordinate
+
+void main()
+{
+    // quad corners of a triangle strip from the vertex Id
+    vec2 corner = vec2(
+        float(gl_VertexID % 2) * 2.0 - 1.0,
+        float(gl_VertexID / 2) * 2.0 - 1.0
+    );
+
+    vec3 coord = instanceCenter + corner.x * instanceRight + corner.y * instanceUp;
+
+    texCoord_ = mix(instanceTexRect.xy, instanceTexRect.zw, 0.5 * (corner + 1.0));
+
+    gl_Position = projectionMatrix * viewMatrix * vec4(coord, 1.0);
+}
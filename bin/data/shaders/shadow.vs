@@ -1,7 +1,16 @@
 #version 150
 
-uniform mat4 modelViewMatrix;   // model to view transform
-uniform mat4 projectionMatrix;  // projection transform
+layout(std140) uniform Camera
+{
+    mat4 viewMatrix;            // world to view transform
+    mat4 projectionMatrix;      // projection transform
+};
+
+layout(std140) uniform Object
+{
+    mat4 modelViewMatrix;       // model to view transform
+    mat3 normalMatrix;          // model to view rotation
+};
 
 in vec3 coord;                  // vertex coordinate in world space
 
@@ -1,8 +1,13 @@
 #version 150
 
-uniform mat4 modelViewMatrix;   // model to view transform
-uniform mat4 projectionMatrix;  // projection transform
-uniform mat3 normalMatrix;      // model to view rotation
+layout(std140) uniform Camera
+{
+    mat4 viewMatrix;            // world to view transform
+    mat4 projectionMatrix;      // projection transform
+};
+
+in mat4 instanceModelViewMatrix;    // model to view transform per instance
+in mat3 instanceNormalMatrix;       // model to view rotation per instance
 
 in vec3 coord;                  // vertex coordinate in model space
 in vec3 normal;                 // vertex normal in model space
@@ -17,6 +22,9 @@ out vec2 texCoord_;             // fragment texture coordinate
 
 void main()
 {
+    mat4 modelViewMatrix = instanceModelViewMatrix;
+    mat3 normalMatrix = instanceNormalMatrix;
+
     coord_ = (modelViewMatrix * vec4(coord, 1.0)).xyz;
     normal_ = normalMatrix * normal;
     tangent_ = normalMatrix * tangent;
@@ -0,0 +1,91 @@
+/**
+ * @file geometry/box3.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GEOMETRY_BOX3_H_INCLUDED
+#define GEOMETRY_BOX3_H_INCLUDED
+
+#include <geometry/matrix3x3.h>
+#include <geometry/vector3.h>
+
+class Interval;
+class Transform3;
+
+/**
+ * Describes an oriented 3D box.
+ */
+class Box3
+{
+public:
+    // compiler-generated destructor, copy constructor and assignment operator
+    // are fine
+
+    /**
+     * Default constructor, constructs an uninitialized box.
+     */
+    Box3();
+
+    /**
+     * Constructor.
+     *
+     * @param center Center point.
+     * @param axes Box axes, the rows must be orthonormal.
+     * @param halfSize Half sizes along the box axes, the components must be
+     * non-negative.
+     */
+    Box3(const Vector3& center, const Matrix3x3& axes, const Vector3& halfSize);
+
+    /**
+     * Calculates the volume of <code>*this</code>.
+     *
+     * @return The volume.
+     */
+    float volume() const;
+
+    /**
+     * Exchanges the contents of <code>*this</code> and <code>other</code>.
+     *
+     * @param other The object to swap contents with.
+     */
+    void swap(Box3& other);
+
+    Vector3 center;     ///< Center point.
+    Matrix3x3 axes;     ///< Box axes as rows.
+    Vector3 halfSize;   ///< Half sizes along the box axes.
+};
+
+/**
+ * Fits an oriented box to a set of points. The box axes are the principal
+ * axes of the point set, or the coordinate axes if the box along them is
+ * smaller, so the box is never larger than the extents of the points.
+ *
+ * @param points The points to enclose.
+ * @param numPoints Number of points, must be > 0.
+ *
+ * @return Box enclosing all points.
+ */
+const Box3 fitBox(const Vector3* points, int numPoints);
+
+/**
+ * Calculates the interval of <code>x</code> along <code>axis</code>.
+ *
+ * @param x The box whose interval is to be calculated.
+ * @param axis The axis along which the interval is to be calculated.
+ *
+ * @return The calculated interval.
+ */
+const Interval interval(const Box3& x, const Vector3& axis);
+
+/**
+ * Transforms <code>x</code> by <code>t</code>. The box stays oriented, so
+ * the returned box is as tight as <code>x</code>.
+ *
+ * @param x The box to transform.
+ * @param t The transform to apply.
+ *
+ * @return The transformed box.
+ */
+const Box3 transform(const Box3& x, const Transform3& t);
+
+#endif // #ifndef GEOMETRY_BOX3_H_INCLUDED
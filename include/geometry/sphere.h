@@ -8,6 +8,9 @@
 
 #include <geometry/vector3.h>
 
+class Interval;
+class Transform3;
+
 /**
  * Describes a circle.
  */
@@ -41,4 +44,38 @@ public:
     float radius;   ///< Radius.
 };
 
+/**
+ * Fits the minimal sphere that encloses a set of points. The points are
+ * visited in a fixed pseudo-random order, so the expected running time is
+ * linear and the result is deterministic.
+ *
+ * @param points The points to enclose.
+ * @param numPoints Number of points, must be > 0.
+ *
+ * @return The minimal sphere enclosing all points, within floating point
+ * precision.
+ */
+const Sphere fitSphere(const Vector3* points, int numPoints);
+
+/**
+ * Calculates the interval of <code>x</code> along <code>axis</code>.
+ *
+ * @param x The sphere whose interval is to be calculated.
+ * @param axis The axis along which the interval is to be calculated, must be
+ * a unit vector.
+ *
+ * @return The calculated interval.
+ */
+const Interval interval(const Sphere& x, const Vector3& axis);
+
+/**
+ * Transforms <code>x</code> by <code>t</code>.
+ *
+ * @param x The sphere to transform.
+ * @param t The transform to apply.
+ *
+ * @return The transformed sphere.
+ */
+const Sphere transform(const Sphere& x, const Transform3& t);
+
 #endif // #ifndef GEOMETRY_SPHERE_H_INCLUDED
@@ -0,0 +1,295 @@
+/**
+ * @file graphics/aabbtree.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_AABBTREE_H_INCLUDED
+#define GRAPHICS_AABBTREE_H_INCLUDED
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <geometry/extents3.h>
+
+class GeometryNode;
+class PredrawParams;
+
+/**
+ * Dynamic bounding volume hierarchy of axis-aligned boxes. Each leaf holds a
+ * geometry node and its world extents enlarged by a margin, so that a node
+ * can move a little without the tree being modified. Leaves are inserted
+ * where they increase the total surface area of the tree the least, and the
+ * tree is kept balanced with tree rotations. Inserting, moving and removing
+ * a leaf takes O(log n) time. Leaves are identified by proxy Ids that stay
+ * valid until the leaf is removed.
+ */
+class AabbTree
+{
+public:
+    /**
+     * Destructor.
+     */
+    ~AabbTree();
+
+    /**
+     * Default constructor.
+     */
+    AabbTree();
+
+    /**
+     * Sets the margin by which the extents of inserted and moved leaves are
+     * enlarged. A larger margin makes moving cheaper and culling less
+     * accurate. Affects leaves inserted or reinserted after this call.
+     *
+     * @param margin The margin, must be >= 0.
+     */
+    void setMargin(float margin);
+
+    /**
+     * Gets the margin.
+     *
+     * @return The margin.
+     */
+    float margin() const;
+
+    /**
+     * Inserts a leaf.
+     *
+     * @param extents World extents of the geometry node.
+     * @param node The geometry node, cannot be a null pointer. This object
+     * does not take ownership of the geometry node.
+     *
+     * @return Proxy Id of the inserted leaf.
+     */
+    int insert(const Extents3& extents, GeometryNode* node);
+
+    /**
+     * Removes a leaf.
+     *
+     * @param proxy Proxy Id of the leaf.
+     */
+    void remove(int proxy);
+
+    /**
+     * Updates the extents of a leaf. The leaf is reinserted only if the new
+     * extents do not fit in the enlarged extents of the leaf or if the
+     * enlarged extents have become much larger than needed.
+     *
+     * @param proxy Proxy Id of the leaf.
+     * @param extents New world extents of the geometry node.
+     *
+     * @return <code>true</code>, if the leaf was reinserted,
+     * <code>false</code> otherwise.
+     */
+    bool move(int proxy, const Extents3& extents);
+
+    /**
+     * Gets the geometry node of a leaf.
+     *
+     * @param proxy Proxy Id of the leaf.
+     *
+     * @return The geometry node.
+     */
+    GeometryNode* node(int proxy) const;
+
+    /**
+     * Gets the enlarged extents of a leaf.
+     *
+     * @param proxy Proxy Id of the leaf.
+     *
+     * @return The enlarged extents.
+     */
+    const Extents3& fatExtents(int proxy) const;
+
+    /**
+     * Sets the moved flag of a leaf. The flag is not used by this class, the
+     * owner of the tree can use it to avoid queuing a leaf multiple times.
+     *
+     * @param proxy Proxy Id of the leaf.
+     * @param moved The flag.
+     */
+    void setMoved(int proxy, bool moved);
+
+    /**
+     * Gets the moved flag of a leaf.
+     *
+     * @param proxy Proxy Id of the leaf.
+     *
+     * @return The flag.
+     */
+    bool isMoved(int proxy) const;
+
+    /**
+     * Finds the geometry nodes whose enlarged extents intersect a region.
+     *
+     * @param region The region.
+     * @param nodes The found geometry nodes are appended here.
+     */
+    void query(const Extents3& region, std::vector<GeometryNode*>& nodes) const;
+
+    /**
+     * Culls the tree against the visibility test of given predraw parameters.
+     * Subtrees outside the frustum are skipped, and the predraw call is
+     * propagated to the geometry nodes of visible leaves with the frustum
+     * planes left to test.
+     *
+     * @param params Predraw parameters.
+     * @param planeMask Frustum planes to test, see
+     * <code>Node::predraw(const PredrawParams&, uint32_t) const</code>.
+     */
+    void predraw(const PredrawParams& params, uint32_t planeMask) const;
+
+    /**
+     * Culls the upper levels of the tree like
+     * <code>predraw(const PredrawParams&, uint32_t) const</code> and collects
+     * the visible subtrees of at most a given height instead of descending
+     * into them. The collected subtrees can then be culled independently with
+     * <code>predrawSubtree(int, const PredrawParams&, uint32_t) const</code>,
+     * also concurrently by different threads.
+     *
+     * @param params Predraw parameters.
+     * @param planeMask Frustum planes to test.
+     * @param maxHeight Maximum height of a collected subtree, must be >= 0.
+     * @param subtrees Node indices of the collected subtrees are appended
+     * here.
+     * @param planeMasks Frustum planes left to test in each collected subtree
+     * are appended here.
+     */
+    void splitPredraw(
+        const PredrawParams& params,
+        uint32_t planeMask,
+        int maxHeight,
+        std::vector<int>& subtrees,
+        std::vector<uint32_t>& planeMasks) const;
+
+    /**
+     * Culls a subtree collected by
+     * <code>splitPredraw(const PredrawParams&, uint32_t, int, std::vector<int>&, std::vector<uint32_t>&) const</code>.
+     * Calls with different subtrees can run concurrently if the predraw
+     * parameters do not share a render queue or a visibility test.
+     *
+     * @param subtree Node index of the subtree.
+     * @param params Predraw parameters.
+     * @param planeMask Frustum planes left to test in the subtree.
+     */
+    void predrawSubtree(int subtree, const PredrawParams& params, uint32_t planeMask) const;
+
+    /**
+     * Gets the number of leaves.
+     *
+     * @return Number of leaves.
+     */
+    int numProxies() const;
+
+    /**
+     * Gets the height of the tree. A tree with a single leaf has height
+     * <code>0</code>, an empty tree has height <code>-1</code>.
+     *
+     * @return Height of the tree.
+     */
+    int height() const;
+
+    /**
+     * Removes all leaves.
+     */
+    void clear();
+
+private:
+    /**
+     * Leaf, internal node or free node of the tree.
+     */
+    struct TreeNode
+    {
+        Extents3 extents;               ///< Enlarged extents for leaves.
+        GeometryNode* node;             ///< Geometry node of a leaf.
+        int parent;                     ///< Parent or next free node.
+        int child1;                     ///< First child, -1 for leaves.
+        int child2;                     ///< Second child, -1 for leaves.
+        int height;                     ///< 0 for leaves, -1 if free.
+        bool moved;                     ///< Moved flag of a leaf.
+        mutable int lastRejectingPlane; ///< Last rejecting frustum plane.
+    };
+
+    typedef std::vector<TreeNode> TreeNodeVector;
+
+    /**
+     * Takes a node from the free list, grows the node array if needed.
+     *
+     * @return Index of the node.
+     */
+    int allocateNode();
+
+    /**
+     * Returns a node to the free list.
+     *
+     * @param index Index of the node.
+     */
+    void freeNode(int index);
+
+    /**
+     * Inserts a leaf next to the sibling that minimizes the surface area
+     * increase of the tree.
+     *
+     * @param leaf Index of the leaf.
+     */
+    void insertLeaf(int leaf);
+
+    /**
+     * Removes a leaf, its parent is replaced with its sibling.
+     *
+     * @param leaf Index of the leaf.
+     */
+    void removeLeaf(int leaf);
+
+    /**
+     * Refits the extents and heights from a node up to the root, rotating
+     * unbalanced nodes on the way.
+     *
+     * @param index Index of the first node to refit.
+     */
+    void refit(int index);
+
+    /**
+     * Rotates a node if the heights of its subtrees differ by more than one.
+     *
+     * @param index Index of the node.
+     *
+     * @return Index of the node that replaced the rotated node.
+     */
+    int balance(int index);
+
+    /**
+     * Recursive part of <code>query(const Extents3&, std::vector<GeometryNode*>&) const</code>.
+     */
+    void query(int index, const Extents3& region, std::vector<GeometryNode*>& nodes) const;
+
+    /**
+     * Recursive part of <code>predraw(const PredrawParams&, uint32_t) const</code>.
+     */
+    void predraw(int index, const PredrawParams& params, uint32_t planeMask) const;
+
+    /**
+     * Recursive part of
+     * <code>splitPredraw(const PredrawParams&, uint32_t, int, std::vector<int>&, std::vector<uint32_t>&) const</code>.
+     */
+    void splitPredraw(
+        int index,
+        const PredrawParams& params,
+        uint32_t planeMask,
+        int maxHeight,
+        std::vector<int>& subtrees,
+        std::vector<uint32_t>& planeMasks) const;
+
+    TreeNodeVector nodes_;              ///< Node array.
+    int root_;                          ///< Root node, -1 if empty.
+    int freeList_;                      ///< First free node, -1 if none.
+    int numProxies_;                    ///< Number of leaves.
+    float margin_;                      ///< Extents margin.
+
+    // prevent copying
+    AabbTree(const AabbTree&);
+    AabbTree& operator =(const AabbTree&);
+};
+
+#endif // #ifndef GRAPHICS_AABBTREE_H_INCLUDED
@@ -98,7 +98,7 @@ public:
      */
     //@{
     virtual CameraNode* clone() const;
-    virtual void predraw(const PredrawParams&, bool) const;
+    virtual void predraw(const PredrawParams&, uint32_t) const;
     virtual const Extents3 worldExtents() const;
     //@}
 
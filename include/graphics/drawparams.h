@@ -9,7 +9,12 @@
 #include <geometry/matrix4x4.h>
 #include <geometry/transform3.h>
 
+class GeometryNode;
+class InstanceBuffer;
+class MeshArena;
 class Program;
+class StateCache;
+class UniformBuffer;
 
 /**
  * Describes draw parameters.
@@ -32,9 +37,45 @@ public:
      */
     void swap(DrawParams& other);
 
+    /**
+     * Gets the world transform a geometry node passed to a draw call is
+     * drawn with.
+     *
+     * @param node The geometry node.
+     * @param index Index of the node in the nodes passed to the draw call.
+     *
+     * @return <code>worldTransforms[index]</code>, or the world transform of
+     * <code>node</code> if <code>worldTransforms</code> is a null pointer.
+     */
+    const Transform3 worldTransform(const GeometryNode& node, int index) const;
+
+    /**
+     * Gets a copy of these parameters for drawing the nodes passed to a draw
+     * call starting from a given node.
+     *
+     * @param first Index of the first node.
+     *
+     * @return Copy of these parameters, <code>worldTransforms</code> points
+     * to the world transform of the first node.
+     */
+    const DrawParams offset(int first) const;
+
     Matrix4x4 viewMatrix;           ///< World to view transform matrix.
     Matrix4x4 projectionMatrix;     ///< Projection matrix.
     Matrix3x3 worldToViewRotation;  ///< World to view rotation matrix.
+    StateCache* stateCache;         ///< Render state cache.
+    InstanceBuffer* instanceBuffer; ///< Per-instance data buffer.
+    UniformBuffer* uniformBuffer;   ///< Uniform block data buffer.
+    MeshArena* meshArena;           ///< Shared mesh storage.
+    InstanceBuffer* commandBuffer;  ///< Indirect draw command buffer.
+
+    /**
+     * World transforms of the geometry nodes passed to a draw call, one for
+     * each node, or a null pointer if the nodes are drawn with their own world
+     * transforms. Set by the render queue when it draws prefab nodes on behalf
+     * of instance nodes.
+     */
+    const Transform3* worldTransforms;
 
     // TODO: quick & dirty
     Program* program;
@@ -6,9 +6,14 @@
 #ifndef GRAPHICS_GEOMETRYNODE_H_INCLUDED
 #define GRAPHICS_GEOMETRYNODE_H_INCLUDED
 
+#include <stdint.h>
+
 #include <graphics/node.h>
 
 class DrawParams;
+class ImpostorAtlas;
+class OcclusionBuffer;
+class VisibilityTest;
 
 /**
  * Abstract base class for all geometry nodes.
@@ -28,14 +33,147 @@ public:
      */
     virtual void draw(const DrawParams& params) const = 0;
 
+    /**
+     * Gets the render pass of this geometry node. Render passes are drawn in
+     * ascending order. The default implementation returns <code>0</code>.
+     *
+     * @return Render pass, only the low <code>SortKey::passBits</code> bits
+     * are used.
+     */
+    virtual uint32_t renderPass() const;
+
+    /**
+     * Gets the material key of this geometry node. Geometry nodes with equal
+     * material keys are drawn next to each other within a render pass. The
+     * default implementation returns <code>0</code>.
+     *
+     * @return Material key, only the low <code>SortKey::materialBits</code>
+     * bits are used.
+     */
+    virtual uint32_t materialKey() const;
+
+    /**
+     * Tells whether this geometry node can be drawn in the same instanced
+     * draw call as a given geometry node. The render queue looks for runs of
+     * adjacent geometry nodes with equal render passes and material keys for
+     * which this returns <code>true</code>. The default implementation
+     * returns <code>false</code>.
+     *
+     * @param other The geometry node to test.
+     *
+     * @return <code>true</code> if <code>other</code> can be drawn as an
+     * instance of this geometry node, <code>false</code> otherwise.
+     */
+    virtual bool isInstanceCompatible(const GeometryNode& other) const;
+
+    /**
+     * Draws a run of geometry nodes. This is called on the first geometry
+     * node of the run, all other geometry nodes of the run are compatible
+     * with it. The default implementation draws each geometry node with
+     * <code>draw(const DrawParams&)</code>.
+     *
+     * @param params Draw parameters.
+     * @param nodes Geometry nodes to draw, <code>nodes[0]</code> is
+     * <code>this</code>.
+     * @param numNodes Number of geometry nodes to draw, must be greater than
+     * <code>0</code>.
+     *
+     * @see isInstanceCompatible(const GeometryNode&) const
+     */
+    virtual void drawInstanced(
+        const DrawParams& params,
+        const GeometryNode* const* nodes,
+        int numNodes) const;
+
+    /**
+     * Tells whether this geometry node can be submitted in the same
+     * multi-draw indirect call as a given geometry node. Unlike instance
+     * compatible geometry nodes, multi-draw compatible geometry nodes may use
+     * different meshes. The render queue looks for runs of adjacent geometry
+     * nodes with equal render passes for which this returns
+     * <code>true</code>. The default implementation returns
+     * <code>false</code>.
+     *
+     * @param other The geometry node to test.
+     *
+     * @return <code>true</code> if <code>other</code> can be submitted with
+     * this geometry node, <code>false</code> otherwise.
+     */
+    virtual bool isMultiDrawCompatible(const GeometryNode& other) const;
+
+    /**
+     * Draws a run of multi-draw compatible geometry nodes. This is called on
+     * the first geometry node of the run. The default implementation draws
+     * the instance compatible runs within the run with
+     * <code>drawInstanced(const DrawParams&, const GeometryNode* const*, int) const</code>.
+     *
+     * @param params Draw parameters.
+     * @param nodes Geometry nodes to draw, <code>nodes[0]</code> is
+     * <code>this</code>.
+     * @param numNodes Number of geometry nodes to draw, must be greater than
+     * <code>0</code>.
+     *
+     * @see isMultiDrawCompatible(const GeometryNode&) const
+     */
+    virtual void drawMultiDraw(
+        const DrawParams& params,
+        const GeometryNode* const* nodes,
+        int numNodes) const;
+
+    /**
+     * Adds this geometry node to an occlusion buffer as an occluder. The
+     * default implementation does nothing.
+     *
+     * @param buffer The occlusion buffer.
+     */
+    virtual void rasterizeOccluder(OcclusionBuffer& buffer) const;
+
     /**
      * @name Node Interface
      */
     //@{
     virtual GeometryNode* clone() const = 0;
-    virtual void predraw(const PredrawParams&, bool) const;
+    virtual void predraw(const PredrawParams&, uint32_t) const;
+    virtual void predrawPrefab(const PredrawParams&, uint32_t, const Transform3&) const;
+
+    // unregisters this node from the old scene and registers it to the new
+    // scene
+    virtual void setScene(Scene*);
     //@}
 
+    /**
+     * Sets the proxy Id of this node in the spatial index of the scene.
+     *
+     * @param proxy Proxy Id, <code>-1</code> if not registered.
+     *
+     * @warning For internal use only.
+     */
+    void setSceneProxy(int proxy);
+
+    /**
+     * Gets the proxy Id of this node in the spatial index of the scene.
+     *
+     * @return Proxy Id, <code>-1</code> if not registered.
+     */
+    int sceneProxy() const;
+
+    /**
+     * Sets the impostor atlas that has a slot for this node. The slot is
+     * released when this node is deleted.
+     *
+     * @param p Pointer to the impostor atlas, or a null pointer for none.
+     *
+     * @warning For internal use only.
+     */
+    void setImpostorAtlas(ImpostorAtlas* p) const;
+
+    /**
+     * Gets the impostor atlas that has a slot for this node.
+     *
+     * @return Pointer to the impostor atlas, or a null pointer for none.
+     */
+    ImpostorAtlas* impostorAtlas() const;
+
 protected:
     /**
      * Default constructor.
@@ -49,7 +187,52 @@ protected:
      */
     GeometryNode(const GeometryNode& other);
 
+    /**
+     * Tells the scene that the world extents of this node have changed.
+     * Derived classes must call this when their world extents are
+     * invalidated.
+     */
+    void invalidateSceneProxy() const;
+
+    /**
+     * Releases the impostor slot of this node, the node is captured again
+     * when it is next drawn as an impostor. Derived classes must call this
+     * when their appearance changes in a way the material key does not
+     * tell.
+     */
+    void releaseImpostor();
+
+    /**
+     * Tests this node against the frustum of the predraw parameters.
+     *
+     * @param params Predraw parameters.
+     * @param planeMask Frustum planes to test. The planes this node is
+     * completely inside of are cleared.
+     *
+     * @return <code>true</code>, if this node may be visible,
+     * <code>false</code> otherwise.
+     */
+    bool testVisibility(const PredrawParams& params, uint32_t& planeMask) const;
+
+    /**
+     * Tests this node against the frustum planes of a visibility test. The
+     * default implementation tests the world extents, geometry nodes with
+     * tighter bounding volumes override this. Called by
+     * <code>testVisibility(const PredrawParams&, uint32_t&) const</code>.
+     *
+     * @param test The visibility test.
+     * @param planeMask Frustum planes to test, cannot be <code>0</code>. The
+     * planes this node is completely inside of are cleared.
+     *
+     * @return <code>true</code>, if this node may be inside the frustum,
+     * <code>false</code> otherwise.
+     */
+    virtual bool testFrustum(const VisibilityTest& test, uint32_t& planeMask) const;
+
 private:
+    int sceneProxy_;                    ///< Proxy Id in the scene.
+    mutable ImpostorAtlas* impostorAtlas_; ///< Impostor atlas of the slot.
+
     // hide the copy assignment operator
     GeometryNode& operator =(const GeometryNode&);
 };
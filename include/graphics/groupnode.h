@@ -14,6 +14,17 @@
 
 /**
  * A node that can contain child nodes.
+ *
+ * The world extents of a group node are maintained incrementally. When child
+ * nodes move, only the moved child nodes are checked on the next update: a
+ * child node still inside the world extents needs no refit, and a child node
+ * outside of them grows the world extents in place, and so does an attached
+ * child node. A detached child node leaves the world extents as they are.
+ * The world extents are rebuilt from all child nodes when many child nodes
+ * moved at once, when growing has made them much larger than at the last
+ * rebuild, or after as many child node changes as there are child nodes, so
+ * they do not stay loose for long. The world extents therefore enclose the
+ * world extents of the child nodes but may be larger.
  */
 class GroupNode : public Node
 {
@@ -35,24 +46,134 @@ public:
      */
     GroupNode(const GroupNode& other);
 
-    // TODO: comments
+    /**
+     * Attaches a child node. The child node is added after the existing
+     * child nodes.
+     *
+     * @param p The node to attach, must not have a parent node.
+     */
     void attachChild(Node* p);
+
+    /**
+     * Detaches a child node in constant time, the node is not deleted. The
+     * last child node takes the index of the detached node, so the order of
+     * the remaining child nodes may change.
+     *
+     * @param p The node to detach, must be a child node of this node.
+     */
     void detachChild(Node* p);
+
+    /**
+     * Attaches child nodes. Equivalent to attaching the nodes one by one, but
+     * the anchestor node counts are updated only once. The world extents grow
+     * in place to enclose the attached nodes.
+     *
+     * @param nodes The nodes to attach, must not have parent nodes.
+     * @param numNodes Number of nodes to attach.
+     */
+    void attachChildren(Node* const* nodes, int numNodes);
+
+    /**
+     * Detaches child nodes, the nodes are not deleted. Equivalent to
+     * detaching the nodes one by one, but the anchestor node counts are
+     * updated only once. The world extents are not shrunk until the next
+     * rebuild.
+     *
+     * @param nodes The nodes to detach, must be child nodes of this node.
+     * @param numNodes Number of nodes to detach.
+     */
+    void detachChildren(Node* const* nodes, int numNodes);
+
+    /**
+     * Reserves storage for child nodes, so that attaching up to
+     * <code>numChildren</code> child nodes does not reallocate.
+     *
+     * @param numChildren Number of child nodes to reserve storage for.
+     */
+    void reserveChildren(int numChildren);
+
+    // TODO: comments
     Node* child(int index) const;
     int numChildren() const;
     bool hasChildren() const;
 
     /**
-     * Invalidates the world extents.
+     * Gets the number of direct and indirect child nodes. The number is kept
+     * up to date when child nodes are attached and detached.
+     *
+     * @return Number of direct and indirect child nodes.
+     */
+    int numDescendants() const;
+
+    /**
+     * Sets the extents margin. Child node extents that grow the world
+     * extents in place are enlarged by the margin, so that a child node
+     * moving slowly outwards does not grow them on every update.
+     *
+     * @param margin The margin, must be >= 0. The default is 0.
+     */
+    void setExtentsMargin(float margin);
+
+    /**
+     * Gets the extents margin.
+     *
+     * @return The margin.
+     */
+    float extentsMargin() const;
+
+    /**
+     * Tells that the world extents of a child node have changed. The world
+     * extents of this node are refitted incrementally.
+     *
+     * @param child The child node.
+     *
+     * @warning For internal use only.
+     */
+    void invalidateChildExtents(const Node* child) const;
+
+    /**
+     * Resets the world extents counters of all group nodes.
+     */
+    static void resetExtentsCounters();
+
+    /**
+     * Gets the number of world extents rebuilt from all child nodes since the
+     * last reset.
+     *
+     * @return Number of full refits.
+     */
+    static int numFullRefits();
+
+    /**
+     * Gets the number of moved child nodes that grew the world extents of
+     * their parent in place since the last reset.
+     *
+     * @return Number of grown refits.
      */
-    void invalidateWorldExtents() const;
+    static int numGrownRefits();
+
+    /**
+     * Gets the number of moved child nodes that were still inside the world
+     * extents of their parent since the last reset, each of them avoided a
+     * refit.
+     *
+     * @return Number of avoided refits.
+     */
+    static int numAvoidedRefits();
+
+    /**
+     * Invalidates the world extents, they are rebuilt from all child nodes on
+     * the next update.
+     */
+    virtual void invalidateWorldExtents() const;
 
     /**
      * @name Node Interface
      */
     //@{
     virtual GroupNode* clone() const;
-    virtual void predraw(const PredrawParams&, bool) const;
+    virtual void predraw(const PredrawParams&, uint32_t) const;
+    virtual void predrawPrefab(const PredrawParams&, uint32_t, const Transform3&) const;
     virtual const Extents3 worldExtents() const;
 
     // invalidates the world transform of this node and all direct and indirect
@@ -69,17 +190,73 @@ private:
      */
     void deleteChildren();
 
+    /**
+     * Adds a child node without updating the world extents or the anchestor
+     * node counts.
+     *
+     * @param p The node to add.
+     *
+     * @return Number of nodes in the subtree of the added node.
+     */
+    int addChild(Node* p);
+
+    /**
+     * Removes a child node without updating the world extents or the
+     * anchestor node counts.
+     *
+     * @param p The node to remove.
+     *
+     * @return Number of nodes in the subtree of the removed node.
+     */
+    int removeChild(Node* p);
+
+    /**
+     * Propagates the predraw call to the child nodes. The world extents of
+     * the child nodes whose cached visibility results cannot be reused are
+     * tested in batches and the results are stored in their caches.
+     * Invisible child nodes are skipped, the others get the plane mask of
+     * this node and find their results in their caches.
+     *
+     * @param params Predraw parameters.
+     * @param planeMask Frustum planes to test, cannot be <code>0</code>.
+     */
+    void predrawBatched(const PredrawParams& params, uint32_t planeMask) const;
+
     /**
      * Updates and validates the world extents. This is called internally for
      * updating the world extents only when needed.
      */
     void updateWorldExtents() const;
 
+    /**
+     * Adds to the descendant counts of this group node and all anchestor
+     * nodes.
+     *
+     * @param n Number of attached nodes, negative for detached nodes.
+     */
+    void addDescendants(int n);
+
+    /**
+     * Rebuilds the world extents from the world extents of all child nodes.
+     */
+    void rebuildWorldExtents() const;
+
     typedef std::vector<Node*> NodeVector;
+    typedef std::vector<const Node*> ConstNodeVector;
 
     mutable bool worldExtentsValid_;    ///< Are world extents valid?
     mutable Extents3 worldExtents_;     ///< World extents.
+    mutable bool rebuildNeeded_;        ///< Rebuild on the next update?
+    mutable ConstNodeVector movedChildren_; ///< Moved child nodes.
+    mutable int numChanges_;            ///< Changes since the last rebuild.
+    mutable float rebuiltDiagonal_;     ///< Diagonal at the last rebuild.
+    float extentsMargin_;               ///< Extents margin.
     NodeVector children_;               ///< Child nodes.
+    int numDescendants_;                ///< Direct and indirect child nodes.
+
+    static int numFullRefits_;          ///< Rebuilt world extents.
+    static int numGrownRefits_;         ///< Grown world extents.
+    static int numAvoidedRefits_;       ///< Avoided refits.
 
     // hide the copy assignment operator
     GroupNode& operator =(const GroupNode&);
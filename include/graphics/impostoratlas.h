@@ -0,0 +1,363 @@
+/**
+ * @file graphics/impostoratlas.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_IMPOSTORATLAS_H_INCLUDED
+#define GRAPHICS_IMPOSTORATLAS_H_INCLUDED
+
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+#include <geometry/vector3.h>
+
+class DrawParams;
+class GeometryNode;
+class Program;
+class RenderQueue;
+class Texture;
+
+/**
+ * Impostor cache for distant geometry nodes. A render queue with an impostor
+ * atlas collects the visible geometry nodes whose projected size is below the
+ * switch size of the atlas as impostor nodes, the other geometry nodes are
+ * drawn as usual. Each impostor node gets a square slot in a shared atlas
+ * texture, and the node is drawn into the slot with an orthographic camera
+ * that looks at the bounding sphere of the node from the current view
+ * direction. The impostor is then drawn as one textured quad facing the
+ * capture direction, and all impostors are drawn with a single instanced draw
+ * call.
+ *
+ * The capture is kept while the view direction and the light direction,
+ * relative to the node, stay within the angle threshold of the directions at
+ * the capture, so a node is captured again only when it turns or the camera
+ * moves around it. The number of captures per frame is limited, missing
+ * captures are taken before stale ones. Stale impostors beyond the limit are
+ * drawn from the old capture and impostor nodes that have no capture are
+ * drawn as geometry. A slot that has not been
+ * used for a frame can be given to another node, the least recently used
+ * slot first.
+ *
+ * A node releases its slot when it is deleted or its mesh changes, and a node
+ * is captured again when its material key changes or it is scaled. A node has
+ * a slot in one atlas at a time, other atlases draw it as geometry. Only
+ * geometry nodes added without an instance transform are drawn as impostors.
+ */
+class ImpostorAtlas
+{
+public:
+    /**
+     * Destructor.
+     */
+    ~ImpostorAtlas();
+
+    /**
+     * Constructor. The atlas texture is created on the first update.
+     *
+     * @param atlasSize Width and height of the atlas texture in pixels, must
+     * be > 0.
+     * @param slotSize Width and height of a slot in pixels, must be > 2 and
+     * divide <code>atlasSize</code>.
+     */
+    explicit ImpostorAtlas(int atlasSize = 2048, int slotSize = 64);
+
+    /**
+     * Gets the width and height of the atlas texture.
+     *
+     * @return Atlas size in pixels.
+     */
+    int atlasSize() const;
+
+    /**
+     * Gets the width and height of a slot.
+     *
+     * @return Slot size in pixels.
+     */
+    int slotSize() const;
+
+    /**
+     * Gets the number of slots.
+     *
+     * @return Number of slots.
+     */
+    int numSlots() const;
+
+    /**
+     * Sets the switch size. Geometry nodes whose projected size is below the
+     * switch size are drawn as impostors. The LOD hysteresis of the render
+     * queue also applies to the switch size.
+     *
+     * @param size Switch size relative to the viewport height, must be >= 0.
+     *
+     * @see RenderQueue::projectedSize(const Extents3&) const
+     * @see RenderQueue::setLodHysteresis(float)
+     */
+    void setSwitchSize(float size);
+
+    /**
+     * Gets the switch size.
+     *
+     * @return Switch size relative to the viewport height.
+     */
+    float switchSize() const;
+
+    /**
+     * Sets the angle threshold. An impostor is captured again when the view
+     * direction or the light direction, relative to the node, differs from
+     * the direction at the capture by more than the threshold.
+     *
+     * @param angle Angle threshold in degrees, in range (0, 180].
+     */
+    void setAngleThreshold(float angle);
+
+    /**
+     * Gets the angle threshold.
+     *
+     * @return Angle threshold in degrees.
+     */
+    float angleThreshold() const;
+
+    /**
+     * Sets the direction of the light that the impostors are lit with.
+     *
+     * @param direction Light direction in world space, cannot be a zero
+     * vector.
+     */
+    void setLightDirection(const Vector3& direction);
+
+    /**
+     * Gets the light direction.
+     *
+     * @return Normalized light direction in world space.
+     */
+    const Vector3 lightDirection() const;
+
+    /**
+     * Sets the maximum number of captures per frame.
+     *
+     * @param n Maximum number of captures, must be > 0.
+     */
+    void setMaxCaptures(int n);
+
+    /**
+     * Gets the maximum number of captures per frame.
+     *
+     * @return Maximum number of captures.
+     */
+    int maxCaptures() const;
+
+    /**
+     * Sets the program that draws the geometry nodes into the atlas, usually
+     * the program of the render pass.
+     *
+     * @param p Pointer to the capture program.
+     */
+    void setCaptureProgram(Program* p);
+
+    /**
+     * Gets the capture program.
+     *
+     * @return Pointer to the capture program.
+     */
+    Program* captureProgram() const;
+
+    /**
+     * Sets the program that draws the impostor quads. The program takes the
+     * per-instance attributes <code>instanceCenter</code>,
+     * <code>instanceRight</code>, <code>instanceUp</code> and
+     * <code>instanceTexRect</code> and the atlas texture as
+     * <code>atlasMap</code>.
+     *
+     * @param p Pointer to the impostor program.
+     */
+    void setProgram(Program* p);
+
+    /**
+     * Gets the impostor program.
+     *
+     * @return Pointer to the impostor program.
+     */
+    Program* program() const;
+
+    /**
+     * Invalidates all captures, for example when the light color changes.
+     * The impostors are captured again as they are drawn.
+     */
+    void invalidate();
+
+    /**
+     * Releases the slots of all nodes and the atlas texture, the framebuffer
+     * and the vertex array object. Call before the OpenGL context is
+     * destroyed, the atlas is allocated again on the next update.
+     */
+    void release();
+
+    /**
+     * Releases the slot of a geometry node. Called when the node is deleted
+     * or its appearance changes.
+     *
+     * @param node The geometry node.
+     *
+     * @warning For internal use only.
+     */
+    void releaseNode(const GeometryNode* node);
+
+    /**
+     * Tells whether a geometry node should be drawn as an impostor. The
+     * switch size is lowered by the hysteresis for nodes that have no slot
+     * and raised by the hysteresis for nodes that have one. Called
+     * concurrently during the predraw step, the atlas must not be updated at
+     * the same time.
+     *
+     * @param node The geometry node.
+     * @param projectedSize Projected size of the node.
+     * @param hysteresis Hysteresis in range [0, 1).
+     *
+     * @return <code>true</code> if the node should be drawn as an impostor.
+     *
+     * @warning For internal use only.
+     */
+    bool isImpostor(const GeometryNode& node, float projectedSize, float hysteresis) const;
+
+    /**
+     * Assigns slots to the impostor nodes of a render queue and captures the
+     * missing and stale impostors. Call after the predraw step and before the
+     * camera block of the render pass is set, the capture sets the camera
+     * block, the viewport and the framebuffer and restores the viewport and
+     * the framebuffer.
+     *
+     * @param queue The render queue.
+     * @param params Draw parameters of the render pass.
+     */
+    void update(const RenderQueue& queue, const DrawParams& params);
+
+    /**
+     * Draws the impostor nodes of a render queue. The impostor nodes that
+     * have no capture are drawn as geometry with the program of the draw
+     * parameters, the impostors are drawn with the impostor program. The draw
+     * parameters must have an instance buffer.
+     *
+     * @param queue The render queue, updated to this atlas in this frame.
+     * @param params Draw parameters of the render pass.
+     */
+    void draw(const RenderQueue& queue, const DrawParams& params);
+
+    /**
+     * Gets the number of captures in the last update.
+     *
+     * @return Number of captures.
+     */
+    int numCaptures() const;
+
+    /**
+     * Gets the number of impostors drawn in the last draw.
+     *
+     * @return Number of impostors.
+     */
+    int numDrawnImpostors() const;
+
+    /**
+     * Gets the number of impostor nodes drawn as geometry in the last draw.
+     *
+     * @return Number of impostor nodes drawn as geometry.
+     */
+    int numDrawnFallbacks() const;
+
+    /**
+     * Gets the number of slots in use.
+     *
+     * @return Number of slots in use.
+     */
+    int numUsedSlots() const;
+
+private:
+    /**
+     * Atlas slot. The capture directions and the quad are stored in the
+     * model space of the node, so the impostor follows the node until the
+     * node turns past the angle threshold.
+     */
+    struct Slot
+    {
+        const GeometryNode* node;       ///< Node, a null pointer if free.
+        uint32_t materialKey;           ///< Material key of the node.
+        int serial;                     ///< Capture serial, -1 if none.
+        int lastUsedFrame;              ///< Frame the slot was last used.
+        Vector3 viewDirection;          ///< Capture view direction.
+        Vector3 lightDirection;         ///< Capture light direction.
+        Vector3 center;                 ///< Quad center.
+        Vector3 right;                  ///< Quad right half axis.
+        Vector3 up;                     ///< Quad up half axis.
+    };
+
+    typedef std::vector<Slot> SlotVector;
+    typedef std::map<const GeometryNode*, int> SlotMap;
+    typedef std::vector<int> IntVector;
+
+    /**
+     * Creates the atlas texture, the framebuffer and the vertex array
+     * object.
+     */
+    void allocate();
+
+    /**
+     * Finds the slot of a node or assigns a free or the least recently used
+     * slot to it.
+     *
+     * @param node The node.
+     *
+     * @return Slot index, or <code>-1</code> if all slots are in use in this
+     * frame or the node has a slot in another atlas.
+     */
+    int findSlot(const GeometryNode* node);
+
+    /**
+     * Tells whether the capture of a slot is stale for a node.
+     *
+     * @param slot The slot.
+     * @param node The node of the slot.
+     * @param params Draw parameters of the render pass.
+     *
+     * @return <code>true</code> if the impostor should be captured.
+     */
+    bool isStale(const Slot& slot, const GeometryNode& node, const DrawParams& params) const;
+
+    /**
+     * Draws a node into a slot.
+     *
+     * @param index Slot index.
+     * @param node The node.
+     * @param params Draw parameters of the render pass.
+     */
+    void capture(int index, const GeometryNode& node, const DrawParams& params);
+
+    int atlasSize_;                     ///< Atlas size in pixels.
+    int slotSize_;                      ///< Slot size in pixels.
+    float switchSize_;                  ///< Impostor switch size.
+    float angleThreshold_;              ///< Angle threshold in degrees.
+    float cosThreshold_;                ///< Cosine of the angle threshold.
+    Vector3 lightDirection_;            ///< Light direction in world space.
+    int maxCaptures_;                   ///< Maximum captures per frame.
+    Program* captureProgram_;           ///< Capture program.
+    Program* program_;                  ///< Impostor program.
+    Texture* texture_;                  ///< Atlas texture.
+    uint32_t framebufferId_;            ///< Framebuffer object Id.
+    uint32_t depthBufferId_;            ///< Depth renderbuffer Id.
+    uint32_t vertexArrayId_;            ///< Quad vertex array object Id.
+    SlotVector slots_;                  ///< Slots.
+    SlotMap nodeSlots_;                 ///< Slots by node.
+    IntVector freeSlots_;               ///< Free slots.
+    IntVector queueSlots_;              ///< Slots of the impostor nodes.
+    int serial_;                        ///< Current capture serial.
+    int frame_;                         ///< Update counter.
+    int numCaptures_;                   ///< Captures in the last update.
+    int numDrawnImpostors_;             ///< Impostors in the last draw.
+    int numDrawnFallbacks_;             ///< Fallbacks in the last draw.
+
+    // prevent copying
+    ImpostorAtlas(const ImpostorAtlas&);
+    ImpostorAtlas& operator =(const ImpostorAtlas&);
+};
+
+#endif // #ifndef GRAPHICS_IMPOSTORATLAS_H_INCLUDED
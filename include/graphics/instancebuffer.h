@@ -0,0 +1,87 @@
+/**
+ * @file graphics/instancebuffer.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_INSTANCEBUFFER_H_INCLUDED
+#define GRAPHICS_INSTANCEBUFFER_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Represents a streamed OpenGL buffer object for per-instance vertex data.
+ * The buffer is used as a ring buffer, each written block is placed after the
+ * previous block. When the end of the buffer is reached the buffer storage is
+ * orphaned and writing continues from the beginning, so blocks still in use by
+ * the OpenGL implementation are never overwritten. The buffer object is
+ * created on the first write, an OpenGL context must be current when this
+ * object is written to or destroyed.
+ */
+class InstanceBuffer
+{
+public:
+    /**
+     * Destructor.
+     */
+    ~InstanceBuffer();
+
+    /**
+     * Constructor.
+     *
+     * @param capacity Initial buffer capacity in bytes. The capacity is grown
+     * on demand if a single block does not fit in the buffer.
+     */
+    explicit InstanceBuffer(size_t capacity = 256 * 1024);
+
+    /**
+     * Maps a block of the buffer for writing. The block must be unmapped with
+     * <code>unmap()</code> before drawing from it. Leaves the buffer object
+     * bound to <code>GL_ARRAY_BUFFER</code>.
+     *
+     * @param size Block size in bytes, must be greater than <code>0</code>.
+     *
+     * @return Pointer to the mapped block.
+     */
+    void* map(size_t size);
+
+    /**
+     * Unmaps the block mapped with <code>map(size_t)</code>.
+     *
+     * @return Byte offset of the unmapped block in the buffer object.
+     */
+    size_t unmap();
+
+    /**
+     * Gets the OpenGL buffer object Id.
+     *
+     * @return OpenGL buffer object Id, <code>0</code> if the buffer object has
+     * not been created yet.
+     */
+    uint32_t id() const;
+
+    /**
+     * Gets the buffer capacity in bytes.
+     *
+     * @return Buffer capacity in bytes.
+     */
+    size_t capacity() const;
+
+private:
+    /**
+     * Creates or recreates the buffer storage.
+     */
+    void allocate();
+
+    uint32_t id_;           ///< OpenGL buffer object Id.
+    size_t capacity_;       ///< Buffer capacity in bytes.
+    size_t offset_;         ///< Next free byte offset.
+    size_t blockOffset_;    ///< Byte offset of the mapped block.
+    bool mapped_;           ///< Is a block mapped?
+
+    // prevent copying
+    InstanceBuffer(const InstanceBuffer&);
+    InstanceBuffer& operator =(const InstanceBuffer&);
+};
+
+#endif // #ifndef GRAPHICS_INSTANCEBUFFER_H_INCLUDED
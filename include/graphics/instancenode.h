@@ -0,0 +1,96 @@
+/**
+ * @file graphics/instancenode.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_INSTANCENODE_H_INCLUDED
+#define GRAPHICS_INSTANCENODE_H_INCLUDED
+
+#include <geometry/extents3.h>
+
+#include <graphics/geometrynode.h>
+
+/**
+ * A node that draws a shared prefab node hierarchy at its own location.
+ * Instead of cloning the prefab, the instance node only references it, so an
+ * instance costs one node regardless of the size of the prefab. The predraw
+ * step tests the world extents of the instance and then the world extents of
+ * the geometry nodes of the prefab, transformed by the world transform of the
+ * instance, and adds the visible geometry nodes of the prefab to the render
+ * queue with the combined world transforms.
+ *
+ * The prefab is not attached to a group node or registered to a scene, and
+ * it must not be modified or destroyed while it has instances. The prefab
+ * world transforms act as local transforms under the instance, locked
+ * rotations and scalings of the prefab nodes are not taken into account.
+ * Instance nodes in a prefab are supported.
+ */
+class InstanceNode : public GeometryNode
+{
+public:
+    /**
+     * Destructor.
+     */
+    virtual ~InstanceNode();
+
+    /**
+     * Default constructor. The constructed instance has no prefab.
+     */
+    InstanceNode();
+
+    /**
+     * Copy constructor. The constructed instance shares the prefab of
+     * <code>other</code>.
+     *
+     * @param other The object to copy.
+     */
+    InstanceNode(const InstanceNode& other);
+
+    /**
+     * Sets the prefab.
+     *
+     * @param p The prefab, or a null pointer for none.
+     */
+    void setPrefab(const Node* p);
+
+    /**
+     * Gets the prefab.
+     *
+     * @return The prefab, or a null pointer if there is none.
+     */
+    const Node* prefab() const;
+
+    /**
+     * @name Node Interface
+     */
+    //@{
+    virtual InstanceNode* clone() const;
+    virtual void predraw(const PredrawParams&, uint32_t) const;
+    virtual void predrawPrefab(const PredrawParams&, uint32_t, const Transform3&) const;
+    virtual const Extents3 worldExtents() const;
+
+    // invalidates the world transform of this node, invalidates the world
+    // extents of this node and all anchestor nodes
+    virtual void invalidateWorldTransform() const;
+    //@}
+
+    /**
+     * @name GeometryNode Interface
+     */
+    //@{
+    // does nothing, the geometry nodes of the prefab are drawn instead
+    virtual void draw(const DrawParams& params) const;
+    //@}
+
+private:
+    virtual void invalidateWorldExtents() const;
+
+    mutable bool worldExtentsValid_;    ///< Are world extents valid?
+    mutable Extents3 worldExtents_;     ///< World extents.
+    const Node* prefab_;                ///< Prefab.
+
+    // hide the copy assignment operator
+    InstanceNode& operator =(const InstanceNode&);
+};
+
+#endif // #ifndef GRAPHICS_INSTANCENODE_H_INCLUDED
@@ -6,13 +6,37 @@
 #ifndef GRAPHICS_MESH_H_INCLUDED
 #define GRAPHICS_MESH_H_INCLUDED
 
+#include <stdint.h>
+
 #include <vector>
 
+#include <geometry/box3.h>
+#include <geometry/extents3.h>
+#include <geometry/sphere.h>
 #include <geometry/vector2.h>
 #include <geometry/vector3.h>
 
+#include <graphics/vertexformat.h>
+
+class Matrix4x4;
+class Program;
+class StateCache;
+
 /**
- * Represents a 3D triangle mesh.
+ * Represents a 3D triangle mesh. The vertex data is kept in client memory
+ * and uploaded to an OpenGL buffer object when the mesh is drawn for the
+ * first time. The buffer object is re-uploaded only if the vertex data has
+ * been changed after the last upload. Changing the vertex data through any of
+ * the non-const accessors or setters marks the buffer object out of date.
+ *
+ * A mesh is either non-indexed, in which case each three consecutive vertices
+ * form a face, or indexed, in which case each three consecutive indices form
+ * a face. A non-indexed mesh is converted to an indexed mesh with
+ * <code>weld()</code>.
+ *
+ * The vertex data is uploaded interleaved in the vertex format of the mesh.
+ * Quantized vertex coordinates are decoded to model space with the matrix
+ * returned by <code>decodeMatrix()</code>.
  */
 class Mesh
 {
@@ -30,9 +54,10 @@ public:
     explicit Mesh(int numFaces);
 
     /**
-     * Copy constructor.
+     * Copy constructor. The OpenGL objects are not copied, the constructed
+     * mesh uploads its own copy of the vertex data when needed.
      *
-     * @param other The object to copy.
+     * @param other The object to copy, must have client data.
      */
     Mesh(const Mesh& other);
 
@@ -140,6 +165,101 @@ public:
      */
     const std::vector<Vector2>& texCoords() const;
 
+    /**
+     * Sets the vertex format used for the uploaded vertex data. The client
+     * memory copy of the vertex data is not affected.
+     *
+     * @param format The vertex format to set.
+     */
+    void setVertexFormat(const VertexFormat& format);
+
+    /**
+     * Gets the vertex format.
+     *
+     * @return The vertex format.
+     */
+    const VertexFormat vertexFormat() const;
+
+    /**
+     * Gets the matrix that transforms the uploaded vertex coordinates to
+     * model space. The vertex data must be uploaded.
+     *
+     * @return Identity matrix if the vertex coordinates are not quantized,
+     * otherwise a matrix that maps the unit cube to the mesh extents.
+     */
+    const Matrix4x4 decodeMatrix() const;
+
+    /**
+     * Gets the size of the vertex data in the vertex format of this mesh.
+     *
+     * @return Vertex data size in bytes.
+     */
+    size_t vertexDataSize() const;
+
+    /**
+     * Gets the size of the index data. Indices are stored in 16 bits if all
+     * vertices can be addressed with 16 bits, otherwise in 32 bits.
+     *
+     * @return Index data size in bytes.
+     */
+    size_t indexDataSize() const;
+
+    /**
+     * Sets the vertex indices. The size of the given array must be a multiple
+     * of 3 and each index must refer to an existing vertex. An empty array
+     * makes this mesh non-indexed.
+     *
+     * @param indices Vertex index array to copy.
+     */
+    void setIndices(const std::vector<uint32_t>& indices);
+
+    /**
+     * Gets the vertex indices.
+     *
+     * @return Vertex indices, an empty array if this mesh is non-indexed.
+     */
+    const std::vector<uint32_t>& indices() const;
+
+    /**
+     * Gets a boolean value indicating whether or not this mesh is indexed.
+     *
+     * @return <code>true</code>, if this mesh is indexed, <code>false</code>
+     * otherwise.
+     */
+    bool isIndexed() const;
+
+    /**
+     * Gets the number of indices in this mesh.
+     *
+     * @return Number of indices in this mesh, <code>0</code> if this mesh is
+     * non-indexed.
+     */
+    int numIndices() const;
+
+    /**
+     * Merges vertices with equal coordinates, normals, tangents and texture
+     * coordinates and makes this mesh indexed. An indexed mesh can be welded
+     * again, in which case the existing indices are remapped.
+     */
+    void weld();
+
+    /**
+     * Reorders the faces of an indexed mesh for the post-transform vertex
+     * cache. Faces that share vertices are placed close to each other so that
+     * the transformed vertices are reused from the cache. The face order is
+     * chosen with Tom Forsyth's linear-speed vertex cache optimization
+     * algorithm.
+     */
+    void optimizeVertexCache();
+
+    /**
+     * Reorders the vertices of an indexed mesh in the order in which they are
+     * first referenced by the indices, so that vertex fetches access memory
+     * mostly sequentially. Unreferenced vertices are removed. This should be
+     * done after <code>optimizeVertexCache()</code>.
+     */
+    void optimizeVertexFetch();
+
     /**
      * Gets the number of faces in this mesh.
      *
@@ -147,11 +267,154 @@ public:
      */
     int numFaces() const;
 
+    /**
+     * Gets the number of vertices in this mesh.
+     *
+     * @return Number of vertices in this mesh.
+     */
+    int numVertices() const;
+
+    /**
+     * Gets the extents of the vertex coordinates.
+     *
+     * @return Extents of the vertex coordinates.
+     */
+    const Extents3 extents() const;
+
+    /**
+     * Gets the minimal sphere enclosing the vertex coordinates. The sphere
+     * is fitted on each call while the mesh has client data.
+     *
+     * @return The bounding sphere, a zero sphere at the origin if the mesh
+     * has no vertices.
+     *
+     * @see fitSphere(const Vector3*, int)
+     */
+    const Sphere boundingSphere() const;
+
+    /**
+     * Gets an oriented box enclosing the vertex coordinates. The box is
+     * fitted on each call while the mesh has client data.
+     *
+     * @return The bounding box, a zero box at the origin if the mesh has no
+     * vertices.
+     *
+     * @see fitBox(const Vector3*, int)
+     */
+    const Box3 boundingBox() const;
+
+    /**
+     * Uploads the vertex data to the OpenGL buffer object if the buffer object
+     * does not exist or is out of date. An OpenGL context must be current.
+     */
+    void upload();
+
+    /**
+     * Binds a vertex array object that maps the vertex data of this mesh to
+     * the vertex attributes of a given program. The vertex data is uploaded
+     * first if needed. The vertex array objects are created on demand and
+     * cached per program, so the attribute locations are queried only once
+     * per mesh and program pair.
+     *
+     * @param program The program whose attribute layout is to be used, must
+     * be successfully linked.
+     * @param stateCache The state cache used to bind the vertex array object.
+     */
+    void bindVertexArray(const Program& program, StateCache& stateCache);
+
+    /**
+     * Draws this mesh with <code>glDrawElements</code> if this mesh is
+     * indexed or with <code>glDrawArrays</code> if it is not. The vertex
+     * array object must be bound with
+     * <code>bindVertexArray(const Program&, StateCache&)</code> first.
+     */
+    void draw() const;
+
+    /**
+     * Draws instances of this mesh with a single instanced draw call. The
+     * vertex array object must be bound with
+     * <code>bindVertexArray(const Program&, StateCache&)</code> first.
+     *
+     * @param numInstances Number of instances to draw.
+     */
+    void drawInstanced(int numInstances) const;
+
+    /**
+     * Gets the OpenGL buffer object Id of the uploaded vertex data.
+     *
+     * @return Buffer object Id, <code>0</code> if the vertex data has not been
+     * uploaded yet.
+     */
+    uint32_t bufferId() const;
+
+    /**
+     * Gets the OpenGL buffer object Id of the uploaded indices.
+     *
+     * @return Index buffer object Id, <code>0</code> if this mesh is not
+     * indexed or the indices have not been uploaded yet.
+     */
+    uint32_t indexBufferId() const;
+
+    /**
+     * Gets the vertex format of the uploaded vertex data.
+     *
+     * @return The vertex format of the uploaded vertex data.
+     */
+    const VertexFormat bufferFormat() const;
+
+    /**
+     * Gets the OpenGL index type used for the uploaded indices.
+     *
+     * @return <code>GL_UNSIGNED_SHORT</code> if all indices fit in 16 bits,
+     * <code>GL_UNSIGNED_INT</code> otherwise.
+     */
+    uint32_t indexType() const;
+
+    /**
+     * Gets the serial number of the last upload. Each upload of any mesh gets
+     * a new serial number, so a changed serial number means that the buffer
+     * object contents have changed.
+     *
+     * @return Upload serial number, <code>0</code> if the vertex data has not
+     * been uploaded yet.
+     */
+    uint32_t uploadSerial() const;
+
+    /**
+     * Sets the vertex attribute pointers of the currently bound vertex array
+     * object for interleaved vertex data in the buffer object bound to
+     * <code>GL_ARRAY_BUFFER</code>. Attributes the program does not use are
+     * skipped.
+     *
+     * @param program The program whose attribute layout is to be used.
+     * @param format The vertex format of the vertex data.
+     */
+    static void setAttributePointers(const Program& program, const VertexFormat& format);
+
+    /**
+     * Uploads the vertex data if needed and releases the client memory copy.
+     * After this call the vertex data accessors return empty arrays and the
+     * vertex data cannot be changed or uploaded again.
+     */
+    void releaseClientData();
+
+    /**
+     * Gets a boolean value indicating whether or not this mesh still has its
+     * vertex data in client memory.
+     *
+     * @return <code>true</code>, if this mesh has client data,
+     * <code>false</code> otherwise.
+     *
+     * @see releaseClientData()
+     */
+    bool hasClientData() const;
+
     // TODO: generates tangents, update documentation
     /**
      * Generates the vertex normals from vertex data. The generated vertex
      * normals are calculated from face normals without interpolation. This
-     * generation method produces flat surface lighting.
+     * generation method produces flat surface lighting. The mesh must be
+     * non-indexed, weld the mesh after generating the normals.
      */
     void generateFlatNormals();
 
@@ -182,11 +445,70 @@ private:
      */
     const Vector3 faceNormal(int index) const;
 
-    // TODO: VBOs
+    /**
+     * Marks the buffer object out of date.
+     */
+    void invalidateBuffer();
+
+    /**
+     * Deletes all vertex array objects.
+     */
+    void deleteVertexArrays();
+
+    /**
+     * Reorders the vertices. The indices are not changed.
+     *
+     * @param order New vertex order, <code>order[i]</code> is the old index
+     * of the new vertex <code>i</code>.
+     */
+    void reorderVertices(const std::vector<uint32_t>& order);
+
+    /**
+     * Gets the vertex format used for uploading. Texture coordinates that
+     * cannot be stored as 16-bit unsigned normalized integers fall back to
+     * half floats.
+     *
+     * @return The vertex format used for uploading.
+     */
+    const VertexFormat effectiveVertexFormat() const;
+
+    /**
+     * Encodes a vertex in the buffer format.
+     *
+     * @param index Index of the vertex to encode.
+     * @param p Destination, must have room for one vertex.
+     */
+    void encodeVertex(int index, uint8_t* p) const;
+
+    /**
+     * Vertex array object of a program.
+     */
+    struct VertexArray
+    {
+        uint32_t programId;             ///< Program Id.
+        uint32_t id;                    ///< Vertex array object Id.
+    };
+
+    typedef std::vector<VertexArray> VertexArrayVector;
+
     std::vector<Vector3> vertices_;     ///< Vertex coordinates.
     std::vector<Vector3> normals_;      ///< Vertex normals.
     std::vector<Vector3> tangents_;     ///< Vertex tangents for normal mapping.
     std::vector<Vector2> texCoords_;    ///< Vertex texture coordinates.
+    std::vector<uint32_t> indices_;     ///< Vertex indices.
+    VertexFormat vertexFormat_;         ///< Vertex format.
+    VertexFormat bufferFormat_;         ///< Vertex format of the buffer object.
+    Extents3 extents_;                  ///< Extents, valid without client data.
+    Sphere boundingSphere_;             ///< Bounding sphere, valid without client data.
+    Box3 boundingBox_;                  ///< Bounding box, valid without client data.
+    int numVertices_;                   ///< Vertex count, valid without client data.
+    int numIndices_;                    ///< Index count, valid without client data.
+    bool hasClientData_;                ///< Is vertex data in client memory?
+    bool bufferValid_;                  ///< Is the buffer object up to date?
+    uint32_t bufferId_;                 ///< Buffer object Id.
+    uint32_t indexBufferId_;            ///< Index buffer object Id.
+    uint32_t uploadSerial_;             ///< Serial number of the last upload.
+    VertexArrayVector vertexArrays_;    ///< Vertex array objects.
 };
 
 #endif // #ifndef GRAPHICS_MESH_H_INCLUDED
@@ -0,0 +1,208 @@
+/**
+ * @file graphics/mesharena.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_MESHARENA_H_INCLUDED
+#define GRAPHICS_MESHARENA_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+#include <graphics/vertexformat.h>
+
+class Mesh;
+class Program;
+class StateCache;
+
+/**
+ * Shared vertex and index storage for multi-draw indirect submission. Indexed
+ * meshes are copied to large shared buffer objects on first use, so meshes
+ * with equal buffer formats and index types can be drawn with a single
+ * <code>glMultiDrawElementsIndirect</code> call. The vertex and index data is
+ * copied between buffer objects with <code>glCopyBufferSubData</code>, the
+ * meshes do not need client data. A mesh that is uploaded again is copied
+ * again, the space of the old copy is not reused until the arena is
+ * cleared. An OpenGL context must be current when this object is used or
+ * destroyed.
+ */
+class MeshArena
+{
+public:
+    /**
+     * Location of a mesh in the shared storage.
+     */
+    struct Range
+    {
+        int pool;               ///< Index of the pool.
+        int32_t baseVertex;     ///< Index of the first vertex.
+        uint32_t firstIndex;    ///< Index of the first index.
+        uint32_t numIndices;    ///< Number of indices.
+    };
+
+    /**
+     * Destructor.
+     */
+    ~MeshArena();
+
+    /**
+     * Default constructor.
+     */
+    MeshArena();
+
+    /**
+     * Gets a boolean value indicating whether or not the OpenGL implementation
+     * supports multi-draw indirect submission with base instances.
+     *
+     * @return <code>true</code>, if multi-draw indirect submission is
+     * supported, <code>false</code> otherwise.
+     */
+    static bool isMultiDrawSupported();
+
+    /**
+     * Gets the location of a mesh in the shared storage. Uploads the mesh and
+     * copies it to the shared storage if needed.
+     *
+     * @param mesh The mesh.
+     *
+     * @return Pointer to the location of the mesh, or a null pointer if the
+     * mesh is not indexed. The pointer stays valid until the arena is
+     * cleared.
+     */
+    const Range* place(Mesh& mesh);
+
+    /**
+     * Binds a vertex array object that maps the vertex data of a pool to the
+     * vertex attributes of a given program. The element array buffer of the
+     * pool is bound as well.
+     *
+     * @param pool Index of the pool.
+     * @param program The program whose attribute layout is to be used.
+     * @param stateCache The state cache used to bind the vertex array object.
+     */
+    void bindVertexArray(int pool, const Program& program, StateCache& stateCache);
+
+    /**
+     * Gets the OpenGL index type of a pool.
+     *
+     * @param pool Index of the pool.
+     *
+     * @return <code>GL_UNSIGNED_SHORT</code> or <code>GL_UNSIGNED_INT</code>.
+     */
+    uint32_t indexType(int pool) const;
+
+    /**
+     * Gets the number of pools. Each pool holds meshes with one buffer format
+     * and index type.
+     *
+     * @return Number of pools.
+     */
+    int numPools() const;
+
+    /**
+     * Gets the number of meshes in the shared storage.
+     *
+     * @return Number of meshes.
+     */
+    int numMeshes() const;
+
+    /**
+     * Gets the size of the used vertex and index data in bytes.
+     *
+     * @return Size of the used data in bytes.
+     */
+    size_t dataSize() const;
+
+    /**
+     * Deletes all pools and forgets all meshes.
+     *
+     * @param stateCache The state cache, the vertex array binding is reset
+     * because the vertex array objects of the pools are deleted.
+     */
+    void clear(StateCache& stateCache);
+
+private:
+    /**
+     * Vertex array object of a program.
+     */
+    struct VertexArray
+    {
+        uint32_t programId;             ///< Program Id.
+        uint32_t id;                    ///< Vertex array object Id.
+    };
+
+    /**
+     * Shared storage for meshes with one buffer format and index type.
+     */
+    struct Pool
+    {
+        VertexFormat format;            ///< Vertex format.
+        uint32_t indexType;             ///< OpenGL index type.
+        uint32_t vertexBufferId;        ///< Vertex buffer object Id.
+        uint32_t indexBufferId;         ///< Index buffer object Id.
+        size_t vertexCapacity;          ///< Vertex buffer size in bytes.
+        size_t indexCapacity;           ///< Index buffer size in bytes.
+        size_t vertexSize;              ///< Used vertex data in bytes.
+        size_t indexSize;               ///< Used index data in bytes.
+        bool vertexArraysValid;         ///< Are vertex array objects valid?
+        std::vector<VertexArray> vertexArrays;  ///< Vertex array objects.
+    };
+
+    /**
+     * A mesh in the shared storage.
+     */
+    struct Entry
+    {
+        Range range;                    ///< Location of the mesh.
+        uint32_t uploadSerial;          ///< Upload serial of the copy.
+    };
+
+    typedef std::vector<Pool> PoolVector;
+    typedef std::map<const Mesh*, Entry> EntryMap;
+
+    /**
+     * Gets the pool for a given buffer format and index type, creates the
+     * pool if it does not exist.
+     *
+     * @param format The buffer format.
+     * @param indexType The OpenGL index type.
+     *
+     * @return Index of the pool.
+     */
+    int findPool(const VertexFormat& format, uint32_t indexType);
+
+    /**
+     * Grows a buffer object so that it has room for at least a given number
+     * of bytes. The used data is preserved.
+     *
+     * @param id Buffer object Id, updated if the buffer object is recreated.
+     * @param capacity Buffer size in bytes, updated if the buffer object is
+     * recreated.
+     * @param used Used data in bytes.
+     * @param required Required buffer size in bytes.
+     *
+     * @return <code>true</code>, if the buffer object was recreated,
+     * <code>false</code> otherwise.
+     */
+    static bool reserve(uint32_t& id, size_t& capacity, size_t used, size_t required);
+
+    /**
+     * Deletes the vertex array objects of a pool.
+     *
+     * @param pool The pool.
+     * @param stateCache The state cache, the vertex array binding is reset.
+     */
+    static void deleteVertexArrays(Pool& pool, StateCache& stateCache);
+
+    PoolVector pools_;                  ///< Pools.
+    EntryMap entries_;                  ///< Meshes by address.
+
+    // prevent copying
+    MeshArena(const MeshArena&);
+    MeshArena& operator =(const MeshArena&);
+};
+
+#endif // #ifndef GRAPHICS_MESHARENA_H_INCLUDED
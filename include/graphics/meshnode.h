@@ -6,7 +6,11 @@
 #ifndef GRAPHICS_MESHNODE_H_INCLUDED
 #define GRAPHICS_MESHNODE_H_INCLUDED
 
+#include <vector>
+
+#include <geometry/box3.h>
 #include <geometry/extents3.h>
+#include <geometry/sphere.h>
 
 #include <graphics/geometrynode.h>
 #include <graphics/texture.h>
@@ -16,7 +20,9 @@ class Vector3Array;
 class Mesh;
 
 /**
- * Represents a triangle mesh.
+ * Represents a triangle mesh. A mesh node can hold a chain of coarser meshes
+ * of the same model, the predraw step selects the level of detail from the
+ * projected size of the world extents of the node.
  */
 class MeshNode : public GeometryNode
 {
@@ -41,10 +47,31 @@ public:
     /**
      * Updates model extents. This memeber function must be called if the model
      * geometry changes. The mesh pointer must be pointing to a valid mesh when
-     * this member function is called.
+     * this member function is called. The extents of the finest level of
+     * detail are used for all levels. The bounding sphere and the oriented
+     * bounding box of the mesh are updated as well, the frustum test of the
+     * predraw step tests them instead of the world extents.
      */
     void updateModelExtents();
 
+    /**
+     * Gets the bounding sphere of this node in world space.
+     *
+     * @return The world bounding sphere.
+     *
+     * @see Mesh::boundingSphere() const
+     */
+    const Sphere worldBoundingSphere() const;
+
+    /**
+     * Gets the oriented bounding box of this node in world space.
+     *
+     * @return The world bounding box.
+     *
+     * @see Mesh::boundingBox() const
+     */
+    const Box3 worldBoundingBox() const;
+
     /**
      * Sets the mesh pointer. This object does not take ownership of the object
      * pointer by <code>p</code>.
@@ -60,11 +87,78 @@ public:
      */
     Mesh* mesh() const;
 
+    /**
+     * Adds a coarser level of detail to the end of the LOD chain. The mesh
+     * set with <code>setMesh(Mesh*)</code> is level <code>0</code>. A level is
+     * selected when the projected size of the world extents of this node
+     * falls below its switch size, so the switch sizes must decrease along
+     * the chain. This object does not take ownership of the mesh.
+     *
+     * @param p Mesh pointer, cannot be a null pointer.
+     * @param switchSize Switch size relative to the viewport height, must be
+     * > 0 and smaller than the switch size of the previous level.
+     *
+     * @see RenderQueue::projectedSize(const Extents3&) const
+     */
+    void addLod(Mesh* p, float switchSize);
+
+    /**
+     * Removes the coarser levels of detail, only level <code>0</code>
+     * remains.
+     */
+    void clearLods();
+
+    /**
+     * Gets the number of levels of detail, including level <code>0</code>.
+     *
+     * @return Number of levels of detail.
+     */
+    int numLods() const;
+
+    /**
+     * Gets the mesh of a given level of detail.
+     *
+     * @param lod Level of detail.
+     *
+     * @return Mesh pointer.
+     */
+    Mesh* lodMesh(int lod) const;
+
+    /**
+     * Gets the switch size of a given level of detail.
+     *
+     * @param lod Level of detail, must be > 0.
+     *
+     * @return Switch size relative to the viewport height.
+     */
+    float lodSwitchSize(int lod) const;
+
+    /**
+     * Gets the level of detail selected by the last predraw step. Mesh nodes
+     * in a prefab drawn by instance nodes are not predrawn, they stay at the
+     * level they had.
+     *
+     * @return Current level of detail.
+     */
+    int currentLod() const;
+
+    /**
+     * Gets the mesh of the current level of detail, the mesh that is drawn.
+     *
+     * @return Mesh pointer.
+     */
+    Mesh* currentMesh() const;
+
     /**
      * @name Node Interface
      */
     //@{
     virtual MeshNode* clone() const;
+
+    // selects the level of detail of a visible mesh node before adding it to
+    // the render queue
+    virtual void predraw(const PredrawParams&, uint32_t) const;
+
     virtual const Extents3 worldExtents() const;
 
     // invalidates the world transform of this node, invalidates the world
@@ -83,6 +177,89 @@ public:
      * @param params Draw parameters.
      */
     virtual void draw(const DrawParams& params) const;
+
+    /**
+     * Gets the material key. The material key is calculated from the bound
+     * texture maps and the mesh pointer, mesh nodes that use the same texture
+     * maps and the same mesh have equal material keys. The texture maps are
+     * hashed to the high bits, so mesh nodes that use the same texture maps
+     * are sorted next to each other.
+     *
+     * @return Material key.
+     */
+    virtual uint32_t materialKey() const;
+
+    /**
+     * Tells whether a given geometry node is a mesh node that uses the same
+     * mesh and the same texture maps as this mesh node.
+     *
+     * @param other The geometry node to test.
+     *
+     * @return <code>true</code> if <code>other</code> can be drawn as an
+     * instance of this mesh node, <code>false</code> otherwise.
+     */
+    virtual bool isInstanceCompatible(const GeometryNode& other) const;
+
+    /**
+     * Draws a run of compatible mesh nodes with a single instanced draw call.
+     * The per-instance model view and normal matrices are streamed to the
+     * instance buffer of the draw parameters and fed to the
+     * <code>instanceModelViewMatrix</code> and
+     * <code>instanceNormalMatrix</code> vertex attributes. If the current
+     * program does not have these attributes, each mesh node is drawn
+     * separately.
+     *
+     * @param params Draw parameters.
+     * @param nodes Mesh nodes to draw, <code>nodes[0]</code> is
+     * <code>this</code>.
+     * @param numNodes Number of mesh nodes to draw.
+     */
+    virtual void drawInstanced(
+        const DrawParams& params,
+        const GeometryNode* const* nodes,
+        int numNodes) const;
+
+    /**
+     * Tells whether a given geometry node is a mesh node that uses the same
+     * texture maps as this mesh node. The meshes may differ.
+     *
+     * @param other The geometry node to test.
+     *
+     * @return <code>true</code> if <code>other</code> can be submitted in the
+     * same multi-draw indirect call as this mesh node, <code>false</code>
+     * otherwise.
+     */
+    virtual bool isMultiDrawCompatible(const GeometryNode& other) const;
+
+    /**
+     * Draws a run of mesh nodes that use the same texture maps. The meshes
+     * are placed in the mesh arena of the draw parameters, and each pool of
+     * the arena is submitted with a single
+     * <code>glMultiDrawElementsIndirect</code> call. Adjacent mesh nodes that
+     * use the same mesh become a single instanced command. The per-draw
+     * matrices are streamed to the instance buffer and fetched through the
+     * base instance of each command. If the draw parameters have no mesh
+     * arena or command buffer or the current program does not have the
+     * per-instance attributes, the run is drawn with instanced draw calls.
+     * Non-indexed meshes are always drawn separately.
+     *
+     * @param params Draw parameters.
+     * @param nodes Mesh nodes to draw, <code>nodes[0]</code> is
+     * <code>this</code>.
+     * @param numNodes Number of mesh nodes to draw.
+     */
+    virtual void drawMultiDraw(
+        const DrawParams& params,
+        const GeometryNode* const* nodes,
+        int numNodes) const;
+
+    /**
+     * Adds the mesh to an occlusion buffer if <code>occluder</code> is
+     * <code>true</code> and the mesh has client data.
+     *
+     * @param buffer The occlusion buffer.
+     */
+    virtual void rasterizeOccluder(OcclusionBuffer& buffer) const;
     //@}
 
     Texture* diffuseMap;
@@ -90,22 +267,72 @@ public:
     Texture* glowMap;
     Texture* normalMap;
 
+    /**
+     * Does this mesh node hide other nodes? Occluders should be large, close
+     * and have few triangles.
+     */
+    bool occluder;
+
 private:
+    /**
+     * A coarser level of detail.
+     */
+    struct Lod
+    {
+        Mesh* mesh;                     ///< Mesh pointer.
+        float switchSize;               ///< Switch size.
+    };
+
+    typedef std::vector<Lod> LodVector;
+
+    /**
+     * Selects the level of detail for a given projected size. The selection
+     * moves one level at a time from the current level and crosses a switch
+     * size only when the projected size is past it by the hysteresis.
+     *
+     * @param size Projected size of the world extents.
+     * @param hysteresis LOD hysteresis.
+     */
+    void selectLod(float size, float hysteresis) const;
+
+    /**
+     * Binds the texture maps to the samplers of the current program.
+     *
+     * @param params Draw parameters.
+     */
+    void bindMaps(const DrawParams& params) const;
+
+    /**
+     * @name GeometryNode Interface
+     */
+    //@{
+    // tests the world bounding sphere and box, the world extents of a turned
+    // mesh are loose
+    virtual bool testFrustum(const VisibilityTest& test, uint32_t& planeMask) const;
+    //@}
+
     /**
      * Invalidates the world extents.
      */
-    void invalidateWorldExtents() const;
+    virtual void invalidateWorldExtents() const;
 
     /**
-     * Updates and validates the world extents. This is called internally for
-     * updating the world extents only when needed.
+     * Updates and validates the world extents, the world bounding sphere and
+     * the world bounding box. This is called internally for updating the
+     * world extents only when needed.
      */
     void updateWorldExtents() const;
 
     mutable bool worldExtentsValid_;    ///< Are world extents valid?
     mutable Extents3 worldExtents_;     ///< World extents.
+    mutable Sphere worldSphere_;        ///< World bounding sphere.
+    mutable Box3 worldBox_;             ///< World bounding box.
     Extents3 modelExtents_;             ///< Model extents.
+    Sphere modelSphere_;                ///< Model bounding sphere.
+    Box3 modelBox_;                     ///< Model bounding box.
     Mesh* mesh_;                        ///< Mesh pointer.
+    LodVector lods_;                    ///< Coarser levels of detail.
+    mutable int lod_;                   ///< Current level of detail.
 
     // hide the copy assignment operator
     MeshNode& operator =(const MeshNode&);
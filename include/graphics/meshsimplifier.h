@@ -0,0 +1,202 @@
+/**
+ * @file graphics/meshsimplifier.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_MESHSIMPLIFIER_H_INCLUDED
+#define GRAPHICS_MESHSIMPLIFIER_H_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <graphics/mesh.h>
+#include <graphics/resourcemanager.h>
+#include <graphics/taskset.h>
+
+class Node;
+
+typedef ResourceManager<Mesh> MeshManager;
+
+/**
+ * Generates the levels of detail of meshes by simplifying them. Each level is
+ * simplified from the previous one with quadric error metric edge collapses
+ * until its face count drops to the face ratio of the level. Texture
+ * coordinate seams, open borders and creases are kept: a vertex on a seam,
+ * border or crease line can only collapse along the line, and vertices where
+ * the lines meet do not move. Meshes with flat normals get flat normals
+ * generated for the simplified faces, other meshes keep the normals and
+ * tangents of the remaining vertices, so normal seams are kept like texture
+ * coordinate seams.
+ *
+ * The meshes to simplify are queued with <code>addMesh(Mesh*, const
+ * std::string&)</code>, for example by a model reader, and each queued mesh
+ * is a task of this task set. The tasks do not share state, so they can run
+ * on multiple threads, and the results do not depend on the threads.
+ * <code>merge()</code> registers the generated meshes to the mesh manager
+ * and <code>attachLods(Node*) const</code> adds them to the LOD chains of the
+ * mesh nodes.
+ */
+class MeshSimplifier : public TaskSet
+{
+public:
+    /**
+     * Destructor. Deletes the generated meshes that have not been merged.
+     */
+    virtual ~MeshSimplifier();
+
+    /**
+     * Default constructor. No levels are generated until they are added.
+     */
+    MeshSimplifier();
+
+    /**
+     * Sets the mesh manager that takes ownership of the generated meshes.
+     *
+     * @param p Pointer to the mesh manager.
+     */
+    void setMeshManager(MeshManager* p);
+
+    /**
+     * Gets the pointer to the mesh manager.
+     *
+     * @return Pointer to the mesh manager.
+     */
+    MeshManager* meshManager() const;
+
+    /**
+     * Adds a level of detail to generate. Levels are generated in the order
+     * they are added.
+     *
+     * @param faceRatio Target face count relative to the queued mesh, must be
+     * in range (0, 1) and smaller than the face ratio of the previous level.
+     * @param switchSize Switch size of the level relative to the viewport
+     * height, must be > 0 and smaller than the switch size of the previous
+     * level.
+     *
+     * @see MeshNode::addLod(Mesh*, float)
+     */
+    void addLevel(float faceRatio, float switchSize);
+
+    /**
+     * Gets the number of levels of detail to generate.
+     *
+     * @return Number of levels.
+     */
+    int numLevels() const;
+
+    /**
+     * Queues a mesh to simplify. The mesh must have client data and it must
+     * not be changed until the queue is merged.
+     *
+     * @param mesh The mesh to simplify, cannot be a null pointer.
+     * @param name Name of the mesh in the mesh manager, the generated meshes
+     * are named <code>name + "_lod" + level</code>.
+     */
+    void addMesh(Mesh* mesh, const std::string& name);
+
+    /**
+     * @name TaskSet Interface
+     */
+    //@{
+    // one task for each queued mesh
+    virtual int numTasks() const;
+
+    // generates the levels of detail of a queued mesh
+    virtual void runTask(int index);
+
+    // registers the generated meshes to the mesh manager and clears the queue
+    virtual void merge();
+    //@}
+
+    /**
+     * Adds the generated levels of detail to the mesh nodes of a node
+     * hierarchy. Mesh nodes that already have a LOD chain or whose mesh has
+     * no generated levels are left untouched.
+     *
+     * @param root Root node of the hierarchy, cannot be a null pointer.
+     *
+     * @return Number of mesh nodes that got a LOD chain.
+     */
+    int attachLods(Node* root) const;
+
+    /**
+     * Gets the number of faces in the queued meshes simplified by the last
+     * merge.
+     *
+     * @return Number of faces.
+     */
+    int numInputFaces() const;
+
+    /**
+     * Gets the number of faces in the levels of detail generated by the last
+     * merge.
+     *
+     * @return Number of faces.
+     */
+    int numOutputFaces() const;
+
+    /**
+     * Simplifies a mesh with quadric error metric edge collapses. The result
+     * is deterministic, and the function can be called concurrently.
+     *
+     * @param mesh The mesh to simplify, must have client data.
+     * @param targetFaces Target face count, must be > 0. The result can have
+     * more faces if the seams, borders and creases do not allow more
+     * collapses.
+     *
+     * @return The simplified mesh in the vertex format of <code>mesh</code>,
+     * or a null pointer if no faces remain.
+     *
+     * @warning The returned object is allocated via a C++ <code>new</code>
+     * expression. The caller is responsible for deleting it.
+     */
+    static Mesh* simplify(const Mesh& mesh, int targetFaces);
+
+private:
+    /**
+     * A level of detail to generate.
+     */
+    struct Level
+    {
+        float faceRatio;                ///< Target face ratio.
+        float switchSize;               ///< Switch size.
+    };
+
+    /**
+     * A queued mesh.
+     */
+    struct Job
+    {
+        Mesh* mesh;                     ///< The mesh to simplify.
+        std::string name;               ///< Name of the mesh.
+        std::vector<Mesh*> lods;        ///< Generated levels of detail.
+    };
+
+    /**
+     * Generated level of detail of a mesh.
+     */
+    struct Lod
+    {
+        Mesh* mesh;                     ///< Generated mesh.
+        float switchSize;               ///< Switch size.
+    };
+
+    typedef std::vector<Level> LevelVector;
+    typedef std::vector<Job> JobVector;
+    typedef std::vector<Lod> LodVector;
+    typedef std::map<const Mesh*, LodVector> LodMap;
+
+    MeshManager* meshManager_;          ///< Pointer to the mesh manager.
+    LevelVector levels_;                ///< Levels of detail to generate.
+    JobVector jobs_;                    ///< Queued meshes.
+    LodMap lods_;                       ///< Merged levels of detail by mesh.
+    int numInputFaces_;                 ///< Faces in the merged meshes.
+    int numOutputFaces_;                ///< Faces in the merged levels.
+
+    // prevent copying
+    MeshSimplifier(const MeshSimplifier&);
+    MeshSimplifier& operator =(const MeshSimplifier&);
+};
+
+#endif // #ifndef GRAPHICS_MESHSIMPLIFIER_H_INCLUDED
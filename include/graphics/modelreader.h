@@ -10,11 +10,13 @@
 
 #include <graphics/mesh.h>
 #include <graphics/resourcemanager.h>
+#include <graphics/vertexformat.h>
 
 struct Lib3dsFile;
 struct Lib3dsMesh;
 struct Lib3dsNode;
 
+class MeshSimplifier;
 class Node;
 
 typedef ResourceManager<Mesh> MeshManager;
@@ -51,6 +53,37 @@ public:
      */
     MeshManager* meshManager() const;
 
+    /**
+     * Sets the mesh simplifier that generates the levels of detail of the
+     * read meshes. Each read mesh is queued to the simplifier, the caller
+     * runs the simplifier after reading.
+     *
+     * @param p Pointer to the mesh simplifier, or a null pointer for none.
+     */
+    void setMeshSimplifier(MeshSimplifier* p);
+
+    /**
+     * Gets the pointer to the mesh simplifier.
+     *
+     * @return Pointer to the mesh simplifier, or a null pointer if there is
+     * none.
+     */
+    MeshSimplifier* meshSimplifier() const;
+
+    /**
+     * Sets the vertex format of the read meshes.
+     *
+     * @param format The vertex format to set.
+     */
+    void setVertexFormat(const VertexFormat& format);
+
+    /**
+     * Gets the vertex format of the read meshes.
+     *
+     * @return The vertex format of the read meshes.
+     */
+    const VertexFormat vertexFormat() const;
+
     // TODO: decide how errors should be reported
     /**
      * Reads a node hierarchy from a .3ds file.
@@ -64,6 +97,40 @@ public:
      */
     Node* read(const std::string& path);
 
+    /**
+     * @name Memory Report Interface
+     * Describes the mesh data stored by the last call to read().
+     */
+    //@{
+    /**
+     * Gets the number of faces read from the last file.
+     *
+     * @return Number of read faces.
+     */
+    int numReadFaces() const;
+
+    /**
+     * Gets the number of vertices read from the last file after welding.
+     *
+     * @return Number of read vertices.
+     */
+    int numReadVertices() const;
+
+    /**
+     * Gets the size of the vertex data read from the last file.
+     *
+     * @return Size of the read vertex data in bytes.
+     */
+    size_t vertexDataSize() const;
+
+    /**
+     * Gets the size of the index data read from the last file.
+     *
+     * @return Size of the read index data in bytes.
+     */
+    size_t indexDataSize() const;
+    //@}
+
 private:
     /**
      * Reads all meshes from a given .3ds file structure. The active mesh
@@ -76,7 +143,7 @@ private:
 
     /**
      * Reads a mesh from a given .3ds mesh structure. The active mesh manager
-     * takes ownership of the read mesh.
+     * takes ownership of the read mesh. Updates the memory report counters.
      *
      * @param p Pointer to a .3ds mesh structure, cannot be a null pointer.
      * @param prefix Mesh name prefix for the read mesh.
@@ -94,7 +161,13 @@ private:
     static bool isNodeTypeSupported(const Lib3dsNode* p);
 
     MeshManager* meshManager_;  ///< Pointer to the mesh manager.
+    MeshSimplifier* meshSimplifier_; ///< Pointer to the mesh simplifier.
     std::string meshPrefix_;    ///< Prefix for mesh names.
+    VertexFormat vertexFormat_; ///< Vertex format of the read meshes.
+    int numReadFaces_;          ///< Number of faces read from the file.
+    int numReadVertices_;       ///< Number of vertices after welding.
+    size_t vertexDataSize_;     ///< Size of the read vertex data in bytes.
+    size_t indexDataSize_;      ///< Size of the read index data in bytes.
 
     // prevent copying
     ModelReader(const ModelReader&);
@@ -6,8 +6,13 @@
 #ifndef GRAPHICS_NODE_H_INCLUDED
 #define GRAPHICS_NODE_H_INCLUDED
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <geometry/transform3.h>
 
+#include <graphics/visibilitytest.h>
+
 class Extents3;
 class Matrix4x4;
 
@@ -30,6 +35,25 @@ public:
      */
     virtual ~Node();
 
+    /**
+     * Allocates a node from the current node arena.
+     *
+     * @param size Size of the node in bytes.
+     *
+     * @return Pointer to the allocated memory.
+     *
+     * @see NodeArena
+     */
+    static void* operator new(size_t size);
+
+    /**
+     * Returns the memory of a deleted node to the node arena it was allocated
+     * from.
+     *
+     * @param p Pointer to the memory.
+     */
+    static void operator delete(void* p);
+
     /**
      * Virtual copy constructor.
      *
@@ -45,13 +69,33 @@ public:
      * <code>GroupNode</code> classes should override this member function.
      *
      * @param params Predraw parameters.
-     * @param testVisibility Use visibility test? If this is
-     * <code>false</code>, nodes are added to the render queue unconditionally
-     * without visibility testing.
+     * @param planeMask Frustum planes to test, see
+     * <code>VisibilityTest::test(const Extents3&, uint32_t&, int&) const</code>.
+     * <code>VisibilityTest::allPlanes</code> tests the full frustum. If this
+     * is <code>0</code>, the parent is completely visible and nodes are added
+     * to the render queue unconditionally without visibility testing.
      */
     virtual void predraw(
         const PredrawParams& params,
-        bool testVisibility) const = 0;
+        uint32_t planeMask) const = 0;
+
+    /**
+     * Predraw traversal of a prefab node hierarchy drawn by an instance node.
+     * Like <code>predraw()</code>, but the world transform and world extents
+     * of this node are transformed by the world transform of the instance
+     * node. The default implementation does nothing.
+     *
+     * @param params Predraw parameters.
+     * @param planeMask Frustum planes to test, see
+     * <code>predraw(const PredrawParams&, uint32_t) const</code>.
+     * @param transform Transform from the prefab world space to world space.
+     *
+     * @warning For internal use only.
+     */
+    virtual void predrawPrefab(
+        const PredrawParams& params,
+        uint32_t planeMask,
+        const Transform3& transform) const;
 
     /**
      * Gets the world extents.
@@ -68,7 +112,17 @@ public:
     virtual void invalidateWorldTransform() const;
 
     /**
-     * Gets the world transform.
+     * Invalidates the world extents. Called when the world transform of a
+     * node registered to a scene has been updated. The default
+     * implementation does nothing.
+     *
+     * @warning For internal use only.
+     */
+    virtual void invalidateWorldExtents() const;
+
+    /**
+     * Gets the world transform. If this node is registered to a scene, the
+     * world transform is read from the transform hierarchy of the scene.
      *
      * @return World transform.
      */
@@ -200,7 +254,10 @@ public:
 
     /**
      * Sets the scene. Only <code>GroupNode</code> class should override this
-     * member function.
+     * member function. A node registered to a scene keeps its transforms in
+     * the transform hierarchy of the scene, and transform edits are
+     * propagated to the world transforms and world extents by
+     * <code>Scene::update()</code>.
      *
      * @param scene Scene.
      *
@@ -240,6 +297,52 @@ public:
      */
     bool hasParent() const;
 
+    /**
+     * Sets the index of this node in the child nodes of its parent node.
+     *
+     * @param index Index, -1 if this node has no parent node.
+     *
+     * @warning For internal use only.
+     */
+    void setChildIndex(int index);
+
+    /**
+     * Gets the index of this node in the child nodes of its parent node, so
+     * that <code>parent()->child(childIndex()) == this</code>.
+     *
+     * @return Index, -1 if this node has no parent node.
+     */
+    int childIndex() const;
+
+    /**
+     * Sets the slot of this node in the transform hierarchy of the scene.
+     *
+     * @param slot Slot, -1 if not registered.
+     *
+     * @warning For internal use only.
+     */
+    void setTransformSlot(int slot);
+
+    /**
+     * Gets the slot of this node in the transform hierarchy of the scene.
+     *
+     * @return Slot, -1 if not registered.
+     */
+    int transformSlot() const;
+
+    /**
+     * Gets the cached visibility test result of this node. Passed to
+     * <code>VisibilityTest::test(const Extents3&, uint32_t&, VisibilityCache&) const</code>
+     * so that the result can be reused on later frames, and the rejecting
+     * plane is tested first. A group node stores the batch test results of
+     * its child nodes here.
+     *
+     * @return Reference to the visibility cache.
+     *
+     * @warning For internal use only.
+     */
+    VisibilityCache& visibilityCache() const;
+
 protected:
     /**
      * Default constructor.
@@ -263,6 +366,24 @@ protected:
      */
     bool isWorldTransformValid() const;
 
+    /**
+     * Tests the world extents of a prefab node against the frustum of the
+     * predraw parameters. The visibility cache is not used, prefab nodes are
+     * shared by all instance nodes.
+     *
+     * @param extents World extents of the prefab node at the instance.
+     * @param params Predraw parameters.
+     * @param planeMask Frustum planes to test, the planes the extents are
+     * completely inside of are cleared.
+     *
+     * @return <code>true</code>, if the extents may be visible,
+     * <code>false</code> otherwise.
+     */
+    static bool testPrefabExtents(
+        const Extents3& extents,
+        const PredrawParams& params,
+        uint32_t& planeMask);
+
 private:
     /**
      * Updates and validates the world transform. This is called internally for
@@ -270,6 +391,13 @@ private:
      */
     void updateWorldTransform() const;
 
+    /**
+     * Passes an edited local transform to the transform hierarchy of the
+     * scene, or invalidates the world transform if this node is not
+     * registered to a scene.
+     */
+    void localTransformChanged();
+
     mutable bool worldTransformValid_;  ///< Is world transform valid?
     mutable Transform3 worldTransform_; ///< World transform.
     Transform3 localTransform_;         ///< Local transform.
@@ -277,6 +405,9 @@ private:
     bool scalingLocked_;                ///< Is scaling locked to local scaling?
     Scene* scene_;                      ///< Scene.
     GroupNode* parent_;                 ///< Parent node.
+    int childIndex_;                    ///< Index in the parent node.
+    int transformSlot_;                 ///< Transform hierarchy slot.
+    mutable VisibilityCache visibilityCache_;   ///< Visibility cache.
 
     // hide the copy assignment operator
     Node& operator =(const Node&);
@@ -0,0 +1,212 @@
+/**
+ * @file graphics/nodearena.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_NODEARENA_H_INCLUDED
+#define GRAPHICS_NODEARENA_H_INCLUDED
+
+#include <stddef.h>
+
+#include <vector>
+
+class Node;
+
+/**
+ * Pooled storage for scene nodes. All nodes are allocated from the current
+ * arena by <code>Node::operator new</code>. An arena keeps a separate pool
+ * for each node size, so nodes of one type share a pool, and each pool
+ * carves fixed size slots out of large chunks. Deleted nodes return their
+ * slot to the free list of their pool, and the chunks are released only when
+ * the arena is destroyed, so an arena owned by a game level releases the
+ * memory of all its nodes at once. Nodes can be deleted while another arena
+ * is current, each slot knows its pool. Arenas are not thread safe, nodes
+ * must be allocated and deleted on one thread.
+ */
+class NodeArena
+{
+public:
+    /**
+     * Destructor. Releases all chunks. Nodes still allocated from this arena
+     * are not destructed, the memory is released anyway.
+     */
+    ~NodeArena();
+
+    /**
+     * Default constructor.
+     */
+    NodeArena();
+
+    /**
+     * Sets the current arena. Nodes are allocated from the current arena.
+     *
+     * @param arena The arena, or a null pointer for the default arena. The
+     * arena must not be destroyed while it is current.
+     */
+    static void setCurrent(NodeArena* arena);
+
+    /**
+     * Gets the current arena.
+     *
+     * @return Reference to the current arena.
+     */
+    static NodeArena& current();
+
+    /**
+     * Gets the default arena, the current arena unless another one is set.
+     * The default arena lives until the program exits.
+     *
+     * @return Reference to the default arena.
+     */
+    static NodeArena& defaultArena();
+
+    /**
+     * Clones a node hierarchy into this arena. The nodes of the clone are
+     * allocated one after another, so they are carved next to each other
+     * from the end of the pools, or they take the free slots of the most
+     * recently deleted nodes, which are the slots of a deleted clone when
+     * clones of one prefab are spawned and despawned.
+     *
+     * @param prefab The node hierarchy to clone.
+     *
+     * @return The clone, allocated from this arena.
+     */
+    Node* clone(const Node& prefab);
+
+    /**
+     * Allocates a node slot.
+     *
+     * @param size Size of the node in bytes.
+     *
+     * @return Pointer to the slot.
+     *
+     * @warning For internal use only.
+     */
+    void* allocate(size_t size);
+
+    /**
+     * Returns a node slot to the pool it was allocated from.
+     *
+     * @param p Pointer to the slot, can be a null pointer.
+     *
+     * @warning For internal use only.
+     */
+    static void deallocate(void* p);
+
+    /**
+     * Resets the allocation counters.
+     */
+    void resetCounters();
+
+    /**
+     * Gets the number of nodes allocated since the last reset.
+     *
+     * @return Number of allocations.
+     */
+    int numAllocations() const;
+
+    /**
+     * Gets the number of nodes deleted since the last reset.
+     *
+     * @return Number of deallocations.
+     */
+    int numDeallocations() const;
+
+    /**
+     * Gets the number of chunks allocated since the last reset, each of them
+     * is a heap allocation.
+     *
+     * @return Number of chunk allocations.
+     */
+    int numChunkAllocations() const;
+
+    /**
+     * Gets the number of nodes allocated from this arena and not yet
+     * deleted.
+     *
+     * @return Number of live nodes.
+     */
+    int numLiveNodes() const;
+
+    /**
+     * Gets the number of pools, one for each node size.
+     *
+     * @return Number of pools.
+     */
+    int numPools() const;
+
+    /**
+     * Gets the size of all chunks in bytes.
+     *
+     * @return Reserved size in bytes.
+     */
+    size_t reservedSize() const;
+
+    /**
+     * Gets the size of the slots of the live nodes in bytes.
+     *
+     * @return Live size in bytes.
+     */
+    size_t liveSize() const;
+
+    /**
+     * Gets the fragmentation of the pools: the fraction of the carved slots
+     * that are free slots of deleted nodes.
+     *
+     * @return Fragmentation in range [0, 1].
+     */
+    float fragmentation() const;
+
+private:
+    /**
+     * Storage for nodes of one size.
+     */
+    struct Pool
+    {
+        NodeArena* arena;               ///< Owner arena.
+        size_t slotSize;                ///< Slot size in bytes.
+        std::vector<char*> chunks;      ///< Chunks.
+        void* freeList;                 ///< First free slot.
+        char* next;                     ///< Next uncarved slot.
+        char* end;                      ///< End of the last chunk.
+        int numLive;                    ///< Number of live slots.
+        int numFree;                    ///< Number of free slots.
+    };
+
+    /**
+     * Gets the pool for a given slot size, creates the pool if it does not
+     * exist.
+     *
+     * @param slotSize Slot size in bytes.
+     *
+     * @return Reference to the pool.
+     */
+    Pool& findPool(size_t slotSize);
+
+    /**
+     * Carves a slot from the end of a pool, allocates a new chunk if needed.
+     *
+     * @param pool The pool.
+     *
+     * @return Pointer to the slot.
+     */
+    char* carve(Pool& pool);
+
+    typedef std::vector<Pool*> PoolVector;
+
+    PoolVector pools_;                  ///< Pools.
+    int numAllocations_;                ///< Allocations since reset.
+    int numDeallocations_;              ///< Deallocations since reset.
+    int numChunkAllocations_;           ///< Chunk allocations since reset.
+    int numLiveNodes_;                  ///< Live nodes.
+    size_t reservedSize_;               ///< Size of all chunks.
+    size_t liveSize_;                   ///< Size of live slots.
+
+    static NodeArena* current_;         ///< Current arena.
+
+    // prevent copying
+    NodeArena(const NodeArena&);
+    NodeArena& operator =(const NodeArena&);
+};
+
+#endif // #ifndef GRAPHICS_NODEARENA_H_INCLUDED
@@ -0,0 +1,235 @@
+/**
+ * @file graphics/occlusionbuffer.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_OCCLUSIONBUFFER_H_INCLUDED
+#define GRAPHICS_OCCLUSIONBUFFER_H_INCLUDED
+
+#include <vector>
+
+#include <geometry/matrix4x4.h>
+
+class Extents3;
+class Transform3;
+class Vector4;
+
+class CameraNode;
+class Mesh;
+
+/**
+ * Low resolution depth buffer for software occlusion culling. Occluder meshes
+ * are rasterized on the CPU into the depth buffer, and extents are tested
+ * against a hierarchy of tile depth maxima built from it. Rasterization is
+ * split into screen tiles: the occluder triangles are set up and binned to
+ * the tiles they overlap, after which each tile can be rasterized
+ * independently, so disjoint tile ranges can be rasterized by different
+ * threads. No OpenGL context is needed.
+ *
+ * A frame goes as follows: <code>init(const CameraNode&)</code>, any number
+ * of <code>addOccluder(const Mesh&, const Transform3&)</code> calls,
+ * <code>rasterize()</code> and then any number of
+ * <code>isOccluded(const Extents3&) const</code> calls.
+ */
+class OcclusionBuffer
+{
+public:
+    /**
+     * Side length of a tile in pixels.
+     */
+    static const int tileSize = 8;
+
+    /**
+     * Side length of a coarse tile in tiles.
+     */
+    static const int coarseSize = 4;
+
+    /**
+     * Destructor.
+     */
+    ~OcclusionBuffer();
+
+    /**
+     * Default constructor. The default resolution is 256 x 128 pixels.
+     */
+    OcclusionBuffer();
+
+    /**
+     * Sets the resolution. Clears the buffer.
+     *
+     * @param width Width in pixels, must be a positive multiple of
+     * <code>tileSize</code>.
+     * @param height Height in pixels, must be a positive multiple of
+     * <code>tileSize</code>.
+     */
+    void setResolution(int width, int height);
+
+    /**
+     * Gets the width in pixels.
+     *
+     * @return Width in pixels.
+     */
+    int width() const;
+
+    /**
+     * Gets the height in pixels.
+     *
+     * @return Height in pixels.
+     */
+    int height() const;
+
+    /**
+     * Clears the buffer and the counters and sets the view and projection of
+     * a given camera.
+     *
+     * @param camera The camera.
+     */
+    void init(const CameraNode& camera);
+
+    /**
+     * Clears the buffer and the counters and sets the world to clip space
+     * transform.
+     *
+     * @param worldToClip World to clip space matrix.
+     */
+    void init(const Matrix4x4& worldToClip);
+
+    /**
+     * Sets up and bins the triangles of an occluder mesh. Both faces of the
+     * triangles occlude. Triangles are clipped against the near plane.
+     *
+     * @param mesh The occluder mesh, must have client data.
+     * @param transform Model to world transform of the mesh.
+     */
+    void addOccluder(const Mesh& mesh, const Transform3& transform);
+
+    /**
+     * Rasterizes all tiles and updates the depth hierarchy. Equivalent to
+     * calling <code>rasterizeTiles(0, numTiles())</code> and
+     * <code>updateHierarchy()</code>.
+     */
+    void rasterize();
+
+    /**
+     * Gets the number of tiles.
+     *
+     * @return Number of tiles.
+     */
+    int numTiles() const;
+
+    /**
+     * Rasterizes a range of tiles. Calls with disjoint ranges can run
+     * concurrently.
+     *
+     * @param first Index of the first tile.
+     * @param last Index one beyond the last tile.
+     */
+    void rasterizeTiles(int first, int last);
+
+    /**
+     * Updates the coarse tile depths after all tiles have been rasterized.
+     */
+    void updateHierarchy();
+
+    /**
+     * Tests whether given world extents are hidden behind the rasterized
+     * occluders. Extents that intersect the near plane or lie outside the
+     * buffer are never occluded. Can be called concurrently by multiple
+     * threads.
+     *
+     * @param extents The extents to test.
+     *
+     * @return <code>true</code>, if the extents are occluded,
+     * <code>false</code> otherwise.
+     */
+    bool isOccluded(const Extents3& extents) const;
+
+    /**
+     * Gets the depth buffer. Depths are in range [0, 1], rows from bottom to
+     * top.
+     *
+     * @return Pointer to <code>width() * height()</code> depths.
+     */
+    const float* depth() const;
+
+    /**
+     * Gets the number of occluder triangles set up since the last init.
+     *
+     * @return Number of occluder triangles.
+     */
+    int numOccluderTriangles() const;
+
+    /**
+     * Gets the number of occlusion tests since the last init.
+     *
+     * @return Number of occlusion tests.
+     */
+    int numTests() const;
+
+    /**
+     * Gets the number of occluded extents since the last init.
+     *
+     * @return Number of occluded extents.
+     */
+    int numOccluded() const;
+
+private:
+    /**
+     * Screen space triangle set up for rasterization. A pixel center
+     * <code>(x, y)</code> is inside if <code>a[i] * x + b[i] * y + c[i] >=
+     * 0</code> for all three edges.
+     */
+    struct Triangle
+    {
+        float a[3];                     ///< Edge x-coefficients.
+        float b[3];                     ///< Edge y-coefficients.
+        float c[3];                     ///< Edge constants.
+        float zx;                       ///< Depth x-coefficient.
+        float zy;                       ///< Depth y-coefficient.
+        float z0;                       ///< Depth constant.
+    };
+
+    typedef std::vector<Triangle> TriangleVector;
+    typedef std::vector<std::vector<int> > BinVector;
+
+    /**
+     * Clears the buffer and the counters.
+     */
+    void clear();
+
+    /**
+     * Sets up and bins a clip space triangle that is in front of the near
+     * plane.
+     *
+     * @param v Clip space vertices.
+     */
+    void addTriangle(const Vector4* v);
+
+    /**
+     * Rasterizes the triangles binned to a tile and updates the tile depth.
+     *
+     * @param tile Index of the tile.
+     */
+    void rasterizeTile(int tile);
+
+    int width_;                         ///< Width in pixels.
+    int height_;                        ///< Height in pixels.
+    int tilesX_;                        ///< Tiles per row.
+    int tilesY_;                        ///< Tiles per column.
+    int coarseX_;                       ///< Coarse tiles per row.
+    int coarseY_;                       ///< Coarse tiles per column.
+    Matrix4x4 worldToClip_;             ///< World to clip space matrix.
+    std::vector<float> depth_;          ///< Pixel depths.
+    std::vector<float> tileDepth_;      ///< Maximum depth of each tile.
+    std::vector<float> coarseDepth_;    ///< Maximum depth of each coarse tile.
+    TriangleVector triangles_;          ///< Occluder triangles.
+    BinVector bins_;                    ///< Triangle indices of each tile.
+    mutable int numTests_;              ///< Number of tests.
+    mutable int numOccluded_;           ///< Number of occluded extents.
+
+    // prevent copying
+    OcclusionBuffer(const OcclusionBuffer&);
+    OcclusionBuffer& operator =(const OcclusionBuffer&);
+};
+
+#endif // #ifndef GRAPHICS_OCCLUSIONBUFFER_H_INCLUDED
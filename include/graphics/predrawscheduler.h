@@ -0,0 +1,176 @@
+/**
+ * @file graphics/predrawscheduler.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_PREDRAWSCHEDULER_H_INCLUDED
+#define GRAPHICS_PREDRAWSCHEDULER_H_INCLUDED
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <graphics/predrawparams.h>
+#include <graphics/taskset.h>
+#include <graphics/visibilitytest.h>
+
+class GroupNode;
+class Node;
+class RenderQueue;
+class Scene;
+
+/**
+ * Splits the predraw step into tasks that can be run by multiple threads.
+ * The lazily updated world transforms and world extents of the nodes are not
+ * safe to update concurrently, so <code>init()</code> first makes them valid
+ * in an update phase. The upper levels of the node hierarchy or the spatial
+ * index of a scene are then culled on the calling thread, and the visible
+ * subtrees below them are divided into tasks of roughly
+ * <code>taskSize()</code> nodes. Each task culls its subtrees into its own
+ * render queue segment with its own copy of the visibility test, and
+ * <code>merge()</code> appends the segments to the render queue of the
+ * predraw parameters in task order, so the result does not depend on which
+ * thread ran which task.
+ *
+ * A frame goes as follows: <code>init()</code>, <code>runTask(int)</code> for
+ * each task on any threads and then <code>merge()</code> on the thread that
+ * called <code>init()</code>. The render queue is sorted after the merge as
+ * usual. The scheduler does not create threads.
+ */
+class PredrawScheduler : public TaskSet
+{
+public:
+    /**
+     * Destructor.
+     */
+    virtual ~PredrawScheduler();
+
+    /**
+     * Default constructor. The default task size is 1024 nodes.
+     */
+    PredrawScheduler();
+
+    /**
+     * Sets the task size.
+     *
+     * @param numNodes Approximate number of nodes culled by a task, must be
+     * > 0.
+     */
+    void setTaskSize(int numNodes);
+
+    /**
+     * Gets the task size.
+     *
+     * @return Approximate number of nodes culled by a task.
+     */
+    int taskSize() const;
+
+    /**
+     * Validates the world extents of a node hierarchy, culls the group nodes
+     * whose subtrees are larger than the task size and divides the rest of
+     * the hierarchy into tasks. Validating the world extents of the root node
+     * validates the world extents and world transforms of all geometry nodes
+     * in the hierarchy.
+     *
+     * @param root Root node of the hierarchy.
+     * @param params Predraw parameters, must have a render queue and a
+     * visibility test. The render queue must have been initialized.
+     */
+    void init(const GroupNode& root, const PredrawParams& params);
+
+    /**
+     * Updates a scene, culls the upper levels of its spatial index and
+     * divides the subtrees below them into tasks.
+     *
+     * @param scene The scene.
+     * @param params Predraw parameters, must have a render queue and a
+     * visibility test. The render queue must have been initialized.
+     */
+    void init(Scene& scene, const PredrawParams& params);
+
+    /**
+     * @name TaskSet Interface
+     */
+    //@{
+    // the tasks created by the last call to init()
+    virtual int numTasks() const;
+    virtual void runTask(int index);
+
+    // appends the render queue segments of the tasks to the render queue of
+    // the predraw parameters and adds the counters of the visibility test
+    // copies to the visibility test of the predraw parameters
+    virtual void merge();
+    //@}
+
+private:
+    /**
+     * Subtree culled by a task, either a node or a subtree of the spatial
+     * index of a scene.
+     */
+    struct Root
+    {
+        const Node* node;               ///< Root node or a null pointer.
+        int subtree;                    ///< Spatial index subtree or -1.
+        uint32_t planeMask;             ///< Frustum planes left to test.
+    };
+
+    /**
+     * Range of subtrees culled by a task.
+     */
+    struct Task
+    {
+        int first;                      ///< Index of the first subtree.
+        int last;                       ///< Index one beyond the last.
+    };
+
+    typedef std::vector<Root> RootVector;
+    typedef std::vector<Task> TaskVector;
+    typedef std::vector<RenderQueue*> RenderQueueVector;
+    typedef std::vector<VisibilityTest> VisibilityTestVector;
+
+    /**
+     * Clears the tasks and stores the predraw parameters.
+     *
+     * @param params Predraw parameters.
+     */
+    void reset(const PredrawParams& params);
+
+    /**
+     * Culls a group node on the calling thread and adds its child nodes to
+     * the tasks, child nodes with large subtrees are split recursively.
+     *
+     * @param group The group node.
+     * @param planeMask Frustum planes to test.
+     */
+    void split(const GroupNode& group, uint32_t planeMask);
+
+    /**
+     * Adds a subtree to the last task, starts a new task when the last task
+     * is full.
+     *
+     * @param root The subtree.
+     * @param numNodes Number of nodes in the subtree.
+     */
+    void addRoot(const Root& root, int numNodes);
+
+    /**
+     * Creates the render queue segments and the visibility test copies of
+     * the tasks.
+     */
+    void prepareTasks();
+
+    int taskSize_;                      ///< Nodes per task.
+    PredrawParams params_;              ///< Predraw parameters.
+    Scene* scene_;                      ///< Scene of the tasks or null.
+    RootVector roots_;                  ///< Subtrees of the tasks.
+    TaskVector tasks_;                  ///< Tasks.
+    int lastTaskSize_;                  ///< Nodes in the last task.
+    RenderQueueVector segments_;        ///< Render queue of each task.
+    VisibilityTestVector tests_;        ///< Visibility test of each task.
+
+    // prevent copying
+    PredrawScheduler(const PredrawScheduler&);
+    PredrawScheduler& operator =(const PredrawScheduler&);
+};
+
+#endif // #ifndef GRAPHICS_PREDRAWSCHEDULER_H_INCLUDED
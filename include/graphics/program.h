@@ -9,16 +9,32 @@
 #include <stdint.h>
 
 #include <string>
+#include <vector>
 
 class FragmentShader;
 class VertexShader;
 
 /**
- * Represents an OpenGL program.
+ * Represents an OpenGL program. A successful link reflects all active uniforms
+ * and vertex attributes into a table sorted by name hash, see
+ * <code>hashName()</code>. The draw code should hash the names once, for
+ * example into namespace scope constants, and look the locations up by hash
+ * so that no string operations are needed per draw.
  */
 class Program
 {
 public:
+    /**
+     * Calculates the hash of a uniform or attribute name. The hash of an
+     * array uniform is calculated from its name without the
+     * <code>[0]</code> suffix.
+     *
+     * @param name NUL-terminated name, cannot be a null pointer.
+     *
+     * @return 32-bit FNV-1a hash of <code>name</code>.
+     */
+    static uint32_t hashName(const char* name);
+
     /**
      * Destructor.
      */
@@ -76,7 +92,8 @@ public:
 
     /**
      * Links this program. Calling this member function will overwrite the
-     * current info log string.
+     * current info log string. If the link is successful, the active uniforms,
+     * attributes and uniform blocks are reflected into the location tables.
      *
      * @see linkStatus() const
      * @see infoLog() const
@@ -120,7 +137,108 @@ public:
      */
     const std::string infoLog() const;
 
+    /**
+     * Gets the location of an active uniform by name hash.
+     *
+     * @param nameHash Hash of the uniform name.
+     *
+     * @return Uniform location, or <code>-1</code> if the linked program
+     * does not have an active uniform with the given name.
+     *
+     * @see hashName(const char*)
+     */
+    int32_t uniformLocation(uint32_t nameHash) const;
+
+    /**
+     * Gets the location of an active vertex attribute by name hash.
+     *
+     * @param nameHash Hash of the attribute name.
+     *
+     * @return Attribute location, or <code>-1</code> if the linked program
+     * does not have an active attribute with the given name.
+     *
+     * @see hashName(const char*)
+     */
+    int32_t attributeLocation(uint32_t nameHash) const;
+
+    /**
+     * Gets the index of an active uniform block by name hash.
+     *
+     * @param nameHash Hash of the uniform block name.
+     *
+     * @return Uniform block index, or <code>-1</code> if the linked program
+     * does not have an active uniform block with the given name.
+     *
+     * @see hashName(const char*)
+     */
+    int32_t uniformBlockIndex(uint32_t nameHash) const;
+
+    /**
+     * Assigns a uniform buffer binding point to an active uniform block.
+     *
+     * @param nameHash Hash of the uniform block name.
+     * @param binding Uniform buffer binding point.
+     *
+     * @return <code>true</code>, if the linked program has an active uniform
+     * block with the given name, <code>false</code> otherwise.
+     */
+    bool setUniformBlockBinding(uint32_t nameHash, uint32_t binding);
+
+    /**
+     * Gets the number of active uniforms found in the last successful link.
+     *
+     * @return Number of active uniforms.
+     */
+    int numUniforms() const;
+
+    /**
+     * Gets the number of active attributes found in the last successful link.
+     *
+     * @return Number of active attributes.
+     */
+    int numAttributes() const;
+
+    /**
+     * Gets the number of active uniform blocks found in the last successful
+     * link.
+     *
+     * @return Number of active uniform blocks.
+     */
+    int numUniformBlocks() const;
+
 private:
+    /**
+     * Reflected uniform, attribute or uniform block.
+     */
+    struct Slot
+    {
+        uint32_t nameHash;  ///< Name hash.
+        int32_t location;   ///< Location or uniform block index.
+
+        /**
+         * Orders slots by name hash.
+         */
+        bool operator <(const Slot& other) const;
+    };
+
+    typedef std::vector<Slot> SlotVector;
+
+    /**
+     * Reflects the active uniforms, attributes and uniform blocks of the
+     * linked OpenGL program object into the slot tables.
+     */
+    void reflect();
+
+    /**
+     * Finds a slot location by name hash.
+     *
+     * @param slots Slot table, must be sorted by name hash.
+     * @param nameHash Name hash.
+     *
+     * @return Slot location, or <code>-1</code> if not found.
+     */
+    static int32_t findLocation(const SlotVector& slots, uint32_t nameHash);
+
     /**
      * Attaches all registered shaders to the stored OpenGL program object.
      */
@@ -135,6 +253,9 @@ private:
     uint32_t id_;                       ///< Program Id.
     VertexShader* vertexShader_;        ///< Registered vertex shader.
     FragmentShader* fragmentShader_;    ///< Registered fragment shader.
+    SlotVector uniforms_;               ///< Active uniforms.
+    SlotVector attributes_;             ///< Active attributes.
+    SlotVector uniformBlocks_;          ///< Active uniform blocks.
 
     // prevent copying
     Program(const Program&);
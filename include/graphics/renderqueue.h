@@ -6,14 +6,27 @@
 #ifndef GRAPHICS_RENDERQUEUE_H_INCLUDED
 #define GRAPHICS_RENDERQUEUE_H_INCLUDED
 
+#include <stdint.h>
+
 #include <vector>
 
+#include <geometry/extents3.h>
+#include <geometry/transform3.h>
+#include <geometry/vector3.h>
+
+class CameraNode;
 class DrawParams;
 class GeometryNode;
 class GroupNode;
+class ImpostorAtlas;
+class OcclusionBuffer;
 
 /**
- * Represents a sorted render queue.
+ * Represents a sorted render queue. Each added geometry node is assigned a
+ * 64-bit sort key, see <code>SortKey</code> for the key layout. The queue is
+ * sorted with a stable radix sort over key/node pairs. If the geometry nodes
+ * are added in the same order as in the previous frame, the previous sorted
+ * order is reused as a starting point and fixed with an insertion sort.
  */
 class RenderQueue
 {
@@ -30,12 +43,54 @@ public:
     RenderQueue();
 
     /**
-     * Adds a given geometry node to this render queue.
+     * Initializes the view parameters used for calculating the view depth
+     * part of the sort keys and the projected sizes from the state of a given
+     * camera. This does not clear the render queue.
+     *
+     * @param camera The camera from whose state the view parameters are
+     * initialized.
+     */
+    void init(const CameraNode& camera);
+
+    /**
+     * Copies the view parameters of another render queue. Render queues with
+     * equal view parameters calculate equal sort keys, so a render queue
+     * filled by another thread can be appended to the other render queue.
+     * This does not clear the render queue.
+     *
+     * @param other The render queue whose view parameters are copied.
+     *
+     * @see append(const RenderQueue&)
+     */
+    void init(const RenderQueue& other);
+
+    /**
+     * Adds a given geometry node to this render queue and calculates its sort
+     * key. If this render queue has an impostor atlas and the node should be
+     * drawn as an impostor, the node is added to the impostor node list
+     * instead.
      *
      * @param p The geometry node to add, cannot be a null pointer.
+     *
+     * @see setImpostorAtlas(const ImpostorAtlas*)
      */
     void addGeometryNode(const GeometryNode* p);
 
+    /**
+     * Adds a given geometry node to this render queue with a world transform
+     * and world extents of its own. Used for drawing the nodes of a shared
+     * prefab at the location of an instance node.
+     *
+     * @param p The geometry node to add, cannot be a null pointer.
+     * @param worldTransform World transform the node is drawn with.
+     * @param worldExtents World extents of the node when drawn with
+     * <code>worldTransform</code>.
+     */
+    void addGeometryNode(
+        const GeometryNode* p,
+        const Transform3& worldTransform,
+        const Extents3& worldExtents);
+
     /**
      * Gets a geometry node by index.
      *
@@ -48,6 +103,30 @@ public:
      */
     const GeometryNode* geometryNode(int index) const;
 
+    /**
+     * Gets the world transform a geometry node was added with.
+     *
+     * @param index Index of the geometry node, must be between
+     * [<code>0</code>, numGeometryNodes()<code></code>).
+     *
+     * @return Pointer to the world transform, or a null pointer if the node
+     * is drawn with its own world transform. The pointer is valid until the
+     * next node is added.
+     */
+    const Transform3* instanceTransform(int index) const;
+
+    /**
+     * Gets the sort key of a geometry node by index.
+     *
+     * @param index Index of the sort key to return, must be between
+     * [<code>0</code>, numGeometryNodes()<code></code>).
+     *
+     * @return The sort key of the specified geometry node.
+     *
+     * @see numGeometryNodes() const
+     */
+    uint64_t sortKey(int index) const;
+
     /**
      * Gets the number of geometry nodes in this render queue.
      *
@@ -83,22 +162,166 @@ public:
     int numGroupNodes() const;
 
     /**
-     * Clears the geometry node and group node lists of this render queue.
+     * Sets the impostor atlas. Geometry nodes added without an instance
+     * transform whose projected size is below the switch size of the atlas
+     * are added to the impostor node list instead of the geometry node list.
+     * Render queues initialized from another render queue copy the atlas.
+     *
+     * @param p Pointer to the impostor atlas, or a null pointer for none.
+     *
+     * @see ImpostorAtlas::update(const RenderQueue&, const DrawParams&)
+     * @see ImpostorAtlas::draw(const RenderQueue&, const DrawParams&)
+     */
+    void setImpostorAtlas(const ImpostorAtlas* p);
+
+    /**
+     * Gets the impostor atlas.
+     *
+     * @return Pointer to the impostor atlas, or a null pointer if there is
+     * none.
+     */
+    const ImpostorAtlas* impostorAtlas() const;
+
+    /**
+     * Gets an impostor node by index.
+     *
+     * @param index Index of the impostor node to return, must be between
+     * [<code>0</code>, numImpostorNodes()<code></code>).
+     *
+     * @return The specified impostor node.
+     *
+     * @see numImpostorNodes() const
+     */
+    const GeometryNode* impostorNode(int index) const;
+
+    /**
+     * Gets the number of impostor nodes in this render queue.
+     *
+     * @return The number of impostor nodes in this render queue.
+     */
+    int numImpostorNodes() const;
+
+    /**
+     * Appends the geometry nodes and group nodes of another render queue to
+     * this render queue. The sort keys are not recalculated, the view
+     * parameters of the render queues should be equal.
+     *
+     * @param other The render queue to append, cannot be this render queue.
+     *
+     * @see init(const RenderQueue&)
+     */
+    void append(const RenderQueue& other);
+
+    /**
+     * Clears the geometry node, group node and impostor node lists and the
+     * LOD counters of this render queue.
      */
     void clear();
 
+    /**
+     * Removes the geometry nodes, group nodes and impostor nodes whose world
+     * extents are occluded in a given occlusion buffer. Lets the occluders be
+     * selected from the result of the predraw step without repeating it.
+     * This member function should be called before sort().
+     *
+     * @param occlusionBuffer A rasterized occlusion buffer.
+     *
+     * @see OcclusionBuffer::isOccluded(const Extents3&) const
+     */
+    void removeOccluded(const OcclusionBuffer& occlusionBuffer);
+
+    /**
+     * Calculates the projected size of given world extents: the diameter of
+     * the bounding sphere of the extents projected with the projection
+     * settings of the camera, relative to the viewport height. Level of
+     * detail is selected by the projected size during the predraw step.
+     *
+     * @param worldExtents World extents.
+     *
+     * @return The projected size, <code>1</code> fills the viewport height.
+     * <code>0</code> for empty extents, a huge value for extents around the
+     * view position in a perspective projection.
+     */
+    float projectedSize(const Extents3& worldExtents) const;
+
+    /**
+     * Sets the LOD hysteresis. A node switches to a coarser level of detail
+     * when its projected size falls below the switch size of the level by
+     * this fraction, and back when it grows above the switch size by this
+     * fraction, so a node near a switch size does not flicker between the
+     * levels. Render queues initialized from another render queue copy the
+     * hysteresis.
+     *
+     * @param hysteresis LOD hysteresis in range [0, 1).
+     */
+    void setLodHysteresis(float hysteresis);
+
+    /**
+     * Gets the LOD hysteresis.
+     *
+     * @return LOD hysteresis.
+     */
+    float lodHysteresis() const;
+
+    /**
+     * Counts a node added with a given level of detail.
+     *
+     * @param lod Level of detail, <code>0</code> is the finest.
+     *
+     * @warning For internal use only.
+     */
+    void countLod(int lod);
+
+    /**
+     * Gets the number of nodes added with a given level of detail since the
+     * last clear, including the nodes of appended render queues.
+     *
+     * @param lod Level of detail, <code>0</code> is the finest.
+     *
+     * @return Number of nodes.
+     */
+    int numLodNodes(int lod) const;
+
+    /**
+     * Gets the number of LOD counters, one more than the coarsest level of
+     * detail counted since the last clear.
+     *
+     * @return Number of LOD counters.
+     */
+    int numLodCounters() const;
+
     /**
      * Draws all geometry nodes in this render queue. The caller is responsible
      * ensuring that this render queue has been sorted before this member
      * function is called. Drawing an unsorted render queue may result in loss
      * of performance and produce incorrect visual results.
      *
+     * Adjacent geometry nodes with equal render passes and material keys are
+     * drawn as a single run if they are instance compatible with the first
+     * geometry node of the run. If the draw parameters have a mesh arena and
+     * a command buffer and multi-draw indirect submission is supported,
+     * adjacent geometry nodes with equal render passes are drawn as a single
+     * run if they are multi-draw compatible with the first geometry node of
+     * the run instead.
+     *
      * @param params Draw parameters.
      *
      * @see sort()
+     * @see GeometryNode::isInstanceCompatible(const GeometryNode&) const
+     * @see GeometryNode::drawInstanced(const DrawParams&, const GeometryNode* const*, int) const
+     * @see GeometryNode::isMultiDrawCompatible(const GeometryNode&) const
+     * @see GeometryNode::drawMultiDraw(const DrawParams&, const GeometryNode* const*, int) const
      */
     void draw(const DrawParams& params) const;
 
+    /**
+     * Gets the number of geometry node runs drawn by the last call to
+     * draw(const DrawParams&) const.
+     *
+     * @return Number of drawn geometry node runs.
+     */
+    int numDrawnRuns() const;
+
     /**
      * Sorts the render queue contents. This member function should be called
      * once after the predraw step is complete, that is, before the render
@@ -106,23 +329,105 @@ public:
      */
     void sort();
 
-private:
     /**
-     * Comparison function used for sorting the render queue geometry nodes.
-     *
-     * @param a Pointer to a geometry node.
-     * @param b Pointer to a geometry node.
+     * Gets a boolean value indicating whether or not the last call to sort()
+     * was able to reuse the sorted order of the previous frame.
      *
-     * @return <code>true</code>, if <code></code> is strictly 'less' than
-     * <code>b</code>, <code>false</code> otherwise.
+     * @return <code>true</code>, if the previous sorted order was reused,
+     * <code>false</code> if a full radix sort was done.
+     */
+    bool isSortReused() const;
+
+private:
+    /**
+     * Render queue item.
      */
-    static bool compare(const GeometryNode* a, const GeometryNode* b);
+    struct Item
+    {
+        uint64_t key;               ///< Sort key.
+        const GeometryNode* node;   ///< Geometry node.
+        int index;                  ///< Index in the order of addition.
+        int transform;              ///< Instance transform index or -1.
+    };
 
+    typedef std::vector<Item> ItemVector;
+    typedef std::vector<Extents3> ExtentsVector;
     typedef std::vector<const GeometryNode*> GeometryNodeVector;
     typedef std::vector<const GroupNode*> GroupNodeVector;
+    typedef std::vector<int> IntVector;
+    typedef std::vector<Transform3> TransformVector;
+
+    /**
+     * Adds an item.
+     *
+     * @param p The geometry node.
+     * @param worldExtents World extents of the node.
+     * @param transform Instance transform index or -1.
+     */
+    void addItem(const GeometryNode* p, const Extents3& worldExtents, int transform);
+
+    /**
+     * Collects the world transforms of the nodes of a run for the draw
+     * parameters.
+     *
+     * @param first Index of the first item of the run.
+     * @param last Index past the last item of the run.
+     *
+     * @return Pointer to the world transforms, or a null pointer if all nodes
+     * of this render queue are drawn with their own world transforms.
+     */
+    const Transform3* runTransforms(size_t first, size_t last) const;
+
+    /**
+     * Draws all geometry nodes in runs of multi-draw compatible geometry
+     * nodes.
+     *
+     * @param params Draw parameters.
+     */
+    void drawMultiDraw(const DrawParams& params) const;
+
+    /**
+     * Tries to sort the items by applying the sorted order of the previous
+     * frame and fixing the result with an insertion sort.
+     *
+     * @return <code>true</code>, if the items were sorted,
+     * <code>false</code> if the previous order could not be used or the
+     * items were too far from sorted.
+     */
+    bool sortFromPreviousOrder();
+
+    /**
+     * Sorts the items with a stable LSD radix sort.
+     */
+    void radixSort();
+
+    /**
+     * Stores the addition order and the sorted order of the items for the
+     * next frame.
+     */
+    void storeOrder();
 
-    GeometryNodeVector geometryNodes_;  ///< Geometry nodes.
+    ItemVector items_;                  ///< Geometry node items.
+    ItemVector buffer_;                 ///< Sort buffer.
     GroupNodeVector groupNodes_;        ///< Group nodes.
+    GeometryNodeVector impostorNodes_;  ///< Impostor nodes.
+    TransformVector transforms_;        ///< Instance transforms.
+    ExtentsVector instanceExtents_;     ///< Instance world extents.
+    GeometryNodeVector previousNodes_;  ///< Previous addition order.
+    IntVector previousOrder_;           ///< Previous sorted order.
+    Vector3 viewPosition_;              ///< View position in world space.
+    Vector3 viewDirection_;             ///< View direction in world space.
+    float near_;                        ///< Near view depth.
+    float far_;                         ///< Far view depth.
+    bool perspective_;                  ///< Is the projection perspective?
+    float sizeScale_;                   ///< Projected size scale.
+    float lodHysteresis_;               ///< LOD hysteresis.
+    IntVector lodCounts_;               ///< Nodes per level of detail.
+    const ImpostorAtlas* impostorAtlas_; ///< Impostor atlas.
+    bool sortReused_;                   ///< Was the previous order reused?
+    mutable GeometryNodeVector run_;    ///< Geometry nodes of a drawn run.
+    mutable TransformVector runTransforms_; ///< World transforms of a run.
+    mutable int numDrawnRuns_;          ///< Number of drawn runs.
 
     // prevent copying
     RenderQueue(const RenderQueue&);
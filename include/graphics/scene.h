@@ -0,0 +1,159 @@
+/**
+ * @file graphics/scene.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_SCENE_H_INCLUDED
+#define GRAPHICS_SCENE_H_INCLUDED
+
+#include <vector>
+
+#include <graphics/aabbtree.h>
+#include <graphics/transformhierarchy.h>
+
+class Extents3;
+
+class GeometryNode;
+class GroupNode;
+class PredrawParams;
+
+/**
+ * Spatial index of a node hierarchy. All geometry nodes in the hierarchy of
+ * the root node are kept in a dynamic AABB tree. Geometry nodes register
+ * themselves when they are attached to the hierarchy and unregister when
+ * they are detached or deleted, and moved geometry nodes are refitted before
+ * the next predraw or query. The predraw traversal culls the tree instead of
+ * the node hierarchy, so culling cost does not depend on how the hierarchy
+ * is organized. Group nodes are not added to the render queue.
+ *
+ * The transforms of all nodes in the hierarchy are kept in a flattened
+ * transform hierarchy. Transform edits only mark the edited nodes dirty, and
+ * the world transforms and world extents are brought up to date by
+ * <code>update()</code>.
+ */
+class Scene
+{
+public:
+    /**
+     * Destructor. Unregisters all nodes of the root node hierarchy.
+     */
+    ~Scene();
+
+    /**
+     * Default constructor.
+     */
+    Scene();
+
+    /**
+     * Sets the root node. The nodes of the old root node hierarchy are
+     * unregistered and the nodes of the new root node hierarchy are
+     * registered. This object does not take ownership of the root node.
+     *
+     * @param p Root node, can be a null pointer. Must not be attached to a
+     * group node.
+     */
+    void setRootNode(GroupNode* p);
+
+    /**
+     * Gets the root node.
+     *
+     * @return Root node.
+     */
+    GroupNode* rootNode() const;
+
+    /**
+     * Updates the world transforms of the nodes whose transforms were edited
+     * since the last update and refits the moved geometry nodes. This is
+     * called by <code>predraw(const PredrawParams&)</code> and
+     * <code>query(const Extents3&, std::vector<GeometryNode*>&)</code>.
+     */
+    void update();
+
+    /**
+     * Propagates the predraw call to the geometry nodes inside the view
+     * frustum of the visibility test of given predraw parameters.
+     *
+     * @param params Predraw parameters.
+     */
+    void predraw(const PredrawParams& params);
+
+    /**
+     * Finds the geometry nodes whose extents may intersect a region. The
+     * found geometry nodes are within the tree margin of the region.
+     *
+     * @param region The region.
+     * @param nodes The found geometry nodes are appended here.
+     */
+    void query(const Extents3& region, std::vector<GeometryNode*>& nodes);
+
+    /**
+     * Gets the spatial index.
+     *
+     * @return Reference to the spatial index.
+     */
+    AabbTree& tree();
+
+    /**
+     * Gets the transform hierarchy.
+     *
+     * @return Reference to the transform hierarchy.
+     */
+    TransformHierarchy& transforms();
+
+    /**
+     * Gets the number of geometry nodes refitted in the last update.
+     *
+     * @return Number of refitted geometry nodes.
+     */
+    int numRefittedNodes() const;
+
+    /**
+     * Gets the number of geometry nodes reinserted in the last update, the
+     * other refitted geometry nodes still fit in their enlarged extents.
+     *
+     * @return Number of reinserted geometry nodes.
+     */
+    int numReinsertedNodes() const;
+
+    /**
+     * Registers a geometry node.
+     *
+     * @param p The geometry node.
+     *
+     * @warning For internal use only.
+     */
+    void addNode(GeometryNode* p);
+
+    /**
+     * Unregisters a geometry node.
+     *
+     * @param p The geometry node.
+     *
+     * @warning For internal use only.
+     */
+    void removeNode(GeometryNode* p);
+
+    /**
+     * Tells that the world extents of a registered geometry node have
+     * changed.
+     *
+     * @param p The geometry node.
+     *
+     * @warning For internal use only.
+     */
+    void invalidateNode(const GeometryNode* p);
+
+private:
+    GroupNode* rootNode_;               ///< Root node.
+    TransformHierarchy transforms_;     ///< Node transforms.
+    AabbTree tree_;                     ///< Spatial index.
+    std::vector<int> movedProxies_;     ///< Proxies to refit.
+    int numRefittedNodes_;              ///< Refitted in the last update.
+    int numReinsertedNodes_;            ///< Reinserted in the last update.
+
+    // prevent copying
+    Scene(const Scene&);
+    Scene& operator =(const Scene&);
+};
+
+#endif // #ifndef GRAPHICS_SCENE_H_INCLUDED
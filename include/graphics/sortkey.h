@@ -0,0 +1,89 @@
+/**
+ * @file graphics/sortkey.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_SORTKEY_H_INCLUDED
+#define GRAPHICS_SORTKEY_H_INCLUDED
+
+#include <stdint.h>
+
+/**
+ * Packs and unpacks 64-bit render queue sort keys. Sorting the keys in
+ * ascending order groups the geometry nodes by render pass first and material
+ * second. Geometry nodes that share a material are drawn in front to back
+ * order. The bit layout from the most significant bit to the least
+ * significant bit is:
+ *
+ * <pre>
+ * | pass (8) | material (32) | depth (24) |
+ * </pre>
+ *
+ * The program is not part of the key, the render queue draws all geometry
+ * nodes with the program of the draw parameters.
+ */
+class SortKey
+{
+public:
+    static const int passBits = 8;          ///< Number of render pass bits.
+    static const int materialBits = 32;     ///< Number of material bits.
+    static const int depthBits = 24;        ///< Number of depth bits.
+
+    /**
+     * Packs a sort key. Field values that do not fit in their bit fields are
+     * truncated.
+     *
+     * @param pass Render pass.
+     * @param material Material key.
+     * @param depth Quantized view depth.
+     *
+     * @return The packed sort key.
+     */
+    static uint64_t pack(
+        uint32_t pass,
+        uint32_t material,
+        uint32_t depth);
+
+    /**
+     * Quantizes a normalized view depth to a depth bit field value.
+     *
+     * @param depth Normalized view depth, values outside [<code>0</code>,
+     * <code>1</code>] are clamped.
+     *
+     * @return The quantized view depth.
+     */
+    static uint32_t quantizeDepth(float depth);
+
+    /**
+     * Gets the render pass of a sort key.
+     *
+     * @param key A sort key.
+     *
+     * @return The render pass of <code>key</code>.
+     */
+    static uint32_t pass(uint64_t key);
+
+    /**
+     * Gets the material key of a sort key.
+     *
+     * @param key A sort key.
+     *
+     * @return The material key of <code>key</code>.
+     */
+    static uint32_t material(uint64_t key);
+
+    /**
+     * Gets the quantized view depth of a sort key.
+     *
+     * @param key A sort key.
+     *
+     * @return The quantized view depth of <code>key</code>.
+     */
+    static uint32_t depth(uint64_t key);
+
+private:
+    // prevent construction
+    SortKey();
+};
+
+#endif // #ifndef GRAPHICS_SORTKEY_H_INCLUDED
@@ -0,0 +1,175 @@
+/**
+ * @file graphics/statecache.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_STATECACHE_H_INCLUDED
+#define GRAPHICS_STATECACHE_H_INCLUDED
+
+#include <stdint.h>
+
+#include <graphics/blendsettings.h>
+#include <graphics/culltestsettings.h>
+#include <graphics/depthtestsettings.h>
+#include <graphics/stenciltestsettings.h>
+
+class Program;
+class Texture;
+
+/**
+ * Keeps a shadow copy of the OpenGL render state and issues only the OpenGL
+ * calls that change it. All render state changes made during drawing should go
+ * through a state cache. If OpenGL state is changed directly, the cache must
+ * be invalidated before it is used again.
+ */
+class StateCache
+{
+public:
+    /**
+     * Maximum number of tracked texture units.
+     */
+    static const int maxTextureUnits = 16;
+
+    // compiler-generated destructor is fine
+
+    /**
+     * Default constructor. The constructed cache does not know the OpenGL
+     * state, the first apply or bind call of each kind issues its OpenGL
+     * calls unconditionally.
+     */
+    StateCache();
+
+    /**
+     * Forgets the shadow copy of the OpenGL state. This must be called if the
+     * OpenGL state has been changed without going through this cache.
+     */
+    void invalidate();
+
+    /**
+     * Applies blend settings. The blend color, equations and factors are
+     * applied only if blending is enabled.
+     *
+     * @param settings Blend settings to apply.
+     */
+    void apply(const BlendSettings& settings);
+
+    /**
+     * Applies depth test settings. The comparison function is applied only if
+     * depth testing is enabled.
+     *
+     * @param settings Depth test settings to apply.
+     */
+    void apply(const DepthTestSettings& settings);
+
+    /**
+     * Applies stencil test settings. The face settings are applied only if
+     * stencil testing is enabled.
+     *
+     * @param settings Stencil test settings to apply.
+     */
+    void apply(const StencilTestSettings& settings);
+
+    /**
+     * Applies cull test settings. The cull face is applied only if culling is
+     * enabled.
+     *
+     * @param settings Cull test settings to apply.
+     */
+    void apply(const CullTestSettings& settings);
+
+    /**
+     * Sets the current program.
+     *
+     * @param p The program to use, a null pointer unbinds the current
+     * program.
+     */
+    void useProgram(const Program* p);
+
+    /**
+     * Binds a 2D texture to a texture unit.
+     *
+     * @param unit Texture unit, must be between [<code>0</code>,
+     * <code>maxTextureUnits</code>).
+     * @param p The texture to bind, a null pointer unbinds the current
+     * texture.
+     */
+    void bindTexture(int unit, const Texture* p);
+
+    /**
+     * Binds a vertex array object.
+     *
+     * @param id Vertex array object Id, <code>0</code> unbinds the current
+     * vertex array object.
+     */
+    void bindVertexArray(uint32_t id);
+
+    /**
+     * Gets the number of OpenGL calls issued since the last counter reset.
+     *
+     * @return Number of issued OpenGL calls.
+     */
+    int numIssuedCalls() const;
+
+    /**
+     * Gets the number of redundant OpenGL calls avoided since the last counter
+     * reset.
+     *
+     * @return Number of avoided OpenGL calls.
+     */
+    int numSavedCalls() const;
+
+    /**
+     * Resets the issued and saved call counters.
+     */
+    void resetCounters();
+
+private:
+    /**
+     * Updates the call counters.
+     *
+     * @param differs Does the requested state differ from the shadow state?
+     *
+     * @return <code>differs</code>.
+     */
+    bool count(bool differs);
+
+    /**
+     * Sets the active texture unit.
+     *
+     * @param unit Texture unit.
+     */
+    void setActiveTextureUnit(int unit);
+
+    /**
+     * Applies stencil face settings.
+     *
+     * @param face OpenGL face enumeration value.
+     * @param settings Face settings to apply.
+     * @param current Shadow face settings.
+     */
+    void applyFace(
+        uint32_t face,
+        const StencilTestFaceSettings& settings,
+        StencilTestFaceSettings& current);
+
+    BlendSettings blend_;               ///< Shadow blend settings.
+    DepthTestSettings depthTest_;       ///< Shadow depth test settings.
+    StencilTestSettings stencilTest_;   ///< Shadow stencil test settings.
+    CullTestSettings cullTest_;         ///< Shadow cull test settings.
+    bool blendEnabledValid_;            ///< Is the blend enable shadow valid?
+    bool depthTestEnabledValid_;        ///< Is the depth test enable shadow valid?
+    bool stencilTestEnabledValid_;      ///< Is the stencil test enable shadow valid?
+    bool cullTestEnabledValid_;         ///< Is the cull test enable shadow valid?
+    bool blendValid_;                   ///< Is the blend shadow valid?
+    bool depthTestValid_;               ///< Is the depth test shadow valid?
+    bool stencilTestValid_;             ///< Is the stencil test shadow valid?
+    bool cullTestValid_;                ///< Is the cull test shadow valid?
+    uint32_t programId_;                ///< Current program Id.
+    uint32_t vertexArrayId_;            ///< Current vertex array object Id.
+    int activeTextureUnit_;             ///< Active texture unit.
+    uint32_t textureIds_[maxTextureUnits];  ///< Bound texture Ids per unit.
+    int numIssuedCalls_;                ///< Number of issued OpenGL calls.
+    int numSavedCalls_;                 ///< Number of avoided OpenGL calls.
+};
+
+#endif // #ifndef GRAPHICS_STATECACHE_H_INCLUDED
@@ -0,0 +1,244 @@
+/**
+ * @file graphics/staticbatcher.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_STATICBATCHER_H_INCLUDED
+#define GRAPHICS_STATICBATCHER_H_INCLUDED
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <geometry/vector2.h>
+#include <geometry/vector3.h>
+
+#include <graphics/mesh.h>
+#include <graphics/resourcemanager.h>
+#include <graphics/vertexformat.h>
+
+class GroupNode;
+class MeshNode;
+class Texture;
+
+typedef ResourceManager<Mesh> MeshManager;
+
+/**
+ * Merges the mesh nodes of a static node hierarchy into a few large mesh
+ * nodes. Mesh nodes that use the same texture maps and the same vertex format
+ * are pre-transformed to the model space of the root node and merged into
+ * indexed meshes. Each merged mesh is split spatially so that the resulting
+ * mesh nodes can still be culled separately. Batching is opt-in, the nodes of
+ * the batched hierarchy must not move relative to the root node after
+ * batching.
+ */
+class StaticBatcher
+{
+public:
+    /**
+     * Destructor.
+     */
+    ~StaticBatcher();
+
+    /**
+     * Default constructor.
+     */
+    StaticBatcher();
+
+    /**
+     * Sets the mesh manager that takes ownership of the merged meshes.
+     *
+     * @param p Pointer to the mesh manager.
+     */
+    void setMeshManager(MeshManager* p);
+
+    /**
+     * Gets the pointer to the mesh manager.
+     *
+     * @return Pointer to the mesh manager.
+     */
+    MeshManager* meshManager() const;
+
+    /**
+     * Sets the maximum number of vertices in a merged mesh. Merged meshes with
+     * more vertices are split.
+     *
+     * @param numVertices Maximum number of vertices, must be > 0.
+     */
+    void setMaxBatchVertices(int numVertices);
+
+    /**
+     * Gets the maximum number of vertices in a merged mesh.
+     *
+     * @return Maximum number of vertices.
+     */
+    int maxBatchVertices() const;
+
+    /**
+     * Sets the maximum extents side length of a merged mesh in the model
+     * space of the root node. Merged meshes with larger extents are split so
+     * that they are culled at a finer granularity.
+     *
+     * @param size Maximum side length, must be > 0.
+     */
+    void setMaxBatchSize(float size);
+
+    /**
+     * Gets the maximum extents side length of a merged mesh.
+     *
+     * @return Maximum side length.
+     */
+    float maxBatchSize() const;
+
+    /**
+     * Batches the mesh nodes in a node hierarchy. The batched mesh nodes are
+     * deleted and replaced with merged mesh nodes attached directly to
+     * <code>root</code>. Group nodes left empty are deleted. Mesh nodes
+     * without a mesh or whose mesh has no client data are left untouched, as
+     * are all other types of nodes.
+     *
+     * @param root Root node of the hierarchy to batch, cannot be a null
+     * pointer.
+     * @param name Mesh name prefix for the merged meshes. The merged meshes
+     * are named <code>name</code>_batch<i>n</i>, with the lowest numbers
+     * <i>n</i> that are free in the mesh manager, so a hierarchy can be
+     * batched again with the same prefix.
+     *
+     * @return Number of merged mesh nodes created.
+     */
+    int batch(GroupNode* root, const std::string& name);
+
+    /**
+     * Gets the number of mesh nodes merged in the last call to
+     * <code>batch(GroupNode*, const std::string&)</code>.
+     *
+     * @return Number of merged mesh nodes.
+     */
+    int numBatchedNodes() const;
+
+    /**
+     * Gets the number of merged mesh nodes created in the last call to
+     * <code>batch(GroupNode*, const std::string&)</code>.
+     *
+     * @return Number of created mesh nodes.
+     */
+    int numBatches() const;
+
+private:
+    /**
+     * Mesh nodes that can be merged together.
+     */
+    struct Material
+    {
+        Texture* diffuseMap;            ///< Diffuse map.
+        Texture* specularMap;           ///< Specular map.
+        Texture* glowMap;               ///< Glow map.
+        Texture* normalMap;             ///< Normal map.
+        VertexFormat vertexFormat;      ///< Vertex format.
+        std::vector<MeshNode*> nodes;   ///< Mesh nodes to merge.
+    };
+
+    /**
+     * Triangle in the vertex pool of a material.
+     */
+    struct Triangle
+    {
+        uint32_t indices[3];            ///< Vertex pool indices.
+        Vector3 centroid;               ///< Centroid in root model space.
+    };
+
+    /**
+     * Orders triangles by the centroid coordinate along an axis.
+     */
+    struct TriangleLess
+    {
+        explicit TriangleLess(int axis);
+        bool operator ()(const Triangle& a, const Triangle& b) const;
+
+        int axis;                       ///< Axis to compare.
+    };
+
+    typedef std::vector<Material> MaterialVector;
+    typedef std::vector<Triangle> TriangleVector;
+
+    /**
+     * Collects the mesh nodes of a node hierarchy to the material table.
+     *
+     * @param p Root node of the hierarchy.
+     */
+    void collect(const GroupNode* p);
+
+    /**
+     * Pre-transforms the vertices of all mesh nodes of a material to the
+     * model space of the root node and fills the vertex pool and the triangle
+     * array.
+     *
+     * @param material The material.
+     */
+    void fillPool(const Material& material);
+
+    /**
+     * Splits a range of triangles until each part satisfies the batch limits
+     * and creates a mesh node for each part.
+     *
+     * @param material The material.
+     * @param first Index of the first triangle.
+     * @param last Index one beyond the last triangle.
+     */
+    void split(const Material& material, int first, int last);
+
+    /**
+     * Creates a merged mesh node from a range of triangles and attaches it to
+     * the root node.
+     *
+     * @param material The material.
+     * @param first Index of the first triangle.
+     * @param last Index one beyond the last triangle.
+     */
+    void createBatch(const Material& material, int first, int last);
+
+    /**
+     * Counts the distinct pool vertices referred to by a range of triangles.
+     * Leaves the pool to batch vertex mapping in <code>remap_</code>.
+     *
+     * @param first Index of the first triangle.
+     * @param last Index one beyond the last triangle.
+     *
+     * @return Number of distinct vertices.
+     */
+    int remapVertices(int first, int last);
+
+    /**
+     * Deletes the group nodes in a node hierarchy that have no child nodes.
+     * The root node itself is not deleted.
+     *
+     * @param p Root node of the hierarchy.
+     */
+    static void pruneEmptyGroups(GroupNode* p);
+
+    MeshManager* meshManager_;          ///< Pointer to the mesh manager.
+    int maxBatchVertices_;              ///< Maximum vertices in a batch.
+    float maxBatchSize_;                ///< Maximum batch side length.
+    int numBatchedNodes_;               ///< Number of merged mesh nodes.
+    int numBatches_;                    ///< Number of created mesh nodes.
+
+    // temporary state of a batch(GroupNode*, const std::string&) call
+    GroupNode* root_;                   ///< Root node being batched.
+    std::string name_;                  ///< Mesh name prefix.
+    int nextNameId_;                    ///< Next mesh name number to try.
+    MaterialVector materials_;          ///< Mesh nodes by material.
+    std::vector<Vector3> vertices_;     ///< Vertex pool coordinates.
+    std::vector<Vector3> normals_;      ///< Vertex pool normals.
+    std::vector<Vector3> tangents_;     ///< Vertex pool tangents.
+    std::vector<Vector2> texCoords_;    ///< Vertex pool texture coordinates.
+    TriangleVector triangles_;          ///< Triangles of the material.
+    std::vector<int32_t> remap_;        ///< Pool to batch vertex mapping.
+    std::vector<uint32_t> remapped_;    ///< Remapped pool vertices.
+
+    // prevent copying
+    StaticBatcher(const StaticBatcher&);
+    StaticBatcher& operator =(const StaticBatcher&);
+};
+
+#endif // #ifndef GRAPHICS_STATICBATCHER_H_INCLUDED
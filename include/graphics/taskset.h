@@ -0,0 +1,60 @@
+/**
+ * @file graphics/taskset.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_TASKSET_H_INCLUDED
+#define GRAPHICS_TASKSET_H_INCLUDED
+
+/**
+ * Work divided into tasks that can be run by multiple threads. The tasks are
+ * run with <code>runTask(int)</code> on any threads, and when all of them are
+ * done, <code>merge()</code> is called on one thread. Task sets do not create
+ * threads, the caller decides which threads run the tasks.
+ */
+class TaskSet
+{
+public:
+    /**
+     * Destructor.
+     */
+    virtual ~TaskSet();
+
+    /**
+     * Gets the number of tasks.
+     *
+     * @return Number of tasks.
+     */
+    virtual int numTasks() const = 0;
+
+    /**
+     * Runs a task. Calls with different task indices can run concurrently.
+     *
+     * @param index Index of the task, must be between [<code>0</code>,
+     * <code>numTasks()</code>).
+     */
+    virtual void runTask(int index) = 0;
+
+    /**
+     * Merges the results of the tasks. All tasks must have been run.
+     */
+    virtual void merge() = 0;
+
+    /**
+     * Runs all tasks on the calling thread and merges them.
+     */
+    void runAll();
+
+protected:
+    /**
+     * Default constructor.
+     */
+    TaskSet();
+
+private:
+    // prevent copying
+    TaskSet(const TaskSet&);
+    TaskSet& operator =(const TaskSet&);
+};
+
+#endif // #ifndef GRAPHICS_TASKSET_H_INCLUDED
@@ -45,6 +45,15 @@ class Texture
          */
         bool loadImage( std::string imagepath );
 
+        /**
+         * Allocates an empty RGBA image, for example for rendering into the
+         * texture. The contents of the image are undefined.
+         *
+         * @param width width of the image in pixels
+         * @param height height of the image in pixels
+         */
+        void createImage( int width, int height );
+
         /**
          * Calls glBindTexture with textureHandle.
          */
@@ -0,0 +1,168 @@
+/**
+ * @file graphics/transformhierarchy.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_TRANSFORMHIERARCHY_H_INCLUDED
+#define GRAPHICS_TRANSFORMHIERARCHY_H_INCLUDED
+
+#include <stdint.h>
+
+#include <vector>
+
+class Transform3;
+
+class Node;
+
+/**
+ * Flattened transform hierarchy of the nodes of a scene. The local and world
+ * transforms of the nodes are stored in structure of arrays form, one array
+ * per transform component, and the nodes are ordered so that a parent node
+ * always comes before its child nodes. Editing the local transform of a node
+ * only marks the node dirty. <code>update()</code> then calculates the world
+ * transforms of the dirty nodes and their descendants in one linear pass and
+ * invalidates their world extents. World transforms read before the update
+ * are calculated from the local transforms of the node and its anchestors.
+ */
+class TransformHierarchy
+{
+public:
+    /**
+     * Destructor.
+     */
+    ~TransformHierarchy();
+
+    /**
+     * Default constructor.
+     */
+    TransformHierarchy();
+
+    /**
+     * Adds a node. The parent node of the added node, if any, must have been
+     * added before it. The added node is dirty.
+     *
+     * @param p The node to add.
+     *
+     * @return Slot of the node.
+     *
+     * @warning For internal use only.
+     */
+    int addNode(Node* p);
+
+    /**
+     * Removes a node. The child nodes of the removed node must be removed as
+     * well before the next update.
+     *
+     * @param slot Slot of the node.
+     *
+     * @warning For internal use only.
+     */
+    void removeNode(int slot);
+
+    /**
+     * Sets the local transform of a node and marks the node dirty.
+     *
+     * @param slot Slot of the node.
+     * @param transform Local transform.
+     * @param rotationLocked Is the world rotation locked to local rotation?
+     * @param scalingLocked Is the world scaling locked to local scaling?
+     *
+     * @warning For internal use only.
+     */
+    void setLocalTransform(
+        int slot,
+        const Transform3& transform,
+        bool rotationLocked,
+        bool scalingLocked);
+
+    /**
+     * Gets the world transform of a node. If the node or any of its
+     * anchestors is dirty, the world transform is calculated from the local
+     * transforms.
+     *
+     * @param slot Slot of the node.
+     *
+     * @return World transform.
+     */
+    const Transform3 worldTransform(int slot) const;
+
+    /**
+     * Calculates the world transforms of the dirty nodes and their
+     * descendants and invalidates their world extents. Removed slots are
+     * compacted first if there are many of them.
+     */
+    void update();
+
+    /**
+     * Gets the number of nodes.
+     *
+     * @return Number of nodes.
+     */
+    int numNodes() const;
+
+    /**
+     * Gets the number of world transforms calculated by the last update.
+     *
+     * @return Number of updated nodes.
+     */
+    int numUpdatedNodes() const;
+
+private:
+    /**
+     * Number of transform components: translation, rotation and scaling.
+     */
+    static const int numComponents = 13;
+
+    typedef std::vector<float> FloatVector;
+
+    /**
+     * Reads a transform.
+     *
+     * @param components Component arrays to read.
+     * @param slot Slot of the node.
+     *
+     * @return The transform.
+     */
+    static const Transform3 load(const FloatVector* components, int slot);
+
+    /**
+     * Writes a transform.
+     *
+     * @param components Component arrays to write.
+     * @param slot Slot of the node.
+     * @param transform The transform.
+     */
+    static void store(FloatVector* components, int slot, const Transform3& transform);
+
+    /**
+     * Gets a boolean value indicating whether or not a node or any of its
+     * anchestors is dirty.
+     *
+     * @param slot Slot of the node.
+     *
+     * @return <code>true</code>, if the stored world transform is out of
+     * date, <code>false</code> otherwise.
+     */
+    bool isStale(int slot) const;
+
+    /**
+     * Removes the slots of removed nodes, keeps the order of the remaining
+     * nodes.
+     */
+    void compact();
+
+    FloatVector local_[numComponents];  ///< Local transform components.
+    FloatVector world_[numComponents];  ///< World transform components.
+    std::vector<int> parents_;          ///< Parent slots, -1 for none.
+    std::vector<uint8_t> flags_;        ///< Dirty and lock flags.
+    std::vector<Node*> nodes_;          ///< Nodes, null if removed.
+    int numRemoved_;                    ///< Number of removed slots.
+    bool dirty_;                        ///< Are there dirty nodes?
+    int numUpdatedNodes_;               ///< Updated by the last update.
+
+    // prevent copying
+    TransformHierarchy(const TransformHierarchy&);
+    TransformHierarchy& operator =(const TransformHierarchy&);
+};
+
+#endif // #ifndef GRAPHICS_TRANSFORMHIERARCHY_H_INCLUDED
@@ -0,0 +1,95 @@
+/**
+ * @file graphics/uniformblocks.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_UNIFORMBLOCKS_H_INCLUDED
+#define GRAPHICS_UNIFORMBLOCKS_H_INCLUDED
+
+#include <stdint.h>
+
+class DrawParams;
+class Matrix3x3;
+class Matrix4x4;
+class Program;
+
+/**
+ * Writes the shared uniform blocks. The per-frame <code>Camera</code> block
+ * holds the view and projection matrices, the per-object <code>Object</code>
+ * block holds the model to view transform and rotation. Both blocks use the
+ * <code>std140</code> layout:
+ *
+ * <pre>
+ * layout(std140) uniform Camera
+ * {
+ *     mat4 viewMatrix;
+ *     mat4 projectionMatrix;
+ * };
+ *
+ * layout(std140) uniform Object
+ * {
+ *     mat4 modelViewMatrix;
+ *     mat3 normalMatrix;
+ * };
+ * </pre>
+ */
+class UniformBlocks
+{
+public:
+    /**
+     * Uniform buffer binding point of the <code>Camera</code> block.
+     */
+    static const uint32_t cameraBinding = 0;
+
+    /**
+     * Uniform buffer binding point of the <code>Object</code> block.
+     */
+    static const uint32_t objectBinding = 1;
+
+    /**
+     * Assigns the binding points of the shared uniform blocks used by a
+     * program. Must be called after each successful link.
+     *
+     * @param program The program.
+     */
+    static void bindBlocks(Program& program);
+
+    /**
+     * Writes the <code>Camera</code> block and binds it. Should be called once
+     * per frame before drawing.
+     *
+     * @param params Draw parameters, <code>params.uniformBuffer</code> cannot
+     * be a null pointer.
+     */
+    static void setCameraBlock(const DrawParams& params);
+
+    /**
+     * Writes an <code>Object</code> block and binds it.
+     *
+     * @param params Draw parameters, <code>params.uniformBuffer</code> cannot
+     * be a null pointer.
+     * @param modelViewMatrix Model to view transform matrix.
+     * @param normalMatrix Model to view rotation matrix.
+     */
+    static void setObjectBlock(
+        const DrawParams& params,
+        const Matrix4x4& modelViewMatrix,
+        const Matrix3x3& normalMatrix);
+
+    /**
+     * Gets a boolean value indicating whether or not a program uses the
+     * <code>Object</code> block.
+     *
+     * @param program The program.
+     *
+     * @return <code>true</code>, if the program has an active
+     * <code>Object</code> block, <code>false</code> otherwise.
+     */
+    static bool hasObjectBlock(const Program& program);
+
+private:
+    // prevent construction
+    UniformBlocks();
+};
+
+#endif // #ifndef GRAPHICS_UNIFORMBLOCKS_H_INCLUDED
@@ -0,0 +1,123 @@
+/**
+ * @file graphics/uniformbuffer.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_UNIFORMBUFFER_H_INCLUDED
+#define GRAPHICS_UNIFORMBUFFER_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Represents a ring allocator for uniform block data. The buffer is divided
+ * into segments that are filled one after another. A segment is fenced when
+ * it is left and waited on before it is filled again, so uniform data still
+ * in use by the OpenGL implementation is never overwritten. If
+ * <code>ARB_buffer_storage</code> is supported the buffer is persistently
+ * mapped and written directly, otherwise the data is written with
+ * <code>glBufferSubData</code>. The buffer object is created on the first
+ * write, an OpenGL context must be current when this object is written to or
+ * destroyed.
+ */
+class UniformBuffer
+{
+public:
+    /**
+     * Number of segments.
+     */
+    static const int numSegments = 3;
+
+    /**
+     * Destructor.
+     */
+    ~UniformBuffer();
+
+    /**
+     * Constructor.
+     *
+     * @param segmentSize Segment size in bytes, a segment should hold the
+     * uniform data of a whole frame. Rounded up to the uniform buffer offset
+     * alignment.
+     */
+    explicit UniformBuffer(size_t segmentSize = 256 * 1024);
+
+    /**
+     * Writes a block of uniform data to the buffer.
+     *
+     * @param data The data to write.
+     * @param size Data size in bytes, cannot be greater than the segment
+     * size.
+     *
+     * @return Byte offset of the written block in the buffer object, aligned
+     * to the uniform buffer offset alignment.
+     */
+    size_t write(const void* data, size_t size);
+
+    /**
+     * Binds a block of this buffer to an indexed uniform buffer binding
+     * point.
+     *
+     * @param binding Uniform buffer binding point.
+     * @param offset Byte offset of the block returned by
+     * <code>write(const void*, size_t)</code>.
+     * @param size Block size in bytes.
+     */
+    void bindRange(uint32_t binding, size_t offset, size_t size) const;
+
+    /**
+     * Ends the current frame. Fences the current segment and continues from
+     * the next segment.
+     */
+    void endFrame();
+
+    /**
+     * Gets the OpenGL buffer object Id.
+     *
+     * @return OpenGL buffer object Id, <code>0</code> if the buffer object has
+     * not been created yet.
+     */
+    uint32_t id() const;
+
+    /**
+     * Gets a boolean value indicating whether or not the buffer is
+     * persistently mapped.
+     *
+     * @return <code>true</code>, if the buffer is persistently mapped,
+     * <code>false</code> otherwise.
+     */
+    bool isPersistent() const;
+
+private:
+    /**
+     * Creates the buffer object and starts filling the first segment.
+     */
+    void create();
+
+    /**
+     * Starts filling a segment. Waits until the OpenGL implementation has
+     * finished using the segment.
+     *
+     * @param segment Index of the segment.
+     */
+    void beginSegment(int segment);
+
+    /**
+     * Fences the current segment.
+     */
+    void endSegment();
+
+    uint32_t id_;                   ///< OpenGL buffer object Id.
+    size_t segmentSize_;            ///< Segment size in bytes.
+    size_t alignment_;              ///< Block offset alignment in bytes.
+    int segment_;                   ///< Current segment.
+    size_t offset_;                 ///< Next free offset in the segment.
+    uint8_t* mapping_;              ///< Persistent mapping.
+    void* fences_[numSegments];     ///< Segment fences.
+
+    // prevent copying
+    UniformBuffer(const UniformBuffer&);
+    UniformBuffer& operator =(const UniformBuffer&);
+};
+
+#endif // #ifndef GRAPHICS_UNIFORMBUFFER_H_INCLUDED
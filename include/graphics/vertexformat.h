@@ -0,0 +1,213 @@
+/**
+ * @file graphics/vertexformat.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef GRAPHICS_VERTEXFORMAT_H_INCLUDED
+#define GRAPHICS_VERTEXFORMAT_H_INCLUDED
+
+#include <stdint.h>
+
+class Vector3;
+
+/**
+ * Enumeration wrapper for possible vertex coordinate formats.
+ */
+struct PositionFormat
+{
+    /**
+     * Possible vertex coordinate formats.
+     */
+    enum Enum
+    {
+        /**
+         * Three 32-bit floats, 12 bytes.
+         */
+        Float,
+
+        /**
+         * Three 16-bit unsigned normalized integers quantized against the
+         * mesh extents and padded to 8 bytes.
+         */
+        UNorm16
+    };
+};
+
+/**
+ * Enumeration wrapper for possible normal and tangent formats.
+ */
+struct DirectionFormat
+{
+    /**
+     * Possible normal and tangent formats.
+     */
+    enum Enum
+    {
+        /**
+         * Three 32-bit floats, 12 bytes.
+         */
+        Float,
+
+        /**
+         * Three 10-bit signed normalized integers packed with 2 unused bits to
+         * 4 bytes, <code>GL_INT_2_10_10_10_REV</code>.
+         */
+        Int2101010
+    };
+};
+
+/**
+ * Enumeration wrapper for possible texture coordinate formats.
+ */
+struct TexCoordFormat
+{
+    /**
+     * Possible texture coordinate formats.
+     */
+    enum Enum
+    {
+        /**
+         * Two 32-bit floats, 8 bytes.
+         */
+        Float,
+
+        /**
+         * Two 16-bit floats, 4 bytes.
+         */
+        HalfFloat,
+
+        /**
+         * Two 16-bit unsigned normalized integers, 4 bytes. Can be used only
+         * if all texture coordinates are between [<code>0</code>,
+         * <code>1</code>], meshes with other texture coordinates fall back
+         * to <code>HalfFloat</code>.
+         */
+        UNorm16
+    };
+};
+
+/**
+ * Describes an interleaved vertex layout. The vertex attributes are stored in
+ * a single stream in the order coordinate, normal, tangent, texture
+ * coordinate. Each attribute starts at a 4-byte boundary.
+ */
+class VertexFormat
+{
+public:
+    // compiler-generated destructor, copy constructor and copy assignment
+    // operator are fine
+
+    /**
+     * Default constructor, constructs a full precision vertex format.
+     */
+    VertexFormat();
+
+    /**
+     * Gets a compact vertex format with quantized coordinates, packed normals
+     * and tangents and half float texture coordinates.
+     *
+     * @return A compact vertex format.
+     */
+    static const VertexFormat compact();
+
+    /**
+     * Exchanges the contents of <code>*this</code> and <code>other</code>.
+     *
+     * @param other The object to swap contents with.
+     */
+    void swap(VertexFormat& other);
+
+    /**
+     * Gets the vertex size, that is, the stride between consecutive
+     * vertices.
+     *
+     * @return Vertex size in bytes.
+     */
+    int vertexSize() const;
+
+    /**
+     * Gets the byte offset of the normal in a vertex.
+     *
+     * @return Byte offset of the normal.
+     */
+    int normalOffset() const;
+
+    /**
+     * Gets the byte offset of the tangent in a vertex.
+     *
+     * @return Byte offset of the tangent.
+     */
+    int tangentOffset() const;
+
+    /**
+     * Gets the byte offset of the texture coordinate in a vertex.
+     *
+     * @return Byte offset of the texture coordinate.
+     */
+    int texCoordOffset() const;
+
+    /**
+     * Encodes a value between [<code>0</code>, <code>1</code>] as a 16-bit
+     * unsigned normalized integer. Values outside the range are clamped.
+     *
+     * @param x The value to encode.
+     *
+     * @return The encoded value.
+     */
+    static uint16_t encodeUNorm16(float x);
+
+    /**
+     * Decodes a 16-bit unsigned normalized integer.
+     *
+     * @param x The value to decode.
+     *
+     * @return The decoded value.
+     */
+    static float decodeUNorm16(uint16_t x);
+
+    /**
+     * Encodes a value as a 16-bit float. The value is rounded to the nearest
+     * representable value, values too large in magnitude become infinities.
+     *
+     * @param x The value to encode.
+     *
+     * @return The encoded value.
+     */
+    static uint16_t encodeHalf(float x);
+
+    /**
+     * Decodes a 16-bit float.
+     *
+     * @param x The value to decode.
+     *
+     * @return The decoded value.
+     */
+    static float decodeHalf(uint16_t x);
+
+    /**
+     * Encodes a unit vector as three 10-bit signed normalized integers in the
+     * <code>GL_INT_2_10_10_10_REV</code> layout.
+     *
+     * @param v The vector to encode, the components are clamped to
+     * [<code>-1</code>, <code>1</code>].
+     *
+     * @return The encoded vector.
+     */
+    static uint32_t encodeDirection(const Vector3& v);
+
+    /**
+     * Decodes a vector encoded with <code>encodeDirection()</code>.
+     *
+     * @param x The value to decode.
+     *
+     * @return The decoded vector.
+     */
+    static const Vector3 decodeDirection(uint32_t x);
+
+    PositionFormat::Enum position;      ///< Vertex coordinate format.
+    DirectionFormat::Enum normal;       ///< Normal format.
+    DirectionFormat::Enum tangent;      ///< Tangent format.
+    TexCoordFormat::Enum texCoord;      ///< Texture coordinate format.
+};
+
+#endif // #ifndef GRAPHICS_VERTEXFORMAT_H_INCLUDED
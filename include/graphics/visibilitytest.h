@@ -6,9 +6,13 @@
 #ifndef GRAPHICS_VISIBILITYTEST_H_INCLUDED
 #define GRAPHICS_VISIBILITYTEST_H_INCLUDED
 
+#include <stdint.h>
+
 #include <geometry/plane3.h>
 
+class Box3;
 class Extents3;
+class Sphere;
 class Transform3;
 
 class CameraNode;
@@ -30,28 +34,122 @@ struct VisibilityState
     };
 };
 
+/**
+ * Result of a visibility test remembered across frames. Each node owns one.
+ * The owner must call <code>invalidate()</code> when its world extents
+ * change. A result is reused only by the visibility test that stored it.
+ */
+struct VisibilityCache
+{
+    /**
+     * Default constructor, constructs an invalid cache.
+     */
+    VisibilityCache();
+
+    /**
+     * Marks the cached result invalid, the next test is not reused.
+     */
+    void invalidate();
+
+    bool valid;                         ///< Is the cached result valid?
+    VisibilityState::Enum state;        ///< Cached visibility state.
+    uint32_t inputMask;                 ///< Plane mask passed to the test.
+    uint32_t outputMask;                ///< Plane mask after the test.
+    uint32_t testId;                    ///< Id of the storing test.
+    uint32_t frustumSerial;             ///< Frustum serial of the test.
+    uint32_t expires;                   ///< First frame to test again.
+    uint32_t phase;                     ///< Recheck phase of this cache.
+    int lastPlane;                      ///< Last rejecting frustum plane.
+    bool fromBatch;                     ///< Stored by a batch test?
+};
+
 /**
  * Implements a plane culling visibility test.
  */
 class VisibilityTest
 {
 public:
+    /**
+     * Plane mask with all six frustum planes active.
+     */
+    static const uint32_t allPlanes = 0x3F;
+
     // compiler-generated destructor, copy constructor and copy assignment
-    // operator are fine
+    // operator are fine, a copy shares the caches of the original like the
+    // per-thread copies of one visibility test should
 
     /**
-     * Default constructor, does not initialize the test parameters.
+     * Default constructor, does not initialize the test parameters. Each
+     * constructed visibility test gets an id of its own, so the caches
+     * stored by one are not reused by another.
      */
     VisibilityTest();
 
     /**
-     * Initializes the test parameters from the state of a given camera.
+     * Initializes the test parameters from the state of a given camera. Starts
+     * a new frame: the frustum serial is incremented if the frustum differs
+     * from the previous frame, and the counters are reset.
      *
      * @param camera The camera from whose state the visibility test parameters
      * are initialized.
      */
     void init(const CameraNode& camera);
 
+    /**
+     * Sets the recheck interval for cached results after the frustum has
+     * changed. A visible or partially visible result is reused for up to
+     * <code>frames</code> frames, the caches are rechecked in rotation so
+     * that about <code>1 / frames</code> of them are tested each frame.
+     * Invisible results are always tested again. Reused results may make
+     * nodes outside the frustum visible for a few frames, never the other way
+     * around. With the default value <code>1</code>, results are reused only
+     * while the frustum stays unchanged.
+     *
+     * @param frames Recheck interval in frames, must be > 0.
+     */
+    void setRecheckInterval(int frames);
+
+    /**
+     * Gets the recheck interval.
+     *
+     * @return Recheck interval in frames.
+     */
+    int recheckInterval() const;
+
+    /**
+     * Gets a boolean value indicating whether or not the frustum changed in
+     * the last call to <code>init(const CameraNode&)</code>.
+     *
+     * @return <code>true</code>, if the frustum changed, <code>false</code>
+     * otherwise.
+     */
+    bool isFrustumChanged() const;
+
+    /**
+     * Gets the number of visibility tests with a cache since the last
+     * initialization.
+     *
+     * @return Number of tests.
+     */
+    int numTests() const;
+
+    /**
+     * Gets the number of cached results reused since the last
+     * initialization.
+     *
+     * @return Number of reused results.
+     */
+    int numReused() const;
+
+    /**
+     * Adds the counters of another visibility test to the counters of this
+     * visibility test. Threads that cull in parallel use copies of one
+     * visibility test, the counters of the copies are summed up with this.
+     *
+     * @param other The visibility test whose counters are added.
+     */
+    void addCounters(const VisibilityTest& other);
+
     /**
      * Calculates the visibility state of given extents.
      *
@@ -61,6 +159,178 @@ public:
      */
     VisibilityState::Enum test(const Extents3& extents) const;
 
+    /**
+     * Calculates the visibility state of given extents against the active
+     * frustum planes. Planes the extents lie completely inside of are removed
+     * from the plane mask, so the updated mask can be passed to the child
+     * nodes of the tested node: anything inside the extents is inside those
+     * planes as well. The plane that rejected the extents the last time is
+     * tested first, extents that stay outside the same plane from frame to
+     * frame are rejected with a single plane test.
+     *
+     * @param extents The extents to test.
+     * @param planeMask Bit <code>i</code> is set if frustum plane
+     * <code>i</code> is to be tested. On return, holds the planes the extents
+     * intersect. Not changed if the extents are invisible.
+     * @param lastPlane Index of the plane tested first, or <code>-1</code>.
+     * If the extents are invisible, set to the index of the rejecting plane.
+     *
+     * @return The visibility state of <code>extents</code>.
+     * <code>VisibilityState::CompletelyVisible</code> if
+     * <code>planeMask</code> is or becomes <code>0</code>.
+     */
+    VisibilityState::Enum test(
+        const Extents3& extents,
+        uint32_t& planeMask,
+        int& lastPlane) const;
+
+    /**
+     * Calculates the visibility state of given extents like
+     * <code>test(const Extents3&, uint32_t&, int&) const</code>, but reuses
+     * the cached result when the extents, the plane mask and the frustum are
+     * unchanged since it was calculated, or when a visible result is within
+     * the recheck interval.
+     *
+     * @param extents The extents to test.
+     * @param planeMask Frustum planes to test, updated as by
+     * <code>test(const Extents3&, uint32_t&, int&) const</code>.
+     * @param cache The cache of the tested node.
+     *
+     * @return The visibility state of <code>extents</code>.
+     */
+    VisibilityState::Enum test(
+        const Extents3& extents,
+        uint32_t& planeMask,
+        VisibilityCache& cache) const;
+
+    /**
+     * Calculates the visibility state of an object bounded by both a sphere
+     * and an oriented box against the active frustum planes. Each plane is
+     * tested against the sphere first and against the box only if the
+     * sphere intersects the plane, the object is invisible if either volume
+     * is outside a plane. The plane mask and the last plane are updated like
+     * by <code>test(const Extents3&, uint32_t&, int&) const</code>.
+     *
+     * @param sphere Bounding sphere of the object.
+     * @param box Oriented bounding box of the object.
+     * @param planeMask Bit <code>i</code> is set if frustum plane
+     * <code>i</code> is to be tested. On return, holds the planes the object
+     * intersects. Not changed if the object is invisible.
+     * @param lastPlane Index of the plane tested first, or <code>-1</code>.
+     * If the object is invisible, set to the index of the rejecting plane.
+     *
+     * @return The visibility state of the object.
+     */
+    VisibilityState::Enum test(
+        const Sphere& sphere,
+        const Box3& box,
+        uint32_t& planeMask,
+        int& lastPlane) const;
+
+    /**
+     * Calculates the visibility state of an object bounded by both a sphere
+     * and an oriented box like
+     * <code>test(const Sphere&, const Box3&, uint32_t&, int&) const</code>,
+     * and reuses the cached result like
+     * <code>test(const Extents3&, uint32_t&, VisibilityCache&) const</code>.
+     *
+     * @param sphere Bounding sphere of the object.
+     * @param box Oriented bounding box of the object.
+     * @param planeMask Frustum planes to test, updated as by
+     * <code>test(const Sphere&, const Box3&, uint32_t&, int&) const</code>.
+     * @param cache The cache of the tested node.
+     *
+     * @return The visibility state of the object.
+     */
+    VisibilityState::Enum test(
+        const Sphere& sphere,
+        const Box3& box,
+        uint32_t& planeMask,
+        VisibilityCache& cache) const;
+
+    /**
+     * Calculates the visibility states of a batch of axis-aligned boxes. The
+     * boxes are given as structure of arrays, each array holds one component
+     * of the box centers or half sizes. Several boxes are tested at once with
+     * the widest SIMD kernel supported by the processor.
+     *
+     * @param centers Arrays of the x-, y- and z-components of the box
+     * centers.
+     * @param halfSizes Arrays of the x-, y- and z-components of the box half
+     * sizes, the components must be non-negative.
+     * @param count Number of boxes.
+     * @param planeMask Bit <code>i</code> is set if frustum plane
+     * <code>i</code> is to be tested.
+     * @param states Output array for the visibility states of the boxes, must
+     * have room for <code>count</code> items.
+     * @param planeMasks Output array for the planes each box intersects, must
+     * have room for <code>count</code> items. Like the plane mask updated by
+     * <code>test(const Extents3&, uint32_t&, int&) const</code>, it can be
+     * passed to the child nodes of the box. <code>0</code> for completely
+     * visible and invisible boxes.
+     *
+     * @see batchKernel()
+     */
+    void testBatch(
+        const float* const centers[3],
+        const float* const halfSizes[3],
+        int count,
+        uint32_t planeMask,
+        VisibilityState::Enum* states,
+        uint32_t* planeMasks) const;
+
+    /**
+     * Calculates the visibility states of a batch of axis-aligned boxes like
+     * <code>testBatch(const float* const[3], const float* const[3], int, uint32_t, VisibilityState::Enum*, uint32_t*) const</code>,
+     * and stores each result in the cache of its box, so that
+     * <code>test(const Extents3&, uint32_t&, VisibilityCache&) const</code>
+     * can reuse it with the same plane mask, both in the predraw step of the
+     * tested node and on later frames. Partially visible results are
+     * refined by
+     * <code>test(const Sphere&, const Box3&, uint32_t&, VisibilityCache&) const</code>
+     * against the planes the box intersects instead of being reused.
+     *
+     * @param centers Arrays of the x-, y- and z-components of the box
+     * centers.
+     * @param halfSizes Arrays of the x-, y- and z-components of the box half
+     * sizes, the components must be non-negative.
+     * @param count Number of boxes.
+     * @param planeMask Frustum planes to test.
+     * @param caches The caches of the boxes, must have <code>count</code>
+     * items.
+     * @param states Output array for the visibility states of the boxes.
+     * @param planeMasks Output array for the planes each box intersects.
+     */
+    void testBatch(
+        const float* const centers[3],
+        const float* const halfSizes[3],
+        int count,
+        uint32_t planeMask,
+        VisibilityCache* const* caches,
+        VisibilityState::Enum* states,
+        uint32_t* planeMasks) const;
+
+    /**
+     * Tells whether
+     * <code>test(const Extents3&, uint32_t&, VisibilityCache&) const</code>
+     * would reuse a cached result. Does not change the counters.
+     *
+     * @param planeMask Frustum planes to test.
+     * @param cache The cache of the tested node.
+     *
+     * @return <code>true</code> if the cached result would be reused.
+     */
+    bool isCached(uint32_t planeMask, const VisibilityCache& cache) const;
+
+    /**
+     * Gets the name of the kernel used by
+     * <code>testBatch(const float* const[3], const float* const[3], int, uint32_t, VisibilityState::Enum*, uint32_t*) const</code>.
+     *
+     * @return <code>"avx"</code>, <code>"sse"</code> or
+     * <code>"scalar"</code>.
+     */
+    static const char* batchKernel();
+
     /**
      * Exchanges the contents of <code>*this</code> and <code>other</code>.
      *
@@ -85,7 +355,60 @@ private:
      */
     void initPerspective(const ProjectionSettings& s, const Transform3& t);
 
-    Plane3 planes_[6];  ///< Frustum planes.
+    /**
+     * Reuses a cached result if the plane mask, the frustum and the recheck
+     * interval allow it.
+     *
+     * @param planeMask Frustum planes to test, set to the cached output mask
+     * if the result is reused.
+     * @param cache The cache of the tested node.
+     *
+     * @return <code>true</code> if the cached result is reused.
+     */
+    bool reuseResult(uint32_t& planeMask, const VisibilityCache& cache) const;
+
+    /**
+     * Takes a result stored by a batch test in the predraw step of the
+     * parent node. The result is taken only once and is not counted as
+     * reused.
+     *
+     * @param planeMask Frustum planes to test, set to the cached output mask
+     * if the result is taken.
+     * @param cache The cache of the tested node.
+     *
+     * @return <code>true</code> if the stored result is taken.
+     */
+    bool takeBatchResult(uint32_t& planeMask, VisibilityCache& cache) const;
+
+    /**
+     * Stores a result in a cache.
+     *
+     * @param state The visibility state.
+     * @param inputMask Plane mask passed to the test.
+     * @param outputMask Plane mask after the test.
+     * @param cache The cache to store the result in.
+     */
+    void storeResult(
+        VisibilityState::Enum state,
+        uint32_t inputMask,
+        uint32_t outputMask,
+        VisibilityCache& cache) const;
+
+    /**
+     * Starts a new frame after the frustum planes have been calculated.
+     *
+     * @param oldPlanes Frustum planes of the previous frame.
+     */
+    void beginFrame(const Plane3* oldPlanes);
+
+    Plane3 planes_[6];          ///< Frustum planes.
+    uint32_t id_;               ///< Id stored in the caches.
+    uint32_t frame_;            ///< Number of initializations.
+    uint32_t frustumSerial_;    ///< Incremented when the frustum changes.
+    bool frustumChanged_;       ///< Did the frustum change in the last frame?
+    int recheckInterval_;       ///< Recheck interval in frames.
+    mutable int numTests_;      ///< Number of tests with a cache.
+    mutable int numReused_;     ///< Number of reused results.
 };
 
 #endif // #ifndef GRAPHICS_VISIBILITYTEST_H_INCLUDED
@@ -7,21 +7,20 @@
 GameObject::GameObject()
  : graphicalPresentation(NULL),
    gameProgram(NULL),
-   parent(NULL)
+   parent(NULL),
+   indexInParent(-1)
 {
 }
 
 GameObject::~GameObject()
 {
 
-    std::list<GameObject*>::iterator childIterator = children.begin();
     std::list<Controller*>::iterator controllerIterator = controllers.begin();
 
-    // iterate over children and delete all of them
-    while( childIterator != children.end() )
+    // delete all children, the last child is the cheapest one to remove
+    while( !children.empty() )
     {
-        destroyChild( *childIterator );
-        childIterator++;
+        destroyChild( children.back() );
     }
 
     // iterate over controllers and delete all of them.
@@ -79,7 +78,6 @@ void GameObject::setParent( GameObject* newParent )
 void GameObject::update( float deltaTime )
 {
     std::list<Controller*>::iterator controllerIterator = controllers.begin();
-    std::list<GameObject*>::iterator childIterator = children.begin();
 
     while( controllerIterator != controllers.end() )
     {
@@ -87,10 +85,9 @@ void GameObject::update( float deltaTime )
         controllerIterator++;
     }
 
-    while( childIterator != children.end() )
+    for( size_t i = 0; i < children.size(); i++ )
     {
-        (*childIterator)->update( deltaTime );
-        childIterator++;
+        children[i]->update( deltaTime );
     }
 }
 
@@ -110,16 +107,56 @@ void GameObject::attachChild( GameObject* child )
         return;
 
     child->setParent(this);
+    child->indexInParent = children.size();
     children.push_back( child );
 }
 
 void GameObject::detachChild( GameObject* child )
 {
-    if( child == NULL )
+    if( child == NULL || child->parent != this )
+        return;
+
+    int index = child->indexInParent;
+
+    if( index < 0 || index >= (int)children.size() || children[index] != child )
         return;
 
-    child->setParent(NULL);
-    children.remove( child );
+    // move the last child to the place of the removed child
+    GameObject* last = children.back();
+    children[index] = last;
+    last->indexInParent = index;
+    children.pop_back();
+
+    child->parent = NULL;
+    child->indexInParent = -1;
+}
+
+void GameObject::attachChildren( const std::vector<GameObject*>& newChildren )
+{
+    reserveChildren( children.size() + newChildren.size() );
+
+    for( size_t i = 0; i < newChildren.size(); i++ )
+    {
+        attachChild( newChildren[i] );
+    }
+}
+
+void GameObject::detachChildren( const std::vector<GameObject*>& oldChildren )
+{
+    for( size_t i = 0; i < oldChildren.size(); i++ )
+    {
+        detachChild( oldChildren[i] );
+    }
+}
+
+void GameObject::reserveChildren( int numChildren )
+{
+    if( numChildren > (int)children.capacity() )
+    {
+        // grow geometrically so that repeated bulk attaches stay cheap
+        size_t capacity = 2 * children.capacity();
+        children.reserve( capacity > (size_t)numChildren ? capacity : numChildren );
+    }
 }
 
 void GameObject::destroyChild( GameObject* child )
@@ -5,6 +5,7 @@
 #include "geometry/transform2.h"
 #include "graphics/node.h"
 #include <list>
+#include <vector>
 
 /**
  * @file game/gameobject.h
@@ -105,12 +106,47 @@ class GameObject
         /**
          * Detach a child from the object. Note that only a pointer to the child
          * is removed, the actual memory is not freed here. Make sure you
-         * remember to free the child afterwards!
+         * remember to free the child afterwards! Takes constant time, the last
+         * child takes the place of the removed child so the order of the
+         * children may change.
          *
          * @param child child to remove
          */
         void detachChild( GameObject* child );
 
+        /**
+         * Attach several children to the object at once. Same as calling
+         * attachChild() for each child, but the storage for the children is
+         * allocated only once.
+         *
+         * @param newChildren children to attach to this object.
+         */
+        void attachChildren( const std::vector<GameObject*>& newChildren );
+
+        /**
+         * Detach several children from the object at once. Same as calling
+         * detachChild() for each child.
+         *
+         * @param oldChildren children to remove
+         */
+        void detachChildren( const std::vector<GameObject*>& oldChildren );
+
+        /**
+         * Reserve storage for children, so that attaching up to the given
+         * number of children does not allocate memory. Useful for objects
+         * that spawn and despawn many children, like bullets.
+         *
+         * @param numChildren number of children to reserve storage for.
+         */
+        void reserveChildren( int numChildren );
+
+        /**
+         * Getter for the number of children.
+         *
+         * @return int number of children attached to this object.
+         */
+        inline int getNumChildren() const { return children.size(); }
+
         /**
          * Same as detachChild(), but frees the memory of the child object
          * as well.
@@ -170,9 +206,10 @@ class GameObject
     std::list<Controller*> controllers;
 
     /**
-     * Children owned by this object.
+     * Children owned by this object. Each child knows its index in the
+     * vector, so detaching a child does not have to search for it.
      */
-    std::list<GameObject*> children;
+    std::vector<GameObject*> children;
 
     /**
      * Backpointer to GameProgram that own's this object
@@ -184,6 +221,12 @@ class GameObject
      */
     GameObject* parent;
 
+    /**
+     * Index of the object in the children of the parent object, -1 if the
+     * object is not attached to a parent.
+     */
+    int indexInParent;
+
     private:
 };
 
@@ -5,6 +5,7 @@
 
 #include "gameprogram.h"
 
+#include <cstdlib>
 #include <iostream>
 
 #include <graphics/opengl.h>
@@ -16,11 +17,19 @@
 #include <graphics/meshnode.h>
 #include <graphics/cameranode.h>
 #include <graphics/groupnode.h>
+#include <graphics/impostoratlas.h>
+#include <graphics/nodearena.h>
+#include <graphics/instancebuffer.h>
 #include <graphics/drawparams.h>
 #include <graphics/predrawparams.h>
+#include <graphics/predrawscheduler.h>
 #include <graphics/renderqueue.h>
 #include <graphics/runtimeassert.h>
+#include <graphics/scene.h>
+#include <graphics/statecache.h>
+#include <graphics/uniformblocks.h>
 #include <graphics/modelreader.h>
+#include <graphics/occlusionbuffer.h>
 #include <graphics/visibilitytest.h>
 #include "state.h"
 #include "introstate.h"
@@ -28,6 +37,7 @@
 #include "gamestate.h"
 #include "gamemenustate.h"
 #include "creditsstate.h"
+#include "predrawworkers.h"
 
 GameProgram::GameProgram()
 :
@@ -41,6 +51,8 @@ GameProgram::GameProgram()
     camera_(0),
     rootNode_(0),
     drawExtents_(false),
+    occlusionCulling_(true),
+    predrawWorkers_(NULL),
     diffuseMipmappingOn(true),
     glowMipmappingOn(true),
     normalMipmappingOn(false),
@@ -52,6 +64,11 @@ GameProgram::GameProgram()
     programManager_(),
     meshManager_(),
     textureManager_(),
+    instanceBuffer_(),
+    uniformBuffer_(),
+    commandBuffer_(),
+    meshArena_(),
+    impostorAtlas_(),
     currentState(NULL)
 {
     running         = true;
@@ -115,6 +132,13 @@ int GameProgram::execute()
     GRAPHICS_RUNTIME_ASSERT(vertexShader->compileStatus());
     vertexShaderManager_.loadResource("shadow", vertexShader);
 
+    vertexShader = new VertexShader();
+    vertexShader->setSourceText(readSourceText("data/shaders/impostor.vs"));
+    vertexShader->compile();
+    //const std::string info = vertexShader->infoLog();
+    GRAPHICS_RUNTIME_ASSERT(vertexShader->compileStatus());
+    vertexShaderManager_.loadResource("impostor", vertexShader);
+
     FragmentShader* fragmentShader = new FragmentShader();
     fragmentShader->setSourceText(readSourceText("data/shaders/default.fs"));
     fragmentShader->compile();
@@ -149,12 +173,20 @@ int GameProgram::execute()
     GRAPHICS_RUNTIME_ASSERT(fragmentShader->compileStatus());
     fragmentShaderManager_.loadResource("shadow", fragmentShader);
 
+    fragmentShader = new FragmentShader();
+    fragmentShader->setSourceText(readSourceText("data/shaders/impostor.fs"));
+    fragmentShader->compile();
+    //const std::string info = fragmentShader->infoLog();
+    GRAPHICS_RUNTIME_ASSERT(fragmentShader->compileStatus());
+    fragmentShaderManager_.loadResource("impostor", fragmentShader);
+
     // program for drawing mesh nodes
     Program* program = new Program();
     program->setVertexShader(vertexShaderManager_.getResource("default"));
     program->setFragmentShader(fragmentShaderManager_.getResource("default"));
     program->link();
     GRAPHICS_RUNTIME_ASSERT(program->linkStatus());
+    UniformBlocks::bindBlocks(*program);
     programManager_.loadResource("default", program);
 
     // program for drawing node extents
@@ -163,6 +195,7 @@ int GameProgram::execute()
     program->setFragmentShader(fragmentShaderManager_.getResource("extents"));
     program->link();
     GRAPHICS_RUNTIME_ASSERT(program->linkStatus());
+    UniformBlocks::bindBlocks(*program);
     programManager_.loadResource("extents", program);
 
     // program for lit render passes
@@ -171,6 +204,7 @@ int GameProgram::execute()
     program->setFragmentShader(fragmentShaderManager_.getResource("test"));
     program->link();
     GRAPHICS_RUNTIME_ASSERT(program->linkStatus());
+    UniformBlocks::bindBlocks(*program);
     programManager_.loadResource("test", program);
 
     // program for unlit render passes
@@ -179,6 +213,7 @@ int GameProgram::execute()
     program->setFragmentShader(fragmentShaderManager_.getResource("unlit"));
     program->link();
     GRAPHICS_RUNTIME_ASSERT(program->linkStatus());
+    UniformBlocks::bindBlocks(*program);
     programManager_.loadResource("unlit", program);
 
     // program for shadow render passes
@@ -187,8 +222,18 @@ int GameProgram::execute()
     program->setFragmentShader(fragmentShaderManager_.getResource("shadow"));
     program->link();
     GRAPHICS_RUNTIME_ASSERT(program->linkStatus());
+    UniformBlocks::bindBlocks(*program);
     programManager_.loadResource("shadow", program);
 
+    // program for drawing impostors
+    program = new Program();
+    program->setVertexShader(vertexShaderManager_.getResource("impostor"));
+    program->setFragmentShader(fragmentShaderManager_.getResource("impostor"));
+    program->link();
+    GRAPHICS_RUNTIME_ASSERT(program->linkStatus());
+    UniformBlocks::bindBlocks(*program);
+    programManager_.loadResource("impostor", program);
+
 
     // init textures
 
@@ -230,6 +275,18 @@ int GameProgram::execute()
 
     configuration.readConfiguration("config.ini");
 
+    // the predraw step is split between the main thread and the worker
+    // threads
+    int predrawThreads = 3;
+    std::map<std::string, std::string>& properties = configuration.getProperties();
+
+    if( properties.find("predraw_threads") != properties.end() )
+    {
+        predrawThreads = std::max( 0, atoi( properties["predraw_threads"].c_str() ) );
+    }
+
+    predrawWorkers_ = new PredrawWorkers( predrawThreads );
+
     if( mouseBoundToScreen )
     {
         mouse.setMouseMode( Mouse::MOUSE_BOUND );
@@ -268,6 +325,11 @@ int GameProgram::execute()
             drawExtents_ = !drawExtents_;
         }
 
+        if(keyboard.keyWasPressedInThisFrame(Keyboard::KEY_F9))
+        {
+            occlusionCulling_ = !occlusionCulling_;
+        }
+
         if(keyboard.keyWasPressedInThisFrame(Keyboard::KEY_F2))
         {
             diffuseMipmappingOn = !diffuseMipmappingOn;
@@ -352,13 +414,16 @@ int GameProgram::execute()
             running = false;
             break;
         }
+		// nodes spawned by the state are released with the state
+		NodeArena::setCurrent( &currentState->getNodeArena() );
 		currentState->update( deltaTime );
+		NodeArena::setCurrent( NULL );
 
 		keyboard.updateKeyboardState();
 
 		//mouse.updateMouse();
 
-		render( currentState->getRootNode() );
+		render( currentState->getRootNode(), currentState->getRenderScene() );
 		lastTicks = currentTicks;
 
 		if(changingState)
@@ -371,6 +436,9 @@ int GameProgram::execute()
     std::cout << "Leaving main loop." << std::endl;
 
     mixer_.close();
+
+    // the atlas deletes its OpenGL objects while the context still exists
+    impostorAtlas_.release();
 	cleanup();
 	std::cout << "bye!" << std::endl;
 
@@ -379,37 +447,90 @@ int GameProgram::execute()
 
 void drawExtents(const Node* node, const DrawParams& params);
 
-void GameProgram::render(Node* rootNode_)
+// extents program name hashes
+static const uint32_t mvpMatrixId = Program::hashName("mvp_matrix");
+static const uint32_t coordId = Program::hashName("coord");
+
+void GameProgram::render(Node* rootNode_, Scene* scene)
 {
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
+    // TODO: REALLY quick & dirty
+
+    static RenderQueue renderQueue;
+    static VisibilityTest visibilityTest;
+    static OcclusionBuffer occlusionBuffer;
+    static StateCache stateCache;
+
+    DepthTestSettings depthTestSettings;
+    depthTestSettings.enabled = true;
+    depthTestSettings.compareFunc = DepthTestCompareFunc::Less;
+
+    CullTestSettings cullTestSettings;
+    cullTestSettings.enabled = true;
+    cullTestSettings.cullFace = CullFace::Back;
+
+    // texture parameter changes rebind textures outside the cache between
+    // frames
+    stateCache.invalidate();
+    stateCache.resetCounters();
+    stateCache.apply(depthTestSettings);
+    stateCache.apply(cullTestSettings);
+
     glDepthRange(0.0f, 1.0f);
     glClearDepth(1.0f);
 
-    glEnable(GL_CULL_FACE);
-
 	//glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 	glClearColor(0.5f, 0.5f, 0.5f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 
-    // TODO: REALLY quick & dirty
-
-    static RenderQueue renderQueue;
-    static VisibilityTest visibilityTest;
-
-
     // predraw step
 
     renderQueue.clear();
+    renderQueue.init(*camera_);
+
+    // distant geometry nodes are drawn as impostors captured with the unlit
+    // program
+    impostorAtlas_.setCaptureProgram(programManager_.getResource("unlit"));
+    impostorAtlas_.setProgram(programManager_.getResource("impostor"));
+    renderQueue.setImpostorAtlas(&impostorAtlas_);
+
+    // visible results are rechecked every fourth frame while the camera
+    // moves
+    visibilityTest.setRecheckInterval(4);
     visibilityTest.init(*camera_);
 
     PredrawParams predrawParams;
     predrawParams.setRenderQueue(&renderQueue);
     predrawParams.setVisibilityTest(&visibilityTest);
 
-    // setting the second parameter to false disables frustum culling
-    rootNode_->predraw(predrawParams, true);
+    predraw(rootNode_, scene, predrawParams);
+
+    if (occlusionCulling_)
+    {
+        // the occluders that passed the frustum test are rasterized, and the
+        // nodes they hide are removed from the render queue
+        occlusionBuffer.init(*camera_);
+
+        // occluders covering less of the view hide too little to pay for
+        // their rasterization
+        const float minOccluderSize = 0.1f;
+
+        for (int i = 0; i < renderQueue.numGeometryNodes(); ++i)
+        {
+            // prefab nodes drawn for instance nodes are not occluders
+            if( renderQueue.instanceTransform(i) == NULL
+            &&  renderQueue.projectedSize( renderQueue.geometryNode(i)->worldExtents() ) >= minOccluderSize )
+            {
+                renderQueue.geometryNode(i)->rasterizeOccluder(occlusionBuffer);
+            }
+        }
+
+        if (occlusionBuffer.numOccluderTriangles() > 0)
+        {
+            occlusionBuffer.rasterize();
+            renderQueue.removeOccluded(occlusionBuffer);
+        }
+    }
     renderQueue.sort();
 
 
@@ -417,28 +538,47 @@ void GameProgram::render(Node* rootNode_)
 
     DrawParams drawParams;
     drawParams.viewMatrix = camera_->worldToViewMatrix();
-    // TODO: load projection matrix directly to the shader?
     drawParams.projectionMatrix = camera_->projectionMatrix();
     drawParams.worldToViewRotation = transpose(camera_->worldTransform().rotation);
     drawParams.cameraToWorld = camera_->worldTransform();
+    drawParams.stateCache = &stateCache;
+    drawParams.instanceBuffer = &instanceBuffer_;
+    drawParams.uniformBuffer = &uniformBuffer_;
+    drawParams.meshArena = &meshArena_;
+    drawParams.commandBuffer = &commandBuffer_;
+
+    // the captures set their own camera blocks
+    impostorAtlas_.update(renderQueue, drawParams);
+
+    // the camera block is shared by all programs for the whole frame
+    UniformBlocks::setCameraBlock(drawParams);
 
     drawParams.program = programManager_.getResource("unlit");
-    glUseProgram(drawParams.program->id());
+    stateCache.useProgram(drawParams.program);
 
     // unlit render pass
     renderQueue.draw(drawParams);
+    impostorAtlas_.draw(renderQueue, drawParams);
 
 
     if (drawExtents_)
     {
-        glDepthFunc(GL_LEQUAL);
+        depthTestSettings.compareFunc = DepthTestCompareFunc::LessEqual;
+        stateCache.apply(depthTestSettings);
 
         drawParams.program = programManager_.getResource("extents");
-        glUseProgram(drawParams.program->id());
+        stateCache.useProgram(drawParams.program);
+
+        // the extents are drawn from client side vertex arrays
+        stateCache.bindVertexArray(0);
 
         for (int i = 0; i < renderQueue.numGeometryNodes(); ++i)
         {
-            drawExtents(renderQueue.geometryNode(i), drawParams);
+            // the extents of prefab nodes are not at the instance location
+            if( renderQueue.instanceTransform(i) == NULL )
+            {
+                drawExtents(renderQueue.geometryNode(i), drawParams);
+            }
         }
 
         for (int i = 0; i < renderQueue.numGroupNodes(); ++i)
@@ -447,10 +587,44 @@ void GameProgram::render(Node* rootNode_)
         }
     }
 
+    uniformBuffer_.endFrame();
+
     SDL_GL_SwapBuffers();
 }
 
 // TODO: quick & dirty, this does not belong here
+void GameProgram::predraw(Node* rootNode_, Scene* scene, const PredrawParams& params)
+{
+    static PredrawScheduler scheduler;
+
+    if (scene != 0)
+    {
+        // culls the spatial index instead of the node hierarchy
+        scheduler.init(*scene, params);
+    }
+    else
+    {
+        const GroupNode* const group = dynamic_cast<const GroupNode*>(rootNode_);
+
+        if (group == 0)
+        {
+            rootNode_->predraw(params, VisibilityTest::allPlanes);
+            return;
+        }
+
+        scheduler.init(*group, params);
+    }
+
+    if (predrawWorkers_ != 0)
+    {
+        predrawWorkers_->run(scheduler);
+    }
+    else
+    {
+        scheduler.runAll();
+    }
+}
+
 void drawExtents(const Node* node, const DrawParams& params)
 {
     const Extents3 extents = node->worldExtents();
@@ -486,10 +660,10 @@ void drawExtents(const Node* node, const DrawParams& params)
 
     const Matrix4x4 mvpMatrix = params.viewMatrix * params.projectionMatrix;
 
-    const GLint mvpMatrixLocation = glGetUniformLocation(params.program->id(), "mvp_matrix");
+    const GLint mvpMatrixLocation = params.program->uniformLocation(mvpMatrixId);
     glUniformMatrix4fv(mvpMatrixLocation, 1, false, mvpMatrix.data());
 
-    const GLint coordLocation = glGetAttribLocation(params.program->id(), "coord");
+    const GLint coordLocation = params.program->attributeLocation(coordId);
     glVertexAttribPointer(coordLocation, 3, GL_FLOAT, false, 0, vertices->data());
     glEnableVertexAttribArray(coordLocation);
 
@@ -639,6 +813,7 @@ void GameProgram::test()
 {
     ModelReader modelReader;
     modelReader.setMeshManager(&meshManager_);
+    modelReader.setVertexFormat(VertexFormat::compact());
 
     Mesh* const boxMesh = createBox(0.5f, 0.5f, 0.5f);
     meshManager_.loadResource("box", boxMesh);
@@ -744,11 +919,15 @@ State* GameProgram::InitNewState(STATES state)
         break;
     }
 
+    // the state constructor made the node arena of the state current
+    NodeArena::setCurrent( NULL );
+
     return tmpState;
 }
 
 GameProgram::~GameProgram()
 {
+    delete predrawWorkers_;
     delete rootNode_;
     delete camera_;
 
@@ -22,6 +22,10 @@
 #include <graphics/vertexshader.h>
 #include <graphics/fragmentshader.h>
 #include <graphics/program.h>
+#include <graphics/impostoratlas.h>
+#include <graphics/instancebuffer.h>
+#include <graphics/mesharena.h>
+#include <graphics/uniformbuffer.h>
 #include <graphics/mesh.h>
 #include <geometry/vector3.h>
 #include <graphics/texture.h>
@@ -35,6 +39,9 @@ class Vector3Array;
 class ColorArray;
 class IndexArray;
 class Node;
+class PredrawParams;
+class PredrawWorkers;
+class Scene;
 class State;
 
 typedef ResourceManager<VertexShader> VertexShaderManager;
@@ -75,7 +82,7 @@ public:
 	 * Renders the scene
 	 *
 	 */
-	void render(Node* rootNode);
+	void render(Node* rootNode, Scene* scene = 0);
 
 	/**
 	 *
@@ -123,6 +130,14 @@ public:
 	 */
 	void setRunning( bool value ) { this->running = value; }
 
+	/**
+	 *
+	 * getter for the predraw worker threads, also used for other task sets
+	 *
+	 * @return PredrawWorkers*, NULL before initialization
+	 */
+	inline PredrawWorkers* getPredrawWorkers() const { return predrawWorkers_; }
+
     /*
      * Exits the main loop and calls SDL_Quit()
      */
@@ -169,6 +184,15 @@ public:
 private:
     void test();
 
+    /**
+     * Runs the predraw step on the predraw worker threads.
+     *
+     * @param rootNode root node to cull if there is no scene.
+     * @param scene spatial index to cull, can be NULL.
+     * @param params predraw parameters.
+     */
+    void predraw( Node* rootNode, Scene* scene, const PredrawParams& params );
+
 	Configuration configuration;
 	Mixer mixer_;
 	Node* ship;
@@ -185,6 +209,8 @@ private:
     CameraNode* camera_;
     GroupNode* rootNode_;
     bool drawExtents_;
+    bool occlusionCulling_;
+    PredrawWorkers* predrawWorkers_;
     bool diffuseMipmappingOn;
     bool glowMipmappingOn;
     bool normalMipmappingOn;
@@ -199,6 +225,11 @@ public:
     ProgramManager programManager_;
     MeshManager meshManager_;
     TextureManager textureManager_;
+    InstanceBuffer instanceBuffer_;
+    UniformBuffer uniformBuffer_;
+    InstanceBuffer commandBuffer_;
+    MeshArena meshArena_;
+    ImpostorAtlas impostorAtlas_;
 private:
 
     /**
@@ -1,10 +1,12 @@
 #include "gamestate.h"
 #include "gameobject.h"
 #include "keyboardcontroller.h"
+#include "predrawworkers.h"
 #include "graphics/texture.h"
 #include "graphics/meshnode.h"
 
 #include  <iostream>
+#include <graphics/meshsimplifier.h>
 #include <graphics/modelreader.h>
 
 GameState::GameState( GameProgram* backpointer )
@@ -14,6 +16,15 @@ GameState::GameState( GameProgram* backpointer )
 
     ModelReader modelReader;
     modelReader.setMeshManager( &backpointer->meshManager_ );
+    modelReader.setVertexFormat( VertexFormat::compact() );
+
+    // levels of detail for the ship meshes, generated after reading
+    MeshSimplifier meshSimplifier;
+    meshSimplifier.setMeshManager( &backpointer->meshManager_ );
+    meshSimplifier.addLevel( 0.5f, 0.2f );
+    meshSimplifier.addLevel( 0.25f, 0.08f );
+    meshSimplifier.addLevel( 0.1f, 0.03f );
+    modelReader.setMeshSimplifier( &meshSimplifier );
 
 // PLAYER
     GameObject* playerShip = new GameObject();
@@ -68,6 +79,24 @@ GameState::GameState( GameProgram* backpointer )
     enemyMesh->glowMap = glow;
 // ENEMY END
 
+    // simplify the ship meshes on the worker threads, one mesh per task
+    if( backpointer->getPredrawWorkers() != NULL )
+    {
+        backpointer->getPredrawWorkers()->run( meshSimplifier );
+    }
+    else
+    {
+        meshSimplifier.runAll();
+    }
+
+    meshSimplifier.attachLods( playerShip->getGraphicalPresentation() );
+    meshSimplifier.attachLods( enemyShip->getGraphicalPresentation() );
+
+    // the ship hulls are the only solid geometry in the level, they hide
+    // whatever is behind them when close to the camera
+    playerMesh->occluder = true;
+    enemyMesh->occluder = true;
+
     gameScene->addObject( playerShip );
     gameScene->addObject( enemyShip );
 
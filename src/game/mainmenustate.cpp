@@ -109,6 +109,7 @@ MainMenuState::MainMenuState( GameProgram* backpointer )
 
     ModelReader modelReader;
     modelReader.setMeshManager( &backpointer->meshManager_ );
+    modelReader.setVertexFormat( VertexFormat::compact() );
 
 //    GroupNode* groupNode = new GroupNode();
 //    rootNode = groupNode;
@@ -124,7 +125,7 @@ MainMenuState::MainMenuState( GameProgram* backpointer )
     hack->glowMap = textureManager_.getResource("newGlow");
     hack->normalMap = textureManager_.getResource("newNormal");
 
-    menu2 = menu1->clone();
+    menu2 = nodeArena.clone( *menu1 );
     hack = (MeshNode*)((GroupNode*)menu2)->child(0);
     //hack->setScaling(scaling);
     hack->diffuseMap = textureManager_.getResource("optDiffuse");
@@ -132,7 +133,7 @@ MainMenuState::MainMenuState( GameProgram* backpointer )
     hack->glowMap = textureManager_.getResource("optGlow");
     hack->normalMap = textureManager_.getResource("optNormal");
 
-    menu3 = menu1->clone();
+    menu3 = nodeArena.clone( *menu1 );
     hack = (MeshNode*)((GroupNode*)menu3)->child(0);
     //hack->setScaling(scaling);
     hack->diffuseMap = textureManager_.getResource("credDiffuse");
@@ -140,7 +141,7 @@ MainMenuState::MainMenuState( GameProgram* backpointer )
     hack->glowMap = textureManager_.getResource("credGlow");
     hack->normalMap = textureManager_.getResource("credNormal");
 
-    menu4 = menu1->clone();
+    menu4 = nodeArena.clone( *menu1 );
     hack = (MeshNode*)((GroupNode*)menu4)->child(0);
     //hack->setScaling(scaling);
     hack->diffuseMap = textureManager_.getResource("exitDiffuse");
@@ -0,0 +1,114 @@
+/**
+ * @file game/predrawworkers.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include "predrawworkers.h"
+
+#include <graphics/taskset.h>
+
+PredrawWorkers::PredrawWorkers( int numThreads )
+:   threads_(),
+    mutex_( SDL_CreateMutex() ),
+    workReady_( SDL_CreateCond() ),
+    workDone_( SDL_CreateCond() ),
+    tasks_( NULL ),
+    nextTask_( 0 ),
+    numTasks_( 0 ),
+    numPending_( 0 ),
+    quit_( false )
+{
+    for( int i = 0; i < numThreads; i++ )
+    {
+        SDL_Thread* thread = SDL_CreateThread( threadMain, this );
+
+        if( thread == NULL )
+        {
+            // the calling thread runs the tasks the workers do not
+            break;
+        }
+
+        threads_.push_back( thread );
+    }
+}
+
+PredrawWorkers::~PredrawWorkers()
+{
+    SDL_LockMutex( mutex_ );
+    quit_ = true;
+    SDL_CondBroadcast( workReady_ );
+    SDL_UnlockMutex( mutex_ );
+
+    for( size_t i = 0; i < threads_.size(); i++ )
+    {
+        SDL_WaitThread( threads_[i], NULL );
+    }
+
+    SDL_DestroyCond( workDone_ );
+    SDL_DestroyCond( workReady_ );
+    SDL_DestroyMutex( mutex_ );
+}
+
+void PredrawWorkers::run( TaskSet& tasks )
+{
+    SDL_LockMutex( mutex_ );
+
+    tasks_ = &tasks;
+    nextTask_ = 0;
+    numTasks_ = tasks.numTasks();
+    numPending_ = numTasks_;
+
+    SDL_CondBroadcast( workReady_ );
+
+    runTasks();
+
+    while( numPending_ > 0 )
+    {
+        SDL_CondWait( workDone_, mutex_ );
+    }
+
+    tasks_ = NULL;
+
+    SDL_UnlockMutex( mutex_ );
+
+    // the results are merged in task order, for example the render queue
+    // segments of a predraw scheduler
+    tasks.merge();
+}
+
+int PredrawWorkers::threadMain( void* data )
+{
+    PredrawWorkers* workers = static_cast<PredrawWorkers*>( data );
+
+    SDL_LockMutex( workers->mutex_ );
+
+    while( workers->quit_ == false )
+    {
+        workers->runTasks();
+        SDL_CondWait( workers->workReady_, workers->mutex_ );
+    }
+
+    SDL_UnlockMutex( workers->mutex_ );
+
+    return 0;
+}
+
+void PredrawWorkers::runTasks()
+{
+    while( tasks_ != NULL && nextTask_ < numTasks_ )
+    {
+        TaskSet* tasks = tasks_;
+        const int task = nextTask_++;
+
+        SDL_UnlockMutex( mutex_ );
+        tasks->runTask( task );
+        SDL_LockMutex( mutex_ );
+
+        numPending_--;
+
+        if( numPending_ == 0 )
+        {
+            SDL_CondSignal( workDone_ );
+        }
+    }
+}
@@ -0,0 +1,91 @@
+/**
+ * @file game/predrawworkers.h
+ * @author Mika Haarahiltunen
+ */
+
+#ifndef PREDRAWWORKERS_H
+#define PREDRAWWORKERS_H
+
+#include <vector>
+
+#include <SDL/SDL.h>
+
+class TaskSet;
+
+/**
+ * Pool of SDL threads that run the tasks of a predraw scheduler, or of any
+ * other task set such as the LOD generation of a mesh simplifier. The calling
+ * thread runs tasks as well, so a pool with zero threads runs the tasks on
+ * the calling thread only.
+ */
+class PredrawWorkers
+{
+    public:
+        /**
+         * Starts the worker threads.
+         *
+         * @param numThreads number of worker threads to start in addition to
+         *                   the calling thread.
+         */
+        explicit PredrawWorkers( int numThreads );
+
+        /**
+         * Stops and waits for the worker threads.
+         */
+        ~PredrawWorkers();
+
+        /**
+         * Runs all tasks of a task set on the worker threads and the calling
+         * thread, and merges the results when all tasks are done.
+         *
+         * @param tasks the task set whose tasks to run, for example an
+         *              initialized predraw scheduler.
+         */
+        void run( TaskSet& tasks );
+
+        /**
+         * Getter for the number of worker threads.
+         *
+         * @return int number of worker threads.
+         */
+        inline int getNumThreads() const { return threads_.size(); }
+
+    private:
+        /**
+         * Thread function of the worker threads.
+         *
+         * @param data pointer to the pool.
+         */
+        static int threadMain( void* data );
+
+        /**
+         * Runs tasks until the current task set has no tasks left to start.
+         * Called with the mutex locked, returns with the mutex locked.
+         */
+        void runTasks();
+
+        std::vector<SDL_Thread*>        threads_;
+        SDL_mutex*                      mutex_;
+
+        /**
+         * Signaled when there are tasks to run or the pool is stopped.
+         */
+        SDL_cond*                       workReady_;
+
+        /**
+         * Signaled when the last task of the current task set is done.
+         */
+        SDL_cond*                       workDone_;
+
+        TaskSet*                        tasks_;
+        int                             nextTask_;
+        int                             numTasks_;
+        int                             numPending_;
+        bool                            quit_;
+
+        // prevent copying
+        PredrawWorkers( const PredrawWorkers& );
+        PredrawWorkers& operator =( const PredrawWorkers& );
+};
+
+#endif // PREDRAWWORKERS_H
@@ -3,15 +3,32 @@
 
 State::State( GameProgram* backpointer )
  :  owner( backpointer ),
+    nodeArena(),
     scene( NULL )
 {
+    // the nodes created by the derived state constructors go to the arena
+    // as well, GameProgram resets the current arena afterwards
+    NodeArena::setCurrent( &nodeArena );
+
     rootNode = new GroupNode();
+
+    renderScene = new Scene();
+    renderScene->setRootNode( rootNode );
 }
 
 State::~State()
 {
+    // unregisters the nodes of the root node hierarchy
+    delete renderScene;
+    renderScene = NULL;
+
     delete rootNode;
     rootNode = NULL;
+
+    if( &NodeArena::current() == &nodeArena )
+    {
+        NodeArena::setCurrent( NULL );
+    }
 //    if( scene != NULL )
 //    {
 //        delete scene;
@@ -6,6 +6,8 @@
 #include <graphics/node.h>
 #include "gamescene.h"
 #include <graphics/groupnode.h>
+#include <graphics/nodearena.h>
+#include <graphics/scene.h>
 
 /**
  * @file game/state.h
@@ -31,6 +33,19 @@ class State
          */
         inline GroupNode* getRootNode() const { return rootNode; }
 
+        /**
+         * Getter for the spatial index of the root node hierarchy. Used for
+         * culling the geometry of the state.
+         */
+        inline Scene* getRenderScene() const { return renderScene; }
+
+        /**
+         * Getter for the node arena of the state. All nodes of the state are
+         * allocated from it, and its memory is released when the state is
+         * destroyed.
+         */
+        inline NodeArena& getNodeArena() { return nodeArena; }
+
         /**
          * Sets the scene that contains the objects in this state.
          * @param scene a pointer to a GameScene object.
@@ -49,11 +64,22 @@ class State
          */
         GameProgram* owner;
 
+        /**
+         * Storage for the nodes of the state. The arena is current while the
+         * state is constructed and updated.
+         */
+        NodeArena nodeArena;
+
         /**
          * Root node of the state. Used to draw geometry of the state.
          */
         GroupNode* rootNode;
 
+        /**
+         * Spatial index of the root node hierarchy.
+         */
+        Scene* renderScene;
+
         /**
          * Scene that plays in this state.
          */
@@ -0,0 +1,272 @@
+/**
+ * @file geometry/box3.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <geometry/box3.h>
+
+#include <cmath>
+
+#include <geometry/interval.h>
+#include <geometry/math.h>
+#include <geometry/runtimeassert.h>
+#include <geometry/transform3.h>
+
+namespace {
+
+/**
+ * Fits a box with given axes to a set of points.
+ *
+ * @param axes Box axes, the rows must be orthonormal.
+ * @param points The points to enclose.
+ * @param numPoints Number of points, must be > 0.
+ *
+ * @return Box enclosing all points.
+ */
+const Box3 fitBoxToAxes(
+    const Matrix3x3& axes,
+    const Vector3* const points,
+    const int numPoints)
+{
+    Interval intervals[3];
+
+    for (int i = 0; i < numPoints; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            intervals[j].enclose(dot(points[i], axes.row(j)));
+        }
+    }
+
+    Vector3 center(0.0f, 0.0f, 0.0f);
+    float halfSize[3];
+
+    for (int j = 0; j < 3; ++j)
+    {
+        center += 0.5f * (intervals[j].min + intervals[j].max) * axes.row(j);
+        halfSize[j] = 0.5f * (intervals[j].max - intervals[j].min);
+    }
+
+    return Box3(center, axes, Vector3(halfSize[0], halfSize[1], halfSize[2]));
+}
+
+/**
+ * Tells whether box <code>a</code> is smaller than box <code>b</code>. Flat
+ * boxes are compared by their surface area.
+ *
+ * @param a A box.
+ * @param b A box.
+ *
+ * @return <code>true</code> if <code>a</code> is smaller than
+ * <code>b</code>.
+ */
+bool isSmaller(const Box3& a, const Box3& b)
+{
+    const float volumeA = a.volume();
+    const float volumeB = b.volume();
+
+    if (volumeA != volumeB)
+    {
+        return volumeA < volumeB;
+    }
+
+    const Vector3& x = a.halfSize;
+    const Vector3& y = b.halfSize;
+
+    return x.x * x.y + x.y * x.z + x.z * x.x < y.x * y.y + y.y * y.z + y.z * y.x;
+}
+
+/**
+ * Calculates the eigenvectors of a symmetric 3x3 matrix with Jacobi
+ * rotations.
+ *
+ * @param a The symmetric matrix, destroyed by the calculation.
+ *
+ * @return Orthonormal eigenvectors as rows.
+ */
+const Matrix3x3 eigenvectors(double a[3][3])
+{
+    double v[3][3] = {
+        { 1.0, 0.0, 0.0 },
+        { 0.0, 1.0, 0.0 },
+        { 0.0, 0.0, 1.0 }
+    };
+
+    const double scale = Math::abs(a[0][0]) + Math::abs(a[1][1]) + Math::abs(a[2][2]);
+
+    for (int iteration = 0; iteration < 32; ++iteration)
+    {
+        // the largest off-diagonal element is rotated to zero
+        int p = 0;
+        int q = 1;
+
+        if (Math::abs(a[0][2]) > Math::abs(a[p][q]))
+        {
+            p = 0;
+            q = 2;
+        }
+
+        if (Math::abs(a[1][2]) > Math::abs(a[p][q]))
+        {
+            p = 1;
+            q = 2;
+        }
+
+        if (Math::abs(a[p][q]) <= 1.0e-12 * scale)
+        {
+            break;
+        }
+
+        const double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+        const double t = (theta < 0.0 ? -1.0 : 1.0) / (Math::abs(theta) + std::sqrt(theta * theta + 1.0));
+        const double c = 1.0 / std::sqrt(t * t + 1.0);
+        const double s = t * c;
+
+        for (int k = 0; k < 3; ++k)
+        {
+            const double akp = a[k][p];
+            const double akq = a[k][q];
+            a[k][p] = c * akp - s * akq;
+            a[k][q] = s * akp + c * akq;
+        }
+
+        for (int k = 0; k < 3; ++k)
+        {
+            const double apk = a[p][k];
+            const double aqk = a[q][k];
+            a[p][k] = c * apk - s * aqk;
+            a[q][k] = s * apk + c * aqk;
+        }
+
+        for (int k = 0; k < 3; ++k)
+        {
+            const double vkp = v[k][p];
+            const double vkq = v[k][q];
+            v[k][p] = c * vkp - s * vkq;
+            v[k][q] = s * vkp + c * vkq;
+        }
+    }
+
+    // the eigenvectors are the columns of v
+    const Matrix3x3 m = orthogonalize(Matrix3x3(
+        Vector3(v[0][0], v[1][0], v[2][0]),
+        Vector3(v[0][1], v[1][1], v[2][1]),
+        Vector3(v[0][2], v[1][2], v[2][2])
+    ));
+
+    // a right-handed basis
+    return Matrix3x3(m.row(0), m.row(1), cross(m.row(0), m.row(1)));
+}
+
+} // namespace
+
+Box3::Box3()
+{
+    // ...
+}
+
+Box3::Box3(
+    const Vector3& center,
+    const Matrix3x3& axes,
+    const Vector3& halfSize)
+:   center(center),
+    axes(axes),
+    halfSize(halfSize)
+{
+    // ...
+}
+
+float Box3::volume() const
+{
+    return 8.0f * halfSize.x * halfSize.y * halfSize.z;
+}
+
+void Box3::swap(Box3& other)
+{
+    center.swap(other.center);
+    axes.swap(other.axes);
+    halfSize.swap(other.halfSize);
+}
+
+const Box3 fitBox(const Vector3* const points, const int numPoints)
+{
+    GEOMETRY_RUNTIME_ASSERT(points != 0);
+    GEOMETRY_RUNTIME_ASSERT(numPoints > 0);
+
+    // the covariance is accumulated in double precision around the mean, so
+    // points far from the origin do not lose the spread
+    double mean[3] = { 0.0, 0.0, 0.0 };
+
+    for (int i = 0; i < numPoints; ++i)
+    {
+        mean[0] += points[i].x;
+        mean[1] += points[i].y;
+        mean[2] += points[i].z;
+    }
+
+    for (int j = 0; j < 3; ++j)
+    {
+        mean[j] /= numPoints;
+    }
+
+    double covariance[3][3] = {
+        { 0.0, 0.0, 0.0 },
+        { 0.0, 0.0, 0.0 },
+        { 0.0, 0.0, 0.0 }
+    };
+
+    for (int i = 0; i < numPoints; ++i)
+    {
+        const double d[3] = {
+            points[i].x - mean[0],
+            points[i].y - mean[1],
+            points[i].z - mean[2]
+        };
+
+        for (int j = 0; j < 3; ++j)
+        {
+            for (int k = j; k < 3; ++k)
+            {
+                covariance[j][k] += d[j] * d[k];
+            }
+        }
+    }
+
+    for (int j = 0; j < 3; ++j)
+    {
+        for (int k = 0; k < j; ++k)
+        {
+            covariance[j][k] = covariance[k][j];
+        }
+    }
+
+    // the principal axes fit elongated and diagonal shapes, the coordinate
+    // axes fit shapes whose principal axes are ambiguous, such as cubes
+    const Box3 principal = fitBoxToAxes(eigenvectors(covariance), points, numPoints);
+    const Box3 aligned = fitBoxToAxes(Matrix3x3::identity(), points, numPoints);
+
+    return isSmaller(principal, aligned) ? principal : aligned;
+}
+
+const Interval interval(const Box3& x, const Vector3& axis)
+{
+    const float center = dot(x.center, axis);
+
+    const float radius =
+        x.halfSize.x * Math::abs(dot(x.axes.row(0), axis)) +
+        x.halfSize.y * Math::abs(dot(x.axes.row(1), axis)) +
+        x.halfSize.z * Math::abs(dot(x.axes.row(2), axis));
+
+    return Interval(center - radius, center + radius);
+}
+
+const Box3 transform(const Box3& x, const Transform3& t)
+{
+    GEOMETRY_RUNTIME_ASSERT(t.scaling > 0.0f);
+
+    return Box3(
+        transform(x.center, t),
+        x.axes * t.rotation,
+        t.scaling * x.halfSize
+    );
+}
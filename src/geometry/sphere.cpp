@@ -5,7 +5,103 @@
 
 #include <geometry/sphere.h>
 
+#include <stdint.h>
+
+#include <vector>
+
+#include <geometry/interval.h>
 #include <geometry/math.h>
+#include <geometry/runtimeassert.h>
+#include <geometry/transform3.h>
+
+namespace {
+
+// relative tolerance of the containment test, points this close to the
+// sphere surface do not grow the sphere
+const float tolerance = 1.0e-5f;
+
+bool contains(const Sphere& s, const Vector3& q)
+{
+    return sqrDistance(s.center, q) <= Math::sqr(s.radius * (1.0f + tolerance));
+}
+
+// the smallest sphere with a and b on its surface
+const Sphere sphere(const Vector3& a, const Vector3& b)
+{
+    return Sphere(0.5f * (a + b), 0.5f * distance(a, b));
+}
+
+// the smallest sphere with a, b and c on its surface
+const Sphere sphere(const Vector3& a, const Vector3& b, const Vector3& c)
+{
+    const Vector3 ab = b - a;
+    const Vector3 ac = c - a;
+    const Vector3 n = cross(ab, ac);
+    const float d = 2.0f * sqrLength(n);
+
+    if (sqrLength(n) <= Math::sqr(tolerance) * sqrLength(ab) * sqrLength(ac))
+    {
+        // collinear, the sphere of the farthest pair
+        const Sphere s = sphere(a, b);
+        const Sphere t = sphere(a, c);
+        const Sphere u = sphere(b, c);
+
+        const Sphere& st = s.radius < t.radius ? t : s;
+        return st.radius < u.radius ? u : st;
+    }
+
+    const Vector3 center = a + (sqrLength(ac) * cross(n, ab) + sqrLength(ab) * cross(ac, n)) / d;
+    return Sphere(center, distance(center, a));
+}
+
+// the smallest sphere with a, b, c and d on its surface
+const Sphere sphere(
+    const Vector3& a,
+    const Vector3& b,
+    const Vector3& c,
+    const Vector3& d)
+{
+    const Vector3 u = b - a;
+    const Vector3 v = c - a;
+    const Vector3 w = d - a;
+    const float det = 2.0f * dot(u, cross(v, w));
+
+    if (Math::abs(det) <= tolerance * length(u) * length(v) * length(w))
+    {
+        // coplanar, the smallest sphere of three points that contains the
+        // fourth
+        const Sphere spheres[] = {
+            sphere(a, b, c),
+            sphere(a, b, d),
+            sphere(a, c, d),
+            sphere(b, c, d)
+        };
+        const Vector3 others[] = { d, c, b, a };
+
+        int best = -1;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            if (contains(spheres[i], others[i])
+            &&  (best == -1 || spheres[i].radius < spheres[best].radius))
+            {
+                best = i;
+            }
+        }
+
+        return spheres[best == -1 ? 0 : best];
+    }
+
+    const Vector3 center = a + (
+        sqrLength(u) * cross(v, w) +
+        sqrLength(v) * cross(w, u) +
+        sqrLength(w) * cross(u, v)
+    ) / det;
+
+    return Sphere(center, distance(center, a));
+}
+
+} // namespace
 
 Sphere::Sphere()
 {
@@ -24,3 +120,86 @@ void Sphere::swap(Sphere& other)
     center.swap(other.center);
     Math::swap(radius, other.radius);
 }
+
+const Sphere fitSphere(const Vector3* const points, const int numPoints)
+{
+    GEOMETRY_RUNTIME_ASSERT(points != 0);
+    GEOMETRY_RUNTIME_ASSERT(numPoints > 0);
+
+    // a random order makes the expected running time linear, a fixed seed
+    // keeps the result deterministic
+    std::vector<Vector3> p(points, points + numPoints);
+    uint32_t seed = 0x9E3779B9u;
+
+    for (int i = numPoints - 1; i > 0; --i)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        Math::swap(p[i], p[(seed >> 8) % (i + 1)]);
+    }
+
+    // Welzl's algorithm unrolled into loops, each nested loop fixes one
+    // more point on the sphere surface
+    Sphere s(p[0], 0.0f);
+
+    for (int i = 1; i < numPoints; ++i)
+    {
+        if (contains(s, p[i]))
+        {
+            continue;
+        }
+
+        s = Sphere(p[i], 0.0f);
+
+        for (int j = 0; j < i; ++j)
+        {
+            if (contains(s, p[j]))
+            {
+                continue;
+            }
+
+            s = sphere(p[i], p[j]);
+
+            for (int k = 0; k < j; ++k)
+            {
+                if (contains(s, p[k]))
+                {
+                    continue;
+                }
+
+                s = sphere(p[i], p[j], p[k]);
+
+                for (int l = 0; l < k; ++l)
+                {
+                    if (contains(s, p[l]) == false)
+                    {
+                        s = sphere(p[i], p[j], p[k], p[l]);
+                    }
+                }
+            }
+        }
+    }
+
+    // the tolerance may leave points slightly outside
+    float sqrRadius = 0.0f;
+
+    for (int i = 0; i < numPoints; ++i)
+    {
+        sqrRadius = Math::max(sqrRadius, sqrDistance(s.center, p[i]));
+    }
+
+    s.radius = Math::sqrt(sqrRadius);
+
+    return s;
+}
+
+const Interval interval(const Sphere& x, const Vector3& axis)
+{
+    const float center = dot(x.center, axis);
+    return Interval(center - x.radius, center + x.radius);
+}
+
+const Sphere transform(const Sphere& x, const Transform3& t)
+{
+    GEOMETRY_RUNTIME_ASSERT(t.scaling > 0.0f);
+    return Sphere(transform(x.center, t), t.scaling * x.radius);
+}
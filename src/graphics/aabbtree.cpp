@@ -0,0 +1,624 @@
+/**
+ * @file graphics/aabbtree.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/aabbtree.h>
+
+#include <geometry/math.h>
+
+#include <graphics/geometrynode.h>
+#include <graphics/predrawparams.h>
+#include <graphics/runtimeassert.h>
+#include <graphics/visibilitytest.h>
+
+namespace {
+
+// reinsert a leaf whose enlarged extents exceed the actual extents by more
+// than this many margins
+const float maxMargins = 4.0f;
+
+const Extents3 merge(const Extents3& a, const Extents3& b)
+{
+    Extents3 c = a;
+    c.enclose(b);
+    return c;
+}
+
+const Extents3 enlarge(const Extents3& x, const float margin)
+{
+    const Vector3 d(margin, margin, margin);
+    return Extents3(x.min - d, x.max + d);
+}
+
+bool contains(const Extents3& a, const Extents3& b)
+{
+    return a.min.x <= b.min.x && a.min.y <= b.min.y && a.min.z <= b.min.z
+        && a.max.x >= b.max.x && a.max.y >= b.max.y && a.max.z >= b.max.z;
+}
+
+float surfaceArea(const Extents3& x)
+{
+    const Vector3 d = x.max - x.min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+} // namespace
+
+AabbTree::~AabbTree()
+{
+    // ...
+}
+
+AabbTree::AabbTree()
+:   nodes_(),
+    root_(-1),
+    freeList_(-1),
+    numProxies_(0),
+    margin_(1.0f)
+{
+    // ...
+}
+
+void AabbTree::setMargin(const float margin)
+{
+    GRAPHICS_RUNTIME_ASSERT(margin >= 0.0f);
+    margin_ = margin;
+}
+
+float AabbTree::margin() const
+{
+    return margin_;
+}
+
+int AabbTree::insert(const Extents3& extents, GeometryNode* const node)
+{
+    GRAPHICS_RUNTIME_ASSERT(node != 0);
+
+    const int proxy = allocateNode();
+
+    nodes_[proxy].extents = enlarge(extents, margin_);
+    nodes_[proxy].node = node;
+    nodes_[proxy].height = 0;
+
+    insertLeaf(proxy);
+    ++numProxies_;
+
+    return proxy;
+}
+
+void AabbTree::remove(const int proxy)
+{
+    GRAPHICS_RUNTIME_ASSERT(proxy >= 0 && proxy < static_cast<int>(nodes_.size()));
+    GRAPHICS_RUNTIME_ASSERT(nodes_[proxy].height == 0);
+
+    removeLeaf(proxy);
+    freeNode(proxy);
+    --numProxies_;
+}
+
+bool AabbTree::move(const int proxy, const Extents3& extents)
+{
+    GRAPHICS_RUNTIME_ASSERT(proxy >= 0 && proxy < static_cast<int>(nodes_.size()));
+    GRAPHICS_RUNTIME_ASSERT(nodes_[proxy].height == 0);
+
+    const Extents3& fatExtents = nodes_[proxy].extents;
+
+    if (contains(fatExtents, extents)
+    &&  contains(enlarge(extents, maxMargins * margin_), fatExtents))
+    {
+        // still fits and is not much too large
+        return false;
+    }
+
+    removeLeaf(proxy);
+    nodes_[proxy].extents = enlarge(extents, margin_);
+    insertLeaf(proxy);
+
+    return true;
+}
+
+GeometryNode* AabbTree::node(const int proxy) const
+{
+    GRAPHICS_RUNTIME_ASSERT(proxy >= 0 && proxy < static_cast<int>(nodes_.size()));
+    GRAPHICS_RUNTIME_ASSERT(nodes_[proxy].height == 0);
+
+    return nodes_[proxy].node;
+}
+
+const Extents3& AabbTree::fatExtents(const int proxy) const
+{
+    GRAPHICS_RUNTIME_ASSERT(proxy >= 0 && proxy < static_cast<int>(nodes_.size()));
+    GRAPHICS_RUNTIME_ASSERT(nodes_[proxy].height == 0);
+
+    return nodes_[proxy].extents;
+}
+
+void AabbTree::setMoved(const int proxy, const bool moved)
+{
+    GRAPHICS_RUNTIME_ASSERT(proxy >= 0 && proxy < static_cast<int>(nodes_.size()));
+    GRAPHICS_RUNTIME_ASSERT(nodes_[proxy].height == 0);
+
+    nodes_[proxy].moved = moved;
+}
+
+bool AabbTree::isMoved(const int proxy) const
+{
+    GRAPHICS_RUNTIME_ASSERT(proxy >= 0 && proxy < static_cast<int>(nodes_.size()));
+    GRAPHICS_RUNTIME_ASSERT(nodes_[proxy].height == 0);
+
+    return nodes_[proxy].moved;
+}
+
+void AabbTree::query(
+    const Extents3& region,
+    std::vector<GeometryNode*>& nodes) const
+{
+    if (root_ != -1)
+    {
+        query(root_, region, nodes);
+    }
+}
+
+void AabbTree::predraw(
+    const PredrawParams& params,
+    const uint32_t planeMask) const
+{
+    if (root_ != -1)
+    {
+        predraw(root_, params, planeMask);
+    }
+}
+
+void AabbTree::splitPredraw(
+    const PredrawParams& params,
+    const uint32_t planeMask,
+    const int maxHeight,
+    std::vector<int>& subtrees,
+    std::vector<uint32_t>& planeMasks) const
+{
+    GRAPHICS_RUNTIME_ASSERT(maxHeight >= 0);
+
+    if (root_ != -1)
+    {
+        splitPredraw(root_, params, planeMask, maxHeight, subtrees, planeMasks);
+    }
+}
+
+void AabbTree::predrawSubtree(
+    const int subtree,
+    const PredrawParams& params,
+    const uint32_t planeMask) const
+{
+    GRAPHICS_RUNTIME_ASSERT(subtree >= 0 && subtree < static_cast<int>(nodes_.size()));
+    GRAPHICS_RUNTIME_ASSERT(nodes_[subtree].height >= 0);
+
+    predraw(subtree, params, planeMask);
+}
+
+int AabbTree::numProxies() const
+{
+    return numProxies_;
+}
+
+int AabbTree::height() const
+{
+    return root_ != -1 ? nodes_[root_].height : -1;
+}
+
+void AabbTree::clear()
+{
+    nodes_.clear();
+    root_ = -1;
+    freeList_ = -1;
+    numProxies_ = 0;
+}
+
+int AabbTree::allocateNode()
+{
+    if (freeList_ == -1)
+    {
+        // the free list is empty, append a node
+        TreeNode node;
+        node.parent = -1;
+        node.height = -1;
+
+        freeList_ = nodes_.size();
+        nodes_.push_back(node);
+    }
+
+    const int index = freeList_;
+    TreeNode& node = nodes_[index];
+
+    freeList_ = node.parent;
+
+    node.extents = Extents3();
+    node.node = 0;
+    node.parent = -1;
+    node.child1 = -1;
+    node.child2 = -1;
+    node.height = 0;
+    node.moved = false;
+    node.lastRejectingPlane = -1;
+
+    return index;
+}
+
+void AabbTree::freeNode(const int index)
+{
+    GRAPHICS_RUNTIME_ASSERT(index >= 0 && index < static_cast<int>(nodes_.size()));
+
+    nodes_[index].node = 0;
+    nodes_[index].parent = freeList_;
+    nodes_[index].height = -1;
+
+    freeList_ = index;
+}
+
+void AabbTree::insertLeaf(const int leaf)
+{
+    if (root_ == -1)
+    {
+        root_ = leaf;
+        nodes_[leaf].parent = -1;
+        return;
+    }
+
+    const Extents3 leafExtents = nodes_[leaf].extents;
+
+    // descend to the sibling that minimizes the surface area increase, the
+    // increase inherited by the ancestors is included in the cost
+    int index = root_;
+
+    while (nodes_[index].child1 != -1)
+    {
+        const TreeNode& node = nodes_[index];
+
+        const float area = surfaceArea(node.extents);
+        const float combinedArea = surfaceArea(merge(node.extents, leafExtents));
+
+        // cost of creating a new parent for this node and the leaf
+        const float cost = 2.0f * combinedArea;
+
+        // minimum cost of pushing the leaf further down the tree
+        const float inheritanceCost = 2.0f * (combinedArea - area);
+
+        float childCost[2];
+        const int children[] = { node.child1, node.child2 };
+
+        for (int i = 0; i < 2; ++i)
+        {
+            const TreeNode& child = nodes_[children[i]];
+            const float newArea = surfaceArea(merge(child.extents, leafExtents));
+
+            if (child.child1 == -1)
+            {
+                childCost[i] = newArea + inheritanceCost;
+            }
+            else
+            {
+                childCost[i] = newArea - surfaceArea(child.extents) + inheritanceCost;
+            }
+        }
+
+        if (cost < childCost[0] && cost < childCost[1])
+        {
+            break;
+        }
+
+        index = childCost[0] < childCost[1] ? children[0] : children[1];
+    }
+
+    const int sibling = index;
+    const int oldParent = nodes_[sibling].parent;
+
+    // may reallocate the node array
+    const int newParent = allocateNode();
+
+    nodes_[newParent].parent = oldParent;
+    nodes_[newParent].extents = merge(leafExtents, nodes_[sibling].extents);
+    nodes_[newParent].height = nodes_[sibling].height + 1;
+    nodes_[newParent].child1 = sibling;
+    nodes_[newParent].child2 = leaf;
+
+    if (oldParent != -1)
+    {
+        if (nodes_[oldParent].child1 == sibling)
+        {
+            nodes_[oldParent].child1 = newParent;
+        }
+        else
+        {
+            nodes_[oldParent].child2 = newParent;
+        }
+    }
+    else
+    {
+        root_ = newParent;
+    }
+
+    nodes_[sibling].parent = newParent;
+    nodes_[leaf].parent = newParent;
+
+    refit(newParent);
+}
+
+void AabbTree::removeLeaf(const int leaf)
+{
+    if (leaf == root_)
+    {
+        root_ = -1;
+        return;
+    }
+
+    const int parent = nodes_[leaf].parent;
+    const int grandParent = nodes_[parent].parent;
+    const int sibling = nodes_[parent].child1 == leaf
+        ? nodes_[parent].child2
+        : nodes_[parent].child1;
+
+    // the sibling takes the place of the parent
+    if (grandParent != -1)
+    {
+        if (nodes_[grandParent].child1 == parent)
+        {
+            nodes_[grandParent].child1 = sibling;
+        }
+        else
+        {
+            nodes_[grandParent].child2 = sibling;
+        }
+    }
+    else
+    {
+        root_ = sibling;
+    }
+
+    nodes_[sibling].parent = grandParent;
+    freeNode(parent);
+
+    nodes_[leaf].parent = -1;
+
+    refit(grandParent);
+}
+
+void AabbTree::refit(int index)
+{
+    while (index != -1)
+    {
+        index = balance(index);
+
+        TreeNode& node = nodes_[index];
+        const TreeNode& child1 = nodes_[node.child1];
+        const TreeNode& child2 = nodes_[node.child2];
+
+        node.height = 1 + Math::max(child1.height, child2.height);
+        node.extents = merge(child1.extents, child2.extents);
+
+        index = node.parent;
+    }
+}
+
+int AabbTree::balance(const int iA)
+{
+    TreeNode& a = nodes_[iA];
+
+    if (a.child1 == -1 || a.height < 2)
+    {
+        return iA;
+    }
+
+    const int iB = a.child1;
+    const int iC = a.child2;
+    TreeNode& b = nodes_[iB];
+    TreeNode& c = nodes_[iC];
+
+    const int difference = c.height - b.height;
+
+    if (difference > 1)
+    {
+        // rotate c up, a becomes a child of c
+        const int iF = c.child1;
+        const int iG = c.child2;
+        TreeNode& f = nodes_[iF];
+        TreeNode& g = nodes_[iG];
+
+        c.child1 = iA;
+        c.parent = a.parent;
+        a.parent = iC;
+
+        if (c.parent != -1)
+        {
+            if (nodes_[c.parent].child1 == iA)
+            {
+                nodes_[c.parent].child1 = iC;
+            }
+            else
+            {
+                nodes_[c.parent].child2 = iC;
+            }
+        }
+        else
+        {
+            root_ = iC;
+        }
+
+        // the taller child of c stays with c
+        if (f.height > g.height)
+        {
+            c.child2 = iF;
+            a.child2 = iG;
+            g.parent = iA;
+
+            a.extents = merge(b.extents, g.extents);
+            c.extents = merge(a.extents, f.extents);
+            a.height = 1 + Math::max(b.height, g.height);
+            c.height = 1 + Math::max(a.height, f.height);
+        }
+        else
+        {
+            c.child2 = iG;
+            a.child2 = iF;
+            f.parent = iA;
+
+            a.extents = merge(b.extents, f.extents);
+            c.extents = merge(a.extents, g.extents);
+            a.height = 1 + Math::max(b.height, f.height);
+            c.height = 1 + Math::max(a.height, g.height);
+        }
+
+        return iC;
+    }
+
+    if (difference < -1)
+    {
+        // rotate b up, a becomes a child of b
+        const int iD = b.child1;
+        const int iE = b.child2;
+        TreeNode& d = nodes_[iD];
+        TreeNode& e = nodes_[iE];
+
+        b.child1 = iA;
+        b.parent = a.parent;
+        a.parent = iB;
+
+        if (b.parent != -1)
+        {
+            if (nodes_[b.parent].child1 == iA)
+            {
+                nodes_[b.parent].child1 = iB;
+            }
+            else
+            {
+                nodes_[b.parent].child2 = iB;
+            }
+        }
+        else
+        {
+            root_ = iB;
+        }
+
+        // the taller child of b stays with b
+        if (d.height > e.height)
+        {
+            b.child2 = iD;
+            a.child1 = iE;
+            e.parent = iA;
+
+            a.extents = merge(c.extents, e.extents);
+            b.extents = merge(a.extents, d.extents);
+            a.height = 1 + Math::max(c.height, e.height);
+            b.height = 1 + Math::max(a.height, d.height);
+        }
+        else
+        {
+            b.child2 = iE;
+            a.child1 = iD;
+            d.parent = iA;
+
+            a.extents = merge(c.extents, d.extents);
+            b.extents = merge(a.extents, e.extents);
+            a.height = 1 + Math::max(c.height, d.height);
+            b.height = 1 + Math::max(a.height, e.height);
+        }
+
+        return iB;
+    }
+
+    return iA;
+}
+
+void AabbTree::query(
+    const int index,
+    const Extents3& region,
+    std::vector<GeometryNode*>& nodes) const
+{
+    const TreeNode& node = nodes_[index];
+
+    if (intersect(node.extents, region) == false)
+    {
+        return;
+    }
+
+    if (node.child1 == -1)
+    {
+        nodes.push_back(node.node);
+        return;
+    }
+
+    query(node.child1, region, nodes);
+    query(node.child2, region, nodes);
+}
+
+void AabbTree::predraw(
+    const int index,
+    const PredrawParams& params,
+    uint32_t planeMask) const
+{
+    const TreeNode& node = nodes_[index];
+
+    if (planeMask != 0)
+    {
+        // clears the planes the subtree is completely inside of
+        const VisibilityState::Enum state = params.visibilityTest()->test(
+            node.extents,
+            planeMask,
+            node.lastRejectingPlane
+        );
+
+        if (state == VisibilityState::Invisible)
+        {
+            // early out
+            return;
+        }
+    }
+
+    if (node.child1 == -1)
+    {
+        // the geometry node tests its actual extents against the remaining
+        // planes
+        node.node->predraw(params, planeMask);
+        return;
+    }
+
+    predraw(node.child1, params, planeMask);
+    predraw(node.child2, params, planeMask);
+}
+
+void AabbTree::splitPredraw(
+    const int index,
+    const PredrawParams& params,
+    uint32_t planeMask,
+    const int maxHeight,
+    std::vector<int>& subtrees,
+    std::vector<uint32_t>& planeMasks) const
+{
+    const TreeNode& node = nodes_[index];
+
+    if (node.height <= maxHeight)
+    {
+        // the subtree tests its own root node
+        subtrees.push_back(index);
+        planeMasks.push_back(planeMask);
+        return;
+    }
+
+    if (planeMask != 0)
+    {
+        const VisibilityState::Enum state = params.visibilityTest()->test(
+            node.extents,
+            planeMask,
+            node.lastRejectingPlane
+        );
+
+        if (state == VisibilityState::Invisible)
+        {
+            // early out
+            return;
+        }
+    }
+
+    // a node higher than maxHeight >= 0 is not a leaf
+    splitPredraw(node.child1, params, planeMask, maxHeight, subtrees, planeMasks);
+    splitPredraw(node.child2, params, planeMask, maxHeight, subtrees, planeMasks);
+}
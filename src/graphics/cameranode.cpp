@@ -88,7 +88,7 @@ CameraNode* CameraNode::clone() const
     return new CameraNode(*this);
 }
 
-void CameraNode::predraw(const PredrawParams&, const bool) const
+void CameraNode::predraw(const PredrawParams&, const uint32_t) const
 {
     // nothing to do
 }
@@ -7,10 +7,18 @@
 
 #include <algorithm>
 
+#include <graphics/geometrynode.h>
+
 DrawParams::DrawParams()
 :   viewMatrix(Matrix4x4::identity()),
     projectionMatrix(Matrix4x4::identity()),
     worldToViewRotation(Matrix3x3::identity()),
+    stateCache(0),
+    instanceBuffer(0),
+    uniformBuffer(0),
+    meshArena(0),
+    commandBuffer(0),
+    worldTransforms(0),
     program(0),
     cameraToWorld()
 {
@@ -22,6 +30,31 @@ void DrawParams::swap(DrawParams& other)
     viewMatrix.swap(other.viewMatrix);
     projectionMatrix.swap(other.projectionMatrix);
     worldToViewRotation.swap(other.worldToViewRotation);
+    std::swap(stateCache, other.stateCache);
+    std::swap(instanceBuffer, other.instanceBuffer);
+    std::swap(uniformBuffer, other.uniformBuffer);
+    std::swap(meshArena, other.meshArena);
+    std::swap(commandBuffer, other.commandBuffer);
+    std::swap(worldTransforms, other.worldTransforms);
     std::swap(program, other.program);
     cameraToWorld.swap(other.cameraToWorld);
 }
+
+const Transform3 DrawParams::worldTransform(
+    const GeometryNode& node,
+    const int index) const
+{
+    return worldTransforms != 0 ? worldTransforms[index] : node.worldTransform();
+}
+
+const DrawParams DrawParams::offset(const int first) const
+{
+    DrawParams params = *this;
+
+    if (worldTransforms != 0)
+    {
+        params.worldTransforms = worldTransforms + first;
+    }
+
+    return params;
+}
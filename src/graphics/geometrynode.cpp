@@ -7,37 +7,215 @@
 
 #include <geometry/extents3.h>
 
+#include <graphics/drawparams.h>
+#include <graphics/impostoratlas.h>
 #include <graphics/predrawparams.h>
 #include <graphics/renderqueue.h>
+#include <graphics/runtimeassert.h>
+#include <graphics/scene.h>
 #include <graphics/visibilitytest.h>
 
 GeometryNode::~GeometryNode()
+{
+    if (scene() != 0)
+    {
+        // the root node of a scene may be deleted while registered
+        scene()->removeNode(this);
+    }
+
+    releaseImpostor();
+}
+
+uint32_t GeometryNode::renderPass() const
+{
+    return 0;
+}
+
+uint32_t GeometryNode::materialKey() const
+{
+    return 0;
+}
+
+bool GeometryNode::isInstanceCompatible(const GeometryNode&) const
+{
+    return false;
+}
+
+void GeometryNode::drawInstanced(
+    const DrawParams& params,
+    const GeometryNode* const* const nodes,
+    const int numNodes) const
+{
+    GRAPHICS_RUNTIME_ASSERT(nodes != 0 && numNodes > 0);
+    GRAPHICS_RUNTIME_ASSERT(nodes[0] == this);
+
+    if (params.worldTransforms == 0)
+    {
+        for (int i = 0; i < numNodes; ++i)
+        {
+            nodes[i]->draw(params);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < numNodes; ++i)
+        {
+            nodes[i]->draw(params.offset(i));
+        }
+    }
+}
+
+bool GeometryNode::isMultiDrawCompatible(const GeometryNode&) const
+{
+    return false;
+}
+
+void GeometryNode::drawMultiDraw(
+    const DrawParams& params,
+    const GeometryNode* const* const nodes,
+    const int numNodes) const
+{
+    GRAPHICS_RUNTIME_ASSERT(nodes != 0 && numNodes > 0);
+    GRAPHICS_RUNTIME_ASSERT(nodes[0] == this);
+
+    int i = 0;
+
+    while (i < numNodes)
+    {
+        const GeometryNode* const first = nodes[i];
+        int j = i + 1;
+
+        while (j < numNodes && first->isInstanceCompatible(*nodes[j]))
+        {
+            ++j;
+        }
+
+        first->drawInstanced(params.offset(i), nodes + i, j - i);
+        i = j;
+    }
+}
+
+void GeometryNode::rasterizeOccluder(OcclusionBuffer&) const
 {
     // ...
 }
 
 void GeometryNode::predraw(
     const PredrawParams& params,
-    const bool testVisibility) const
+    uint32_t planeMask) const
+{
+    if (testVisibility(params, planeMask))
+    {
+        params.renderQueue()->addGeometryNode(this);
+    }
+}
+
+void GeometryNode::predrawPrefab(
+    const PredrawParams& params,
+    uint32_t planeMask,
+    const Transform3& transform) const
 {
-    if (testVisibility
-    &&  params.visibilityTest()->test(worldExtents()) == VisibilityState::Invisible)
+    // the whole extents are needed even for completely visible nodes, the
+    // render queue can be tested against an occlusion buffer afterwards
+    const Extents3 extents = ::transform(worldExtents(), transform);
+
+    if (planeMask != 0 && testPrefabExtents(extents, params, planeMask) == false)
     {
         // early out
         return;
     }
 
-    params.renderQueue()->addGeometryNode(this);
+    params.renderQueue()->addGeometryNode(
+        this,
+        ::transform(worldTransform(), transform),
+        extents
+    );
+}
+
+void GeometryNode::setScene(Scene* const scene)
+{
+    if (this->scene() != 0)
+    {
+        this->scene()->removeNode(this);
+    }
+
+    // call the base class version
+    Node::setScene(scene);
+
+    if (scene != 0)
+    {
+        scene->addNode(this);
+    }
+}
+
+void GeometryNode::setSceneProxy(const int proxy)
+{
+    sceneProxy_ = proxy;
+}
+
+int GeometryNode::sceneProxy() const
+{
+    return sceneProxy_;
+}
+
+void GeometryNode::setImpostorAtlas(ImpostorAtlas* const p) const
+{
+    impostorAtlas_ = p;
+}
+
+ImpostorAtlas* GeometryNode::impostorAtlas() const
+{
+    return impostorAtlas_;
 }
 
 GeometryNode::GeometryNode()
-:   Node()
+:   Node(),
+    sceneProxy_(-1),
+    impostorAtlas_(0)
 {
     // ...
 }
 
 GeometryNode::GeometryNode(const GeometryNode& other)
-:   Node(other)
+:   Node(other),
+    sceneProxy_(-1),
+    impostorAtlas_(0)
 {
     // ...
 }
+
+void GeometryNode::invalidateSceneProxy() const
+{
+    if (scene() != 0 && sceneProxy_ != -1)
+    {
+        scene()->invalidateNode(this);
+    }
+}
+
+void GeometryNode::releaseImpostor()
+{
+    if (impostorAtlas_ != 0)
+    {
+        impostorAtlas_->releaseNode(this);
+    }
+}
+
+bool GeometryNode::testVisibility(
+    const PredrawParams& params,
+    uint32_t& planeMask) const
+{
+    if (planeMask != 0 && testFrustum(*params.visibilityTest(), planeMask) == false)
+    {
+        // early out
+        return false;
+    }
+
+    return true;
+}
+
+bool GeometryNode::testFrustum(
+    const VisibilityTest& test,
+    uint32_t& planeMask) const
+{
+    return test.test(worldExtents(), planeMask, visibilityCache()) != VisibilityState::Invisible;
+}
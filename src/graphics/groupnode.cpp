@@ -5,11 +5,51 @@
 
 #include <graphics/groupnode.h>
 
+#include <algorithm>
+
+#include <geometry/math.h>
+
 #include <graphics/predrawparams.h>
 #include <graphics/renderqueue.h>
 #include <graphics/runtimeassert.h>
 #include <graphics/visibilitytest.h>
 
+namespace {
+
+// minimum number of child nodes tested as a batch
+const size_t minBatchSize = 8;
+
+// number of child nodes tested per batch
+const int batchSize = 64;
+
+// the world extents are rebuilt when they have grown to this many times the
+// diagonal they had when they were last rebuilt
+const float maxGrowth = 1.5f;
+
+// gets the number of nodes in the subtree of a node
+int subtreeSize(const Node* p)
+{
+    const GroupNode* const group = dynamic_cast<const GroupNode*>(p);
+    return group != 0 ? 1 + group->numDescendants() : 1;
+}
+
+bool contains(const Extents3& a, const Extents3& b)
+{
+    return a.min.x <= b.min.x && a.min.y <= b.min.y && a.min.z <= b.min.z
+        && a.max.x >= b.max.x && a.max.y >= b.max.y && a.max.z >= b.max.z;
+}
+
+float diagonal(const Extents3& x)
+{
+    return x.isEmpty() ? 0.0f : length(x.max - x.min);
+}
+
+} // namespace
+
+int GroupNode::numFullRefits_ = 0;
+int GroupNode::numGrownRefits_ = 0;
+int GroupNode::numAvoidedRefits_ = 0;
+
 GroupNode::~GroupNode()
 {
     deleteChildren();
@@ -19,7 +59,13 @@ GroupNode::GroupNode()
 :   Node(),
     worldExtentsValid_(false),
     worldExtents_(),
-    children_()
+    rebuildNeeded_(true),
+    movedChildren_(),
+    numChanges_(0),
+    rebuiltDiagonal_(0.0f),
+    extentsMargin_(0.0f),
+    children_(),
+    numDescendants_(0)
 {
     // ...
 }
@@ -28,10 +74,18 @@ GroupNode::GroupNode(const GroupNode& other)
 :   Node(other),
     worldExtentsValid_(false),
     worldExtents_(),
-    children_()
+    rebuildNeeded_(true),
+    movedChildren_(),
+    numChanges_(0),
+    rebuiltDiagonal_(0.0f),
+    extentsMargin_(other.extentsMargin_),
+    children_(),
+    numDescendants_(0)
 {
     try
     {
+        reserveChildren(other.children_.size());
+
         for (size_t i = 0; i < other.children_.size(); ++i)
         {
             attachChild(other.children_[i]->clone());
@@ -48,37 +102,70 @@ GroupNode::GroupNode(const GroupNode& other)
 
 void GroupNode::attachChild(Node* const p)
 {
-    GRAPHICS_RUNTIME_ASSERT(p != 0);
-    GRAPHICS_RUNTIME_ASSERT(p->hasParent() == false);
+    attachChildren(&p, 1);
+}
 
-    children_.push_back(p);
+void GroupNode::detachChild(Node* const p)
+{
+    detachChildren(&p, 1);
+}
 
-    // update back pointers
-    p->setScene(scene());
-    p->setParent(this);
+void GroupNode::attachChildren(Node* const* const nodes, const int numNodes)
+{
+    GRAPHICS_RUNTIME_ASSERT(numNodes >= 0);
+
+    reserveChildren(children_.size() + numNodes);
+
+    int n = 0;
+
+    for (int i = 0; i < numNodes; ++i)
+    {
+        n += addChild(nodes[i]);
+    }
+
+    addDescendants(n);
+
+    // the attached nodes grow the world extents in place like moved child
+    // nodes
+    for (int i = 0; i < numNodes; ++i)
+    {
+        invalidateChildExtents(nodes[i]);
+    }
 }
 
-void GroupNode::detachChild(Node* const p)
+void GroupNode::detachChildren(Node* const* const nodes, const int numNodes)
 {
-    NodeVector::iterator i = children_.begin();
+    GRAPHICS_RUNTIME_ASSERT(numNodes >= 0);
+
+    int n = 0;
 
-    while (i != children_.end())
+    for (int i = 0; i < numNodes; ++i)
     {
-        const Node* child = *i;
+        n += removeChild(nodes[i]);
+    }
 
-        if (child == p)
-        {
-            // detach, do not delete
-            children_.erase(i);
-            p->setParent(0);
-            return;
-        }
+    addDescendants(-n);
+
+    // the world extents stay conservative, the removed nodes count towards
+    // the next rebuild like moved child nodes
+    numChanges_ += numNodes;
 
-        ++i;
+    if (numChanges_ > static_cast<int>(children_.size()))
+    {
+        invalidateWorldExtents();
     }
+}
+
+void GroupNode::reserveChildren(const int numChildren)
+{
+    GRAPHICS_RUNTIME_ASSERT(numChildren >= 0);
 
-    // not found
-    GRAPHICS_RUNTIME_ASSERT(false);
+    if (static_cast<size_t>(numChildren) > children_.capacity())
+    {
+        // grow geometrically, so that repeated bulk attaches do not
+        // reallocate every time
+        children_.reserve(Math::max(static_cast<size_t>(numChildren), 2 * children_.capacity()));
+    }
 }
 
 Node* GroupNode::child(const int index) const
@@ -97,12 +184,88 @@ bool GroupNode::hasChildren() const
     return children_.empty() == false;
 }
 
-void GroupNode::invalidateWorldExtents() const
+int GroupNode::numDescendants() const
+{
+    return numDescendants_;
+}
+
+void GroupNode::setExtentsMargin(const float margin)
+{
+    GRAPHICS_RUNTIME_ASSERT(margin >= 0.0f);
+    extentsMargin_ = margin;
+}
+
+float GroupNode::extentsMargin() const
+{
+    return extentsMargin_;
+}
+
+void GroupNode::invalidateChildExtents(const Node* const child) const
 {
+    GRAPHICS_RUNTIME_ASSERT(child != 0 && child->parent() == this);
+
+    if (rebuildNeeded_)
+    {
+        // the rebuild checks all child nodes
+        GRAPHICS_RUNTIME_ASSERT(worldExtentsValid_ == false);
+        return;
+    }
+
+    movedChildren_.push_back(child);
+
+    if (movedChildren_.size() * 2 > children_.size())
+    {
+        // a rebuild is cheaper than checking most of the child nodes one by
+        // one
+        rebuildNeeded_ = true;
+        movedChildren_.clear();
+    }
+
     if (worldExtentsValid_ == false)
     {
-        // TODO: make sure the world extents of all anchestor nodes are invalid
+        // anchestor nodes have already been told
+        return;
+    }
+
+    worldExtentsValid_ = false;
+
+    if (hasParent())
+    {
+        parent()->invalidateChildExtents(this);
+    }
+}
+
+void GroupNode::resetExtentsCounters()
+{
+    numFullRefits_ = 0;
+    numGrownRefits_ = 0;
+    numAvoidedRefits_ = 0;
+}
+
+int GroupNode::numFullRefits()
+{
+    return numFullRefits_;
+}
+
+int GroupNode::numGrownRefits()
+{
+    return numGrownRefits_;
+}
 
+int GroupNode::numAvoidedRefits()
+{
+    return numAvoidedRefits_;
+}
+
+void GroupNode::invalidateWorldExtents() const
+{
+    visibilityCache().invalidate();
+
+    rebuildNeeded_ = true;
+    movedChildren_.clear();
+
+    if (worldExtentsValid_ == false)
+    {
         // already invalidated, nothing to do
         return;
     }
@@ -112,7 +275,7 @@ void GroupNode::invalidateWorldExtents() const
     if (hasParent())
     {
         // propagate the call to anchestor nodes
-        parent()->invalidateWorldExtents();
+        parent()->invalidateChildExtents(this);
     }
 }
 
@@ -121,32 +284,127 @@ GroupNode* GroupNode::clone() const
     return new GroupNode(*this);
 }
 
-void GroupNode::predraw(const PredrawParams& params, bool testVisibility) const
+void GroupNode::predraw(const PredrawParams& params, uint32_t planeMask) const
 {
-    if (testVisibility)
+    if (planeMask != 0)
     {
-        const VisibilityState::Enum state = params.visibilityTest()->test(worldExtents());
+        // clears the planes this node is completely inside of, the child
+        // nodes need not test them
+        const VisibilityState::Enum state = params.visibilityTest()->test(
+            worldExtents(),
+            planeMask,
+            visibilityCache()
+        );
 
         if (state == VisibilityState::Invisible)
         {
             // early out
             return;
         }
+    }
 
-        if (state == VisibilityState::CompletelyVisible)
+    if (planeMask != 0 && children_.size() >= minBatchSize)
+    {
+        predrawBatched(params, planeMask);
+    }
+    else
+    {
+        // propagate the call to all attached child nodes
+        for (size_t i = 0; i < children_.size(); ++i)
         {
-            // all child nodes are completely visible
-            testVisibility = false;
+            children_[i]->predraw(params, planeMask);
         }
     }
 
-    // propagate the call to all attached child nodes
+    params.renderQueue()->addGroupNode(this);
+}
+
+void GroupNode::predrawPrefab(
+    const PredrawParams& params,
+    uint32_t planeMask,
+    const Transform3& transform) const
+{
+    if (testPrefabExtents(::transform(worldExtents(), transform), params, planeMask) == false)
+    {
+        // early out
+        return;
+    }
+
     for (size_t i = 0; i < children_.size(); ++i)
     {
-        children_[i]->predraw(params, testVisibility);
+        children_[i]->predrawPrefab(params, planeMask, transform);
     }
+}
 
-    params.renderQueue()->addGroupNode(this);
+void GroupNode::predrawBatched(
+    const PredrawParams& params,
+    const uint32_t planeMask) const
+{
+    float cx[batchSize];
+    float cy[batchSize];
+    float cz[batchSize];
+    float hx[batchSize];
+    float hy[batchSize];
+    float hz[batchSize];
+    VisibilityState::Enum states[batchSize];
+    uint32_t masks[batchSize];
+    VisibilityCache* caches[batchSize];
+    int batchIndices[batchSize];
+
+    const float* const centers[] = { cx, cy, cz };
+    const float* const halfSizes[] = { hx, hy, hz };
+
+    const VisibilityTest* const test = params.visibilityTest();
+
+    for (size_t first = 0; first < children_.size(); first += batchSize)
+    {
+        const int numChildren = Math::min(children_.size() - first, static_cast<size_t>(batchSize));
+        int count = 0;
+
+        // only the child nodes whose cached results cannot be reused are
+        // tested in the batch
+        for (int i = 0; i < numChildren; ++i)
+        {
+            const Node* const child = children_[first + i];
+
+            if (test->isCached(planeMask, child->visibilityCache()))
+            {
+                batchIndices[i] = -1;
+                continue;
+            }
+
+            const Extents3 extents = child->worldExtents();
+
+            cx[count] = 0.5f * (extents.min.x + extents.max.x);
+            cy[count] = 0.5f * (extents.min.y + extents.max.y);
+            cz[count] = 0.5f * (extents.min.z + extents.max.z);
+            hx[count] = 0.5f * (extents.max.x - extents.min.x);
+            hy[count] = 0.5f * (extents.max.y - extents.min.y);
+            hz[count] = 0.5f * (extents.max.z - extents.min.z);
+            caches[count] = &child->visibilityCache();
+
+            batchIndices[i] = count;
+            ++count;
+        }
+
+        // the results are stored in the caches of the child nodes
+        test->testBatch(centers, halfSizes, count, planeMask, caches, states, masks);
+
+        // the child nodes are visited in order, so the render queue sees the
+        // same order from frame to frame
+        for (int i = 0; i < numChildren; ++i)
+        {
+            const int j = batchIndices[i];
+
+            // the child nodes reuse the cached or just stored results with
+            // the same plane mask, and continue with the planes they
+            // intersect
+            if (j == -1 || states[j] != VisibilityState::Invisible)
+            {
+                children_[first + i]->predraw(params, planeMask);
+            }
+        }
+    }
 }
 
 const Extents3 GroupNode::worldExtents() const
@@ -206,11 +464,108 @@ void GroupNode::deleteChildren()
     }
 }
 
+int GroupNode::addChild(Node* const p)
+{
+    GRAPHICS_RUNTIME_ASSERT(p != 0);
+    GRAPHICS_RUNTIME_ASSERT(p->hasParent() == false);
+
+    p->setChildIndex(children_.size());
+    children_.push_back(p);
+
+    // update back pointers, the parent is set first so that the scene sees
+    // the world transform of the attached node
+    p->setParent(this);
+    p->setScene(scene());
+
+    return subtreeSize(p);
+}
+
+int GroupNode::removeChild(Node* const p)
+{
+    GRAPHICS_RUNTIME_ASSERT(p != 0);
+    GRAPHICS_RUNTIME_ASSERT(p->parent() == this);
+
+    const int index = p->childIndex();
+    GRAPHICS_RUNTIME_ASSERT(children_[index] == p);
+
+    // move the last child node to the index of the removed node
+    Node* const last = children_.back();
+    children_[index] = last;
+    last->setChildIndex(index);
+    children_.pop_back();
+
+    // detach, do not delete
+    p->setScene(0);
+    p->setParent(0);
+    p->setChildIndex(-1);
+
+    // leaving the scene may have reported the node as moved
+    movedChildren_.erase(
+        std::remove(movedChildren_.begin(), movedChildren_.end(), p),
+        movedChildren_.end()
+    );
+
+    return subtreeSize(p);
+}
+
 void GroupNode::updateWorldExtents() const
 {
     // make sure we are not doing any unnecessary function calls
     GRAPHICS_RUNTIME_ASSERT(worldExtentsValid_ == false);
 
+    if (rebuildNeeded_)
+    {
+        rebuildWorldExtents();
+        return;
+    }
+
+    bool changed = false;
+
+    // child nodes moving inwards leave the world extents loose without
+    // growing them, so every change counts towards the next rebuild
+    numChanges_ += movedChildren_.size();
+
+    for (size_t i = 0; i < movedChildren_.size(); ++i)
+    {
+        const Extents3 extents = movedChildren_[i]->worldExtents();
+
+        if (extents.isEmpty() || contains(worldExtents_, extents))
+        {
+            ++numAvoidedRefits_;
+            continue;
+        }
+
+        // grow in place
+        const Vector3 d(extentsMargin_, extentsMargin_, extentsMargin_);
+        worldExtents_.enclose(Extents3(extents.min - d, extents.max + d));
+
+        ++numGrownRefits_;
+        changed = true;
+    }
+
+    movedChildren_.clear();
+
+    // a rebuild after as many changes as there are child nodes costs
+    // constant time per change, extents grown much larger are rebuilt at
+    // once
+    if (numChanges_ > static_cast<int>(children_.size())
+    ||  (changed && diagonal(worldExtents_) > maxGrowth * rebuiltDiagonal_))
+    {
+        // shrink the loose extents
+        rebuildWorldExtents();
+        return;
+    }
+
+    if (changed)
+    {
+        visibilityCache().invalidate();
+    }
+
+    worldExtentsValid_ = true;
+}
+
+void GroupNode::rebuildWorldExtents() const
+{
     worldExtents_.clear();
 
     for (size_t i = 0; i < children_.size(); ++i)
@@ -218,5 +573,21 @@ void GroupNode::updateWorldExtents() const
         worldExtents_.enclose(children_[i]->worldExtents());
     }
 
+    visibilityCache().invalidate();
+
+    rebuildNeeded_ = false;
+    movedChildren_.clear();
+    numChanges_ = 0;
+    rebuiltDiagonal_ = diagonal(worldExtents_);
     worldExtentsValid_ = true;
+
+    ++numFullRefits_;
+}
+
+void GroupNode::addDescendants(const int n)
+{
+    for (GroupNode* p = this; p != 0; p = p->parent())
+    {
+        p->numDescendants_ += n;
+    }
 }
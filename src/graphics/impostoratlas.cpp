@@ -0,0 +1,703 @@
+/**
+ * @file graphics/impostoratlas.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/impostoratlas.h>
+
+#include <geometry/extents3.h>
+#include <geometry/math.h>
+#include <geometry/matrix4x4.h>
+#include <geometry/transform3.h>
+
+#include <graphics/drawparams.h>
+#include <graphics/geometrynode.h>
+#include <graphics/instancebuffer.h>
+#include <graphics/opengl.h>
+#include <graphics/program.h>
+#include <graphics/projectionsettings.h>
+#include <graphics/renderqueue.h>
+#include <graphics/runtimeassert.h>
+#include <graphics/statecache.h>
+#include <graphics/texture.h>
+#include <graphics/uniformblocks.h>
+
+namespace {
+
+// uniform name hashes
+const uint32_t atlasMapId = Program::hashName("atlasMap");
+
+// per-instance attribute name hashes
+const uint32_t instanceCenterId = Program::hashName("instanceCenter");
+const uint32_t instanceRightId = Program::hashName("instanceRight");
+const uint32_t instanceUpId = Program::hashName("instanceUp");
+const uint32_t instanceTexRectId = Program::hashName("instanceTexRect");
+
+// per-instance data size in bytes, the quad center and half axes in world
+// space followed by the texture coordinate rectangle of the slot
+const size_t instanceSize = (3 + 3 + 3 + 4) * sizeof(float);
+
+// a node keeps its slot while its size stays within this factor of the size
+// at the capture, the world extents of a turning node change by less
+const float maxSizeRatio = 2.0f;
+
+// view direction of the render pass towards a point in world space
+const Vector3 viewDirection(const Vector3& point, const DrawParams& params)
+{
+    if (params.projectionMatrix.m23 == 0.0f)
+    {
+        // orthographic projection, the view direction is the same everywhere
+        return -params.cameraToWorld.rotation.row(2);
+    }
+
+    return point - params.cameraToWorld.translation;
+}
+
+void setInstanceAttribute(
+    const GLint location,
+    const int size,
+    const size_t offset)
+{
+    glVertexAttribPointer(
+        location,
+        size,
+        GL_FLOAT,
+        false,
+        instanceSize,
+        reinterpret_cast<const GLvoid*>(offset)
+    );
+    glVertexAttribDivisor(location, 1);
+    glEnableVertexAttribArray(location);
+}
+
+} // namespace
+
+ImpostorAtlas::~ImpostorAtlas()
+{
+    release();
+}
+
+ImpostorAtlas::ImpostorAtlas(const int atlasSize, const int slotSize)
+:   atlasSize_(atlasSize),
+    slotSize_(slotSize),
+    switchSize_(0.05f),
+    angleThreshold_(0.0f),
+    cosThreshold_(0.0f),
+    lightDirection_(0.0f, 0.0f, -1.0f),
+    maxCaptures_(8),
+    captureProgram_(0),
+    program_(0),
+    texture_(0),
+    framebufferId_(0),
+    depthBufferId_(0),
+    vertexArrayId_(0),
+    slots_(),
+    nodeSlots_(),
+    freeSlots_(),
+    queueSlots_(),
+    serial_(0),
+    frame_(0),
+    numCaptures_(0),
+    numDrawnImpostors_(0),
+    numDrawnFallbacks_(0)
+{
+    GRAPHICS_RUNTIME_ASSERT(atlasSize > 0);
+    GRAPHICS_RUNTIME_ASSERT(slotSize > 2 && atlasSize % slotSize == 0);
+
+    setAngleThreshold(4.0f);
+
+    const int n = numSlots();
+
+    Slot slot;
+    slot.node = 0;
+    slot.materialKey = 0;
+    slot.serial = -1;
+    slot.lastUsedFrame = -1;
+
+    slots_.assign(n, slot);
+    freeSlots_.reserve(n);
+
+    // the first slots are taken first
+    for (int i = n - 1; i >= 0; --i)
+    {
+        freeSlots_.push_back(i);
+    }
+}
+
+int ImpostorAtlas::atlasSize() const
+{
+    return atlasSize_;
+}
+
+int ImpostorAtlas::slotSize() const
+{
+    return slotSize_;
+}
+
+int ImpostorAtlas::numSlots() const
+{
+    const int n = atlasSize_ / slotSize_;
+    return n * n;
+}
+
+void ImpostorAtlas::setSwitchSize(const float size)
+{
+    GRAPHICS_RUNTIME_ASSERT(size >= 0.0f);
+    switchSize_ = size;
+}
+
+float ImpostorAtlas::switchSize() const
+{
+    return switchSize_;
+}
+
+void ImpostorAtlas::setAngleThreshold(const float angle)
+{
+    GRAPHICS_RUNTIME_ASSERT(angle > 0.0f && angle <= 180.0f);
+
+    angleThreshold_ = angle;
+    cosThreshold_ = Math::cos(Math::radians(angle));
+}
+
+float ImpostorAtlas::angleThreshold() const
+{
+    return angleThreshold_;
+}
+
+void ImpostorAtlas::setLightDirection(const Vector3& direction)
+{
+    GRAPHICS_RUNTIME_ASSERT(sqrLength(direction) > 0.0f);
+    lightDirection_ = normalize(direction);
+}
+
+const Vector3 ImpostorAtlas::lightDirection() const
+{
+    return lightDirection_;
+}
+
+void ImpostorAtlas::setMaxCaptures(const int n)
+{
+    GRAPHICS_RUNTIME_ASSERT(n > 0);
+    maxCaptures_ = n;
+}
+
+int ImpostorAtlas::maxCaptures() const
+{
+    return maxCaptures_;
+}
+
+void ImpostorAtlas::setCaptureProgram(Program* const p)
+{
+    captureProgram_ = p;
+}
+
+Program* ImpostorAtlas::captureProgram() const
+{
+    return captureProgram_;
+}
+
+void ImpostorAtlas::setProgram(Program* const p)
+{
+    program_ = p;
+}
+
+Program* ImpostorAtlas::program() const
+{
+    return program_;
+}
+
+void ImpostorAtlas::invalidate()
+{
+    // the slots keep their captures until they are captured again
+    ++serial_;
+}
+
+void ImpostorAtlas::release()
+{
+    for (SlotMap::const_iterator i = nodeSlots_.begin(); i != nodeSlots_.end(); ++i)
+    {
+        i->first->setImpostorAtlas(0);
+    }
+
+    nodeSlots_.clear();
+    freeSlots_.clear();
+    queueSlots_.clear();
+
+    // the first slots are taken first
+    for (int i = numSlots() - 1; i >= 0; --i)
+    {
+        Slot& slot = slots_[i];
+        slot.node = 0;
+        slot.serial = -1;
+        slot.lastUsedFrame = -1;
+
+        freeSlots_.push_back(i);
+    }
+
+    delete texture_;
+    texture_ = 0;
+
+    if (framebufferId_ != 0)
+    {
+        glDeleteFramebuffers(1, &framebufferId_);
+        framebufferId_ = 0;
+    }
+
+    if (depthBufferId_ != 0)
+    {
+        glDeleteRenderbuffers(1, &depthBufferId_);
+        depthBufferId_ = 0;
+    }
+
+    if (vertexArrayId_ != 0)
+    {
+        glDeleteVertexArrays(1, &vertexArrayId_);
+        vertexArrayId_ = 0;
+    }
+}
+
+void ImpostorAtlas::releaseNode(const GeometryNode* const node)
+{
+    GRAPHICS_RUNTIME_ASSERT(node != 0);
+
+    const SlotMap::iterator i = nodeSlots_.find(node);
+
+    if (i == nodeSlots_.end())
+    {
+        return;
+    }
+
+    // the slot is given to another node before any used slot
+    Slot& slot = slots_[i->second];
+    slot.node = 0;
+    slot.serial = -1;
+    slot.lastUsedFrame = -1;
+
+    freeSlots_.push_back(i->second);
+    nodeSlots_.erase(i);
+
+    node->setImpostorAtlas(0);
+}
+
+bool ImpostorAtlas::isImpostor(
+    const GeometryNode& node,
+    const float projectedSize,
+    const float hysteresis) const
+{
+    if (switchSize_ <= 0.0f)
+    {
+        return false;
+    }
+
+    // a node near the switch size does not flicker between an impostor and
+    // geometry
+    const bool hasSlot = nodeSlots_.find(&node) != nodeSlots_.end();
+    return projectedSize < switchSize_ * (hasSlot ? 1.0f + hysteresis : 1.0f - hysteresis);
+}
+
+void ImpostorAtlas::update(const RenderQueue& queue, const DrawParams& params)
+{
+    GRAPHICS_RUNTIME_ASSERT(params.stateCache != 0);
+    GRAPHICS_RUNTIME_ASSERT(captureProgram_ != 0);
+
+    const int n = queue.numImpostorNodes();
+
+    ++frame_;
+    numCaptures_ = 0;
+    queueSlots_.assign(n, -1);
+
+    if (n == 0)
+    {
+        return;
+    }
+
+    if (texture_ == 0)
+    {
+        allocate();
+
+        // the texture was bound outside the state cache
+        params.stateCache->invalidate();
+    }
+
+    // all impostor nodes keep or get their slots before any slot is given
+    // away
+    for (int i = 0; i < n; ++i)
+    {
+        const int index = findSlot(queue.impostorNode(i));
+
+        if (index != -1)
+        {
+            slots_[index].lastUsedFrame = frame_;
+            queueSlots_[i] = index;
+        }
+    }
+
+    GLint viewport[4];
+    GLfloat clearColor[4];
+
+    // the missing captures are taken in the first pass, the stale ones in the
+    // second, a stale impostor can still be drawn from its old capture
+    for (int pass = 0; pass < 2 * n && numCaptures_ < maxCaptures_; ++pass)
+    {
+        const int i = pass % n;
+        const int index = queueSlots_[i];
+
+        if (index == -1 || (slots_[index].serial == -1) != (pass < n))
+        {
+            continue;
+        }
+
+        if (pass >= n && isStale(slots_[index], *queue.impostorNode(i), params) == false)
+        {
+            continue;
+        }
+
+        if (numCaptures_ == 0)
+        {
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, framebufferId_);
+            glEnable(GL_SCISSOR_TEST);
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+            params.stateCache->useProgram(captureProgram_);
+        }
+
+        capture(index, *queue.impostorNode(i), params);
+        ++numCaptures_;
+    }
+
+    if (numCaptures_ > 0)
+    {
+        glDisable(GL_SCISSOR_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    }
+}
+
+void ImpostorAtlas::draw(const RenderQueue& queue, const DrawParams& params)
+{
+    GRAPHICS_RUNTIME_ASSERT(params.stateCache != 0);
+    GRAPHICS_RUNTIME_ASSERT(static_cast<int>(queueSlots_.size()) == queue.numImpostorNodes());
+
+    numDrawnImpostors_ = 0;
+    numDrawnFallbacks_ = 0;
+
+    // impostor nodes are drawn with their own world transforms, each as a
+    // run of one so the matrices take the same path as in the render queue
+    DrawParams nodeParams = params;
+    nodeParams.worldTransforms = 0;
+
+    for (size_t i = 0; i < queueSlots_.size(); ++i)
+    {
+        const int index = queueSlots_[i];
+
+        if (index == -1 || slots_[index].serial == -1)
+        {
+            // no capture yet, draw the geometry
+            const GeometryNode* const node = queue.impostorNode(i);
+            node->drawInstanced(nodeParams, &node, 1);
+            ++numDrawnFallbacks_;
+        }
+        else
+        {
+            ++numDrawnImpostors_;
+        }
+    }
+
+    if (numDrawnImpostors_ == 0)
+    {
+        return;
+    }
+
+    GRAPHICS_RUNTIME_ASSERT(program_ != 0);
+    GRAPHICS_RUNTIME_ASSERT(params.instanceBuffer != 0);
+
+    float* data = static_cast<float*>(
+        params.instanceBuffer->map(numDrawnImpostors_ * instanceSize)
+    );
+
+    const int slotsPerRow = atlasSize_ / slotSize_;
+    const float texelSize = 1.0f / atlasSize_;
+
+    for (size_t i = 0; i < queueSlots_.size(); ++i)
+    {
+        const int index = queueSlots_[i];
+
+        if (index == -1 || slots_[index].serial == -1)
+        {
+            continue;
+        }
+
+        // the quad follows the node, it is turned with the node
+        const Slot& slot = slots_[index];
+        const Transform3 t = queue.impostorNode(i)->worldTransform();
+
+        const Vector3 center = transform(slot.center, t);
+        const Vector3 right = t.scaling * (slot.right * t.rotation);
+        const Vector3 up = t.scaling * (slot.up * t.rotation);
+
+        // the captured image is one texel inside the slot, so linear
+        // filtering does not sample the neighbor slots
+        const int x = (index % slotsPerRow) * slotSize_;
+        const int y = (index / slotsPerRow) * slotSize_;
+
+        const float texRect[4] = {
+            (x + 1) * texelSize,
+            (y + 1) * texelSize,
+            (x + slotSize_ - 1) * texelSize,
+            (y + slotSize_ - 1) * texelSize
+        };
+
+        *data++ = center.x;
+        *data++ = center.y;
+        *data++ = center.z;
+        *data++ = right.x;
+        *data++ = right.y;
+        *data++ = right.z;
+        *data++ = up.x;
+        *data++ = up.y;
+        *data++ = up.z;
+
+        for (int j = 0; j < 4; ++j)
+        {
+            *data++ = texRect[j];
+        }
+    }
+
+    const size_t offset = params.instanceBuffer->unmap();
+
+    params.stateCache->useProgram(program_);
+    params.stateCache->bindVertexArray(vertexArrayId_);
+
+    // the quad corners come from the vertex Id, the vertex array object only
+    // holds the per-instance attributes
+    glBindBuffer(GL_ARRAY_BUFFER, params.instanceBuffer->id());
+    setInstanceAttribute(program_->attributeLocation(instanceCenterId), 3, offset);
+    setInstanceAttribute(program_->attributeLocation(instanceRightId), 3, offset + 3 * sizeof(float));
+    setInstanceAttribute(program_->attributeLocation(instanceUpId), 3, offset + 6 * sizeof(float));
+    setInstanceAttribute(program_->attributeLocation(instanceTexRectId), 4, offset + 9 * sizeof(float));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glUniform1i(program_->uniformLocation(atlasMapId), 0);
+    params.stateCache->bindTexture(0, texture_);
+
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, numDrawnImpostors_);
+}
+
+int ImpostorAtlas::numCaptures() const
+{
+    return numCaptures_;
+}
+
+int ImpostorAtlas::numDrawnImpostors() const
+{
+    return numDrawnImpostors_;
+}
+
+int ImpostorAtlas::numDrawnFallbacks() const
+{
+    return numDrawnFallbacks_;
+}
+
+int ImpostorAtlas::numUsedSlots() const
+{
+    return nodeSlots_.size();
+}
+
+void ImpostorAtlas::allocate()
+{
+    GRAPHICS_RUNTIME_ASSERT(texture_ == 0);
+
+    texture_ = new Texture();
+    texture_->createImage(atlasSize_, atlasSize_);
+
+    glGenRenderbuffers(1, &depthBufferId_);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBufferId_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasSize_, atlasSize_);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebufferId_);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebufferId_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_->getTextureHandle(), 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBufferId_);
+    GRAPHICS_RUNTIME_ASSERT(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenVertexArrays(1, &vertexArrayId_);
+}
+
+int ImpostorAtlas::findSlot(const GeometryNode* const node)
+{
+    const SlotMap::const_iterator i = nodeSlots_.find(node);
+
+    if (i != nodeSlots_.end())
+    {
+        return i->second;
+    }
+
+    if (node->impostorAtlas() != 0)
+    {
+        // the node has a slot in another atlas
+        return -1;
+    }
+
+    int index = -1;
+
+    if (freeSlots_.empty() == false)
+    {
+        index = freeSlots_.back();
+        freeSlots_.pop_back();
+    }
+    else
+    {
+        // the least recently used slot that is not used in this frame
+        for (size_t j = 0; j < slots_.size(); ++j)
+        {
+            const int lastUsedFrame = slots_[j].lastUsedFrame;
+
+            if (lastUsedFrame < frame_ && (index == -1 || lastUsedFrame < slots_[index].lastUsedFrame))
+            {
+                index = j;
+            }
+        }
+
+        if (index == -1)
+        {
+            // all slots are in use
+            return -1;
+        }
+
+        slots_[index].node->setImpostorAtlas(0);
+        nodeSlots_.erase(slots_[index].node);
+    }
+
+    Slot& slot = slots_[index];
+    slot.node = node;
+    slot.serial = -1;
+
+    nodeSlots_[node] = index;
+    node->setImpostorAtlas(this);
+
+    return index;
+}
+
+bool ImpostorAtlas::isStale(
+    const Slot& slot,
+    const GeometryNode& node,
+    const DrawParams& params) const
+{
+    if (slot.serial != serial_ || slot.materialKey != node.materialKey())
+    {
+        return true;
+    }
+
+    const Transform3 t = node.worldTransform();
+    const Extents3 e = node.worldExtents();
+
+    // a scaled node
+    const float size = 0.5f * length(e.max - e.min);
+    const float capturedSize = t.scaling * length(slot.right);
+
+    if (size > capturedSize * maxSizeRatio || size * maxSizeRatio < capturedSize)
+    {
+        return true;
+    }
+
+    // the directions relative to the node, a turning node is captured again
+    // like a node the camera moves around
+    const Vector3 direction = viewDirection(0.5f * (e.min + e.max), params);
+
+    if (sqrLength(direction) > 0.0f
+    &&  dot(normalize(timesTranspose(direction, t.rotation)), slot.viewDirection) < cosThreshold_)
+    {
+        return true;
+    }
+
+    return dot(timesTranspose(lightDirection_, t.rotation), slot.lightDirection) < cosThreshold_;
+}
+
+void ImpostorAtlas::capture(
+    const int index,
+    const GeometryNode& node,
+    const DrawParams& params)
+{
+    const Transform3 t = node.worldTransform();
+    const Extents3 e = node.worldExtents();
+
+    const Vector3 center = 0.5f * (e.min + e.max);
+    const float radius = 0.5f * length(e.max - e.min);
+
+    GRAPHICS_RUNTIME_ASSERT(radius > 0.0f);
+
+    Vector3 direction = viewDirection(center, params);
+
+    if (sqrLength(direction) <= 0.0f)
+    {
+        direction = -params.cameraToWorld.rotation.row(2);
+    }
+
+    // the capture camera looks at the bounding sphere along the view
+    // direction, the up axis of the render pass camera keeps the image
+    // upright
+    const Vector3 back = -normalize(direction);
+    Vector3 right = cross(params.cameraToWorld.rotation.row(1), back);
+
+    if (sqrLength(right) < 1.0e-6f)
+    {
+        // looking along the up axis
+        right = cross(params.cameraToWorld.rotation.row(2), back);
+    }
+
+    right = normalize(right);
+    const Vector3 up = cross(back, right);
+
+    const Matrix3x3 rotation(right, up, back);
+    const Transform3 cameraToWorld(center + 2.0f * radius * back, rotation, 1.0f);
+
+    DrawParams captureParams = params;
+    captureParams.cameraToWorld = cameraToWorld;
+    captureParams.viewMatrix = toMatrix4x4(inverse(cameraToWorld));
+    captureParams.worldToViewRotation = transpose(rotation);
+    captureParams.projectionMatrix = ProjectionSettings::orthographic(
+        -radius,
+        radius,
+        -radius,
+        radius,
+        radius,
+        3.0f * radius
+    ).projectionMatrix();
+    captureParams.worldTransforms = 0;
+    captureParams.program = captureProgram_;
+
+    if (captureParams.uniformBuffer != 0)
+    {
+        UniformBlocks::setCameraBlock(captureParams);
+    }
+
+    const int slotsPerRow = atlasSize_ / slotSize_;
+    const int x = (index % slotsPerRow) * slotSize_;
+    const int y = (index / slotsPerRow) * slotSize_;
+
+    // the border texels of the slot stay clear
+    glScissor(x, y, slotSize_, slotSize_);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glViewport(x + 1, y + 1, slotSize_ - 2, slotSize_ - 2);
+
+    // the capture takes the instanced path of the render queue, the capture
+    // program may take the matrices as per-instance attributes only
+    const GeometryNode* const run = &node;
+    node.drawInstanced(captureParams, &run, 1);
+
+    // the capture in the model space of the node
+    Slot& slot = slots_[index];
+    slot.materialKey = node.materialKey();
+    slot.serial = serial_;
+    slot.viewDirection = normalize(timesTranspose(direction, t.rotation));
+    slot.lightDirection = timesTranspose(lightDirection_, t.rotation);
+    slot.center = transformByInverse(center, t);
+    slot.right = (radius / t.scaling) * timesTranspose(right, t.rotation);
+    slot.up = (radius / t.scaling) * timesTranspose(up, t.rotation);
+}
@@ -0,0 +1,109 @@
+/**
+ * @file graphics/instancebuffer.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/instancebuffer.h>
+
+#include <graphics/opengl.h>
+#include <graphics/runtimeassert.h>
+
+namespace {
+
+// block alignment in bytes
+const size_t blockAlignment = 16;
+
+size_t align(const size_t offset)
+{
+    return (offset + blockAlignment - 1) & ~(blockAlignment - 1);
+}
+
+} // namespace
+
+InstanceBuffer::~InstanceBuffer()
+{
+    if (id_ != 0)
+    {
+        glDeleteBuffers(1, &id_);
+    }
+}
+
+InstanceBuffer::InstanceBuffer(const size_t capacity)
+:   id_(0),
+    capacity_(align(capacity)),
+    offset_(0),
+    blockOffset_(0),
+    mapped_(false)
+{
+    GRAPHICS_RUNTIME_ASSERT(capacity > 0);
+}
+
+void* InstanceBuffer::map(const size_t size)
+{
+    GRAPHICS_RUNTIME_ASSERT(size > 0);
+    GRAPHICS_RUNTIME_ASSERT(mapped_ == false);
+
+    if (id_ == 0)
+    {
+        glGenBuffers(1, &id_);
+        allocate();
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, id_);
+
+    if (size > capacity_)
+    {
+        // grow to fit the block with room for more
+        capacity_ = align(2 * size);
+        allocate();
+    }
+    else if (offset_ + size > capacity_)
+    {
+        // the end of the buffer was reached, orphan the storage so blocks
+        // still in use are not overwritten
+        allocate();
+    }
+
+    void* const p = glMapBufferRange(
+        GL_ARRAY_BUFFER,
+        offset_,
+        size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+    );
+
+    GRAPHICS_RUNTIME_ASSERT(p != 0);
+
+    blockOffset_ = offset_;
+    offset_ = align(offset_ + size);
+    mapped_ = true;
+
+    return p;
+}
+
+size_t InstanceBuffer::unmap()
+{
+    GRAPHICS_RUNTIME_ASSERT(mapped_);
+
+    glBindBuffer(GL_ARRAY_BUFFER, id_);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    mapped_ = false;
+
+    return blockOffset_;
+}
+
+uint32_t InstanceBuffer::id() const
+{
+    return id_;
+}
+
+size_t InstanceBuffer::capacity() const
+{
+    return capacity_;
+}
+
+void InstanceBuffer::allocate()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, id_);
+    glBufferData(GL_ARRAY_BUFFER, capacity_, 0, GL_STREAM_DRAW);
+    offset_ = 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file graphics/instancenode.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/instancenode.h>
+
+#include <graphics/groupnode.h>
+#include <graphics/predrawparams.h>
+#include <graphics/runtimeassert.h>
+
+InstanceNode::~InstanceNode()
+{
+    // ...
+}
+
+InstanceNode::InstanceNode()
+:   GeometryNode(),
+    worldExtentsValid_(false),
+    worldExtents_(),
+    prefab_(0)
+{
+    // ...
+}
+
+InstanceNode::InstanceNode(const InstanceNode& other)
+:   GeometryNode(other),
+    worldExtentsValid_(false),
+    worldExtents_(),
+    prefab_(other.prefab_)
+{
+    // ...
+}
+
+void InstanceNode::setPrefab(const Node* const p)
+{
+    GRAPHICS_RUNTIME_ASSERT(p != this);
+    GRAPHICS_RUNTIME_ASSERT(p == 0 || (p->hasParent() == false && p->scene() == 0));
+
+    prefab_ = p;
+    invalidateWorldExtents();
+}
+
+const Node* InstanceNode::prefab() const
+{
+    return prefab_;
+}
+
+InstanceNode* InstanceNode::clone() const
+{
+    return new InstanceNode(*this);
+}
+
+void InstanceNode::predraw(
+    const PredrawParams& params,
+    uint32_t planeMask) const
+{
+    if (prefab_ == 0 || testVisibility(params, planeMask) == false)
+    {
+        // nothing to draw
+        return;
+    }
+
+    // the prefab nodes need not test the planes this node is completely
+    // inside of
+    prefab_->predrawPrefab(params, planeMask, worldTransform());
+}
+
+const Extents3 InstanceNode::worldExtents() const
+{
+    if (worldExtentsValid_ == false)
+    {
+        worldExtents_.clear();
+
+        if (prefab_ != 0)
+        {
+            // also validates the world transforms and world extents of the
+            // prefab nodes, the predraw step only reads them
+            worldExtents_ = ::transform(prefab_->worldExtents(), worldTransform());
+        }
+
+        worldExtentsValid_ = true;
+    }
+
+    return worldExtents_;
+}
+
+void InstanceNode::invalidateWorldTransform() const
+{
+    if (isWorldTransformValid() == false)
+    {
+        // already invalidated, nothing to do
+        return;
+    }
+
+    // call the base class version
+    GeometryNode::invalidateWorldTransform();
+
+    // transforming an instance node invalidates its world extents and the
+    // world extents of all anchestor nodes
+    invalidateWorldExtents();
+}
+
+void InstanceNode::draw(const DrawParams&) const
+{
+    // ...
+}
+
+void InstanceNode::predrawPrefab(
+    const PredrawParams& params,
+    uint32_t planeMask,
+    const Transform3& transform) const
+{
+    if (prefab_ == 0
+    ||  testPrefabExtents(::transform(worldExtents(), transform), params, planeMask) == false)
+    {
+        // early out
+        return;
+    }
+
+    // an instance node in a prefab, the prefab of this node is placed by the
+    // world transform of this node in the outer prefab world space
+    prefab_->predrawPrefab(params, planeMask, ::transform(worldTransform(), transform));
+}
+
+void InstanceNode::invalidateWorldExtents() const
+{
+    const bool wasValid = worldExtentsValid_;
+
+    worldExtentsValid_ = false;
+    visibilityCache().invalidate();
+    invalidateSceneProxy();
+
+    if (wasValid && hasParent())
+    {
+        // the parent node refits only the moved child nodes
+        parent()->invalidateChildExtents(this);
+    }
+}
@@ -5,20 +5,186 @@
 
 #include <graphics/mesh.h>
 
+#include <algorithm>
+#include <cstring>
+
+#include <geometry/math.h>
 #include <geometry/matrix3x3.h>
+#include <geometry/matrix4x4.h>
 
+#include <graphics/opengl.h>
+#include <graphics/program.h>
 #include <graphics/runtimeassert.h>
+#include <graphics/statecache.h>
+
+namespace {
+
+// vertex attribute name hashes
+const uint32_t coordId = Program::hashName("coord");
+const uint32_t normalId = Program::hashName("normal");
+const uint32_t tangentId = Program::hashName("tangent");
+const uint32_t texCoordId = Program::hashName("texCoord");
+
+// marks a vertex that has not been assigned a new index
+const uint32_t unassigned = 0xFFFFFFFF;
+
+// simulated post-transform vertex cache size
+const int vertexCacheSize = 32;
+
+// vertex score parameters from Tom Forsyth's "Linear-Speed Vertex Cache
+// Optimisation"
+const float cacheDecayPower = 1.5f;
+const float lastFaceScore = 0.75f;
+const float valenceBoostScale = 2.0f;
+const float valenceBoostPower = 0.5f;
+
+// serial number of the last upload of any mesh
+uint32_t lastUploadSerial = 0;
+
+float vertexScore(const int cachePosition, const int numActiveFaces)
+{
+    if (numActiveFaces == 0)
+    {
+        // no faces left to draw, the vertex is not needed anymore
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+
+    if (cachePosition >= 0 && cachePosition < 3)
+    {
+        // the vertex was used by the last face, a fixed score is given to
+        // avoid favoring any of the last face vertices
+        score = lastFaceScore;
+    }
+    else if (cachePosition >= 3)
+    {
+        const float scale = 1.0f / (vertexCacheSize - 3);
+        score = Math::pow(1.0f - (cachePosition - 3) * scale, cacheDecayPower);
+    }
+
+    // boost vertices with few faces left, this gets rid of lone faces
+    score += valenceBoostScale * Math::pow(static_cast<float>(numActiveFaces), -valenceBoostPower);
+
+    return score;
+}
+
+int compare(const float a, const float b)
+{
+    return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+int compare(const Vector2& a, const Vector2& b)
+{
+    int result = compare(a.x, b.x);
+
+    if (result == 0)
+    {
+        result = compare(a.y, b.y);
+    }
+
+    return result;
+}
+
+int compare(const Vector3& a, const Vector3& b)
+{
+    int result = compare(a.x, b.x);
+
+    if (result == 0)
+    {
+        result = compare(a.y, b.y);
+    }
+
+    if (result == 0)
+    {
+        result = compare(a.z, b.z);
+    }
+
+    return result;
+}
+
+/**
+ * Orders vertex indices by the vertex data they refer to, vertices with equal
+ * data are ordered by index.
+ */
+class VertexLess
+{
+public:
+    explicit VertexLess(const Mesh& mesh)
+    :   mesh_(mesh)
+    {
+        // ...
+    }
+
+    // compares the data of two vertices
+    int compareVertices(const uint32_t a, const uint32_t b) const
+    {
+        int result = compare(mesh_.vertices()[a], mesh_.vertices()[b]);
+
+        if (result == 0)
+        {
+            result = compare(mesh_.normals()[a], mesh_.normals()[b]);
+        }
+
+        if (result == 0)
+        {
+            result = compare(mesh_.tangents()[a], mesh_.tangents()[b]);
+        }
+
+        if (result == 0)
+        {
+            result = compare(mesh_.texCoords()[a], mesh_.texCoords()[b]);
+        }
+
+        return result;
+    }
+
+    bool operator ()(const uint32_t a, const uint32_t b) const
+    {
+        const int result = compareVertices(a, b);
+        return result < 0 || (result == 0 && a < b);
+    }
+
+private:
+    const Mesh& mesh_;
+};
+
+} // namespace
 
 Mesh::~Mesh()
 {
-    // ...
+    deleteVertexArrays();
+
+    if (bufferId_ != 0)
+    {
+        glDeleteBuffers(1, &bufferId_);
+    }
+
+    if (indexBufferId_ != 0)
+    {
+        glDeleteBuffers(1, &indexBufferId_);
+    }
 }
 
 Mesh::Mesh(const int numFaces)
 :   vertices_(numFaces * 3),
     normals_(numFaces * 3),
     tangents_(numFaces * 3),
-    texCoords_(numFaces * 3)
+    texCoords_(numFaces * 3),
+    indices_(),
+    vertexFormat_(),
+    bufferFormat_(),
+    extents_(),
+    boundingSphere_(),
+    boundingBox_(),
+    numVertices_(numFaces * 3),
+    numIndices_(0),
+    hasClientData_(true),
+    bufferValid_(false),
+    bufferId_(0),
+    indexBufferId_(0),
+    uploadSerial_(0),
+    vertexArrays_()
 {
     // ...
 }
@@ -27,9 +193,24 @@ Mesh::Mesh(const Mesh& other)
 :   vertices_(other.vertices_),
     normals_(other.normals_),
     tangents_(other.tangents_),
-    texCoords_(other.texCoords_)
+    texCoords_(other.texCoords_),
+    indices_(other.indices_),
+    vertexFormat_(other.vertexFormat_),
+    bufferFormat_(),
+    extents_(other.extents_),
+    boundingSphere_(other.boundingSphere_),
+    boundingBox_(other.boundingBox_),
+    numVertices_(other.numVertices_),
+    numIndices_(other.numIndices_),
+    hasClientData_(other.hasClientData_),
+    bufferValid_(false),
+    bufferId_(0),
+    indexBufferId_(0),
+    uploadSerial_(0),
+    vertexArrays_()
 {
-    // ...
+    // the vertex data of a mesh without client data cannot be copied
+    GRAPHICS_RUNTIME_ASSERT(other.hasClientData_);
 }
 
 Mesh& Mesh::operator =(const Mesh& other)
@@ -40,12 +221,15 @@ Mesh& Mesh::operator =(const Mesh& other)
 
 void Mesh::setVertices(const std::vector<Vector3>& vertices)
 {
-    GRAPHICS_RUNTIME_ASSERT(vertices.size() % 3 == 0);
+    GRAPHICS_RUNTIME_ASSERT(indices_.empty() == false || vertices.size() % 3 == 0);
+    GRAPHICS_RUNTIME_ASSERT(hasClientData_);
     vertices_ = vertices;
+    invalidateBuffer();
 }
 
 std::vector<Vector3>& Mesh::vertices()
 {
+    invalidateBuffer();
     return vertices_;
 }
 
@@ -56,12 +240,15 @@ const std::vector<Vector3>& Mesh::vertices() const
 
 void Mesh::setNormals(const std::vector<Vector3>& normals)
 {
-    GRAPHICS_RUNTIME_ASSERT(normals.size() % 3 == 0);
+    GRAPHICS_RUNTIME_ASSERT(indices_.empty() == false || normals.size() % 3 == 0);
+    GRAPHICS_RUNTIME_ASSERT(hasClientData_);
     normals_ = normals;
+    invalidateBuffer();
 }
 
 std::vector<Vector3>& Mesh::normals()
 {
+    invalidateBuffer();
     return normals_;
 }
 
@@ -72,12 +259,15 @@ const std::vector<Vector3>& Mesh::normals() const
 
 void Mesh::setTangents(const std::vector<Vector3>& tangents)
 {
-    GRAPHICS_RUNTIME_ASSERT(tangents.size() % 3 == 0);
+    GRAPHICS_RUNTIME_ASSERT(indices_.empty() == false || tangents.size() % 3 == 0);
+    GRAPHICS_RUNTIME_ASSERT(hasClientData_);
     tangents_ = tangents;
+    invalidateBuffer();
 }
 
 std::vector<Vector3>& Mesh::tangents()
 {
+    invalidateBuffer();
     return tangents_;
 }
 
@@ -88,12 +278,15 @@ const std::vector<Vector3>& Mesh::tangents() const
 
 void Mesh::setTexCoords(const std::vector<Vector2>& texCoords)
 {
-    GRAPHICS_RUNTIME_ASSERT(texCoords.size() % 3 == 0);
+    GRAPHICS_RUNTIME_ASSERT(indices_.empty() == false || texCoords.size() % 3 == 0);
+    GRAPHICS_RUNTIME_ASSERT(hasClientData_);
     texCoords_ = texCoords;
+    invalidateBuffer();
 }
 
 std::vector<Vector2>& Mesh::texCoords()
 {
+    invalidateBuffer();
     return texCoords_;
 }
 
@@ -102,14 +295,682 @@ const std::vector<Vector2>& Mesh::texCoords() const
     return texCoords_;
 }
 
+void Mesh::setVertexFormat(const VertexFormat& format)
+{
+    GRAPHICS_RUNTIME_ASSERT(hasClientData_);
+    vertexFormat_ = format;
+    invalidateBuffer();
+}
+
+const VertexFormat Mesh::vertexFormat() const
+{
+    return vertexFormat_;
+}
+
+const Matrix4x4 Mesh::decodeMatrix() const
+{
+    GRAPHICS_RUNTIME_ASSERT(bufferValid_);
+
+    if (bufferFormat_.position == PositionFormat::Float)
+    {
+        return Matrix4x4::identity();
+    }
+
+    // maps the unit cube of normalized coordinates to the upload extents
+    const Vector3 min = extents_.min;
+    const Vector3 size = extents_.max - extents_.min;
+
+    return Matrix4x4(
+        size.x,     0.0f,       0.0f,       0.0f,
+        0.0f,       size.y,     0.0f,       0.0f,
+        0.0f,       0.0f,       size.z,     0.0f,
+        min.x,      min.y,      min.z,      1.0f
+    );
+}
+
+size_t Mesh::vertexDataSize() const
+{
+    const VertexFormat format = hasClientData_ ? effectiveVertexFormat() : bufferFormat_;
+    return numVertices() * format.vertexSize();
+}
+
+size_t Mesh::indexDataSize() const
+{
+    const size_t indexSize = numVertices() <= 0x10000 ? sizeof(uint16_t) : sizeof(uint32_t);
+    return numIndices() * indexSize;
+}
+
+void Mesh::setIndices(const std::vector<uint32_t>& indices)
+{
+    GRAPHICS_RUNTIME_ASSERT(indices.size() % 3 == 0);
+    GRAPHICS_RUNTIME_ASSERT(hasClientData_);
+
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        GRAPHICS_RUNTIME_ASSERT(indices[i] < vertices_.size());
+    }
+
+    indices_ = indices;
+    invalidateBuffer();
+}
+
+const std::vector<uint32_t>& Mesh::indices() const
+{
+    return indices_;
+}
+
+bool Mesh::isIndexed() const
+{
+    return numIndices() > 0;
+}
+
+int Mesh::numIndices() const
+{
+    if (hasClientData_)
+    {
+        return indices_.size();
+    }
+
+    return numIndices_;
+}
+
+void Mesh::weld()
+{
+    GRAPHICS_RUNTIME_ASSERT(hasClientData_);
+    GRAPHICS_RUNTIME_ASSERT(vertices_.size() == normals_.size());
+    GRAPHICS_RUNTIME_ASSERT(vertices_.size() == tangents_.size());
+    GRAPHICS_RUNTIME_ASSERT(vertices_.size() == texCoords_.size());
+
+    const size_t n = vertices_.size();
+
+    if (indices_.empty())
+    {
+        // a non-indexed mesh refers to its vertices in order
+        indices_.resize(n);
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            indices_[i] = i;
+        }
+    }
+
+    // sort the vertex indices so that equal vertices are next to each other
+    std::vector<uint32_t> order(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        order[i] = i;
+    }
+
+    const VertexLess less(*this);
+    std::sort(order.begin(), order.end(), less);
+
+    // the first vertex of each group of equal vertices is kept
+    std::vector<uint32_t> remap(n);
+    std::vector<uint32_t> unique;
+    unique.reserve(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i == 0 || less.compareVertices(order[i - 1], order[i]) != 0)
+        {
+            unique.push_back(order[i]);
+        }
+
+        remap[order[i]] = unique.size() - 1;
+    }
+
+    for (size_t i = 0; i < indices_.size(); ++i)
+    {
+        indices_[i] = remap[indices_[i]];
+    }
+
+    reorderVertices(unique);
+    invalidateBuffer();
+}
+
+void Mesh::optimizeVertexCache()
+{
+    GRAPHICS_RUNTIME_ASSERT(hasClientData_);
+    GRAPHICS_RUNTIME_ASSERT(indices_.size() % 3 == 0);
+
+    const int numFaces = indices_.size() / 3;
+    const int n = vertices_.size();
+
+    if (numFaces < 2)
+    {
+        // nothing to reorder
+        return;
+    }
+
+    // count the faces that use each vertex
+    std::vector<int> numActiveFaces(n, 0);
+
+    for (size_t i = 0; i < indices_.size(); ++i)
+    {
+        ++numActiveFaces[indices_[i]];
+    }
+
+    // build the vertex to face adjacency lists, the faces of vertex v are
+    // faces[faceOffsets[v]] ... faces[faceOffsets[v] + numActiveFaces[v] - 1]
+    std::vector<int> faceOffsets(n + 1, 0);
+
+    for (int v = 0; v < n; ++v)
+    {
+        faceOffsets[v + 1] = faceOffsets[v] + numActiveFaces[v];
+    }
+
+    std::vector<int> faces(indices_.size());
+    std::vector<int> fillOffsets(faceOffsets.begin(), faceOffsets.end() - 1);
+
+    for (int f = 0; f < numFaces; ++f)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            faces[fillOffsets[indices_[f * 3 + k]]++] = f;
+        }
+    }
+
+    // initial scores
+    std::vector<float> vertexScores(n);
+    std::vector<float> faceScores(numFaces, 0.0f);
+    std::vector<bool> emitted(numFaces, false);
+
+    for (int v = 0; v < n; ++v)
+    {
+        vertexScores[v] = vertexScore(-1, numActiveFaces[v]);
+    }
+
+    int bestFace = 0;
+
+    for (int f = 0; f < numFaces; ++f)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            faceScores[f] += vertexScores[indices_[f * 3 + k]];
+        }
+
+        if (faceScores[f] > faceScores[bestFace])
+        {
+            bestFace = f;
+        }
+    }
+
+    // the cache holds up to 3 extra entries while it is being updated
+    int cache[vertexCacheSize + 3];
+    int cacheSize = 0;
+
+    std::vector<uint32_t> result;
+    result.reserve(indices_.size());
+
+    // faces before this one have all been emitted
+    int nextFace = 0;
+
+    for (int i = 0; i < numFaces; ++i)
+    {
+        if (bestFace == -1)
+        {
+            // no cached vertex has faces left, continue from the first face
+            // not yet emitted
+            while (emitted[nextFace])
+            {
+                ++nextFace;
+            }
+
+            bestFace = nextFace;
+        }
+
+        const uint32_t* const face = &indices_[bestFace * 3];
+
+        result.push_back(face[0]);
+        result.push_back(face[1]);
+        result.push_back(face[2]);
+        emitted[bestFace] = true;
+
+        // the face vertices go to the front of the cache
+        int newCache[vertexCacheSize + 3];
+        int newCacheSize = 0;
+
+        for (int k = 0; k < 3; ++k)
+        {
+            const int v = face[k];
+
+            // remove the face from the active faces of the vertex, a
+            // degenerate face is listed once for each corner using the vertex
+            int* const begin = &faces[faceOffsets[v]];
+            int* const end = begin + numActiveFaces[v];
+            int* const p = std::find(begin, end, bestFace);
+
+            GRAPHICS_RUNTIME_ASSERT(p != end);
+
+            std::swap(*p, *(end - 1));
+            --numActiveFaces[v];
+
+            if (std::find(newCache, newCache + newCacheSize, v) == newCache + newCacheSize)
+            {
+                newCache[newCacheSize++] = v;
+            }
+        }
+
+        const int numFaceVertices = newCacheSize;
+
+        for (int j = 0; j < cacheSize; ++j)
+        {
+            const int v = cache[j];
+
+            if (std::find(newCache, newCache + numFaceVertices, v) == newCache + numFaceVertices)
+            {
+                newCache[newCacheSize++] = v;
+            }
+        }
+
+        // update the scores of the vertices whose cache position or active
+        // face count changed, vertices pushed out of the cache are included
+        for (int j = 0; j < newCacheSize; ++j)
+        {
+            const int v = newCache[j];
+            const int position = j < vertexCacheSize ? j : -1;
+            const float score = vertexScore(position, numActiveFaces[v]);
+            const float delta = score - vertexScores[v];
+
+            vertexScores[v] = score;
+
+            for (int k = 0; k < numActiveFaces[v]; ++k)
+            {
+                faceScores[faces[faceOffsets[v] + k]] += delta;
+            }
+        }
+
+        cacheSize = std::min(newCacheSize, vertexCacheSize);
+        std::copy(newCache, newCache + cacheSize, cache);
+
+        // the next face is the best face that uses a cached vertex
+        bestFace = -1;
+        float bestScore = -1.0f;
+
+        for (int j = 0; j < cacheSize; ++j)
+        {
+            const int v = cache[j];
+
+            for (int k = 0; k < numActiveFaces[v]; ++k)
+            {
+                const int f = faces[faceOffsets[v] + k];
+
+                if (emitted[f] == false && faceScores[f] > bestScore)
+                {
+                    bestFace = f;
+                    bestScore = faceScores[f];
+                }
+            }
+        }
+    }
+
+    indices_.swap(result);
+    invalidateBuffer();
+}
+
+void Mesh::optimizeVertexFetch()
+{
+    GRAPHICS_RUNTIME_ASSERT(hasClientData_);
+
+    std::vector<uint32_t> remap(vertices_.size(), unassigned);
+    std::vector<uint32_t> order;
+    order.reserve(vertices_.size());
+
+    // number the vertices in the order of first use
+    for (size_t i = 0; i < indices_.size(); ++i)
+    {
+        const uint32_t index = indices_[i];
+
+        if (remap[index] == unassigned)
+        {
+            remap[index] = order.size();
+            order.push_back(index);
+        }
+
+        indices_[i] = remap[index];
+    }
+
+    reorderVertices(order);
+    invalidateBuffer();
+}
+
 int Mesh::numFaces() const
 {
-    GRAPHICS_RUNTIME_ASSERT(vertices_.size() % 3 == 0);
-    return vertices_.size() / 3;
+    if (isIndexed())
+    {
+        GRAPHICS_RUNTIME_ASSERT(numIndices() % 3 == 0);
+        return numIndices() / 3;
+    }
+
+    GRAPHICS_RUNTIME_ASSERT(numVertices() % 3 == 0);
+    return numVertices() / 3;
+}
+
+int Mesh::numVertices() const
+{
+    if (hasClientData_)
+    {
+        return vertices_.size();
+    }
+
+    return numVertices_;
+}
+
+const Extents3 Mesh::extents() const
+{
+    if (hasClientData_)
+    {
+        return Extents3(vertices_.begin(), vertices_.end());
+    }
+
+    return extents_;
+}
+
+const Sphere Mesh::boundingSphere() const
+{
+    if (hasClientData_ == false)
+    {
+        return boundingSphere_;
+    }
+
+    if (vertices_.empty())
+    {
+        return Sphere(Vector3(0.0f, 0.0f, 0.0f), 0.0f);
+    }
+
+    return fitSphere(&vertices_[0], vertices_.size());
+}
+
+const Box3 Mesh::boundingBox() const
+{
+    if (hasClientData_ == false)
+    {
+        return boundingBox_;
+    }
+
+    if (vertices_.empty())
+    {
+        return Box3(Vector3(0.0f, 0.0f, 0.0f), Matrix3x3::identity(), Vector3(0.0f, 0.0f, 0.0f));
+    }
+
+    return fitBox(&vertices_[0], vertices_.size());
+}
+
+void Mesh::upload()
+{
+    if (bufferValid_)
+    {
+        // up to date, nothing to do
+        return;
+    }
+
+    GRAPHICS_RUNTIME_ASSERT(hasClientData_);
+    GRAPHICS_RUNTIME_ASSERT(vertices_.size() == normals_.size());
+    GRAPHICS_RUNTIME_ASSERT(vertices_.size() == tangents_.size());
+    GRAPHICS_RUNTIME_ASSERT(vertices_.size() == texCoords_.size());
+
+    if (bufferId_ == 0)
+    {
+        glGenBuffers(1, &bufferId_);
+    }
+
+    // the stream offsets may change, vertex array objects must be rebuilt
+    deleteVertexArrays();
+
+    const size_t n = vertices_.size();
+
+    // the coordinates are quantized against the extents at upload time
+    bufferFormat_ = effectiveVertexFormat();
+    extents_ = extents();
+
+    const size_t stride = bufferFormat_.vertexSize();
+    std::vector<uint8_t> data(n * stride);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        encodeVertex(i, &data[i * stride]);
+    }
+
+    // interleaved layout: coord, normal, tangent, texture coord
+    glBindBuffer(GL_ARRAY_BUFFER, bufferId_);
+    glBufferData(GL_ARRAY_BUFFER, data.size(), n > 0 ? &data[0] : 0, GL_STATIC_DRAW);
+
+    numVertices_ = n;
+    numIndices_ = indices_.size();
+
+    if (numIndices_ > 0)
+    {
+        if (indexBufferId_ == 0)
+        {
+            glGenBuffers(1, &indexBufferId_);
+        }
+
+        // uploaded through the array buffer binding, so the element array
+        // buffer binding of the current vertex array object is not changed
+        glBindBuffer(GL_ARRAY_BUFFER, indexBufferId_);
+
+        if (indexType() == GL_UNSIGNED_SHORT)
+        {
+            const std::vector<uint16_t> shortIndices(indices_.begin(), indices_.end());
+            glBufferData(GL_ARRAY_BUFFER, numIndices_ * sizeof(uint16_t), &shortIndices[0], GL_STATIC_DRAW);
+        }
+        else
+        {
+            glBufferData(GL_ARRAY_BUFFER, numIndices_ * sizeof(uint32_t), &indices_[0], GL_STATIC_DRAW);
+        }
+    }
+    else if (indexBufferId_ != 0)
+    {
+        glDeleteBuffers(1, &indexBufferId_);
+        indexBufferId_ = 0;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    uploadSerial_ = ++lastUploadSerial;
+    bufferValid_ = true;
+}
+
+void Mesh::bindVertexArray(const Program& program, StateCache& stateCache)
+{
+    upload();
+
+    const uint32_t programId = program.id();
+
+    for (size_t i = 0; i < vertexArrays_.size(); ++i)
+    {
+        if (vertexArrays_[i].programId == programId)
+        {
+            stateCache.bindVertexArray(vertexArrays_[i].id);
+            return;
+        }
+    }
+
+    // first use with this program, build a new vertex array object
+    VertexArray vertexArray;
+    vertexArray.programId = programId;
+    vertexArray.id = 0;
+
+    glGenVertexArrays(1, &vertexArray.id);
+    stateCache.bindVertexArray(vertexArray.id);
+    glBindBuffer(GL_ARRAY_BUFFER, bufferId_);
+
+    setAttributePointers(program, bufferFormat_);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (numIndices_ > 0)
+    {
+        // the element array buffer binding is stored in the vertex array
+        // object
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferId_);
+    }
+
+    vertexArrays_.push_back(vertexArray);
+}
+
+void Mesh::draw() const
+{
+    GRAPHICS_RUNTIME_ASSERT(bufferValid_);
+
+    if (numIndices_ > 0)
+    {
+        glDrawElements(GL_TRIANGLES, numIndices_, indexType(), 0);
+    }
+    else
+    {
+        glDrawArrays(GL_TRIANGLES, 0, numVertices_);
+    }
+}
+
+void Mesh::drawInstanced(const int numInstances) const
+{
+    GRAPHICS_RUNTIME_ASSERT(bufferValid_);
+    GRAPHICS_RUNTIME_ASSERT(numInstances > 0);
+
+    if (numIndices_ > 0)
+    {
+        glDrawElementsInstanced(GL_TRIANGLES, numIndices_, indexType(), 0, numInstances);
+    }
+    else
+    {
+        glDrawArraysInstanced(GL_TRIANGLES, 0, numVertices_, numInstances);
+    }
+}
+
+uint32_t Mesh::bufferId() const
+{
+    return bufferId_;
+}
+
+uint32_t Mesh::indexBufferId() const
+{
+    return indexBufferId_;
+}
+
+const VertexFormat Mesh::bufferFormat() const
+{
+    return bufferFormat_;
+}
+
+uint32_t Mesh::indexType() const
+{
+    return numVertices_ <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+uint32_t Mesh::uploadSerial() const
+{
+    return uploadSerial_;
+}
+
+void Mesh::setAttributePointers(const Program& program, const VertexFormat& format)
+{
+    const VertexFormat& f = format;
+    const bool coordFloat = f.position == PositionFormat::Float;
+    const bool normalFloat = f.normal == DirectionFormat::Float;
+    const bool tangentFloat = f.tangent == DirectionFormat::Float;
+
+    const GLenum coordType = coordFloat ? GL_FLOAT : GL_UNSIGNED_SHORT;
+    const GLenum normalType = normalFloat ? GL_FLOAT : GL_INT_2_10_10_10_REV;
+    const GLenum tangentType = tangentFloat ? GL_FLOAT : GL_INT_2_10_10_10_REV;
+    GLenum texCoordType = GL_FLOAT;
+
+    if (f.texCoord == TexCoordFormat::HalfFloat)
+    {
+        texCoordType = GL_HALF_FLOAT;
+    }
+    else if (f.texCoord == TexCoordFormat::UNorm16)
+    {
+        texCoordType = GL_UNSIGNED_SHORT;
+    }
+
+    const uint32_t nameHashes[] = { coordId, normalId, tangentId, texCoordId };
+
+    const GLint sizes[] = {
+        3,
+        normalFloat ? 3 : 4,
+        tangentFloat ? 3 : 4,
+        2
+    };
+
+    const GLenum types[] = {
+        coordType,
+        normalType,
+        tangentType,
+        texCoordType
+    };
+
+    const GLboolean normalized[] = {
+        coordFloat == false,
+        normalFloat == false,
+        tangentFloat == false,
+        f.texCoord == TexCoordFormat::UNorm16
+    };
+
+    const int offsets[] = {
+        0,
+        f.normalOffset(),
+        f.tangentOffset(),
+        f.texCoordOffset()
+    };
+
+    for (int i = 0; i < 4; ++i)
+    {
+        const GLint location = program.attributeLocation(nameHashes[i]);
+
+        if (location != -1)
+        {
+            glVertexAttribPointer(
+                location,
+                sizes[i],
+                types[i],
+                normalized[i],
+                f.vertexSize(),
+                reinterpret_cast<const GLvoid*>(offsets[i])
+            );
+
+            glEnableVertexAttribArray(location);
+        }
+    }
+}
+
+void Mesh::releaseClientData()
+{
+    if (hasClientData_ == false)
+    {
+        // already released, nothing to do
+        return;
+    }
+
+    upload();
+
+    extents_ = extents();
+    boundingSphere_ = boundingSphere();
+    boundingBox_ = boundingBox();
+    numVertices_ = vertices_.size();
+    numIndices_ = indices_.size();
+    hasClientData_ = false;
+
+    // swap with empty arrays to release the memory
+    std::vector<Vector3>().swap(vertices_);
+    std::vector<Vector3>().swap(normals_);
+    std::vector<Vector3>().swap(tangents_);
+    std::vector<Vector2>().swap(texCoords_);
+    std::vector<uint32_t>().swap(indices_);
+}
+
+bool Mesh::hasClientData() const
+{
+    return hasClientData_;
 }
 
 void Mesh::generateFlatNormals()
 {
+    GRAPHICS_RUNTIME_ASSERT(hasClientData_);
+    GRAPHICS_RUNTIME_ASSERT(indices_.empty());
+    invalidateBuffer();
+
     if (vertices_.size() != normals_.size())
     {
         normals_.resize(vertices_.size());
@@ -161,6 +1022,20 @@ void Mesh::swap(Mesh& other)
     normals_.swap(other.normals_);
     tangents_.swap(other.tangents_);
     texCoords_.swap(other.texCoords_);
+    indices_.swap(other.indices_);
+    vertexFormat_.swap(other.vertexFormat_);
+    bufferFormat_.swap(other.bufferFormat_);
+    extents_.swap(other.extents_);
+    boundingSphere_.swap(other.boundingSphere_);
+    boundingBox_.swap(other.boundingBox_);
+    std::swap(numVertices_, other.numVertices_);
+    std::swap(numIndices_, other.numIndices_);
+    std::swap(hasClientData_, other.hasClientData_);
+    std::swap(bufferValid_, other.bufferValid_);
+    std::swap(bufferId_, other.bufferId_);
+    std::swap(indexBufferId_, other.indexBufferId_);
+    std::swap(uploadSerial_, other.uploadSerial_);
+    vertexArrays_.swap(other.vertexArrays_);
 }
 
 const Vector3 Mesh::faceNormal(const int index) const
@@ -177,3 +1052,134 @@ const Vector3 Mesh::faceNormal(const int index) const
     // calculating the normal vector?
     return normalize(cross(v1 - v0, v2 - v0));
 }
+
+void Mesh::invalidateBuffer()
+{
+    bufferValid_ = false;
+}
+
+void Mesh::deleteVertexArrays()
+{
+    for (size_t i = 0; i < vertexArrays_.size(); ++i)
+    {
+        glDeleteVertexArrays(1, &vertexArrays_[i].id);
+    }
+
+    vertexArrays_.clear();
+}
+
+void Mesh::reorderVertices(const std::vector<uint32_t>& order)
+{
+    const size_t n = order.size();
+
+    std::vector<Vector3> vertices(n);
+    std::vector<Vector3> normals(n);
+    std::vector<Vector3> tangents(n);
+    std::vector<Vector2> texCoords(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const uint32_t index = order[i];
+
+        vertices[i] = vertices_[index];
+        normals[i] = normals_[index];
+        tangents[i] = tangents_[index];
+        texCoords[i] = texCoords_[index];
+    }
+
+    vertices_.swap(vertices);
+    normals_.swap(normals);
+    tangents_.swap(tangents);
+    texCoords_.swap(texCoords);
+}
+
+const VertexFormat Mesh::effectiveVertexFormat() const
+{
+    VertexFormat format = vertexFormat_;
+
+    if (format.texCoord == TexCoordFormat::UNorm16)
+    {
+        for (size_t i = 0; i < texCoords_.size(); ++i)
+        {
+            const Vector2 t = texCoords_[i];
+
+            if (t.x < 0.0f || t.x > 1.0f || t.y < 0.0f || t.y > 1.0f)
+            {
+                // cannot be represented, fall back to half floats
+                format.texCoord = TexCoordFormat::HalfFloat;
+                break;
+            }
+        }
+    }
+
+    return format;
+}
+
+void Mesh::encodeVertex(const int index, uint8_t* const p) const
+{
+    const VertexFormat& f = bufferFormat_;
+
+    if (f.position == PositionFormat::Float)
+    {
+        std::memcpy(p, vertices_[index].data(), sizeof(Vector3));
+    }
+    else
+    {
+        const Vector3 v = vertices_[index] - extents_.min;
+        const Vector3 size = extents_.max - extents_.min;
+
+        const uint16_t coord[] = {
+            VertexFormat::encodeUNorm16(size.x > 0.0f ? v.x / size.x : 0.0f),
+            VertexFormat::encodeUNorm16(size.y > 0.0f ? v.y / size.y : 0.0f),
+            VertexFormat::encodeUNorm16(size.z > 0.0f ? v.z / size.z : 0.0f),
+            0
+        };
+
+        std::memcpy(p, coord, sizeof(coord));
+    }
+
+    const Vector3* const directions[] = { &normals_[index], &tangents_[index] };
+    const DirectionFormat::Enum directionFormats[] = { f.normal, f.tangent };
+    const int directionOffsets[] = { f.normalOffset(), f.tangentOffset() };
+
+    for (int i = 0; i < 2; ++i)
+    {
+        uint8_t* const q = p + directionOffsets[i];
+
+        if (directionFormats[i] == DirectionFormat::Float)
+        {
+            std::memcpy(q, directions[i]->data(), sizeof(Vector3));
+        }
+        else
+        {
+            const uint32_t packed = VertexFormat::encodeDirection(*directions[i]);
+            std::memcpy(q, &packed, sizeof(packed));
+        }
+    }
+
+    const Vector2 t = texCoords_[index];
+    uint8_t* const q = p + f.texCoordOffset();
+
+    if (f.texCoord == TexCoordFormat::Float)
+    {
+        std::memcpy(q, t.data(), sizeof(Vector2));
+    }
+    else if (f.texCoord == TexCoordFormat::HalfFloat)
+    {
+        const uint16_t texCoord[] = {
+            VertexFormat::encodeHalf(t.x),
+            VertexFormat::encodeHalf(t.y)
+        };
+
+        std::memcpy(q, texCoord, sizeof(texCoord));
+    }
+    else
+    {
+        const uint16_t texCoord[] = {
+            VertexFormat::encodeUNorm16(t.x),
+            VertexFormat::encodeUNorm16(t.y)
+        };
+
+        std::memcpy(q, texCoord, sizeof(texCoord));
+    }
+}
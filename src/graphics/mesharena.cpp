@@ -0,0 +1,293 @@
+/**
+ * @file graphics/mesharena.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/mesharena.h>
+
+#include <graphics/mesh.h>
+#include <graphics/opengl.h>
+#include <graphics/program.h>
+#include <graphics/runtimeassert.h>
+#include <graphics/statecache.h>
+
+namespace {
+
+// initial buffer size in bytes
+const size_t initialCapacity = 1024 * 1024;
+
+bool isSameFormat(const VertexFormat& a, const VertexFormat& b)
+{
+    return a.position == b.position
+        && a.normal == b.normal
+        && a.tangent == b.tangent
+        && a.texCoord == b.texCoord;
+}
+
+} // namespace
+
+MeshArena::~MeshArena()
+{
+    for (size_t i = 0; i < pools_.size(); ++i)
+    {
+        Pool& pool = pools_[i];
+
+        for (size_t j = 0; j < pool.vertexArrays.size(); ++j)
+        {
+            glDeleteVertexArrays(1, &pool.vertexArrays[j].id);
+        }
+
+        glDeleteBuffers(1, &pool.vertexBufferId);
+        glDeleteBuffers(1, &pool.indexBufferId);
+    }
+}
+
+MeshArena::MeshArena()
+:   pools_(),
+    entries_()
+{
+    // ...
+}
+
+bool MeshArena::isMultiDrawSupported()
+{
+    return GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+}
+
+const MeshArena::Range* MeshArena::place(Mesh& mesh)
+{
+    mesh.upload();
+
+    if (mesh.isIndexed() == false)
+    {
+        return 0;
+    }
+
+    EntryMap::iterator i = entries_.find(&mesh);
+
+    if (i != entries_.end() && i->second.uploadSerial == mesh.uploadSerial())
+    {
+        // up to date
+        return &i->second.range;
+    }
+
+    const VertexFormat format = mesh.bufferFormat();
+    const uint32_t indexType = mesh.indexType();
+    const size_t stride = format.vertexSize();
+    const size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    const int poolIndex = findPool(format, indexType);
+    Pool& pool = pools_[poolIndex];
+
+    const size_t vertexDataSize = mesh.numVertices() * stride;
+    const size_t indexDataSize = mesh.numIndices() * indexSize;
+
+    const bool vertexBufferGrown = reserve(pool.vertexBufferId, pool.vertexCapacity, pool.vertexSize, pool.vertexSize + vertexDataSize);
+    const bool indexBufferGrown = reserve(pool.indexBufferId, pool.indexCapacity, pool.indexSize, pool.indexSize + indexDataSize);
+
+    if (vertexBufferGrown || indexBufferGrown)
+    {
+        // the vertex array objects refer to the old buffer objects
+        pool.vertexArraysValid = false;
+    }
+
+    // the copy bindings do not affect the vertex array object state
+    glBindBuffer(GL_COPY_READ_BUFFER, mesh.bufferId());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pool.vertexBufferId);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, pool.vertexSize, vertexDataSize);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, mesh.indexBufferId());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pool.indexBufferId);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, pool.indexSize, indexDataSize);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    Entry entry;
+    entry.range.pool = poolIndex;
+    entry.range.baseVertex = pool.vertexSize / stride;
+    entry.range.firstIndex = pool.indexSize / indexSize;
+    entry.range.numIndices = mesh.numIndices();
+    entry.uploadSerial = mesh.uploadSerial();
+
+    pool.vertexSize += vertexDataSize;
+    pool.indexSize += indexDataSize;
+
+    Entry& stored = entries_[&mesh];
+    stored = entry;
+
+    return &stored.range;
+}
+
+void MeshArena::bindVertexArray(
+    const int poolIndex,
+    const Program& program,
+    StateCache& stateCache)
+{
+    GRAPHICS_RUNTIME_ASSERT(poolIndex >= 0 && poolIndex < numPools());
+
+    Pool& pool = pools_[poolIndex];
+
+    if (pool.vertexArraysValid == false)
+    {
+        deleteVertexArrays(pool, stateCache);
+        pool.vertexArraysValid = true;
+    }
+
+    const uint32_t programId = program.id();
+
+    for (size_t i = 0; i < pool.vertexArrays.size(); ++i)
+    {
+        if (pool.vertexArrays[i].programId == programId)
+        {
+            stateCache.bindVertexArray(pool.vertexArrays[i].id);
+            return;
+        }
+    }
+
+    // first use with this program, build a new vertex array object
+    VertexArray vertexArray;
+    vertexArray.programId = programId;
+    vertexArray.id = 0;
+
+    glGenVertexArrays(1, &vertexArray.id);
+    stateCache.bindVertexArray(vertexArray.id);
+
+    glBindBuffer(GL_ARRAY_BUFFER, pool.vertexBufferId);
+    Mesh::setAttributePointers(program, pool.format);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // the element array buffer binding is stored in the vertex array object
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indexBufferId);
+
+    pool.vertexArrays.push_back(vertexArray);
+}
+
+uint32_t MeshArena::indexType(const int pool) const
+{
+    GRAPHICS_RUNTIME_ASSERT(pool >= 0 && pool < numPools());
+    return pools_[pool].indexType;
+}
+
+int MeshArena::numPools() const
+{
+    return pools_.size();
+}
+
+int MeshArena::numMeshes() const
+{
+    return entries_.size();
+}
+
+size_t MeshArena::dataSize() const
+{
+    size_t size = 0;
+
+    for (size_t i = 0; i < pools_.size(); ++i)
+    {
+        size += pools_[i].vertexSize + pools_[i].indexSize;
+    }
+
+    return size;
+}
+
+void MeshArena::clear(StateCache& stateCache)
+{
+    for (size_t i = 0; i < pools_.size(); ++i)
+    {
+        deleteVertexArrays(pools_[i], stateCache);
+        glDeleteBuffers(1, &pools_[i].vertexBufferId);
+        glDeleteBuffers(1, &pools_[i].indexBufferId);
+    }
+
+    pools_.clear();
+    entries_.clear();
+}
+
+int MeshArena::findPool(const VertexFormat& format, const uint32_t indexType)
+{
+    for (size_t i = 0; i < pools_.size(); ++i)
+    {
+        if (pools_[i].indexType == indexType && isSameFormat(pools_[i].format, format))
+        {
+            return i;
+        }
+    }
+
+    Pool pool;
+    pool.format = format;
+    pool.indexType = indexType;
+    pool.vertexBufferId = 0;
+    pool.indexBufferId = 0;
+    pool.vertexCapacity = 0;
+    pool.indexCapacity = 0;
+    pool.vertexSize = 0;
+    pool.indexSize = 0;
+    pool.vertexArraysValid = true;
+
+    pools_.push_back(pool);
+
+    return pools_.size() - 1;
+}
+
+bool MeshArena::reserve(
+    uint32_t& id,
+    size_t& capacity,
+    const size_t used,
+    const size_t required)
+{
+    if (id != 0 && required <= capacity)
+    {
+        // fits
+        return false;
+    }
+
+    size_t newCapacity = capacity > 0 ? capacity : initialCapacity;
+
+    while (newCapacity < required)
+    {
+        newCapacity *= 2;
+    }
+
+    GLuint newId = 0;
+    glGenBuffers(1, &newId);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newId);
+    glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, 0, GL_STATIC_DRAW);
+
+    if (id != 0)
+    {
+        if (used > 0)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, id);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+
+        glDeleteBuffers(1, &id);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    id = newId;
+    capacity = newCapacity;
+
+    return true;
+}
+
+void MeshArena::deleteVertexArrays(Pool& pool, StateCache& stateCache)
+{
+    if (pool.vertexArrays.empty())
+    {
+        return;
+    }
+
+    // a deleted vertex array object may be bound, and its name may be reused
+    stateCache.bindVertexArray(0);
+
+    for (size_t i = 0; i < pool.vertexArrays.size(); ++i)
+    {
+        glDeleteVertexArrays(1, &pool.vertexArrays[i].id);
+    }
+
+    pool.vertexArrays.clear();
+}
@@ -5,14 +5,155 @@
 
 #include <graphics/meshnode.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <geometry/matrix4x4.h>
 
 #include <graphics/drawparams.h>
 #include <graphics/groupnode.h>
+#include <graphics/instancebuffer.h>
 #include <graphics/mesh.h>
+#include <graphics/mesharena.h>
+#include <graphics/occlusionbuffer.h>
 #include <graphics/opengl.h>
+#include <graphics/predrawparams.h>
 #include <graphics/program.h>
+#include <graphics/renderqueue.h>
 #include <graphics/runtimeassert.h>
+#include <graphics/sortkey.h>
+#include <graphics/statecache.h>
+#include <graphics/uniformblocks.h>
+#include <graphics/visibilitytest.h>
+
+namespace {
+
+// uniform name hashes
+const uint32_t diffuseMapId = Program::hashName("diffuseMap");
+const uint32_t specularMapId = Program::hashName("specularMap");
+const uint32_t glowMapId = Program::hashName("glowMap");
+const uint32_t normalMapId = Program::hashName("normalMap");
+const uint32_t modelViewMatrixId = Program::hashName("modelViewMatrix");
+const uint32_t projectionMatrixId = Program::hashName("projectionMatrix");
+const uint32_t normalMatrixId = Program::hashName("normalMatrix");
+
+// per-instance attribute name hashes
+const uint32_t instanceModelViewMatrixId = Program::hashName("instanceModelViewMatrix");
+const uint32_t instanceNormalMatrixId = Program::hashName("instanceNormalMatrix");
+
+// per-instance data size in bytes, a 4x4 model view matrix followed by a 3x3
+// normal matrix
+const size_t instanceSize = (16 + 9) * sizeof(float);
+
+// glMultiDrawElementsIndirect command layout
+struct DrawElementsIndirectCommand
+{
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+void setProjectionUniform(const DrawParams& params)
+{
+    const GLint location = params.program->uniformLocation(projectionMatrixId);
+
+    if (location != -1)
+    {
+        // the program does not take the projection from the camera block
+        glUniformMatrix4fv(location, 1, false, params.projectionMatrix.data());
+    }
+}
+
+// writes the per-instance matrices of the node at a given index of a run,
+// returns the next write position
+float* writeInstance(
+    float* const data,
+    const DrawParams& params,
+    const GeometryNode& node,
+    const int index,
+    const Matrix4x4& decodeMatrix)
+{
+    const Transform3 worldTransform = params.worldTransform(node, index);
+    const Matrix4x4 modelViewMatrix = decodeMatrix * toMatrix4x4(transformByInverse(worldTransform, params.cameraToWorld));
+    const Matrix3x3 normalMatrix = worldTransform.rotation * params.worldToViewRotation;
+
+    std::copy(modelViewMatrix.data(), modelViewMatrix.data() + 16, data);
+    std::copy(normalMatrix.data(), normalMatrix.data() + 9, data + 16);
+
+    return data + instanceSize / sizeof(float);
+}
+
+// points the per-instance attributes of the bound vertex array object to a
+// block of the instance buffer, the instance attributes are stored in the
+// vertex array object but the block offset changes from run to run
+void setInstanceAttributes(
+    const GLint modelViewMatrixLocation,
+    const GLint normalMatrixLocation,
+    const InstanceBuffer& instanceBuffer,
+    const size_t offset)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer.id());
+
+    for (int i = 0; i < 4; ++i)
+    {
+        const GLuint location = modelViewMatrixLocation + i;
+        glVertexAttribPointer(
+            location,
+            4,
+            GL_FLOAT,
+            false,
+            instanceSize,
+            reinterpret_cast<const GLvoid*>(offset + i * 4 * sizeof(float))
+        );
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        const GLuint location = normalMatrixLocation + i;
+        glVertexAttribPointer(
+            location,
+            3,
+            GL_FLOAT,
+            false,
+            instanceSize,
+            reinterpret_cast<const GLvoid*>(offset + (16 + i * 3) * sizeof(float))
+        );
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// sets the per-instance attributes of the bound vertex array object to
+// constant values for a single node, the attribute arrays left enabled by an
+// instanced draw would override the constant values
+void setInstanceConstants(
+    const GLint modelViewMatrixLocation,
+    const GLint normalMatrixLocation,
+    const Matrix4x4& modelViewMatrix,
+    const Matrix3x3& normalMatrix)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        const GLuint location = modelViewMatrixLocation + i;
+        glDisableVertexAttribArray(location);
+        glVertexAttrib4fv(location, modelViewMatrix.data() + i * 4);
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        const GLuint location = normalMatrixLocation + i;
+        glDisableVertexAttribArray(location);
+        glVertexAttrib3fv(location, normalMatrix.data() + i * 3);
+    }
+}
+
+} // namespace
 
 MeshNode::~MeshNode()
 {
@@ -25,10 +166,17 @@ MeshNode::MeshNode()
     specularMap(0),
     glowMap(0),
     normalMap(0),
+    occluder(false),
     worldExtentsValid_(false),
     worldExtents_(),
+    worldSphere_(),
+    worldBox_(),
     modelExtents_(),
-    mesh_(0)
+    modelSphere_(),
+    modelBox_(),
+    mesh_(0),
+    lods_(),
+    lod_(0)
 {
     // ...
 }
@@ -39,10 +187,17 @@ MeshNode::MeshNode(const MeshNode& other)
     specularMap(other.specularMap),
     glowMap(other.glowMap),
     normalMap(other.normalMap),
+    occluder(other.occluder),
     worldExtentsValid_(false),
     worldExtents_(),
+    worldSphere_(),
+    worldBox_(),
     modelExtents_(other.modelExtents_),
-    mesh_(other.mesh_)
+    modelSphere_(other.modelSphere_),
+    modelBox_(other.modelBox_),
+    mesh_(other.mesh_),
+    lods_(other.lods_),
+    lod_(other.lod_)
 {
     // ...
 }
@@ -51,13 +206,39 @@ void MeshNode::updateModelExtents()
 {
     GRAPHICS_RUNTIME_ASSERT(mesh_ != 0);
 
-    const std::vector<Vector3>& vertices = mesh_->vertices();
-    modelExtents_ = Extents3(vertices.begin(), vertices.end());
+    modelExtents_ = mesh_->extents();
+    modelSphere_ = mesh_->boundingSphere();
+    modelBox_ = mesh_->boundingBox();
     invalidateWorldExtents();
 }
 
+const Sphere MeshNode::worldBoundingSphere() const
+{
+    if (worldExtentsValid_ == false)
+    {
+        updateWorldExtents();
+    }
+
+    return worldSphere_;
+}
+
+const Box3 MeshNode::worldBoundingBox() const
+{
+    if (worldExtentsValid_ == false)
+    {
+        updateWorldExtents();
+    }
+
+    return worldBox_;
+}
+
 void MeshNode::setMesh(Mesh* const p)
 {
+    if (p != mesh_)
+    {
+        releaseImpostor();
+    }
+
     mesh_ = p;
 }
 
@@ -66,11 +247,79 @@ Mesh* MeshNode::mesh() const
     return mesh_;
 }
 
+void MeshNode::addLod(Mesh* const p, const float switchSize)
+{
+    GRAPHICS_RUNTIME_ASSERT(p != 0);
+    GRAPHICS_RUNTIME_ASSERT(switchSize > 0.0f);
+    GRAPHICS_RUNTIME_ASSERT(lods_.empty() || switchSize < lods_.back().switchSize);
+
+    Lod lod;
+    lod.mesh = p;
+    lod.switchSize = switchSize;
+
+    lods_.push_back(lod);
+}
+
+void MeshNode::clearLods()
+{
+    lods_.clear();
+    lod_ = 0;
+}
+
+int MeshNode::numLods() const
+{
+    return lods_.size() + 1;
+}
+
+Mesh* MeshNode::lodMesh(const int lod) const
+{
+    GRAPHICS_RUNTIME_ASSERT(lod >= 0 && lod < numLods());
+    return lod == 0 ? mesh_ : lods_[lod - 1].mesh;
+}
+
+float MeshNode::lodSwitchSize(const int lod) const
+{
+    GRAPHICS_RUNTIME_ASSERT(lod > 0 && lod < numLods());
+    return lods_[lod - 1].switchSize;
+}
+
+int MeshNode::currentLod() const
+{
+    return lod_;
+}
+
+Mesh* MeshNode::currentMesh() const
+{
+    return lod_ == 0 ? mesh_ : lods_[lod_ - 1].mesh;
+}
+
 MeshNode* MeshNode::clone() const
 {
     return new MeshNode(*this);
 }
 
+void MeshNode::predraw(
+    const PredrawParams& params,
+    uint32_t planeMask) const
+{
+    if (testVisibility(params, planeMask) == false)
+    {
+        return;
+    }
+
+    RenderQueue& renderQueue = *params.renderQueue();
+
+    if (lods_.empty() == false)
+    {
+        // the material key of the node depends on the selected mesh, so the
+        // level of detail is selected before the node is added
+        selectLod(renderQueue.projectedSize(worldExtents()), renderQueue.lodHysteresis());
+    }
+
+    renderQueue.addGeometryNode(this);
+    renderQueue.countLod(lod_);
+}
+
 const Extents3 MeshNode::worldExtents() const
 {
     if (worldExtentsValid_ == false)
@@ -105,110 +354,333 @@ void MeshNode::invalidateWorldTransform() const
 
 void MeshNode::draw(const DrawParams& params) const
 {
-    GRAPHICS_RUNTIME_ASSERT(mesh_ != 0);
+    Mesh* const mesh = currentMesh();
+
+    GRAPHICS_RUNTIME_ASSERT(mesh != 0);
+    GRAPHICS_RUNTIME_ASSERT(params.stateCache != 0);
+
+    bindMaps(params);
+
+    // uploads the vertex data on first use or after the mesh was changed
+    mesh->bindVertexArray(*params.program, *params.stateCache);
 
-    const std::vector<Vector3>& coords = mesh_->vertices();
-    const std::vector<Vector3>& normals = mesh_->normals();
-    const std::vector<Vector3>& tangents = mesh_->tangents();
-    const std::vector<Vector2>& texCoords = mesh_->texCoords();
+    // the decode matrix maps quantized vertex coordinates to model space
+    const Transform3 worldTransform = params.worldTransform(*this, 0);
+    const Matrix4x4 modelViewMatrix = mesh->decodeMatrix() * toMatrix4x4(transformByInverse(worldTransform, params.cameraToWorld));
+    const Matrix3x3 normalMatrix = worldTransform.rotation * params.worldToViewRotation;
 
-    GRAPHICS_RUNTIME_ASSERT(coords.size() == normals.size());
-    GRAPHICS_RUNTIME_ASSERT(coords.size() == tangents.size());
-    GRAPHICS_RUNTIME_ASSERT(coords.size() == texCoords.size());
+    const GLint instanceModelViewMatrixLocation = params.program->attributeLocation(instanceModelViewMatrixId);
+    const GLint instanceNormalMatrixLocation = params.program->attributeLocation(instanceNormalMatrixId);
+
+    if (instanceModelViewMatrixLocation != -1 && instanceNormalMatrixLocation != -1)
+    {
+        // the program takes the matrices as per-instance attributes, a single
+        // node sets them as constant attribute values
+        setProjectionUniform(params);
+        setInstanceConstants(
+            instanceModelViewMatrixLocation,
+            instanceNormalMatrixLocation,
+            modelViewMatrix,
+            normalMatrix
+        );
+    }
+    else if (params.uniformBuffer != 0 && UniformBlocks::hasObjectBlock(*params.program))
+    {
+        // the projection matrix comes from the camera block
+        UniformBlocks::setObjectBlock(params, modelViewMatrix, normalMatrix);
+    }
+    else
+    {
+        glUniformMatrix4fv(
+            params.program->uniformLocation(modelViewMatrixId),
+            1,
+            false,
+            modelViewMatrix.data()
+        );
+
+        glUniformMatrix4fv(
+            params.program->uniformLocation(projectionMatrixId),
+            1,
+            false,
+            params.projectionMatrix.data()
+        );
+
+        glUniformMatrix3fv(
+            params.program->uniformLocation(normalMatrixId),
+            1,
+            false,
+            normalMatrix.data()
+        );
+    }
+
+    mesh->draw();
+}
+
+bool MeshNode::isInstanceCompatible(const GeometryNode& other) const
+{
+    const MeshNode* const p = dynamic_cast<const MeshNode*>(&other);
+
+    return p != 0
+        && p->currentMesh() == currentMesh()
+        && p->diffuseMap == diffuseMap
+        && p->specularMap == specularMap
+        && p->glowMap == glowMap
+        && p->normalMap == normalMap;
+}
 
+void MeshNode::drawInstanced(
+    const DrawParams& params,
+    const GeometryNode* const* const nodes,
+    const int numNodes) const
+{
+    Mesh* const mesh = currentMesh();
+
+    GRAPHICS_RUNTIME_ASSERT(mesh != 0);
+    GRAPHICS_RUNTIME_ASSERT(params.stateCache != 0);
+    GRAPHICS_RUNTIME_ASSERT(nodes != 0 && numNodes > 0);
+    GRAPHICS_RUNTIME_ASSERT(nodes[0] == this);
+
+    const GLint modelViewMatrixLocation = params.program->attributeLocation(instanceModelViewMatrixId);
+    const GLint normalMatrixLocation = params.program->attributeLocation(instanceNormalMatrixId);
+
+    if (modelViewMatrixLocation == -1
+    ||  normalMatrixLocation == -1
+    ||  params.instanceBuffer == 0)
+    {
+        // the program takes the matrices as uniforms
+        GeometryNode::drawInstanced(params, nodes, numNodes);
+        return;
+    }
+
+    bindMaps(params);
+    setProjectionUniform(params);
+
+    // uploads the vertex data on first use or after the mesh was changed
+    mesh->bindVertexArray(*params.program, *params.stateCache);
+
+    // the decode matrix maps quantized vertex coordinates to model space
+    const Matrix4x4 decodeMatrix = mesh->decodeMatrix();
+
+    // stream the per-instance matrices
+    float* data = static_cast<float*>(
+        params.instanceBuffer->map(numNodes * instanceSize)
+    );
+
+    for (int i = 0; i < numNodes; ++i)
+    {
+        data = writeInstance(data, params, *nodes[i], i, decodeMatrix);
+    }
+
+    const size_t offset = params.instanceBuffer->unmap();
+
+    setInstanceAttributes(modelViewMatrixLocation, normalMatrixLocation, *params.instanceBuffer, offset);
+
+    mesh->drawInstanced(numNodes);
+}
+
+bool MeshNode::isMultiDrawCompatible(const GeometryNode& other) const
+{
+    const MeshNode* const p = dynamic_cast<const MeshNode*>(&other);
+
+    return p != 0
+        && p->diffuseMap == diffuseMap
+        && p->specularMap == specularMap
+        && p->glowMap == glowMap
+        && p->normalMap == normalMap;
+}
+
+void MeshNode::drawMultiDraw(
+    const DrawParams& params,
+    const GeometryNode* const* const nodes,
+    const int numNodes) const
+{
+    GRAPHICS_RUNTIME_ASSERT(params.stateCache != 0);
+    GRAPHICS_RUNTIME_ASSERT(nodes != 0 && numNodes > 0);
+    GRAPHICS_RUNTIME_ASSERT(nodes[0] == this);
+
+    const GLint modelViewMatrixLocation = params.program->attributeLocation(instanceModelViewMatrixId);
+    const GLint normalMatrixLocation = params.program->attributeLocation(instanceNormalMatrixId);
+
+    if (modelViewMatrixLocation == -1
+    ||  normalMatrixLocation == -1
+    ||  params.instanceBuffer == 0
+    ||  params.commandBuffer == 0
+    ||  params.meshArena == 0)
+    {
+        // draw the instance compatible runs separately
+        GeometryNode::drawMultiDraw(params, nodes, numNodes);
+        return;
+    }
+
+    // place the meshes in the shared storage, the run consists of mesh nodes
+    // only
+    std::vector<const MeshArena::Range*> ranges(numNodes);
+    std::vector<int> pools;
+    pools.reserve(params.meshArena->numPools());
+
+    for (int i = 0; i < numNodes; ++i)
+    {
+        const MeshNode* const node = static_cast<const MeshNode*>(nodes[i]);
+        GRAPHICS_RUNTIME_ASSERT(node->currentMesh() != 0);
+
+        const MeshArena::Range* const range = params.meshArena->place(*node->currentMesh());
+        ranges[i] = range;
+
+        if (range == 0)
+        {
+            // not indexed, cannot be placed in the shared storage
+            node->draw(params.offset(i));
+        }
+        else if (std::find(pools.begin(), pools.end(), range->pool) == pools.end())
+        {
+            pools.push_back(range->pool);
+        }
+    }
+
+    if (pools.empty())
+    {
+        return;
+    }
+
+    bindMaps(params);
+    setProjectionUniform(params);
+
+    // one submission per pool, the run usually uses a single pool
+    for (size_t p = 0; p < pools.size(); ++p)
+    {
+        const int pool = pools[p];
+
+        int numInstances = 0;
+        int numCommands = 0;
+
+        for (int i = 0; i < numNodes; ++i)
+        {
+            if (ranges[i] != 0 && ranges[i]->pool == pool)
+            {
+                ++numInstances;
+
+                if (i == 0 || ranges[i] != ranges[i - 1])
+                {
+                    ++numCommands;
+                }
+            }
+        }
+
+        float* data = static_cast<float*>(
+            params.instanceBuffer->map(numInstances * instanceSize)
+        );
+
+        // the base instance selects the matrices of each command from the
+        // instance block
+        for (int i = 0; i < numNodes; ++i)
+        {
+            if (ranges[i] != 0 && ranges[i]->pool == pool)
+            {
+                const MeshNode* const node = static_cast<const MeshNode*>(nodes[i]);
+                data = writeInstance(data, params, *node, i, node->currentMesh()->decodeMatrix());
+            }
+        }
+
+        const size_t instanceOffset = params.instanceBuffer->unmap();
+
+        DrawElementsIndirectCommand* command = static_cast<DrawElementsIndirectCommand*>(
+            params.commandBuffer->map(numCommands * sizeof(DrawElementsIndirectCommand))
+        );
+
+        uint32_t baseInstance = 0;
+
+        for (int i = 0; i < numNodes; ++i)
+        {
+            const MeshArena::Range* const range = ranges[i];
+
+            if (range == 0 || range->pool != pool)
+            {
+                continue;
+            }
+
+            // adjacent mesh nodes with the same mesh share a command
+            int j = i + 1;
+
+            while (j < numNodes && ranges[j] == range)
+            {
+                ++j;
+            }
+
+            command->count = range->numIndices;
+            command->instanceCount = j - i;
+            command->firstIndex = range->firstIndex;
+            command->baseVertex = range->baseVertex;
+            command->baseInstance = baseInstance;
+            ++command;
+
+            baseInstance += j - i;
+            i = j - 1;
+        }
+
+        const size_t commandOffset = params.commandBuffer->unmap();
+
+        params.meshArena->bindVertexArray(pool, *params.program, *params.stateCache);
+        setInstanceAttributes(modelViewMatrixLocation, normalMatrixLocation, *params.instanceBuffer, instanceOffset);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, params.commandBuffer->id());
+        glMultiDrawElementsIndirect(
+            GL_TRIANGLES,
+            params.meshArena->indexType(pool),
+            reinterpret_cast<const GLvoid*>(commandOffset),
+            numCommands,
+            0
+        );
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+}
+
+void MeshNode::rasterizeOccluder(OcclusionBuffer& buffer) const
+{
+    if (occluder && currentMesh() != 0 && currentMesh()->hasClientData())
+    {
+        buffer.addOccluder(*currentMesh(), worldTransform());
+    }
+}
+
+void MeshNode::bindMaps(const DrawParams& params) const
+{
     // begin super hack
-    const GLint _diffuseMapLocation = glGetUniformLocation(params.program->id(), "diffuseMap");
-    const GLint _specularMapLocation = glGetUniformLocation(params.program->id(), "specularMap");
-    const GLint _glowMapLocation = glGetUniformLocation(params.program->id(), "glowMap");
-    const GLint _normalMapLocation = glGetUniformLocation(params.program->id(), "normalMap");
+    const GLint _diffuseMapLocation = params.program->uniformLocation(diffuseMapId);
+    const GLint _specularMapLocation = params.program->uniformLocation(specularMapId);
+    const GLint _glowMapLocation = params.program->uniformLocation(glowMapId);
+    const GLint _normalMapLocation = params.program->uniformLocation(normalMapId);
 
     int unit = 0;
 
     if (_diffuseMapLocation != -1)
     {
         glUniform1i(_diffuseMapLocation, unit);
-        glActiveTexture(GL_TEXTURE0 + unit);
-        glEnable(GL_TEXTURE_2D);
-        diffuseMap->bindTexture();
+        params.stateCache->bindTexture(unit, diffuseMap);
         ++unit;
     }
 
     if (_specularMapLocation != -1)
     {
         glUniform1i(_specularMapLocation, unit);
-        glActiveTexture(GL_TEXTURE0 + unit);
-        glEnable(GL_TEXTURE_2D);
-        specularMap->bindTexture();
+        params.stateCache->bindTexture(unit, specularMap);
         ++unit;
     }
 
     if (_glowMapLocation != -1)
     {
         glUniform1i(_glowMapLocation, unit);
-        glActiveTexture(GL_TEXTURE0 + unit);
-        glEnable(GL_TEXTURE_2D);
-        glowMap->bindTexture();
+        params.stateCache->bindTexture(unit, glowMap);
         ++unit;
     }
 
     if (_normalMapLocation != -1)
     {
         glUniform1i(_normalMapLocation, unit);
-        glActiveTexture(GL_TEXTURE0 + unit);
-        glEnable(GL_TEXTURE_2D);
-        normalMap->bindTexture();
+        params.stateCache->bindTexture(unit, normalMap);
         ++unit;
     }
     // end super hack
 
-    const Matrix4x4 modelViewMatrix = toMatrix4x4(transformByInverse(worldTransform(), params.cameraToWorld));
-    const Matrix3x3 normalMatrix = worldTransform().rotation * params.worldToViewRotation;
-
-    glUniformMatrix4fv(
-        glGetUniformLocation(params.program->id(), "modelViewMatrix"),
-        1,
-        false,
-        modelViewMatrix.data()
-    );
-
-    // TODO: can be loaded in the draw initialization step
-    glUniformMatrix4fv(
-        glGetUniformLocation(params.program->id(), "projectionMatrix"),
-        1,
-        false,
-        params.projectionMatrix.data()
-    );
-
-    glUniformMatrix3fv(
-        glGetUniformLocation(params.program->id(), "normalMatrix"),
-        1,
-        false,
-        normalMatrix.data()
-    );
-
-    const GLint coordLocation = glGetAttribLocation(params.program->id(), "coord");
-    glVertexAttribPointer(coordLocation, 3, GL_FLOAT, false, 0, coords[0].data());
-    glEnableVertexAttribArray(coordLocation);
-
-    const GLint normalLocation = glGetAttribLocation(params.program->id(), "normal");
-    glVertexAttribPointer(normalLocation, 3, GL_FLOAT, false, 0, normals[0].data());
-    glEnableVertexAttribArray(normalLocation);
-
-    const GLint tangentLocation = glGetAttribLocation(params.program->id(), "tangent");
-    glVertexAttribPointer(tangentLocation, 3, GL_FLOAT, false, 0, tangents[0].data());
-    glEnableVertexAttribArray(tangentLocation);
-
-    const GLint texCoordLocation = glGetAttribLocation(params.program->id(), "texCoord");
-    glVertexAttribPointer(texCoordLocation, 2, GL_FLOAT, false, 0, texCoords[0].data());
-    glEnableVertexAttribArray(texCoordLocation);
-
-    glDrawArrays(GL_TRIANGLES, 0, coords.size());
-
-    glDisableVertexAttribArray(coordLocation);
-    glDisableVertexAttribArray(normalLocation);
-    glDisableVertexAttribArray(tangentLocation);
-    glDisableVertexAttribArray(texCoordLocation);
-
 //     begin super hack
 //    glActiveTexture(GL_TEXTURE0);
 //    glDisable(GL_TEXTURE_2D);
@@ -221,13 +693,103 @@ void MeshNode::draw(const DrawParams& params) const
 //     end super hack
 }
 
+uint32_t MeshNode::materialKey() const
+{
+    const Texture* const maps[] = {
+        diffuseMap,
+        specularMap,
+        glowMap,
+        normalMap
+    };
+
+    // 32-bit FNV-1a hash of the texture handles
+    uint32_t mapHash = 2166136261u;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        const uint32_t handle = maps[i] != 0 ? maps[i]->getTextureHandle() : 0;
+
+        for (int j = 0; j < 4; ++j)
+        {
+            mapHash ^= (handle >> (j * 8)) & 0xFF;
+            mapHash *= 16777619u;
+        }
+    }
+
+    // the mesh address is hashed separately, so mesh nodes that can be drawn
+    // with a single instanced draw call end up next to each other within the
+    // mesh nodes that use the same texture maps
+    const size_t mesh = reinterpret_cast<size_t>(currentMesh());
+    uint32_t meshHash = 2166136261u;
+
+    for (size_t j = 0; j < sizeof(mesh); ++j)
+    {
+        meshHash ^= (mesh >> (j * 8)) & 0xFF;
+        meshHash *= 16777619u;
+    }
+
+    // texture maps to the high bits, mesh to the low bits
+    const int meshBits = 8;
+    const int mapBits = SortKey::materialBits - meshBits;
+
+    const uint32_t mapKey = ((mapHash >> mapBits) ^ mapHash) & ((1u << mapBits) - 1);
+    const uint32_t meshKey = ((meshHash >> 24) ^ (meshHash >> 16) ^ (meshHash >> 8) ^ meshHash) & ((1u << meshBits) - 1);
+
+    return (mapKey << meshBits) | meshKey;
+}
+
+void MeshNode::selectLod(const float size, const float hysteresis) const
+{
+    const int n = lods_.size();
+    int lod = lod_;
+
+    // coarser levels while the size is below their switch sizes by the
+    // hysteresis
+    while (lod < n && size < lods_[lod].switchSize * (1.0f - hysteresis))
+    {
+        ++lod;
+    }
+
+    // finer levels while the size is above the switch size of the current
+    // level by the hysteresis
+    while (lod > 0 && size > lods_[lod - 1].switchSize * (1.0f + hysteresis))
+    {
+        --lod;
+    }
+
+    lod_ = lod;
+}
+
+bool MeshNode::testFrustum(
+    const VisibilityTest& test,
+    uint32_t& planeMask) const
+{
+    if (modelExtents_.isEmpty())
+    {
+        // no bounding volumes without vertices
+        return GeometryNode::testFrustum(test, planeMask);
+    }
+
+    if (worldExtentsValid_ == false)
+    {
+        updateWorldExtents();
+    }
+
+    return test.test(worldSphere_, worldBox_, planeMask, visibilityCache()) != VisibilityState::Invisible;
+}
+
 void MeshNode::invalidateWorldExtents() const
 {
+    const bool wasValid = worldExtentsValid_;
+
     worldExtentsValid_ = false;
+    visibilityCache().invalidate();
+    invalidateSceneProxy();
 
-    if (hasParent())
+    if (wasValid && hasParent())
     {
-        parent()->invalidateWorldExtents();
+        // the parent node refits only the moved child nodes
+        parent()->invalidateChildExtents(this);
     }
 }
 
@@ -239,7 +801,11 @@ void MeshNode::updateWorldExtents() const
     // TODO: make sure this still works
     //worldExtents_ = modelExtents_;
     //worldExtents_.transformBy(worldTransform());
-    worldExtents_ = ::transform(modelExtents_, worldTransform());
+    const Transform3 t = worldTransform();
+
+    worldExtents_ = ::transform(modelExtents_, t);
+    worldSphere_ = ::transform(modelSphere_, t);
+    worldBox_ = ::transform(modelBox_, t);
 
     worldExtentsValid_ = true;
 }
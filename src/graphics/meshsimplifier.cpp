@@ -0,0 +1,1261 @@
+/**
+ * @file graphics/meshsimplifier.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/meshsimplifier.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include <geometry/vector2.h>
+#include <geometry/vector3.h>
+
+#include <graphics/groupnode.h>
+#include <graphics/meshnode.h>
+#include <graphics/runtimeassert.h>
+
+namespace {
+
+// edges between faces whose normals differ by more than 45 degrees are
+// creases, used only for meshes with flat normals
+const float creaseCosine = 0.7071f;
+
+// collapses that turn a remaining face by more than about 75 degrees are
+// rejected
+const float flipCosine = 0.25f;
+
+// weight of the planes that keep the seam, border and crease edges in place,
+// relative to the face planes
+const double seamWeight = 10.0;
+
+// each pass collapses edges from the cheapest this many times the number of
+// collapses still needed, the costs are recalculated between the passes
+const int candidatesPerCollapse = 2;
+
+// maximum number of passes
+const int maxPasses = 100;
+
+// vertex kinds, a vertex moves only as its kind allows
+enum VertexKind
+{
+    Manifold,                           // collapses to any neighbor
+    Border,                             // collapses along an open border
+    Seam,                               // collapses along a seam or crease
+    Locked                              // does not move
+};
+
+// edge kinds
+enum EdgeKind
+{
+    InteriorEdge,                       // two faces, no discontinuity
+    BorderEdge,                         // one face
+    SeamEdge,                           // two faces, seam or crease
+    ComplexEdge                         // more than two faces
+};
+
+/**
+ * Quadric error of a position, the sum of squared distances to a set of
+ * weighted planes.
+ */
+struct Quadric
+{
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+};
+
+void clear(Quadric& q)
+{
+    q.a00 = q.a01 = q.a02 = q.a11 = q.a12 = q.a22 = 0.0;
+    q.b0 = q.b1 = q.b2 = 0.0;
+    q.c = 0.0;
+}
+
+// adds the plane dot(n, x) + d = 0 with a given weight
+void addPlane(Quadric& q, const Vector3& n, const float d, const double w)
+{
+    q.a00 += w * n.x * n.x;
+    q.a01 += w * n.x * n.y;
+    q.a02 += w * n.x * n.z;
+    q.a11 += w * n.y * n.y;
+    q.a12 += w * n.y * n.z;
+    q.a22 += w * n.z * n.z;
+    q.b0 += w * n.x * d;
+    q.b1 += w * n.y * d;
+    q.b2 += w * n.z * d;
+    q.c += w * d * d;
+}
+
+void add(Quadric& q, const Quadric& other)
+{
+    q.a00 += other.a00;
+    q.a01 += other.a01;
+    q.a02 += other.a02;
+    q.a11 += other.a11;
+    q.a12 += other.a12;
+    q.a22 += other.a22;
+    q.b0 += other.b0;
+    q.b1 += other.b1;
+    q.b2 += other.b2;
+    q.c += other.c;
+}
+
+double evaluate(const Quadric& q, const Vector3& p)
+{
+    const double x = p.x;
+    const double y = p.y;
+    const double z = p.z;
+
+    const double e = x * x * q.a00 + y * y * q.a11 + z * z * q.a22
+                   + 2.0 * (x * y * q.a01 + x * z * q.a02 + y * z * q.a12)
+                   + 2.0 * (x * q.b0 + y * q.b1 + z * q.b2)
+                   + q.c;
+
+    // rounding can make the error slightly negative
+    return e > 0.0 ? e : 0.0;
+}
+
+int compare(const float a, const float b)
+{
+    return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+int compare(const Vector3& a, const Vector3& b)
+{
+    int c = compare(a.x, b.x);
+
+    if (c == 0)
+    {
+        c = compare(a.y, b.y);
+    }
+
+    if (c == 0)
+    {
+        c = compare(a.z, b.z);
+    }
+
+    return c;
+}
+
+int compare(const Vector2& a, const Vector2& b)
+{
+    const int c = compare(a.x, b.x);
+    return c != 0 ? c : compare(a.y, b.y);
+}
+
+/**
+ * Orders vertices by position and by the attributes that define the seams.
+ * The vertex index breaks ties, so the order is deterministic.
+ */
+struct WedgeLess
+{
+    WedgeLess(const Mesh& mesh, const bool flat, const bool positionOnly)
+    :   mesh(mesh),
+        flat(flat),
+        positionOnly(positionOnly)
+    {
+        // ...
+    }
+
+    int compareWedges(const uint32_t a, const uint32_t b) const
+    {
+        int c = compare(mesh.vertices()[a], mesh.vertices()[b]);
+
+        if (c != 0 || positionOnly)
+        {
+            return c;
+        }
+
+        c = compare(mesh.texCoords()[a], mesh.texCoords()[b]);
+
+        if (c != 0 || flat)
+        {
+            // flat normals are generated again for the simplified faces
+            return c;
+        }
+
+        c = compare(mesh.normals()[a], mesh.normals()[b]);
+
+        if (c == 0)
+        {
+            c = compare(mesh.tangents()[a], mesh.tangents()[b]);
+        }
+
+        return c;
+    }
+
+    bool operator ()(const uint32_t a, const uint32_t b) const
+    {
+        const int c = compareWedges(a, b);
+        return c != 0 ? c < 0 : a < b;
+    }
+
+    const Mesh& mesh;
+    bool flat;
+    bool positionOnly;
+};
+
+/**
+ * Edge of a face, the end positions in increasing order.
+ */
+struct FaceEdge
+{
+    int a;                              // first position
+    int b;                              // second position
+    int face;                           // face
+    int wa;                             // wedge at a in the face
+    int wb;                             // wedge at b in the face
+
+    bool operator <(const FaceEdge& other) const
+    {
+        if (a != other.a)
+        {
+            return a < other.a;
+        }
+
+        if (b != other.b)
+        {
+            return b < other.b;
+        }
+
+        return face < other.face;
+    }
+};
+
+/**
+ * Collapse of the position <code>from</code> to the position <code>to</code>.
+ */
+struct Collapse
+{
+    double cost;
+    int from;
+    int to;
+
+    bool operator <(const Collapse& other) const
+    {
+        if (cost != other.cost)
+        {
+            return cost < other.cost;
+        }
+
+        if (from != other.from)
+        {
+            return from < other.from;
+        }
+
+        return to < other.to;
+    }
+};
+
+/**
+ * Edge collapse state of one simplified mesh. A wedge is a unique combination
+ * of a position and the attributes that define the seams, the faces refer to
+ * wedges. Collapsing a position to a neighbor remaps each wedge of the
+ * position to the wedge of the neighbor on the same side of the seams, the
+ * remaining positions do not move.
+ */
+class EdgeCollapser
+{
+public:
+    EdgeCollapser(const Mesh& mesh, bool flat);
+
+    // collapses edges until the face count is at most the target or no edge
+    // can be collapsed
+    void run(int targetFaces);
+
+    // creates the simplified mesh, a null pointer if no faces remain
+    Mesh* createMesh() const;
+
+private:
+    int findWedge(int w);
+    const Vector3 facePosition(int face, int corner);
+    const Vector3 faceNormal(int face);
+    void compactFaces();
+    void buildAdjacency();
+    void classify(bool addSeamPlanes);
+    bool canCollapse(int from, int to, EdgeKind edge) const;
+    bool tryCollapse(const Collapse& c);
+
+    const Mesh& mesh_;
+    bool flat_;
+    std::vector<Vector3> positions_;    // unique positions
+    std::vector<int> wedgePosition_;    // position of each wedge
+    std::vector<int> wedgeVertex_;      // source vertex of each wedge
+    std::vector<int> wedgeRemap_;       // collapsed wedges, -1 if not
+    std::vector<int> faces_;            // three wedges per face
+    int numFaces_;                      // live faces
+    std::vector<Quadric> quadrics_;     // quadric of each position
+    std::vector<int> adjacencyOffsets_; // faces of each position
+    std::vector<int> adjacency_;
+    std::vector<FaceEdge> edges_;
+    std::vector<VertexKind> kinds_;
+    std::vector<Collapse> collapses_;
+    std::vector<char> touched_;         // moved or grown this pass
+
+    // scratch arrays of tryCollapse()
+    std::vector<std::pair<int, int> > wedgeMap_;
+    std::vector<int> fromNeighbors_;
+    std::vector<int> toNeighbors_;
+};
+
+EdgeCollapser::EdgeCollapser(const Mesh& mesh, const bool flat)
+:   mesh_(mesh),
+    flat_(flat),
+    positions_(),
+    wedgePosition_(),
+    wedgeVertex_(),
+    wedgeRemap_(),
+    faces_(),
+    numFaces_(0),
+    quadrics_(),
+    adjacencyOffsets_(),
+    adjacency_(),
+    edges_(),
+    kinds_(),
+    collapses_(),
+    touched_(),
+    wedgeMap_(),
+    fromNeighbors_(),
+    toNeighbors_()
+{
+    const int n = mesh.vertices().size();
+
+    std::vector<uint32_t> order(n);
+
+    for (int i = 0; i < n; ++i)
+    {
+        order[i] = i;
+    }
+
+    // vertices with equal seam attributes share a wedge
+    const WedgeLess wedgeLess(mesh, flat, false);
+    std::sort(order.begin(), order.end(), wedgeLess);
+
+    std::vector<int> vertexWedge(n);
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (i == 0 || wedgeLess.compareWedges(order[i - 1], order[i]) != 0)
+        {
+            wedgeVertex_.push_back(order[i]);
+        }
+
+        vertexWedge[order[i]] = wedgeVertex_.size() - 1;
+    }
+
+    // wedges with equal positions share a position, the wedges are already
+    // in position order
+    const int numWedges = wedgeVertex_.size();
+    wedgePosition_.resize(numWedges);
+
+    for (int i = 0; i < numWedges; ++i)
+    {
+        const Vector3& p = mesh.vertices()[wedgeVertex_[i]];
+
+        if (positions_.empty() || compare(positions_.back(), p) != 0)
+        {
+            positions_.push_back(p);
+        }
+
+        wedgePosition_[i] = positions_.size() - 1;
+    }
+
+    wedgeRemap_.assign(numWedges, -1);
+
+    const std::vector<uint32_t>& indices = mesh.indices();
+    const int numIndices = mesh.isIndexed() ? indices.size() : n;
+
+    faces_.reserve(numIndices);
+
+    for (int i = 0; i < numIndices; ++i)
+    {
+        faces_.push_back(vertexWedge[mesh.isIndexed() ? indices[i] : i]);
+    }
+
+    // drops degenerate faces
+    compactFaces();
+
+    // the quadric of each position holds the planes of its faces weighted by
+    // the face areas
+    Quadric zero;
+    clear(zero);
+    quadrics_.assign(positions_.size(), zero);
+
+    for (int i = 0; i < numFaces_; ++i)
+    {
+        const Vector3 p0 = facePosition(i, 0);
+        const Vector3 n = cross(facePosition(i, 1) - p0, facePosition(i, 2) - p0);
+        const float area = length(n);
+
+        if (area <= 0.0f)
+        {
+            continue;
+        }
+
+        const Vector3 u = n / area;
+        const float d = -dot(u, p0);
+
+        for (int j = 0; j < 3; ++j)
+        {
+            addPlane(quadrics_[wedgePosition_[faces_[i * 3 + j]]], u, d, 0.5 * area);
+        }
+    }
+
+    buildAdjacency();
+    classify(true);
+}
+
+void EdgeCollapser::run(const int targetFaces)
+{
+    for (int pass = 0; pass < maxPasses && numFaces_ > targetFaces; ++pass)
+    {
+        if (pass > 0)
+        {
+            compactFaces();
+            buildAdjacency();
+            classify(false);
+        }
+
+        // cheapest collapse of each edge
+        collapses_.clear();
+
+        for (size_t i = 0; i < edges_.size(); )
+        {
+            size_t j = i + 1;
+
+            while (j < edges_.size() && edges_[j].a == edges_[i].a && edges_[j].b == edges_[i].b)
+            {
+                ++j;
+            }
+
+            const int a = edges_[i].a;
+            const int b = edges_[i].b;
+            const int count = j - i;
+
+            EdgeKind kind = InteriorEdge;
+
+            if (count == 1)
+            {
+                kind = BorderEdge;
+            }
+            else if (count > 2)
+            {
+                kind = ComplexEdge;
+            }
+            else if (edges_[i].wa != edges_[i + 1].wa
+                 ||  edges_[i].wb != edges_[i + 1].wb
+                 ||  (flat_ && dot(normalize(faceNormal(edges_[i].face)), normalize(faceNormal(edges_[i + 1].face))) < creaseCosine))
+            {
+                kind = SeamEdge;
+            }
+
+            Collapse c;
+            c.cost = -1.0;
+
+            if (canCollapse(a, b, kind))
+            {
+                c.cost = evaluate(quadrics_[a], positions_[b]) + evaluate(quadrics_[b], positions_[b]);
+                c.from = a;
+                c.to = b;
+            }
+
+            if (canCollapse(b, a, kind))
+            {
+                const double cost = evaluate(quadrics_[a], positions_[a]) + evaluate(quadrics_[b], positions_[a]);
+
+                if (c.cost < 0.0 || cost < c.cost)
+                {
+                    c.cost = cost;
+                    c.from = b;
+                    c.to = a;
+                }
+            }
+
+            if (c.cost >= 0.0)
+            {
+                collapses_.push_back(c);
+            }
+
+            i = j;
+        }
+
+        std::sort(collapses_.begin(), collapses_.end());
+
+        // a collapse removes two faces, or one on a border
+        const size_t numCandidates = std::min(
+            collapses_.size(),
+            static_cast<size_t>(candidatesPerCollapse * ((numFaces_ - targetFaces) / 2 + 1))
+        );
+
+        touched_.assign(positions_.size(), 0);
+        int numCollapses = 0;
+
+        for (size_t i = 0; i < numCandidates && numFaces_ > targetFaces; ++i)
+        {
+            if (tryCollapse(collapses_[i]))
+            {
+                ++numCollapses;
+            }
+        }
+
+        if (numCollapses == 0)
+        {
+            // nothing can be collapsed
+            break;
+        }
+    }
+
+    compactFaces();
+}
+
+Mesh* EdgeCollapser::createMesh() const
+{
+    if (numFaces_ == 0)
+    {
+        return 0;
+    }
+
+    const std::vector<Vector3>& vertices = mesh_.vertices();
+    const std::vector<Vector3>& normals = mesh_.normals();
+    const std::vector<Vector3>& tangents = mesh_.tangents();
+    const std::vector<Vector2>& texCoords = mesh_.texCoords();
+
+    Mesh* mesh = 0;
+
+    if (flat_)
+    {
+        // flat normals are generated for the new faces like for a read mesh
+        mesh = new Mesh(numFaces_);
+
+        for (int i = 0; i < numFaces_ * 3; ++i)
+        {
+            const int vertex = wedgeVertex_[faces_[i]];
+
+            mesh->vertices()[i] = vertices[vertex];
+            mesh->texCoords()[i] = texCoords[vertex];
+        }
+
+        mesh->generateFlatNormals();
+        mesh->weld();
+    }
+    else
+    {
+        // the used wedges in the order of first use
+        std::vector<int> remap(wedgeVertex_.size(), -1);
+        std::vector<uint32_t> indices(numFaces_ * 3);
+        int numVertices = 0;
+
+        for (int i = 0; i < numFaces_ * 3; ++i)
+        {
+            if (remap[faces_[i]] == -1)
+            {
+                remap[faces_[i]] = numVertices++;
+            }
+
+            indices[i] = remap[faces_[i]];
+        }
+
+        mesh = new Mesh(1);
+        mesh->vertices().resize(numVertices);
+        mesh->normals().resize(numVertices);
+        mesh->tangents().resize(numVertices);
+        mesh->texCoords().resize(numVertices);
+
+        for (size_t i = 0; i < remap.size(); ++i)
+        {
+            if (remap[i] == -1)
+            {
+                continue;
+            }
+
+            const int vertex = wedgeVertex_[i];
+
+            mesh->vertices()[remap[i]] = vertices[vertex];
+            mesh->normals()[remap[i]] = normals[vertex];
+            mesh->tangents()[remap[i]] = tangents[vertex];
+            mesh->texCoords()[remap[i]] = texCoords[vertex];
+        }
+
+        mesh->setIndices(indices);
+    }
+
+    mesh->optimizeVertexCache();
+    mesh->optimizeVertexFetch();
+    mesh->setVertexFormat(mesh_.vertexFormat());
+
+    return mesh;
+}
+
+int EdgeCollapser::findWedge(int w)
+{
+    int root = w;
+
+    while (wedgeRemap_[root] != -1)
+    {
+        root = wedgeRemap_[root];
+    }
+
+    // shorten the chain for the next lookup
+    while (wedgeRemap_[w] != -1 && wedgeRemap_[w] != root)
+    {
+        const int next = wedgeRemap_[w];
+        wedgeRemap_[w] = root;
+        w = next;
+    }
+
+    return root;
+}
+
+const Vector3 EdgeCollapser::facePosition(const int face, const int corner)
+{
+    return positions_[wedgePosition_[findWedge(faces_[face * 3 + corner])]];
+}
+
+const Vector3 EdgeCollapser::faceNormal(const int face)
+{
+    const Vector3 p0 = facePosition(face, 0);
+    return cross(facePosition(face, 1) - p0, facePosition(face, 2) - p0);
+}
+
+void EdgeCollapser::compactFaces()
+{
+    const int numStored = faces_.size() / 3;
+    int n = 0;
+
+    for (int i = 0; i < numStored; ++i)
+    {
+        const int w0 = findWedge(faces_[i * 3 + 0]);
+        const int w1 = findWedge(faces_[i * 3 + 1]);
+        const int w2 = findWedge(faces_[i * 3 + 2]);
+
+        const int p0 = wedgePosition_[w0];
+        const int p1 = wedgePosition_[w1];
+        const int p2 = wedgePosition_[w2];
+
+        if (p0 == p1 || p1 == p2 || p2 == p0)
+        {
+            // collapsed
+            continue;
+        }
+
+        faces_[n * 3 + 0] = w0;
+        faces_[n * 3 + 1] = w1;
+        faces_[n * 3 + 2] = w2;
+        ++n;
+    }
+
+    numFaces_ = n;
+    faces_.resize(n * 3);
+}
+
+void EdgeCollapser::buildAdjacency()
+{
+    const int numPositions = positions_.size();
+
+    adjacencyOffsets_.assign(numPositions + 1, 0);
+
+    for (int i = 0; i < numFaces_ * 3; ++i)
+    {
+        ++adjacencyOffsets_[wedgePosition_[faces_[i]] + 1];
+    }
+
+    for (int i = 0; i < numPositions; ++i)
+    {
+        adjacencyOffsets_[i + 1] += adjacencyOffsets_[i];
+    }
+
+    adjacency_.resize(numFaces_ * 3);
+    std::vector<int> next(adjacencyOffsets_.begin(), adjacencyOffsets_.end() - 1);
+
+    for (int i = 0; i < numFaces_ * 3; ++i)
+    {
+        adjacency_[next[wedgePosition_[faces_[i]]]++] = i / 3;
+    }
+}
+
+void EdgeCollapser::classify(const bool addSeamPlanes)
+{
+    edges_.clear();
+
+    for (int i = 0; i < numFaces_; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            const int w0 = faces_[i * 3 + j];
+            const int w1 = faces_[i * 3 + (j + 1) % 3];
+            const int p0 = wedgePosition_[w0];
+            const int p1 = wedgePosition_[w1];
+
+            FaceEdge e;
+            e.a = p0 < p1 ? p0 : p1;
+            e.b = p0 < p1 ? p1 : p0;
+            e.face = i;
+            e.wa = p0 < p1 ? w0 : w1;
+            e.wb = p0 < p1 ? w1 : w0;
+
+            edges_.push_back(e);
+        }
+    }
+
+    std::sort(edges_.begin(), edges_.end());
+
+    const int numPositions = positions_.size();
+
+    std::vector<int> numBorders(numPositions, 0);
+    std::vector<int> numSeams(numPositions, 0);
+    kinds_.assign(numPositions, Manifold);
+
+    for (size_t i = 0; i < edges_.size(); )
+    {
+        size_t j = i + 1;
+
+        while (j < edges_.size() && edges_[j].a == edges_[i].a && edges_[j].b == edges_[i].b)
+        {
+            ++j;
+        }
+
+        const FaceEdge& e = edges_[i];
+        const int count = j - i;
+
+        bool seam = false;
+
+        if (count == 1)
+        {
+            ++numBorders[e.a];
+            ++numBorders[e.b];
+            seam = true;
+        }
+        else if (count > 2)
+        {
+            // non-manifold
+            kinds_[e.a] = Locked;
+            kinds_[e.b] = Locked;
+        }
+        else if (e.wa != edges_[i + 1].wa
+             ||  e.wb != edges_[i + 1].wb
+             ||  (flat_ && dot(normalize(faceNormal(e.face)), normalize(faceNormal(edges_[i + 1].face))) < creaseCosine))
+        {
+            ++numSeams[e.a];
+            ++numSeams[e.b];
+            seam = true;
+        }
+
+        if (seam && addSeamPlanes)
+        {
+            // planes through the edge perpendicular to its faces keep the
+            // seam in place
+            const Vector3 pa = positions_[e.a];
+            const Vector3 edge = positions_[e.b] - pa;
+            const double weight = seamWeight * sqrLength(edge);
+
+            for (size_t k = i; k < j; ++k)
+            {
+                const Vector3 n = cross(edge, normalize(faceNormal(edges_[k].face)));
+
+                if (sqrLength(n) > 0.0f)
+                {
+                    const Vector3 u = normalize(n);
+                    addPlane(quadrics_[e.a], u, -dot(u, pa), weight);
+                    addPlane(quadrics_[e.b], u, -dot(u, pa), weight);
+                }
+            }
+        }
+
+        i = j;
+    }
+
+    for (int i = 0; i < numPositions; ++i)
+    {
+        if (kinds_[i] == Locked || numBorders[i] + numSeams[i] == 0)
+        {
+            continue;
+        }
+
+        // a vertex on a single line moves along it, a vertex where lines
+        // meet or end does not move
+        if (numBorders[i] == 2 && numSeams[i] == 0)
+        {
+            kinds_[i] = Border;
+        }
+        else if (numBorders[i] == 0 && numSeams[i] == 2)
+        {
+            kinds_[i] = Seam;
+        }
+        else
+        {
+            kinds_[i] = Locked;
+        }
+    }
+}
+
+bool EdgeCollapser::canCollapse(const int from, const int to, const EdgeKind edge) const
+{
+    switch (kinds_[from])
+    {
+        case Manifold:
+            return edge != ComplexEdge;
+
+        case Border:
+            return edge == BorderEdge && (kinds_[to] == Border || kinds_[to] == Locked);
+
+        case Seam:
+            return edge == SeamEdge && (kinds_[to] == Seam || kinds_[to] == Locked);
+
+        default:
+            return false;
+    }
+}
+
+bool EdgeCollapser::tryCollapse(const Collapse& c)
+{
+    const int from = c.from;
+    const int to = c.to;
+
+    if (touched_[from] || touched_[to])
+    {
+        // the cost is out of date
+        return false;
+    }
+
+    wedgeMap_.clear();
+    fromNeighbors_.clear();
+    toNeighbors_.clear();
+
+    int numRemoved = 0;
+
+    // the faces shared with the collapsed edge define where the wedges of
+    // the collapsed position go
+    for (int i = adjacencyOffsets_[from]; i < adjacencyOffsets_[from + 1]; ++i)
+    {
+        const int face = adjacency_[i];
+
+        int w[3];
+        int p[3];
+
+        for (int j = 0; j < 3; ++j)
+        {
+            w[j] = findWedge(faces_[face * 3 + j]);
+            p[j] = wedgePosition_[w[j]];
+        }
+
+        if (p[0] == p[1] || p[1] == p[2] || p[2] == p[0])
+        {
+            // collapsed by an earlier collapse of this pass
+            continue;
+        }
+
+        int k = 0;
+
+        while (p[k] != from)
+        {
+            ++k;
+        }
+
+        const int k1 = (k + 1) % 3;
+        const int k2 = (k + 2) % 3;
+
+        fromNeighbors_.push_back(p[k1]);
+        fromNeighbors_.push_back(p[k2]);
+
+        if (p[k1] != to && p[k2] != to)
+        {
+            continue;
+        }
+
+        const int target = p[k1] == to ? w[k1] : w[k2];
+        bool mapped = false;
+
+        for (size_t j = 0; j < wedgeMap_.size(); ++j)
+        {
+            if (wedgeMap_[j].first == w[k])
+            {
+                if (wedgeMap_[j].second != target)
+                {
+                    // the wedge would be split
+                    return false;
+                }
+
+                mapped = true;
+            }
+        }
+
+        if (mapped == false)
+        {
+            wedgeMap_.push_back(std::make_pair(w[k], target));
+        }
+
+        ++numRemoved;
+    }
+
+    if (numRemoved == 0)
+    {
+        return false;
+    }
+
+    const Vector3 target = positions_[to];
+
+    // the remaining faces must keep their orientation and all their wedges
+    // must have a destination
+    for (int i = adjacencyOffsets_[from]; i < adjacencyOffsets_[from + 1]; ++i)
+    {
+        const int face = adjacency_[i];
+
+        Vector3 v[3];
+        int k = -1;
+        bool shared = false;
+        bool degenerate = false;
+
+        for (int j = 0; j < 3; ++j)
+        {
+            const int w = findWedge(faces_[face * 3 + j]);
+            const int p = wedgePosition_[w];
+
+            v[j] = positions_[p];
+
+            if (p == from)
+            {
+                if (k != -1)
+                {
+                    degenerate = true;
+                }
+
+                k = j;
+
+                bool mapped = false;
+
+                for (size_t m = 0; m < wedgeMap_.size(); ++m)
+                {
+                    mapped = mapped || wedgeMap_[m].first == w;
+                }
+
+                if (mapped == false)
+                {
+                    return false;
+                }
+            }
+
+            shared = shared || p == to;
+        }
+
+        if (shared || degenerate || k == -1)
+        {
+            continue;
+        }
+
+        const Vector3 n0 = cross(v[1] - v[0], v[2] - v[0]);
+        v[k] = target;
+        const Vector3 n1 = cross(v[1] - v[0], v[2] - v[0]);
+
+        if (dot(n0, n1) <= flipCosine * length(n0) * length(n1))
+        {
+            // flipped or degenerated
+            return false;
+        }
+    }
+
+    // the only neighbors shared by the end positions must be the opposite
+    // positions of the removed faces, otherwise the collapse would fold the
+    // surface onto itself
+    for (int i = adjacencyOffsets_[to]; i < adjacencyOffsets_[to + 1]; ++i)
+    {
+        const int face = adjacency_[i];
+
+        for (int j = 0; j < 3; ++j)
+        {
+            const int p = wedgePosition_[findWedge(faces_[face * 3 + j])];
+
+            if (p != to)
+            {
+                toNeighbors_.push_back(p);
+            }
+        }
+    }
+
+    std::sort(fromNeighbors_.begin(), fromNeighbors_.end());
+    fromNeighbors_.erase(std::unique(fromNeighbors_.begin(), fromNeighbors_.end()), fromNeighbors_.end());
+    std::sort(toNeighbors_.begin(), toNeighbors_.end());
+    toNeighbors_.erase(std::unique(toNeighbors_.begin(), toNeighbors_.end()), toNeighbors_.end());
+
+    int numShared = 0;
+
+    for (size_t i = 0, j = 0; i < fromNeighbors_.size() && j < toNeighbors_.size(); )
+    {
+        if (fromNeighbors_[i] < toNeighbors_[j])
+        {
+            ++i;
+        }
+        else if (toNeighbors_[j] < fromNeighbors_[i])
+        {
+            ++j;
+        }
+        else
+        {
+            if (fromNeighbors_[i] != to && fromNeighbors_[i] != from)
+            {
+                ++numShared;
+            }
+
+            ++i;
+            ++j;
+        }
+    }
+
+    if (numShared != numRemoved)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < wedgeMap_.size(); ++i)
+    {
+        wedgeRemap_[wedgeMap_[i].first] = wedgeMap_[i].second;
+    }
+
+    add(quadrics_[to], quadrics_[from]);
+
+    touched_[from] = 1;
+    touched_[to] = 1;
+    numFaces_ -= numRemoved;
+
+    return true;
+}
+
+// tells whether all faces of a mesh have flat normals
+bool hasFlatNormals(const Mesh& mesh)
+{
+    const std::vector<Vector3>& normals = mesh.normals();
+    const std::vector<uint32_t>& indices = mesh.indices();
+    const int numIndices = mesh.isIndexed() ? indices.size() : normals.size();
+
+    for (int i = 0; i < numIndices; i += 3)
+    {
+        const uint32_t i0 = mesh.isIndexed() ? indices[i + 0] : i + 0;
+        const uint32_t i1 = mesh.isIndexed() ? indices[i + 1] : i + 1;
+        const uint32_t i2 = mesh.isIndexed() ? indices[i + 2] : i + 2;
+
+        if (compare(normals[i0], normals[i1]) != 0 || compare(normals[i0], normals[i2]) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// collects the mesh nodes of a node hierarchy
+void collectMeshNodes(Node* const p, std::vector<MeshNode*>& nodes)
+{
+    MeshNode* const meshNode = dynamic_cast<MeshNode*>(p);
+
+    if (meshNode != 0)
+    {
+        nodes.push_back(meshNode);
+        return;
+    }
+
+    const GroupNode* const group = dynamic_cast<const GroupNode*>(p);
+
+    if (group != 0)
+    {
+        for (int i = 0; i < group->numChildren(); ++i)
+        {
+            collectMeshNodes(group->child(i), nodes);
+        }
+    }
+}
+
+} // namespace
+
+MeshSimplifier::~MeshSimplifier()
+{
+    for (size_t i = 0; i < jobs_.size(); ++i)
+    {
+        for (size_t j = 0; j < jobs_[i].lods.size(); ++j)
+        {
+            delete jobs_[i].lods[j];
+        }
+    }
+}
+
+MeshSimplifier::MeshSimplifier()
+:   TaskSet(),
+    meshManager_(0),
+    levels_(),
+    jobs_(),
+    lods_(),
+    numInputFaces_(0),
+    numOutputFaces_(0)
+{
+    // ...
+}
+
+void MeshSimplifier::setMeshManager(MeshManager* const p)
+{
+    meshManager_ = p;
+}
+
+MeshManager* MeshSimplifier::meshManager() const
+{
+    return meshManager_;
+}
+
+void MeshSimplifier::addLevel(const float faceRatio, const float switchSize)
+{
+    GRAPHICS_RUNTIME_ASSERT(faceRatio > 0.0f && faceRatio < 1.0f);
+    GRAPHICS_RUNTIME_ASSERT(switchSize > 0.0f);
+    GRAPHICS_RUNTIME_ASSERT(levels_.empty() || faceRatio < levels_.back().faceRatio);
+    GRAPHICS_RUNTIME_ASSERT(levels_.empty() || switchSize < levels_.back().switchSize);
+
+    Level level;
+    level.faceRatio = faceRatio;
+    level.switchSize = switchSize;
+
+    levels_.push_back(level);
+}
+
+int MeshSimplifier::numLevels() const
+{
+    return levels_.size();
+}
+
+void MeshSimplifier::addMesh(Mesh* const mesh, const std::string& name)
+{
+    GRAPHICS_RUNTIME_ASSERT(mesh != 0);
+    GRAPHICS_RUNTIME_ASSERT(mesh->hasClientData());
+
+    Job job;
+    job.mesh = mesh;
+    job.name = name;
+
+    jobs_.push_back(job);
+}
+
+int MeshSimplifier::numTasks() const
+{
+    return jobs_.size();
+}
+
+void MeshSimplifier::runTask(const int index)
+{
+    GRAPHICS_RUNTIME_ASSERT(index >= 0 && index < numTasks());
+
+    Job& job = jobs_[index];
+    const Mesh* previous = job.mesh;
+
+    for (size_t i = 0; i < levels_.size(); ++i)
+    {
+        const int targetFaces = std::max(1, static_cast<int>(levels_[i].faceRatio * job.mesh->numFaces() + 0.5f));
+
+        if (targetFaces >= previous->numFaces())
+        {
+            // already simplified enough, the level is skipped with the rest
+            // of the chain so that the switch sizes stay with their levels
+            break;
+        }
+
+        // each level is simplified from the previous one, which is faster
+        // and keeps the levels consistent with each other
+        Mesh* const lod = simplify(*previous, targetFaces);
+
+        if (lod == 0 || lod->numFaces() >= previous->numFaces())
+        {
+            // the seams and creases do not allow simplifying further
+            delete lod;
+            break;
+        }
+
+        job.lods.push_back(lod);
+        previous = lod;
+    }
+}
+
+void MeshSimplifier::merge()
+{
+    GRAPHICS_RUNTIME_ASSERT(meshManager_ != 0);
+
+    numInputFaces_ = 0;
+    numOutputFaces_ = 0;
+
+    for (size_t i = 0; i < jobs_.size(); ++i)
+    {
+        Job& job = jobs_[i];
+        LodVector& lods = lods_[job.mesh];
+
+        numInputFaces_ += job.mesh->numFaces();
+
+        for (size_t j = 0; j < job.lods.size(); ++j)
+        {
+            Mesh* const mesh = job.lods[j];
+
+            std::ostringstream name;
+            name << job.name << "_lod" << j + 1;
+
+            if (lods.size() != j || meshManager_->loadResource(name.str(), mesh) == false)
+            {
+                // the name is taken, or an earlier level was not registered
+                delete mesh;
+                continue;
+            }
+
+            Lod lod;
+            lod.mesh = mesh;
+            lod.switchSize = levels_[j].switchSize;
+
+            lods.push_back(lod);
+            numOutputFaces_ += mesh->numFaces();
+        }
+    }
+
+    jobs_.clear();
+}
+
+int MeshSimplifier::attachLods(Node* const root) const
+{
+    GRAPHICS_RUNTIME_ASSERT(root != 0);
+
+    std::vector<MeshNode*> nodes;
+    collectMeshNodes(root, nodes);
+
+    int count = 0;
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        MeshNode* const node = nodes[i];
+        const LodMap::const_iterator lods = lods_.find(node->mesh());
+
+        if (node->numLods() > 1 || lods == lods_.end() || lods->second.empty())
+        {
+            continue;
+        }
+
+        for (size_t j = 0; j < lods->second.size(); ++j)
+        {
+            node->addLod(lods->second[j].mesh, lods->second[j].switchSize);
+        }
+
+        ++count;
+    }
+
+    return count;
+}
+
+int MeshSimplifier::numInputFaces() const
+{
+    return numInputFaces_;
+}
+
+int MeshSimplifier::numOutputFaces() const
+{
+    return numOutputFaces_;
+}
+
+Mesh* MeshSimplifier::simplify(const Mesh& mesh, const int targetFaces)
+{
+    GRAPHICS_RUNTIME_ASSERT(mesh.hasClientData());
+    GRAPHICS_RUNTIME_ASSERT(targetFaces > 0);
+
+    EdgeCollapser collapser(mesh, hasFlatNormals(mesh));
+    collapser.run(targetFaces);
+
+    return collapser.createMesh();
+}
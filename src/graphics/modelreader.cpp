@@ -6,11 +6,13 @@
 #include <graphics/modelreader.h>
 
 #include <cstring>
+#include <iostream>
 
 #include <lib3ds/lib3ds.h>
 
 #include <graphics/groupnode.h>
 #include <graphics/meshnode.h>
+#include <graphics/meshsimplifier.h>
 #include <graphics/runtimeassert.h>
 
 ModelReader::~ModelReader()
@@ -20,7 +22,13 @@ ModelReader::~ModelReader()
 
 ModelReader::ModelReader()
 :   meshManager_(0),
-    meshPrefix_()
+    meshSimplifier_(0),
+    meshPrefix_(),
+    vertexFormat_(),
+    numReadFaces_(0),
+    numReadVertices_(0),
+    vertexDataSize_(0),
+    indexDataSize_(0)
 {
     // ...
 }
@@ -35,6 +43,26 @@ MeshManager* ModelReader::meshManager() const
     return meshManager_;
 }
 
+void ModelReader::setMeshSimplifier(MeshSimplifier* const p)
+{
+    meshSimplifier_ = p;
+}
+
+MeshSimplifier* ModelReader::meshSimplifier() const
+{
+    return meshSimplifier_;
+}
+
+void ModelReader::setVertexFormat(const VertexFormat& format)
+{
+    vertexFormat_ = format;
+}
+
+const VertexFormat ModelReader::vertexFormat() const
+{
+    return vertexFormat_;
+}
+
 Node* ModelReader::read(const std::string& path)
 {
     GRAPHICS_RUNTIME_ASSERT(meshManager_ != 0);
@@ -50,7 +78,13 @@ Node* ModelReader::read(const std::string& path)
     // set mesh prefix to model file path
     meshPrefix_ = path;
 
+    numReadFaces_ = 0;
+    numReadVertices_ = 0;
+    vertexDataSize_ = 0;
+    indexDataSize_ = 0;
+
     readMeshes(file, path);
+
     // TODO: read materials
     // TODO: read lights
 
@@ -86,6 +120,26 @@ Node* ModelReader::read(const std::string& path)
     return root;
 }
 
+int ModelReader::numReadFaces() const
+{
+    return numReadFaces_;
+}
+
+int ModelReader::numReadVertices() const
+{
+    return numReadVertices_;
+}
+
+size_t ModelReader::vertexDataSize() const
+{
+    return vertexDataSize_;
+}
+
+size_t ModelReader::indexDataSize() const
+{
+    return indexDataSize_;
+}
+
 void ModelReader::readMeshes(const Lib3dsFile* const p, const std::string& prefix)
 {
     GRAPHICS_RUNTIME_ASSERT(p != 0);
@@ -147,7 +201,24 @@ void ModelReader::readMesh(const Lib3dsMesh* const p, const std::string& prefix)
     const char* const meshName = p->name;
 
     mesh->generateFlatNormals();
-    meshManager_->loadResource(prefix + meshName, mesh);
+
+    // share equal vertices and order the faces and vertices for the vertex
+    // cache and vertex fetch
+    mesh->weld();
+    mesh->optimizeVertexCache();
+    mesh->optimizeVertexFetch();
+    mesh->setVertexFormat(vertexFormat_);
+
+    numReadFaces_ += mesh->numFaces();
+    numReadVertices_ += mesh->numVertices();
+    vertexDataSize_ += mesh->vertexDataSize();
+    indexDataSize_ += mesh->indexDataSize();
+
+    if (meshManager_->loadResource(prefix + meshName, mesh) && meshSimplifier_ != 0)
+    {
+        // the levels of detail are generated when the simplifier runs
+        meshSimplifier_->addMesh(mesh, prefix + meshName);
+    }
 }
 
 Node* ModelReader::readModel(const Lib3dsFile* const file)
@@ -8,14 +8,39 @@
 #include <geometry/matrix4x4.h>
 
 #include <graphics/groupnode.h>
+#include <graphics/nodearena.h>
+#include <graphics/predrawparams.h>
 #include <graphics/runtimeassert.h>
+#include <graphics/scene.h>
 
 Node::~Node()
 {
     // make sure we are not deleting a node that is still attached
     GRAPHICS_RUNTIME_ASSERT(hasParent() == false);
 
-    // TODO: unregister from scene
+    if (transformSlot_ != -1)
+    {
+        // the root node of a scene may be deleted while registered
+        scene_->transforms().removeNode(transformSlot_);
+    }
+}
+
+void* Node::operator new(const size_t size)
+{
+    return NodeArena::current().allocate(size);
+}
+
+void Node::operator delete(void* const p)
+{
+    NodeArena::deallocate(p);
+}
+
+void Node::predrawPrefab(
+    const PredrawParams&,
+    uint32_t,
+    const Transform3&) const
+{
+    // ...
 }
 
 void Node::invalidateWorldTransform() const
@@ -23,8 +48,18 @@ void Node::invalidateWorldTransform() const
     worldTransformValid_ = false;
 }
 
+void Node::invalidateWorldExtents() const
+{
+    // ...
+}
+
 const Transform3 Node::worldTransform() const
 {
+    if (transformSlot_ != -1)
+    {
+        return scene_->transforms().worldTransform(transformSlot_);
+    }
+
     if (worldTransformValid_ == false)
     {
         updateWorldTransform();
@@ -39,19 +74,13 @@ const Transform3 Node::worldTransform() const
 void Node::setTransform(const Transform3& transform)
 {
     localTransform_ = transform;
-    invalidateWorldTransform();
-
-    // invalidateWorlTransform() should invalidate the world transform
-    GRAPHICS_RUNTIME_ASSERT(worldTransformValid_ == false);
+    localTransformChanged();
 }
 
 void Node::transformBy(const Transform3& transform)
 {
     localTransform_ = ::transform(localTransform_, transform);
-    invalidateWorldTransform();
-
-    // invalidateWorlTransform() should invalidate the world transform
-    GRAPHICS_RUNTIME_ASSERT(worldTransformValid_ == false);
+    localTransformChanged();
 }
 
 const Transform3 Node::transform() const
@@ -62,19 +91,13 @@ const Transform3 Node::transform() const
 void Node::setTranslation(const Vector3& translation)
 {
     localTransform_.translation = translation;
-    invalidateWorldTransform();
-
-    // invalidateWorlTransform() should invalidate the world transform
-    GRAPHICS_RUNTIME_ASSERT(worldTransformValid_ == false);
+    localTransformChanged();
 }
 
 void Node::translateBy(const Vector3& translation)
 {
     localTransform_.translation += translation;
-    invalidateWorldTransform();
-
-    // invalidateWorlTransform() should invalidate the world transform
-    GRAPHICS_RUNTIME_ASSERT(worldTransformValid_ == false);
+    localTransformChanged();
 }
 
 const Vector3 Node::translation() const
@@ -85,19 +108,13 @@ const Vector3 Node::translation() const
 void Node::setRotation(const Matrix3x3& rotation)
 {
     localTransform_.rotation = rotation;
-    invalidateWorldTransform();
-
-    // invalidateWorlTransform() should invalidate the world transform
-    GRAPHICS_RUNTIME_ASSERT(worldTransformValid_ == false);
+    localTransformChanged();
 }
 
 void Node::rotateBy(const Matrix3x3& rotation)
 {
     localTransform_.rotation *= rotation;
-    invalidateWorldTransform();
-
-    // invalidateWorlTransform() should invalidate the world transform
-    GRAPHICS_RUNTIME_ASSERT(worldTransformValid_ == false);
+    localTransformChanged();
 }
 
 const Matrix3x3 Node::rotation() const
@@ -110,12 +127,7 @@ void Node::setScaling(const float scaling)
     GRAPHICS_RUNTIME_ASSERT(scaling > 0.0f);
 
     localTransform_.scaling = scaling;
-
-
-    invalidateWorldTransform();
-
-    // invalidateWorlTransform() should invalidate the world transform
-    GRAPHICS_RUNTIME_ASSERT(worldTransformValid_ == false);
+    localTransformChanged();
 }
 
 void Node::scaleBy(const float scaling)
@@ -123,10 +135,7 @@ void Node::scaleBy(const float scaling)
     GRAPHICS_RUNTIME_ASSERT(scaling > 0.0f);
 
     localTransform_.scaling *= scaling;
-    invalidateWorldTransform();
-
-    // invalidateWorlTransform() should invalidate the world transform
-    GRAPHICS_RUNTIME_ASSERT(worldTransformValid_ == false);
+    localTransformChanged();
 }
 
 float Node::scaling() const
@@ -143,10 +152,7 @@ void Node::setRotationLocked(const bool locked)
     }
 
     rotationLocked_ = locked;
-    invalidateWorldTransform();
-
-    // invalidateWorlTransform() should invalidate the world transform
-    GRAPHICS_RUNTIME_ASSERT(worldTransformValid_ == false);
+    localTransformChanged();
 }
 
 bool Node::isRotationLocked() const
@@ -163,10 +169,7 @@ void Node::setScalingLocked(const bool locked)
     }
 
     scalingLocked_ = locked;
-    invalidateWorldTransform();
-
-    // invalidateWorlTransform() should invalidate the world transform
-    GRAPHICS_RUNTIME_ASSERT(worldTransformValid_ == false);
+    localTransformChanged();
 }
 
 bool Node::isScalingLocked() const
@@ -184,7 +187,22 @@ void Node::setScene(Scene* const scene)
     // make sure that this node is not being registered to multiple scenes
     GRAPHICS_RUNTIME_ASSERT(scene_ == 0 || scene == 0);
 
+    if (transformSlot_ != -1)
+    {
+        scene_->transforms().removeNode(transformSlot_);
+        transformSlot_ = -1;
+
+        // the world transform is calculated lazily again
+        worldTransformValid_ = false;
+        invalidateWorldExtents();
+    }
+
     scene_ = scene;
+
+    if (scene_ != 0)
+    {
+        transformSlot_ = scene_->transforms().addNode(this);
+    }
 }
 
 Scene* Node::scene() const
@@ -212,6 +230,26 @@ bool Node::hasParent() const
     return parent_ != 0;
 }
 
+void Node::setChildIndex(const int index)
+{
+    childIndex_ = index;
+}
+
+int Node::childIndex() const
+{
+    return childIndex_;
+}
+
+void Node::setTransformSlot(const int slot)
+{
+    transformSlot_ = slot;
+}
+
+int Node::transformSlot() const
+{
+    return transformSlot_;
+}
+
 Node::Node()
 :   worldTransformValid_(false),
     worldTransform_(),
@@ -219,7 +257,10 @@ Node::Node()
     rotationLocked_(false),
     scalingLocked_(false),
     scene_(0),
-    parent_(0)
+    parent_(0),
+    childIndex_(-1),
+    transformSlot_(-1),
+    visibilityCache_()
 {
     // ...
 }
@@ -231,7 +272,10 @@ Node::Node(const Node& other)
     rotationLocked_(other.rotationLocked_),
     scalingLocked_(other.scalingLocked_),
     scene_(0),
-    parent_(0)
+    parent_(0),
+    childIndex_(-1),
+    transformSlot_(-1),
+    visibilityCache_()
 {
     // ...
 }
@@ -241,6 +285,29 @@ bool Node::isWorldTransformValid() const
     return worldTransformValid_;
 }
 
+VisibilityCache& Node::visibilityCache() const
+{
+    return visibilityCache_;
+}
+
+bool Node::testPrefabExtents(
+    const Extents3& extents,
+    const PredrawParams& params,
+    uint32_t& planeMask)
+{
+    if (planeMask != 0)
+    {
+        int lastPlane = -1;
+
+        if (params.visibilityTest()->test(extents, planeMask, lastPlane) == VisibilityState::Invisible)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void Node::updateWorldTransform() const
 {
     // make sure we are not doing any unnecessary function calls
@@ -273,3 +340,24 @@ void Node::updateWorldTransform() const
 
     worldTransformValid_ = true;
 }
+
+void Node::localTransformChanged()
+{
+    if (transformSlot_ != -1)
+    {
+        // the world transforms are updated by the scene
+        scene_->transforms().setLocalTransform(
+            transformSlot_,
+            localTransform_,
+            rotationLocked_,
+            scalingLocked_
+        );
+
+        return;
+    }
+
+    invalidateWorldTransform();
+
+    // invalidateWorlTransform() should invalidate the world transform
+    GRAPHICS_RUNTIME_ASSERT(worldTransformValid_ == false);
+}
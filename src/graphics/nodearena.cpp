@@ -0,0 +1,251 @@
+/**
+ * @file graphics/nodearena.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/nodearena.h>
+
+#include <graphics/node.h>
+#include <graphics/runtimeassert.h>
+
+namespace {
+
+// size of the slot header that points to the pool of the slot, keeps the
+// nodes aligned like heap allocations
+const size_t headerSize = 16;
+
+// slot sizes are multiples of this
+const size_t slotAlignment = 16;
+
+// number of slots carved from one chunk
+const size_t slotsPerChunk = 64;
+
+} // namespace
+
+NodeArena* NodeArena::current_ = 0;
+
+NodeArena::~NodeArena()
+{
+    GRAPHICS_RUNTIME_ASSERT(current_ != this);
+
+    for (size_t i = 0; i < pools_.size(); ++i)
+    {
+        Pool* const pool = pools_[i];
+
+        for (size_t j = 0; j < pool->chunks.size(); ++j)
+        {
+            delete[] pool->chunks[j];
+        }
+
+        delete pool;
+    }
+}
+
+NodeArena::NodeArena()
+:   pools_(),
+    numAllocations_(0),
+    numDeallocations_(0),
+    numChunkAllocations_(0),
+    numLiveNodes_(0),
+    reservedSize_(0),
+    liveSize_(0)
+{
+    // ...
+}
+
+void NodeArena::setCurrent(NodeArena* const arena)
+{
+    current_ = arena;
+}
+
+NodeArena& NodeArena::current()
+{
+    return current_ != 0 ? *current_ : defaultArena();
+}
+
+NodeArena& NodeArena::defaultArena()
+{
+    static NodeArena arena;
+    return arena;
+}
+
+Node* NodeArena::clone(const Node& prefab)
+{
+    NodeArena* const previous = current_;
+    current_ = this;
+
+    Node* p = 0;
+
+    try
+    {
+        p = prefab.clone();
+    }
+    catch (...)
+    {
+        current_ = previous;
+
+        throw;
+    }
+
+    current_ = previous;
+
+    return p;
+}
+
+void* NodeArena::allocate(const size_t size)
+{
+    const size_t slotSize = headerSize + (size + slotAlignment - 1) / slotAlignment * slotAlignment;
+    Pool& pool = findPool(slotSize);
+
+    char* slot = 0;
+
+    if (pool.freeList != 0)
+    {
+        // reuse the most recently freed slot, it is likely in the cache, and
+        // the slots of a deleted hierarchy are reused together
+        slot = static_cast<char*>(pool.freeList);
+        pool.freeList = *reinterpret_cast<void**>(slot + headerSize);
+        --pool.numFree;
+    }
+    else
+    {
+        slot = carve(pool);
+    }
+
+    *reinterpret_cast<Pool**>(slot) = &pool;
+    ++pool.numLive;
+
+    ++numAllocations_;
+    ++numLiveNodes_;
+    liveSize_ += slotSize;
+
+    return slot + headerSize;
+}
+
+void NodeArena::deallocate(void* const p)
+{
+    if (p == 0)
+    {
+        return;
+    }
+
+    char* const slot = static_cast<char*>(p) - headerSize;
+    Pool& pool = **reinterpret_cast<Pool**>(slot);
+    NodeArena& arena = *pool.arena;
+
+    *static_cast<void**>(p) = pool.freeList;
+    pool.freeList = slot;
+    --pool.numLive;
+    ++pool.numFree;
+
+    ++arena.numDeallocations_;
+    --arena.numLiveNodes_;
+    arena.liveSize_ -= pool.slotSize;
+}
+
+void NodeArena::resetCounters()
+{
+    numAllocations_ = 0;
+    numDeallocations_ = 0;
+    numChunkAllocations_ = 0;
+}
+
+int NodeArena::numAllocations() const
+{
+    return numAllocations_;
+}
+
+int NodeArena::numDeallocations() const
+{
+    return numDeallocations_;
+}
+
+int NodeArena::numChunkAllocations() const
+{
+    return numChunkAllocations_;
+}
+
+int NodeArena::numLiveNodes() const
+{
+    return numLiveNodes_;
+}
+
+int NodeArena::numPools() const
+{
+    return pools_.size();
+}
+
+size_t NodeArena::reservedSize() const
+{
+    return reservedSize_;
+}
+
+size_t NodeArena::liveSize() const
+{
+    return liveSize_;
+}
+
+float NodeArena::fragmentation() const
+{
+    int numLive = 0;
+    int numFree = 0;
+
+    for (size_t i = 0; i < pools_.size(); ++i)
+    {
+        numLive += pools_[i]->numLive;
+        numFree += pools_[i]->numFree;
+    }
+
+    if (numLive + numFree == 0)
+    {
+        return 0.0f;
+    }
+
+    return static_cast<float>(numFree) / (numLive + numFree);
+}
+
+NodeArena::Pool& NodeArena::findPool(const size_t slotSize)
+{
+    // there are only a few node types, a linear search is fast enough
+    for (size_t i = 0; i < pools_.size(); ++i)
+    {
+        if (pools_[i]->slotSize == slotSize)
+        {
+            return *pools_[i];
+        }
+    }
+
+    Pool* const pool = new Pool();
+    pool->arena = this;
+    pool->slotSize = slotSize;
+    pool->freeList = 0;
+    pool->next = 0;
+    pool->end = 0;
+    pool->numLive = 0;
+    pool->numFree = 0;
+
+    pools_.push_back(pool);
+
+    return *pool;
+}
+
+char* NodeArena::carve(Pool& pool)
+{
+    if (pool.next == pool.end)
+    {
+        const size_t chunkSize = pool.slotSize * slotsPerChunk;
+
+        pool.chunks.reserve(pool.chunks.size() + 1);
+        pool.chunks.push_back(new char[chunkSize]);
+        pool.next = pool.chunks.back();
+        pool.end = pool.next + chunkSize;
+
+        ++numChunkAllocations_;
+        reservedSize_ += chunkSize;
+    }
+
+    char* const slot = pool.next;
+    pool.next += pool.slotSize;
+
+    return slot;
+}
@@ -0,0 +1,542 @@
+/**
+ * @file graphics/occlusionbuffer.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/occlusionbuffer.h>
+
+#include <algorithm>
+
+#include <geometry/extents3.h>
+#include <geometry/math.h>
+#include <geometry/transform3.h>
+#include <geometry/vector4.h>
+
+#include <graphics/cameranode.h>
+#include <graphics/mesh.h>
+#include <graphics/runtimeassert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define GRAPHICS_OCCLUSIONBUFFER_SSE2
+#endif
+
+namespace {
+
+// triangles with a smaller screen space area are skipped
+const float minArea = 1.0e-6f;
+
+// increments a counter shared by threads that test concurrently
+void increment(int& counter)
+{
+#if defined(__GNUC__)
+    __sync_fetch_and_add(&counter, 1);
+#else
+    ++counter;
+#endif
+}
+
+// signed distance to the near plane in clip space
+float nearDistance(const Vector4& v)
+{
+    return v.z + v.w;
+}
+
+const Vector4 lerp(const Vector4& a, const Vector4& b, const float t)
+{
+    return Vector4(
+        a.x + (b.x - a.x) * t,
+        a.y + (b.y - a.y) * t,
+        a.z + (b.z - a.z) * t,
+        a.w + (b.w - a.w) * t
+    );
+}
+
+} // namespace
+
+OcclusionBuffer::~OcclusionBuffer()
+{
+    // ...
+}
+
+OcclusionBuffer::OcclusionBuffer()
+:   width_(0),
+    height_(0),
+    tilesX_(0),
+    tilesY_(0),
+    coarseX_(0),
+    coarseY_(0),
+    worldToClip_(Matrix4x4::identity()),
+    depth_(),
+    tileDepth_(),
+    coarseDepth_(),
+    triangles_(),
+    bins_(),
+    numTests_(0),
+    numOccluded_(0)
+{
+    setResolution(256, 128);
+}
+
+void OcclusionBuffer::setResolution(const int width, const int height)
+{
+    GRAPHICS_RUNTIME_ASSERT(width > 0 && width % tileSize == 0);
+    GRAPHICS_RUNTIME_ASSERT(height > 0 && height % tileSize == 0);
+
+    width_ = width;
+    height_ = height;
+    tilesX_ = width / tileSize;
+    tilesY_ = height / tileSize;
+    coarseX_ = (tilesX_ + coarseSize - 1) / coarseSize;
+    coarseY_ = (tilesY_ + coarseSize - 1) / coarseSize;
+
+    depth_.resize(width_ * height_);
+    tileDepth_.resize(tilesX_ * tilesY_);
+    coarseDepth_.resize(coarseX_ * coarseY_);
+    bins_.resize(tilesX_ * tilesY_);
+
+    clear();
+}
+
+int OcclusionBuffer::width() const
+{
+    return width_;
+}
+
+int OcclusionBuffer::height() const
+{
+    return height_;
+}
+
+void OcclusionBuffer::init(const CameraNode& camera)
+{
+    init(camera.worldToViewMatrix() * camera.projectionMatrix());
+}
+
+void OcclusionBuffer::init(const Matrix4x4& worldToClip)
+{
+    worldToClip_ = worldToClip;
+    clear();
+}
+
+void OcclusionBuffer::addOccluder(const Mesh& mesh, const Transform3& transform)
+{
+    GRAPHICS_RUNTIME_ASSERT(mesh.hasClientData());
+
+    const Matrix4x4 modelToClip = toMatrix4x4(transform) * worldToClip_;
+    const std::vector<Vector3>& vertices = mesh.vertices();
+    const int numFaces = mesh.numFaces();
+
+    for (int i = 0; i < numFaces; ++i)
+    {
+        Vector4 v[3];
+        float d[3];
+        int numInside = 0;
+
+        for (int j = 0; j < 3; ++j)
+        {
+            const int index = mesh.isIndexed() ? mesh.indices()[3 * i + j] : 3 * i + j;
+            const Vector3& p = vertices[index];
+
+            v[j] = Vector4(p.x, p.y, p.z, 1.0f) * modelToClip;
+            d[j] = nearDistance(v[j]);
+
+            if (d[j] > 0.0f)
+            {
+                ++numInside;
+            }
+        }
+
+        if (numInside == 3)
+        {
+            addTriangle(v);
+            continue;
+        }
+
+        if (numInside == 0)
+        {
+            // behind the near plane
+            continue;
+        }
+
+        // clip against the near plane, results in a triangle or a quad
+        Vector4 polygon[4];
+        int numVertices = 0;
+
+        for (int j = 0; j < 3; ++j)
+        {
+            const int k = (j + 1) % 3;
+
+            if (d[j] > 0.0f)
+            {
+                polygon[numVertices++] = v[j];
+            }
+
+            if ((d[j] > 0.0f) != (d[k] > 0.0f))
+            {
+                polygon[numVertices++] = lerp(v[j], v[k], d[j] / (d[j] - d[k]));
+            }
+        }
+
+        GRAPHICS_RUNTIME_ASSERT(numVertices == 3 || numVertices == 4);
+
+        addTriangle(polygon);
+
+        if (numVertices == 4)
+        {
+            const Vector4 second[] = { polygon[0], polygon[2], polygon[3] };
+            addTriangle(second);
+        }
+    }
+}
+
+void OcclusionBuffer::rasterize()
+{
+    rasterizeTiles(0, numTiles());
+    updateHierarchy();
+}
+
+int OcclusionBuffer::numTiles() const
+{
+    return tilesX_ * tilesY_;
+}
+
+void OcclusionBuffer::rasterizeTiles(const int first, const int last)
+{
+    GRAPHICS_RUNTIME_ASSERT(first >= 0 && first <= last && last <= numTiles());
+
+    for (int i = first; i < last; ++i)
+    {
+        rasterizeTile(i);
+    }
+}
+
+void OcclusionBuffer::updateHierarchy()
+{
+    for (int cy = 0; cy < coarseY_; ++cy)
+    {
+        for (int cx = 0; cx < coarseX_; ++cx)
+        {
+            const int tx1 = Math::min((cx + 1) * coarseSize, tilesX_);
+            const int ty1 = Math::min((cy + 1) * coarseSize, tilesY_);
+
+            float maxDepth = 0.0f;
+
+            for (int ty = cy * coarseSize; ty < ty1; ++ty)
+            {
+                for (int tx = cx * coarseSize; tx < tx1; ++tx)
+                {
+                    maxDepth = Math::max(maxDepth, tileDepth_[ty * tilesX_ + tx]);
+                }
+            }
+
+            coarseDepth_[cy * coarseX_ + cx] = maxDepth;
+        }
+    }
+}
+
+bool OcclusionBuffer::isOccluded(const Extents3& extents) const
+{
+    if (extents.isEmpty())
+    {
+        return false;
+    }
+
+    increment(numTests_);
+
+    float minX = static_cast<float>(width_);
+    float minY = static_cast<float>(height_);
+    float maxX = 0.0f;
+    float maxY = 0.0f;
+    float minZ = 1.0f;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        const Vector4 v = Vector4(
+            (i & 1) ? extents.max.x : extents.min.x,
+            (i & 2) ? extents.max.y : extents.min.y,
+            (i & 4) ? extents.max.z : extents.min.z,
+            1.0f
+        ) * worldToClip_;
+
+        if (nearDistance(v) <= 0.0f)
+        {
+            // the extents intersect the near plane
+            return false;
+        }
+
+        const float invW = 1.0f / v.w;
+        const float x = (v.x * invW * 0.5f + 0.5f) * width_;
+        const float y = (v.y * invW * 0.5f + 0.5f) * height_;
+        const float z = v.z * invW * 0.5f + 0.5f;
+
+        minX = Math::min(minX, x);
+        minY = Math::min(minY, y);
+        maxX = Math::max(maxX, x);
+        maxY = Math::max(maxY, y);
+        minZ = Math::min(minZ, z);
+    }
+
+    if (minX >= width_ || minY >= height_ || maxX <= 0.0f || maxY <= 0.0f)
+    {
+        // outside the buffer, left for the frustum test
+        return false;
+    }
+
+    // covered pixel range, inclusive
+    const int px0 = static_cast<int>(Math::max(minX, 0.0f));
+    const int py0 = static_cast<int>(Math::max(minY, 0.0f));
+    const int px1 = static_cast<int>(Math::min(maxX, width_ - 1.0f));
+    const int py1 = static_cast<int>(Math::min(maxY, height_ - 1.0f));
+
+    const int tx0 = px0 / tileSize;
+    const int ty0 = py0 / tileSize;
+    const int tx1 = px1 / tileSize;
+    const int ty1 = py1 / tileSize;
+
+    // the extents are occluded if the nearest point of the extents is behind
+    // every covered pixel, the hierarchy is descended only where it does not
+    // decide
+    for (int cy = ty0 / coarseSize; cy <= ty1 / coarseSize; ++cy)
+    {
+        for (int cx = tx0 / coarseSize; cx <= tx1 / coarseSize; ++cx)
+        {
+            if (coarseDepth_[cy * coarseX_ + cx] < minZ)
+            {
+                continue;
+            }
+
+            const int cty0 = Math::max(ty0, cy * coarseSize);
+            const int ctx0 = Math::max(tx0, cx * coarseSize);
+            const int cty1 = Math::min(ty1, (cy + 1) * coarseSize - 1);
+            const int ctx1 = Math::min(tx1, (cx + 1) * coarseSize - 1);
+
+            for (int ty = cty0; ty <= cty1; ++ty)
+            {
+                for (int tx = ctx0; tx <= ctx1; ++tx)
+                {
+                    if (tileDepth_[ty * tilesX_ + tx] < minZ)
+                    {
+                        continue;
+                    }
+
+                    const int y0 = Math::max(py0, ty * tileSize);
+                    const int x0 = Math::max(px0, tx * tileSize);
+                    const int y1 = Math::min(py1, (ty + 1) * tileSize - 1);
+                    const int x1 = Math::min(px1, (tx + 1) * tileSize - 1);
+
+                    for (int y = y0; y <= y1; ++y)
+                    {
+                        const float* const row = &depth_[y * width_];
+
+                        for (int x = x0; x <= x1; ++x)
+                        {
+                            if (row[x] >= minZ)
+                            {
+                                // visible through this pixel
+                                return false;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    increment(numOccluded_);
+    return true;
+}
+
+const float* OcclusionBuffer::depth() const
+{
+    return &depth_[0];
+}
+
+int OcclusionBuffer::numOccluderTriangles() const
+{
+    return triangles_.size();
+}
+
+int OcclusionBuffer::numTests() const
+{
+    return numTests_;
+}
+
+int OcclusionBuffer::numOccluded() const
+{
+    return numOccluded_;
+}
+
+void OcclusionBuffer::clear()
+{
+    std::fill(depth_.begin(), depth_.end(), 1.0f);
+    std::fill(tileDepth_.begin(), tileDepth_.end(), 1.0f);
+    std::fill(coarseDepth_.begin(), coarseDepth_.end(), 1.0f);
+
+    triangles_.clear();
+
+    // keeps the capacity of the bins
+    for (size_t i = 0; i < bins_.size(); ++i)
+    {
+        bins_[i].clear();
+    }
+
+    numTests_ = 0;
+    numOccluded_ = 0;
+}
+
+void OcclusionBuffer::addTriangle(const Vector4* const v)
+{
+    float x[3];
+    float y[3];
+    float z[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        const float invW = 1.0f / v[i].w;
+
+        x[i] = (v[i].x * invW * 0.5f + 0.5f) * width_;
+        y[i] = (v[i].y * invW * 0.5f + 0.5f) * height_;
+        z[i] = Math::min(v[i].z * invW * 0.5f + 0.5f, 1.0f);
+    }
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+
+    if (Math::abs(area) < minArea)
+    {
+        return;
+    }
+
+    if (area < 0.0f)
+    {
+        // both faces occlude, make the winding counterclockwise
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+        area = -area;
+    }
+
+    // tile range of the screen space bounding box
+    const float minX = Math::min(x[0], Math::min(x[1], x[2]));
+    const float minY = Math::min(y[0], Math::min(y[1], y[2]));
+    const float maxX = Math::max(x[0], Math::max(x[1], x[2]));
+    const float maxY = Math::max(y[0], Math::max(y[1], y[2]));
+
+    if (minX >= width_ || minY >= height_ || maxX <= 0.0f || maxY <= 0.0f)
+    {
+        // off screen
+        return;
+    }
+
+    const int tx0 = static_cast<int>(Math::max(minX, 0.0f)) / tileSize;
+    const int ty0 = static_cast<int>(Math::max(minY, 0.0f)) / tileSize;
+    const int tx1 = static_cast<int>(Math::min(maxX, width_ - 1.0f)) / tileSize;
+    const int ty1 = static_cast<int>(Math::min(maxY, height_ - 1.0f)) / tileSize;
+
+    Triangle triangle;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        const int j = (i + 1) % 3;
+
+        triangle.a[i] = y[i] - y[j];
+        triangle.b[i] = x[j] - x[i];
+        triangle.c[i] = x[i] * y[j] - x[j] * y[i];
+    }
+
+    // depth is linear in screen space
+    triangle.zx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+    triangle.zy = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) / area;
+    triangle.z0 = z[0] - triangle.zx * x[0] - triangle.zy * y[0];
+
+    const int index = triangles_.size();
+    triangles_.push_back(triangle);
+
+    for (int ty = ty0; ty <= ty1; ++ty)
+    {
+        for (int tx = tx0; tx <= tx1; ++tx)
+        {
+            bins_[ty * tilesX_ + tx].push_back(index);
+        }
+    }
+}
+
+void OcclusionBuffer::rasterizeTile(const int tile)
+{
+    const std::vector<int>& bin = bins_[tile];
+
+    const int x0 = (tile % tilesX_) * tileSize;
+    const int y0 = (tile / tilesX_) * tileSize;
+
+    for (size_t i = 0; i < bin.size(); ++i)
+    {
+        const Triangle& t = triangles_[bin[i]];
+
+        for (int row = 0; row < tileSize; ++row)
+        {
+            // pixel centers
+            const float py = y0 + row + 0.5f;
+            float* const depth = &depth_[(y0 + row) * width_ + x0];
+
+            // edge and depth values at the start of the row
+            const float e0 = t.b[0] * py + t.c[0];
+            const float e1 = t.b[1] * py + t.c[1];
+            const float e2 = t.b[2] * py + t.c[2];
+            const float ez = t.zy * py + t.z0;
+
+#if defined(GRAPHICS_OCCLUSIONBUFFER_SSE2)
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+            for (int col = 0; col < tileSize; col += 4)
+            {
+                const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x0 + col)), offsets);
+
+                const __m128 w0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[0]), px), _mm_set1_ps(e0));
+                const __m128 w1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[1]), px), _mm_set1_ps(e1));
+                const __m128 w2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[2]), px), _mm_set1_ps(e2));
+
+                const __m128 inside = _mm_and_ps(
+                    _mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)),
+                    _mm_cmpge_ps(w2, zero)
+                );
+
+                const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.zx), px), _mm_set1_ps(ez));
+                const __m128 old = _mm_loadu_ps(depth + col);
+                const __m128 nearest = _mm_min_ps(old, z);
+
+                _mm_storeu_ps(
+                    depth + col,
+                    _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old))
+                );
+            }
+#else
+            for (int col = 0; col < tileSize; ++col)
+            {
+                const float px = x0 + col + 0.5f;
+
+                if (t.a[0] * px + e0 >= 0.0f
+                &&  t.a[1] * px + e1 >= 0.0f
+                &&  t.a[2] * px + e2 >= 0.0f)
+                {
+                    depth[col] = Math::min(depth[col], t.zx * px + ez);
+                }
+            }
+#endif
+        }
+    }
+
+    float maxDepth = 0.0f;
+
+    for (int row = 0; row < tileSize; ++row)
+    {
+        const float* const depth = &depth_[(y0 + row) * width_ + x0];
+
+        for (int col = 0; col < tileSize; ++col)
+        {
+            maxDepth = Math::max(maxDepth, depth[col]);
+        }
+    }
+
+    tileDepth_[tile] = maxDepth;
+}
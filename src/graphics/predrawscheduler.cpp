@@ -0,0 +1,235 @@
+/**
+ * @file graphics/predrawscheduler.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/predrawscheduler.h>
+
+#include <geometry/extents3.h>
+
+#include <graphics/groupnode.h>
+#include <graphics/renderqueue.h>
+#include <graphics/runtimeassert.h>
+#include <graphics/scene.h>
+
+PredrawScheduler::~PredrawScheduler()
+{
+    for (size_t i = 0; i < segments_.size(); ++i)
+    {
+        delete segments_[i];
+    }
+}
+
+PredrawScheduler::PredrawScheduler()
+:   taskSize_(1024),
+    params_(),
+    scene_(0),
+    roots_(),
+    tasks_(),
+    lastTaskSize_(0),
+    segments_(),
+    tests_()
+{
+    // ...
+}
+
+void PredrawScheduler::setTaskSize(const int numNodes)
+{
+    GRAPHICS_RUNTIME_ASSERT(numNodes > 0);
+    taskSize_ = numNodes;
+}
+
+int PredrawScheduler::taskSize() const
+{
+    return taskSize_;
+}
+
+void PredrawScheduler::init(const GroupNode& root, const PredrawParams& params)
+{
+    reset(params);
+
+    // update phase, after this the predraw step does not modify the world
+    // transforms or world extents
+    if (root.scene() != 0)
+    {
+        root.scene()->update();
+    }
+
+    root.worldExtents();
+
+    if (1 + root.numDescendants() > taskSize_)
+    {
+        split(root, VisibilityTest::allPlanes);
+    }
+    else
+    {
+        Root r;
+        r.node = &root;
+        r.subtree = -1;
+        r.planeMask = VisibilityTest::allPlanes;
+
+        addRoot(r, 1 + root.numDescendants());
+    }
+
+    prepareTasks();
+}
+
+void PredrawScheduler::init(Scene& scene, const PredrawParams& params)
+{
+    reset(params);
+
+    // update phase, refits the moved geometry nodes
+    scene.update();
+    scene_ = &scene;
+
+    // a subtree of height h has at most 2^h leaves
+    int maxHeight = 0;
+
+    while ((2 << maxHeight) <= taskSize_)
+    {
+        ++maxHeight;
+    }
+
+    std::vector<int> subtrees;
+    std::vector<uint32_t> planeMasks;
+    scene.tree().splitPredraw(params_, VisibilityTest::allPlanes, maxHeight, subtrees, planeMasks);
+
+    for (size_t i = 0; i < subtrees.size(); ++i)
+    {
+        Root r;
+        r.node = 0;
+        r.subtree = subtrees[i];
+        r.planeMask = planeMasks[i];
+
+        // each subtree is a task of its own
+        addRoot(r, taskSize_);
+    }
+
+    prepareTasks();
+}
+
+int PredrawScheduler::numTasks() const
+{
+    return tasks_.size();
+}
+
+void PredrawScheduler::runTask(const int index)
+{
+    GRAPHICS_RUNTIME_ASSERT(index >= 0 && index < numTasks());
+
+    // the render queue and the visibility test counters are not shared with
+    // other tasks
+    PredrawParams params = params_;
+    params.setRenderQueue(segments_[index]);
+    params.setVisibilityTest(&tests_[index]);
+
+    const Task& task = tasks_[index];
+
+    for (int i = task.first; i < task.last; ++i)
+    {
+        const Root& r = roots_[i];
+
+        if (r.node != 0)
+        {
+            r.node->predraw(params, r.planeMask);
+        }
+        else
+        {
+            scene_->tree().predrawSubtree(r.subtree, params, r.planeMask);
+        }
+    }
+}
+
+void PredrawScheduler::merge()
+{
+    for (size_t i = 0; i < tasks_.size(); ++i)
+    {
+        params_.renderQueue()->append(*segments_[i]);
+        params_.visibilityTest()->addCounters(tests_[i]);
+    }
+}
+
+void PredrawScheduler::reset(const PredrawParams& params)
+{
+    GRAPHICS_RUNTIME_ASSERT(params.renderQueue() != 0);
+    GRAPHICS_RUNTIME_ASSERT(params.visibilityTest() != 0);
+
+    params_ = params;
+    scene_ = 0;
+    roots_.clear();
+    tasks_.clear();
+    lastTaskSize_ = 0;
+}
+
+void PredrawScheduler::split(const GroupNode& group, uint32_t planeMask)
+{
+    const Extents3 extents = group.worldExtents();
+
+    if (planeMask != 0)
+    {
+        // the few split group nodes do not use their visibility caches
+        int lastPlane = -1;
+
+        if (params_.visibilityTest()->test(extents, planeMask, lastPlane) == VisibilityState::Invisible)
+        {
+            // early out
+            return;
+        }
+    }
+
+    params_.renderQueue()->addGroupNode(&group);
+
+    for (int i = 0; i < group.numChildren(); ++i)
+    {
+        const Node* const child = group.child(i);
+        const GroupNode* const childGroup = dynamic_cast<const GroupNode*>(child);
+        const int numNodes = childGroup != 0 ? 1 + childGroup->numDescendants() : 1;
+
+        if (numNodes > taskSize_)
+        {
+            split(*childGroup, planeMask);
+        }
+        else
+        {
+            Root r;
+            r.node = child;
+            r.subtree = -1;
+            r.planeMask = planeMask;
+
+            addRoot(r, numNodes);
+        }
+    }
+}
+
+void PredrawScheduler::addRoot(const Root& root, const int numNodes)
+{
+    if (tasks_.empty() || lastTaskSize_ >= taskSize_)
+    {
+        Task task;
+        task.first = roots_.size();
+        task.last = task.first;
+
+        tasks_.push_back(task);
+        lastTaskSize_ = 0;
+    }
+
+    roots_.push_back(root);
+    tasks_.back().last = roots_.size();
+    lastTaskSize_ += numNodes;
+}
+
+void PredrawScheduler::prepareTasks()
+{
+    while (segments_.size() < tasks_.size())
+    {
+        segments_.push_back(new RenderQueue());
+    }
+
+    tests_.assign(tasks_.size(), *params_.visibilityTest());
+
+    for (size_t i = 0; i < tasks_.size(); ++i)
+    {
+        segments_[i]->clear();
+        segments_[i]->init(*params_.renderQueue());
+    }
+}
@@ -5,12 +5,37 @@
 
 #include <graphics/program.h>
 
-#include <vector>
+#include <algorithm>
+#include <cstring>
 
 #include <graphics/fragmentshader.h>
 #include <graphics/opengl.h>
+#include <graphics/runtimeassert.h>
 #include <graphics/vertexshader.h>
 
+uint32_t Program::hashName(const char* const name)
+{
+    GRAPHICS_RUNTIME_ASSERT(name != 0);
+
+    // array uniforms are reported with a "[0]" suffix, hash them without it
+    size_t length = std::strlen(name);
+
+    if (length > 3 && std::strcmp(name + length - 3, "[0]") == 0)
+    {
+        length -= 3;
+    }
+
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
 Program::~Program()
 {
     // this will automatically detach any attached shader objects
@@ -20,7 +45,10 @@ Program::~Program()
 Program::Program()
 :   id_(glCreateProgram()),
     vertexShader_(0),
-    fragmentShader_(0)
+    fragmentShader_(0),
+    uniforms_(),
+    attributes_(),
+    uniformBlocks_()
 {
     // ...
 }
@@ -58,6 +86,15 @@ void Program::link()
     attachShaders();
 
     glLinkProgram(id_);
+
+    uniforms_.clear();
+    attributes_.clear();
+    uniformBlocks_.clear();
+
+    if (linkStatus())
+    {
+        reflect();
+    }
 }
 
 bool Program::linkStatus() const
@@ -96,6 +133,159 @@ const std::string Program::infoLog() const
     return std::string(buffer.data());
 }
 
+int32_t Program::uniformLocation(const uint32_t nameHash) const
+{
+    return findLocation(uniforms_, nameHash);
+}
+
+int32_t Program::attributeLocation(const uint32_t nameHash) const
+{
+    return findLocation(attributes_, nameHash);
+}
+
+int32_t Program::uniformBlockIndex(const uint32_t nameHash) const
+{
+    return findLocation(uniformBlocks_, nameHash);
+}
+
+bool Program::setUniformBlockBinding(const uint32_t nameHash, const uint32_t binding)
+{
+    const int32_t index = uniformBlockIndex(nameHash);
+
+    if (index == -1)
+    {
+        return false;
+    }
+
+    glUniformBlockBinding(id_, index, binding);
+    return true;
+}
+
+int Program::numUniforms() const
+{
+    return uniforms_.size();
+}
+
+int Program::numAttributes() const
+{
+    return attributes_.size();
+}
+
+int Program::numUniformBlocks() const
+{
+    return uniformBlocks_.size();
+}
+
+bool Program::Slot::operator <(const Slot& other) const
+{
+    return nameHash < other.nameHash;
+}
+
+void Program::reflect()
+{
+    GLint numUniforms = 0;
+    GLint numAttributes = 0;
+    GLint numUniformBlocks = 0;
+    GLint maxUniformLength = 0;
+    GLint maxAttributeLength = 0;
+    GLint maxUniformBlockLength = 0;
+
+    glGetProgramiv(id_, GL_ACTIVE_UNIFORMS, &numUniforms);
+    glGetProgramiv(id_, GL_ACTIVE_ATTRIBUTES, &numAttributes);
+    glGetProgramiv(id_, GL_ACTIVE_UNIFORM_BLOCKS, &numUniformBlocks);
+    glGetProgramiv(id_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxUniformLength);
+    glGetProgramiv(id_, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxAttributeLength);
+    glGetProgramiv(id_, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxUniformBlockLength);
+
+    const GLint maxLength = std::max(
+        std::max(maxUniformLength, maxAttributeLength),
+        maxUniformBlockLength
+    );
+
+    std::vector<GLchar> name(maxLength + 1);
+
+    for (GLint i = 0; i < numUniforms; ++i)
+    {
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(id_, i, name.size(), 0, &size, &type, name.data());
+
+        Slot slot;
+        slot.location = glGetUniformLocation(id_, name.data());
+        slot.nameHash = hashName(name.data());
+
+        // uniforms in named uniform blocks do not have a location
+        if (slot.location != -1)
+        {
+            uniforms_.push_back(slot);
+        }
+    }
+
+    for (GLint i = 0; i < numAttributes; ++i)
+    {
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveAttrib(id_, i, name.size(), 0, &size, &type, name.data());
+
+        Slot slot;
+        slot.location = glGetAttribLocation(id_, name.data());
+        slot.nameHash = hashName(name.data());
+
+        // built-in attributes do not have a location
+        if (slot.location != -1)
+        {
+            attributes_.push_back(slot);
+        }
+    }
+
+    for (GLint i = 0; i < numUniformBlocks; ++i)
+    {
+        glGetActiveUniformBlockName(id_, i, name.size(), 0, name.data());
+
+        Slot slot;
+        slot.location = i;
+        slot.nameHash = hashName(name.data());
+
+        uniformBlocks_.push_back(slot);
+    }
+
+    std::sort(uniforms_.begin(), uniforms_.end());
+    std::sort(attributes_.begin(), attributes_.end());
+    std::sort(uniformBlocks_.begin(), uniformBlocks_.end());
+
+    // name hashes must be unique within a program
+    for (size_t i = 1; i < uniforms_.size(); ++i)
+    {
+        GRAPHICS_RUNTIME_ASSERT(uniforms_[i - 1].nameHash != uniforms_[i].nameHash);
+    }
+
+    for (size_t i = 1; i < attributes_.size(); ++i)
+    {
+        GRAPHICS_RUNTIME_ASSERT(attributes_[i - 1].nameHash != attributes_[i].nameHash);
+    }
+
+    for (size_t i = 1; i < uniformBlocks_.size(); ++i)
+    {
+        GRAPHICS_RUNTIME_ASSERT(uniformBlocks_[i - 1].nameHash != uniformBlocks_[i].nameHash);
+    }
+}
+
+int32_t Program::findLocation(const SlotVector& slots, const uint32_t nameHash)
+{
+    Slot key;
+    key.nameHash = nameHash;
+    key.location = -1;
+
+    const SlotVector::const_iterator i = std::lower_bound(slots.begin(), slots.end(), key);
+
+    if (i == slots.end() || i->nameHash != nameHash)
+    {
+        return -1;
+    }
+
+    return i->location;
+}
+
 void Program::attachShaders()
 {
     if (vertexShader() != 0)
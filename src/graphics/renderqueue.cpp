@@ -7,8 +7,51 @@
 
 #include <algorithm>
 
+#include <geometry/math.h>
+
+#include <graphics/cameranode.h>
+#include <graphics/drawparams.h>
 #include <graphics/geometrynode.h>
+#include <graphics/groupnode.h>
+#include <graphics/impostoratlas.h>
+#include <graphics/mesharena.h>
+#include <graphics/occlusionbuffer.h>
 #include <graphics/runtimeassert.h>
+#include <graphics/sortkey.h>
+
+namespace {
+
+// radix sort digit size
+const int radixBits = 8;
+const int radixSize = 1 << radixBits;
+const int numRadixPasses = 64 / radixBits;
+
+// maximum number of item moves per item allowed when fixing the previous
+// sorted order with an insertion sort
+const size_t maxMovesPerItem = 4;
+
+/**
+ * Tells whether a node is occluded. The node is not tested if its parent
+ * node is occluded.
+ *
+ * @param node The node.
+ * @param occludedGroups Occluded group nodes, sorted by address.
+ * @param occlusionBuffer A rasterized occlusion buffer.
+ *
+ * @return <code>true</code> if the node is occluded.
+ */
+bool isOccluded(
+    const Node& node,
+    const std::vector<const GroupNode*>& occludedGroups,
+    const OcclusionBuffer& occlusionBuffer)
+{
+    const GroupNode* const parent = node.parent();
+
+    return std::binary_search(occludedGroups.begin(), occludedGroups.end(), parent)
+        || occlusionBuffer.isOccluded(node.worldExtents());
+}
+
+} // namespace
 
 RenderQueue::~RenderQueue()
 {
@@ -16,27 +59,116 @@ RenderQueue::~RenderQueue()
 }
 
 RenderQueue::RenderQueue()
-:   geometryNodes_(),
-    groupNodes_()
+:   items_(),
+    buffer_(),
+    groupNodes_(),
+    impostorNodes_(),
+    transforms_(),
+    instanceExtents_(),
+    previousNodes_(),
+    previousOrder_(),
+    viewPosition_(0.0f, 0.0f, 0.0f),
+    viewDirection_(0.0f, 0.0f, -1.0f),
+    near_(0.0f),
+    far_(1.0f),
+    perspective_(true),
+    sizeScale_(1.0f),
+    lodHysteresis_(0.1f),
+    lodCounts_(),
+    impostorAtlas_(0),
+    sortReused_(false),
+    run_(),
+    runTransforms_(),
+    numDrawnRuns_(0)
 {
     // ...
 }
 
+void RenderQueue::init(const CameraNode& camera)
+{
+    const Transform3 t = camera.worldTransform();
+    const ProjectionSettings s = camera.projectionSettings();
+
+    viewPosition_ = t.translation;
+    viewDirection_ = -t.rotation.row(2);
+    near_ = Math::min(s.near, s.far);
+    far_ = Math::max(s.near, s.far);
+
+    // a size at unit view distance in a perspective projection, or any size
+    // in an orthographic projection, relative to the viewport height
+    const float height = Math::abs(s.top - s.bottom);
+    perspective_ = s.type == ProjectionType::Perspective;
+
+    if (height > 0.0f)
+    {
+        sizeScale_ = perspective_ ? Math::abs(s.near) / height : 1.0f / height;
+    }
+}
+
+void RenderQueue::init(const RenderQueue& other)
+{
+    viewPosition_ = other.viewPosition_;
+    viewDirection_ = other.viewDirection_;
+    near_ = other.near_;
+    far_ = other.far_;
+    perspective_ = other.perspective_;
+    sizeScale_ = other.sizeScale_;
+    lodHysteresis_ = other.lodHysteresis_;
+    impostorAtlas_ = other.impostorAtlas_;
+}
+
 void RenderQueue::addGeometryNode(const GeometryNode* const p)
 {
     GRAPHICS_RUNTIME_ASSERT(p != 0);
-    geometryNodes_.push_back(p);
+
+    const Extents3 worldExtents = p->worldExtents();
+
+    if (impostorAtlas_ != 0
+    &&  worldExtents.isEmpty() == false
+    &&  impostorAtlas_->isImpostor(*p, projectedSize(worldExtents), lodHysteresis_))
+    {
+        impostorNodes_.push_back(p);
+        return;
+    }
+
+    addItem(p, worldExtents, -1);
+}
+
+void RenderQueue::addGeometryNode(
+    const GeometryNode* const p,
+    const Transform3& worldTransform,
+    const Extents3& worldExtents)
+{
+    GRAPHICS_RUNTIME_ASSERT(p != 0);
+
+    transforms_.push_back(worldTransform);
+    instanceExtents_.push_back(worldExtents);
+    addItem(p, worldExtents, transforms_.size() - 1);
 }
 
 const GeometryNode* RenderQueue::geometryNode(const int index) const
 {
     GRAPHICS_RUNTIME_ASSERT(index >= 0 && index < numGeometryNodes());
-    return geometryNodes_[index];
+    return items_[index].node;
+}
+
+const Transform3* RenderQueue::instanceTransform(const int index) const
+{
+    GRAPHICS_RUNTIME_ASSERT(index >= 0 && index < numGeometryNodes());
+
+    const int transform = items_[index].transform;
+    return transform != -1 ? &transforms_[transform] : 0;
+}
+
+uint64_t RenderQueue::sortKey(const int index) const
+{
+    GRAPHICS_RUNTIME_ASSERT(index >= 0 && index < numGeometryNodes());
+    return items_[index].key;
 }
 
 int RenderQueue::numGeometryNodes() const
 {
-    return geometryNodes_.size();
+    return items_.size();
 }
 
 void RenderQueue::addGroupNode(const GroupNode* const p)
@@ -56,31 +188,471 @@ int RenderQueue::numGroupNodes() const
     return groupNodes_.size();
 }
 
+void RenderQueue::setImpostorAtlas(const ImpostorAtlas* const p)
+{
+    impostorAtlas_ = p;
+}
+
+const ImpostorAtlas* RenderQueue::impostorAtlas() const
+{
+    return impostorAtlas_;
+}
+
+const GeometryNode* RenderQueue::impostorNode(const int index) const
+{
+    GRAPHICS_RUNTIME_ASSERT(index >= 0 && index < numImpostorNodes());
+    return impostorNodes_[index];
+}
+
+int RenderQueue::numImpostorNodes() const
+{
+    return impostorNodes_.size();
+}
+
+void RenderQueue::append(const RenderQueue& other)
+{
+    GRAPHICS_RUNTIME_ASSERT(&other != this);
+
+    const int offset = items_.size();
+    const int transformOffset = transforms_.size();
+
+    items_.insert(items_.end(), other.items_.begin(), other.items_.end());
+    groupNodes_.insert(groupNodes_.end(), other.groupNodes_.begin(), other.groupNodes_.end());
+    impostorNodes_.insert(impostorNodes_.end(), other.impostorNodes_.begin(), other.impostorNodes_.end());
+    transforms_.insert(transforms_.end(), other.transforms_.begin(), other.transforms_.end());
+    instanceExtents_.insert(instanceExtents_.end(), other.instanceExtents_.begin(), other.instanceExtents_.end());
+
+    if (lodCounts_.size() < other.lodCounts_.size())
+    {
+        lodCounts_.resize(other.lodCounts_.size(), 0);
+    }
+
+    for (size_t i = 0; i < other.lodCounts_.size(); ++i)
+    {
+        lodCounts_[i] += other.lodCounts_[i];
+    }
+
+    // continue the order of addition
+    for (size_t i = offset; i < items_.size(); ++i)
+    {
+        items_[i].index = i;
+
+        if (items_[i].transform != -1)
+        {
+            items_[i].transform += transformOffset;
+        }
+    }
+}
+
 void RenderQueue::clear()
 {
     // maintains capacity
-    geometryNodes_.clear();
+    items_.clear();
     groupNodes_.clear();
+    impostorNodes_.clear();
+    transforms_.clear();
+    instanceExtents_.clear();
+    lodCounts_.clear();
+}
+
+void RenderQueue::removeOccluded(const OcclusionBuffer& occlusionBuffer)
+{
+    // the nodes of occluded group nodes are removed without testing them, as
+    // the predraw step would have skipped them
+    GroupNodeVector occludedGroups;
+    size_t n = 0;
+
+    for (size_t i = 0; i < groupNodes_.size(); ++i)
+    {
+        if (occlusionBuffer.isOccluded(groupNodes_[i]->worldExtents()))
+        {
+            occludedGroups.push_back(groupNodes_[i]);
+        }
+        else
+        {
+            groupNodes_[n++] = groupNodes_[i];
+        }
+    }
+
+    groupNodes_.resize(n);
+    std::sort(occludedGroups.begin(), occludedGroups.end());
+
+    n = 0;
+
+    for (size_t i = 0; i < items_.size(); ++i)
+    {
+        const Item& item = items_[i];
+
+        // prefab nodes are tested at the instance location, the instance
+        // transforms of removed items are left unused
+        const bool occluded = item.transform != -1
+            ? occlusionBuffer.isOccluded(instanceExtents_[item.transform])
+            : isOccluded(*item.node, occludedGroups, occlusionBuffer);
+
+        if (occluded == false)
+        {
+            items_[n] = item;
+            items_[n].index = n;
+            ++n;
+        }
+    }
+
+    items_.resize(n);
+
+    n = 0;
+
+    for (size_t i = 0; i < impostorNodes_.size(); ++i)
+    {
+        if (isOccluded(*impostorNodes_[i], occludedGroups, occlusionBuffer) == false)
+        {
+            impostorNodes_[n++] = impostorNodes_[i];
+        }
+    }
+
+    impostorNodes_.resize(n);
+}
+
+float RenderQueue::projectedSize(const Extents3& worldExtents) const
+{
+    if (worldExtents.isEmpty())
+    {
+        return 0.0f;
+    }
+
+    const float diameter = length(worldExtents.max - worldExtents.min);
+
+    if (perspective_ == false)
+    {
+        return diameter * sizeScale_;
+    }
+
+    const Vector3 center = 0.5f * (worldExtents.min + worldExtents.max);
+    const float distance = length(center - viewPosition_);
+
+    if (distance <= 0.5f * diameter)
+    {
+        // the view position is inside the bounding sphere
+        return Math::infinity();
+    }
+
+    // the distance to the center instead of the view depth, so the size does
+    // not change when the camera only turns
+    return diameter / distance * sizeScale_;
+}
+
+void RenderQueue::setLodHysteresis(const float hysteresis)
+{
+    GRAPHICS_RUNTIME_ASSERT(hysteresis >= 0.0f && hysteresis < 1.0f);
+    lodHysteresis_ = hysteresis;
+}
+
+float RenderQueue::lodHysteresis() const
+{
+    return lodHysteresis_;
+}
+
+void RenderQueue::countLod(const int lod)
+{
+    GRAPHICS_RUNTIME_ASSERT(lod >= 0);
+
+    if (lod >= static_cast<int>(lodCounts_.size()))
+    {
+        lodCounts_.resize(lod + 1, 0);
+    }
+
+    ++lodCounts_[lod];
+}
+
+int RenderQueue::numLodNodes(const int lod) const
+{
+    GRAPHICS_RUNTIME_ASSERT(lod >= 0);
+    return lod < numLodCounters() ? lodCounts_[lod] : 0;
+}
+
+int RenderQueue::numLodCounters() const
+{
+    return lodCounts_.size();
 }
 
 void RenderQueue::draw(const DrawParams& params) const
 {
-    for (size_t i = 0; i < geometryNodes_.size(); ++i)
+    const size_t n = items_.size();
+    size_t i = 0;
+
+    numDrawnRuns_ = 0;
+
+    if (params.meshArena != 0
+    &&  params.commandBuffer != 0
+    &&  MeshArena::isMultiDrawSupported())
+    {
+        drawMultiDraw(params);
+        return;
+    }
+
+    DrawParams runParams = params;
+
+    while (i < n)
     {
-        geometryNodes_[i]->draw(params);
+        const GeometryNode* const first = items_[i].node;
+
+        // runs do not cross render pass, program or material boundaries
+        const uint64_t stateKey = items_[i].key >> SortKey::depthBits;
+
+        run_.clear();
+        run_.push_back(first);
+
+        size_t j = i + 1;
+
+        while (j < n
+        &&     (items_[j].key >> SortKey::depthBits) == stateKey
+        &&     first->isInstanceCompatible(*items_[j].node))
+        {
+            run_.push_back(items_[j].node);
+            ++j;
+        }
+
+        runParams.worldTransforms = runTransforms(i, j);
+        first->drawInstanced(runParams, &run_[0], run_.size());
+        ++numDrawnRuns_;
+
+        i = j;
     }
 }
 
+void RenderQueue::drawMultiDraw(const DrawParams& params) const
+{
+    const size_t n = items_.size();
+    size_t i = 0;
+
+    DrawParams runParams = params;
+
+    while (i < n)
+    {
+        const GeometryNode* const first = items_[i].node;
+
+        // runs do not cross render pass boundaries
+        const uint64_t stateKey = items_[i].key >> (SortKey::materialBits + SortKey::depthBits);
+
+        run_.clear();
+        run_.push_back(first);
+
+        size_t j = i + 1;
+
+        while (j < n
+        &&     (items_[j].key >> (SortKey::materialBits + SortKey::depthBits)) == stateKey
+        &&     first->isMultiDrawCompatible(*items_[j].node))
+        {
+            run_.push_back(items_[j].node);
+            ++j;
+        }
+
+        runParams.worldTransforms = runTransforms(i, j);
+        first->drawMultiDraw(runParams, &run_[0], run_.size());
+        ++numDrawnRuns_;
+
+        i = j;
+    }
+}
+
+void RenderQueue::addItem(
+    const GeometryNode* const p,
+    const Extents3& worldExtents,
+    const int transform)
+{
+    float depth = 0.0f;
+
+    if (worldExtents.isEmpty() == false && far_ > near_)
+    {
+        const Vector3 center = 0.5f * (worldExtents.min + worldExtents.max);
+        depth = (dot(center - viewPosition_, viewDirection_) - near_) / (far_ - near_);
+    }
+
+    Item item;
+    item.key = SortKey::pack(
+        p->renderPass(),
+        p->materialKey(),
+        SortKey::quantizeDepth(depth)
+    );
+    item.node = p;
+    item.index = items_.size();
+    item.transform = transform;
+
+    items_.push_back(item);
+}
+
+const Transform3* RenderQueue::runTransforms(const size_t first, const size_t last) const
+{
+    if (transforms_.empty())
+    {
+        // the nodes are drawn with their own world transforms
+        return 0;
+    }
+
+    runTransforms_.clear();
+
+    for (size_t i = first; i < last; ++i)
+    {
+        const Item& item = items_[i];
+
+        runTransforms_.push_back(
+            item.transform != -1 ? transforms_[item.transform] : item.node->worldTransform()
+        );
+    }
+
+    return &runTransforms_[0];
+}
+
+int RenderQueue::numDrawnRuns() const
+{
+    return numDrawnRuns_;
+}
+
 void RenderQueue::sort()
 {
-    std::sort(geometryNodes_.begin(), geometryNodes_.end(), compare);
+    sortReused_ = sortFromPreviousOrder();
+
+    if (sortReused_ == false)
+    {
+        radixSort();
+    }
+
+    storeOrder();
+}
+
+bool RenderQueue::isSortReused() const
+{
+    return sortReused_;
 }
 
-bool RenderQueue::compare(
-    const GeometryNode* const a,
-    const GeometryNode* const b)
+bool RenderQueue::sortFromPreviousOrder()
 {
-    // TODO: ...
+    const size_t n = items_.size();
+
+    if (n != previousNodes_.size())
+    {
+        return false;
+    }
+
+    // the previous order can be used only if the nodes were added in the same
+    // order as in the previous frame
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (items_[i].node != previousNodes_[i])
+        {
+            return false;
+        }
+    }
+
+    buffer_.resize(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        buffer_[i] = items_[previousOrder_[i]];
+    }
+
+    // insertion sort with a move budget, this is stable with respect to the
+    // previous sorted order, which keeps the order of equal keys coherent
+    // from frame to frame
+    const size_t maxMoves = n * maxMovesPerItem;
+    size_t numMoves = 0;
+
+    for (size_t i = 1; i < n; ++i)
+    {
+        if (buffer_[i - 1].key <= buffer_[i].key)
+        {
+            continue;
+        }
+
+        const Item item = buffer_[i];
+        size_t j = i;
+
+        while (j > 0 && item.key < buffer_[j - 1].key)
+        {
+            buffer_[j] = buffer_[j - 1];
+            --j;
+            ++numMoves;
+        }
+
+        buffer_[j] = item;
+
+        if (numMoves > maxMoves)
+        {
+            // too far from sorted, a radix sort is faster
+            return false;
+        }
+    }
+
+    items_.swap(buffer_);
 
-    return false;
+    return true;
+}
+
+void RenderQueue::radixSort()
+{
+    const size_t n = items_.size();
+
+    if (n < 2)
+    {
+        return;
+    }
+
+    // build the histograms of all digits in a single pass
+    size_t counts[numRadixPasses][radixSize] = {{0}};
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const uint64_t key = items_[i].key;
+
+        for (int pass = 0; pass < numRadixPasses; ++pass)
+        {
+            ++counts[pass][(key >> (pass * radixBits)) & (radixSize - 1)];
+        }
+    }
+
+    buffer_.resize(n);
+
+    for (int pass = 0; pass < numRadixPasses; ++pass)
+    {
+        size_t* const count = counts[pass];
+        const int shift = pass * radixBits;
+
+        // all keys share this digit, skip the pass
+        if (count[(items_[0].key >> shift) & (radixSize - 1)] == n)
+        {
+            continue;
+        }
+
+        // convert the digit counts to bucket offsets
+        size_t offset = 0;
+
+        for (int i = 0; i < radixSize; ++i)
+        {
+            const size_t c = count[i];
+            count[i] = offset;
+            offset += c;
+        }
+
+        // stable scatter
+        for (size_t i = 0; i < n; ++i)
+        {
+            const int digit = (items_[i].key >> shift) & (radixSize - 1);
+            buffer_[count[digit]++] = items_[i];
+        }
+
+        items_.swap(buffer_);
+    }
+}
+
+void RenderQueue::storeOrder()
+{
+    const size_t n = items_.size();
+
+    previousNodes_.resize(n);
+    previousOrder_.resize(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        previousNodes_[items_[i].index] = items_[i].node;
+        previousOrder_[i] = items_[i].index;
+    }
 }
@@ -0,0 +1,155 @@
+/**
+ * @file graphics/scene.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/scene.h>
+
+#include <algorithm>
+
+#include <geometry/extents3.h>
+
+#include <graphics/geometrynode.h>
+#include <graphics/groupnode.h>
+#include <graphics/runtimeassert.h>
+#include <graphics/visibilitytest.h>
+
+Scene::~Scene()
+{
+    setRootNode(0);
+}
+
+Scene::Scene()
+:   rootNode_(0),
+    transforms_(),
+    tree_(),
+    movedProxies_(),
+    numRefittedNodes_(0),
+    numReinsertedNodes_(0)
+{
+    // ...
+}
+
+void Scene::setRootNode(GroupNode* const p)
+{
+    GRAPHICS_RUNTIME_ASSERT(p == 0 || p->hasParent() == false);
+
+    if (rootNode_ != 0)
+    {
+        rootNode_->setScene(0);
+    }
+
+    // all geometry nodes should have unregistered
+    GRAPHICS_RUNTIME_ASSERT(tree_.numProxies() == 0);
+
+    rootNode_ = p;
+
+    if (rootNode_ != 0)
+    {
+        rootNode_->setScene(this);
+    }
+}
+
+GroupNode* Scene::rootNode() const
+{
+    return rootNode_;
+}
+
+void Scene::update()
+{
+    // invalidates the world extents of the updated nodes, the updated
+    // geometry nodes are added to the moved proxies
+    transforms_.update();
+
+    numRefittedNodes_ = movedProxies_.size();
+    numReinsertedNodes_ = 0;
+
+    for (size_t i = 0; i < movedProxies_.size(); ++i)
+    {
+        const int proxy = movedProxies_[i];
+
+        tree_.setMoved(proxy, false);
+
+        if (tree_.move(proxy, tree_.node(proxy)->worldExtents()))
+        {
+            ++numReinsertedNodes_;
+        }
+    }
+
+    movedProxies_.clear();
+}
+
+void Scene::predraw(const PredrawParams& params)
+{
+    update();
+    tree_.predraw(params, VisibilityTest::allPlanes);
+}
+
+void Scene::query(const Extents3& region, std::vector<GeometryNode*>& nodes)
+{
+    update();
+    tree_.query(region, nodes);
+}
+
+TransformHierarchy& Scene::transforms()
+{
+    return transforms_;
+}
+
+AabbTree& Scene::tree()
+{
+    return tree_;
+}
+
+int Scene::numRefittedNodes() const
+{
+    return numRefittedNodes_;
+}
+
+int Scene::numReinsertedNodes() const
+{
+    return numReinsertedNodes_;
+}
+
+void Scene::addNode(GeometryNode* const p)
+{
+    GRAPHICS_RUNTIME_ASSERT(p != 0);
+    GRAPHICS_RUNTIME_ASSERT(p->sceneProxy() == -1);
+
+    p->setSceneProxy(tree_.insert(p->worldExtents(), p));
+}
+
+void Scene::removeNode(GeometryNode* const p)
+{
+    GRAPHICS_RUNTIME_ASSERT(p != 0);
+
+    const int proxy = p->sceneProxy();
+    GRAPHICS_RUNTIME_ASSERT(proxy != -1);
+
+    if (tree_.isMoved(proxy))
+    {
+        // the proxy Id may be reused before the next update
+        std::vector<int>::iterator i = std::find(movedProxies_.begin(), movedProxies_.end(), proxy);
+        GRAPHICS_RUNTIME_ASSERT(i != movedProxies_.end());
+
+        *i = movedProxies_.back();
+        movedProxies_.pop_back();
+    }
+
+    tree_.remove(proxy);
+    p->setSceneProxy(-1);
+}
+
+void Scene::invalidateNode(const GeometryNode* const p)
+{
+    GRAPHICS_RUNTIME_ASSERT(p != 0);
+
+    const int proxy = p->sceneProxy();
+    GRAPHICS_RUNTIME_ASSERT(proxy != -1);
+
+    if (tree_.isMoved(proxy) == false)
+    {
+        tree_.setMoved(proxy, true);
+        movedProxies_.push_back(proxy);
+    }
+}
@@ -0,0 +1,51 @@
+/**
+ * @file graphics/sortkey.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/sortkey.h>
+
+#include <geometry/math.h>
+
+namespace {
+
+const int depthShift = 0;
+const int materialShift = depthShift + SortKey::depthBits;
+const int passShift = materialShift + SortKey::materialBits;
+
+const uint64_t depthMask = (uint64_t(1) << SortKey::depthBits) - 1;
+const uint64_t materialMask = (uint64_t(1) << SortKey::materialBits) - 1;
+const uint64_t passMask = (uint64_t(1) << SortKey::passBits) - 1;
+
+} // namespace
+
+uint64_t SortKey::pack(
+    const uint32_t pass,
+    const uint32_t material,
+    const uint32_t depth)
+{
+    return ((pass & passMask) << passShift)
+         | ((material & materialMask) << materialShift)
+         | ((depth & depthMask) << depthShift);
+}
+
+uint32_t SortKey::quantizeDepth(const float depth)
+{
+    const float t = Math::clamp(depth, 0.0f, 1.0f);
+    return static_cast<uint32_t>(t * static_cast<float>(depthMask));
+}
+
+uint32_t SortKey::pass(const uint64_t key)
+{
+    return static_cast<uint32_t>((key >> passShift) & passMask);
+}
+
+uint32_t SortKey::material(const uint64_t key)
+{
+    return static_cast<uint32_t>((key >> materialShift) & materialMask);
+}
+
+uint32_t SortKey::depth(const uint64_t key)
+{
+    return static_cast<uint32_t>((key >> depthShift) & depthMask);
+}
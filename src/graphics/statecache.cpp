@@ -0,0 +1,453 @@
+/**
+ * @file graphics/statecache.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/statecache.h>
+
+#include <graphics/opengl.h>
+#include <graphics/program.h>
+#include <graphics/runtimeassert.h>
+#include <graphics/texture.h>
+
+namespace {
+
+// marks a binding whose state is not known
+const uint32_t unknownId = 0xFFFFFFFF;
+
+GLenum toGLenum(const BlendEquation::Enum x)
+{
+    switch (x)
+    {
+        case BlendEquation::Add:                return GL_FUNC_ADD;
+        case BlendEquation::Subtract:           return GL_FUNC_SUBTRACT;
+        case BlendEquation::ReverseSubtract:    return GL_FUNC_REVERSE_SUBTRACT;
+        case BlendEquation::Min:                return GL_MIN;
+        case BlendEquation::Max:                return GL_MAX;
+
+        default:
+            GRAPHICS_RUNTIME_ASSERT(false);
+            return GL_FUNC_ADD;
+    }
+}
+
+GLenum toGLenum(const SrcBlendFactor::Enum x)
+{
+    switch (x)
+    {
+        case SrcBlendFactor::Zero:                  return GL_ZERO;
+        case SrcBlendFactor::One:                   return GL_ONE;
+        case SrcBlendFactor::SrcColor:              return GL_SRC_COLOR;
+        case SrcBlendFactor::OneMinusSrcColor:      return GL_ONE_MINUS_SRC_COLOR;
+        case SrcBlendFactor::DstColor:              return GL_DST_COLOR;
+        case SrcBlendFactor::OneMinusDstColor:      return GL_ONE_MINUS_DST_COLOR;
+        case SrcBlendFactor::SrcAlpha:              return GL_SRC_ALPHA;
+        case SrcBlendFactor::OneMinusSrcAlpha:      return GL_ONE_MINUS_SRC_ALPHA;
+        case SrcBlendFactor::DstAlpha:              return GL_DST_ALPHA;
+        case SrcBlendFactor::OneMinusDstAlpha:      return GL_ONE_MINUS_DST_ALPHA;
+        case SrcBlendFactor::ConstantColor:         return GL_CONSTANT_COLOR;
+        case SrcBlendFactor::OneMinusConstantColor: return GL_ONE_MINUS_CONSTANT_COLOR;
+        case SrcBlendFactor::ConstantAlpha:         return GL_CONSTANT_ALPHA;
+        case SrcBlendFactor::OneMinusConstantAlpha: return GL_ONE_MINUS_CONSTANT_ALPHA;
+        case SrcBlendFactor::SrcAlphaSaturate:      return GL_SRC_ALPHA_SATURATE;
+
+        default:
+            GRAPHICS_RUNTIME_ASSERT(false);
+            return GL_ONE;
+    }
+}
+
+GLenum toGLenum(const DstBlendFactor::Enum x)
+{
+    switch (x)
+    {
+        case DstBlendFactor::Zero:                  return GL_ZERO;
+        case DstBlendFactor::One:                   return GL_ONE;
+        case DstBlendFactor::SrcColor:              return GL_SRC_COLOR;
+        case DstBlendFactor::OneMinusSrcColor:      return GL_ONE_MINUS_SRC_COLOR;
+        case DstBlendFactor::DstColor:              return GL_DST_COLOR;
+        case DstBlendFactor::OneMinusDstColor:      return GL_ONE_MINUS_DST_COLOR;
+        case DstBlendFactor::SrcAlpha:              return GL_SRC_ALPHA;
+        case DstBlendFactor::OneMinusSrcAlpha:      return GL_ONE_MINUS_SRC_ALPHA;
+        case DstBlendFactor::DstAlpha:              return GL_DST_ALPHA;
+        case DstBlendFactor::OneMinusDstAlpha:      return GL_ONE_MINUS_DST_ALPHA;
+        case DstBlendFactor::ConstantColor:         return GL_CONSTANT_COLOR;
+        case DstBlendFactor::OneMinusConstantColor: return GL_ONE_MINUS_CONSTANT_COLOR;
+        case DstBlendFactor::ConstantAlpha:         return GL_CONSTANT_ALPHA;
+        case DstBlendFactor::OneMinusConstantAlpha: return GL_ONE_MINUS_CONSTANT_ALPHA;
+
+        default:
+            GRAPHICS_RUNTIME_ASSERT(false);
+            return GL_ZERO;
+    }
+}
+
+GLenum toGLenum(const DepthTestCompareFunc::Enum x)
+{
+    switch (x)
+    {
+        case DepthTestCompareFunc::Never:           return GL_NEVER;
+        case DepthTestCompareFunc::Always:          return GL_ALWAYS;
+        case DepthTestCompareFunc::Less:            return GL_LESS;
+        case DepthTestCompareFunc::LessEqual:       return GL_LEQUAL;
+        case DepthTestCompareFunc::Greater:         return GL_GREATER;
+        case DepthTestCompareFunc::GreaterEqual:    return GL_GEQUAL;
+        case DepthTestCompareFunc::Equal:           return GL_EQUAL;
+        case DepthTestCompareFunc::NotEqual:        return GL_NOTEQUAL;
+
+        default:
+            GRAPHICS_RUNTIME_ASSERT(false);
+            return GL_LESS;
+    }
+}
+
+GLenum toGLenum(const StencilTestCompareFunc::Enum x)
+{
+    switch (x)
+    {
+        case StencilTestCompareFunc::Never:         return GL_NEVER;
+        case StencilTestCompareFunc::Always:        return GL_ALWAYS;
+        case StencilTestCompareFunc::Less:          return GL_LESS;
+        case StencilTestCompareFunc::LessEqual:     return GL_LEQUAL;
+        case StencilTestCompareFunc::Greater:       return GL_GREATER;
+        case StencilTestCompareFunc::GreaterEqual:  return GL_GEQUAL;
+        case StencilTestCompareFunc::Equal:         return GL_EQUAL;
+        case StencilTestCompareFunc::NotEqual:      return GL_NOTEQUAL;
+
+        default:
+            GRAPHICS_RUNTIME_ASSERT(false);
+            return GL_ALWAYS;
+    }
+}
+
+GLenum toGLenum(const StencilTestAction::Enum x)
+{
+    switch (x)
+    {
+        case StencilTestAction::Keep:           return GL_KEEP;
+        case StencilTestAction::Zero:           return GL_ZERO;
+        case StencilTestAction::Replace:        return GL_REPLACE;
+        case StencilTestAction::Increment:      return GL_INCR;
+        case StencilTestAction::IncrementWrap:  return GL_INCR_WRAP;
+        case StencilTestAction::Decrement:      return GL_DECR;
+        case StencilTestAction::DecrementWrap:  return GL_DECR_WRAP;
+        case StencilTestAction::Invert:         return GL_INVERT;
+
+        default:
+            GRAPHICS_RUNTIME_ASSERT(false);
+            return GL_KEEP;
+    }
+}
+
+GLenum toGLenum(const CullFace::Enum x)
+{
+    switch (x)
+    {
+        case CullFace::Back:    return GL_BACK;
+        case CullFace::Front:   return GL_FRONT;
+
+        default:
+            GRAPHICS_RUNTIME_ASSERT(false);
+            return GL_BACK;
+    }
+}
+
+void setEnabled(const GLenum capability, const bool enabled)
+{
+    if (enabled)
+    {
+        glEnable(capability);
+    }
+    else
+    {
+        glDisable(capability);
+    }
+}
+
+} // namespace
+
+StateCache::StateCache()
+:   blend_(),
+    depthTest_(),
+    stencilTest_(),
+    cullTest_(),
+    blendEnabledValid_(false),
+    depthTestEnabledValid_(false),
+    stencilTestEnabledValid_(false),
+    cullTestEnabledValid_(false),
+    blendValid_(false),
+    depthTestValid_(false),
+    stencilTestValid_(false),
+    cullTestValid_(false),
+    programId_(unknownId),
+    vertexArrayId_(unknownId),
+    activeTextureUnit_(-1),
+    numIssuedCalls_(0),
+    numSavedCalls_(0)
+{
+    invalidate();
+}
+
+void StateCache::invalidate()
+{
+    blendEnabledValid_ = false;
+    depthTestEnabledValid_ = false;
+    stencilTestEnabledValid_ = false;
+    cullTestEnabledValid_ = false;
+    blendValid_ = false;
+    depthTestValid_ = false;
+    stencilTestValid_ = false;
+    cullTestValid_ = false;
+    programId_ = unknownId;
+    vertexArrayId_ = unknownId;
+    activeTextureUnit_ = -1;
+
+    for (int i = 0; i < maxTextureUnits; ++i)
+    {
+        textureIds_[i] = unknownId;
+    }
+}
+
+void StateCache::apply(const BlendSettings& settings)
+{
+    if (count(blendEnabledValid_ == false || blend_.enabled != settings.enabled))
+    {
+        setEnabled(GL_BLEND, settings.enabled);
+        blend_.enabled = settings.enabled;
+        blendEnabledValid_ = true;
+    }
+
+    if (settings.enabled == false)
+    {
+        // the rest of the state is applied when blending is enabled
+        return;
+    }
+
+    const Color& c = settings.blendColor;
+
+    if (count(blendValid_ == false
+    ||  blend_.blendColor.r != c.r
+    ||  blend_.blendColor.g != c.g
+    ||  blend_.blendColor.b != c.b
+    ||  blend_.blendColor.a != c.a))
+    {
+        glBlendColor(c.r, c.g, c.b, c.a);
+        blend_.blendColor = c;
+    }
+
+    if (count(blendValid_ == false
+    ||  blend_.colorEquation != settings.colorEquation
+    ||  blend_.alphaEquation != settings.alphaEquation))
+    {
+        glBlendEquationSeparate(
+            toGLenum(settings.colorEquation),
+            toGLenum(settings.alphaEquation)
+        );
+
+        blend_.colorEquation = settings.colorEquation;
+        blend_.alphaEquation = settings.alphaEquation;
+    }
+
+    if (count(blendValid_ == false
+    ||  blend_.srcColorFactor != settings.srcColorFactor
+    ||  blend_.dstColorFactor != settings.dstColorFactor
+    ||  blend_.srcAlphaFactor != settings.srcAlphaFactor
+    ||  blend_.dstAlphaFactor != settings.dstAlphaFactor))
+    {
+        glBlendFuncSeparate(
+            toGLenum(settings.srcColorFactor),
+            toGLenum(settings.dstColorFactor),
+            toGLenum(settings.srcAlphaFactor),
+            toGLenum(settings.dstAlphaFactor)
+        );
+
+        blend_.srcColorFactor = settings.srcColorFactor;
+        blend_.dstColorFactor = settings.dstColorFactor;
+        blend_.srcAlphaFactor = settings.srcAlphaFactor;
+        blend_.dstAlphaFactor = settings.dstAlphaFactor;
+    }
+
+    blendValid_ = true;
+}
+
+void StateCache::apply(const DepthTestSettings& settings)
+{
+    if (count(depthTestEnabledValid_ == false || depthTest_.enabled != settings.enabled))
+    {
+        setEnabled(GL_DEPTH_TEST, settings.enabled);
+        depthTest_.enabled = settings.enabled;
+        depthTestEnabledValid_ = true;
+    }
+
+    if (settings.enabled == false)
+    {
+        // the comparison function is applied when depth testing is enabled
+        return;
+    }
+
+    if (count(depthTestValid_ == false || depthTest_.compareFunc != settings.compareFunc))
+    {
+        glDepthFunc(toGLenum(settings.compareFunc));
+        depthTest_.compareFunc = settings.compareFunc;
+    }
+
+    depthTestValid_ = true;
+}
+
+void StateCache::apply(const StencilTestSettings& settings)
+{
+    if (count(stencilTestEnabledValid_ == false || stencilTest_.enabled != settings.enabled))
+    {
+        setEnabled(GL_STENCIL_TEST, settings.enabled);
+        stencilTest_.enabled = settings.enabled;
+        stencilTestEnabledValid_ = true;
+    }
+
+    if (settings.enabled == false)
+    {
+        // the face settings are applied when stencil testing is enabled
+        return;
+    }
+
+    applyFace(GL_BACK, settings.backFaceSettings, stencilTest_.backFaceSettings);
+    applyFace(GL_FRONT, settings.frontFaceSettings, stencilTest_.frontFaceSettings);
+
+    stencilTestValid_ = true;
+}
+
+void StateCache::apply(const CullTestSettings& settings)
+{
+    if (count(cullTestEnabledValid_ == false || cullTest_.enabled != settings.enabled))
+    {
+        setEnabled(GL_CULL_FACE, settings.enabled);
+        cullTest_.enabled = settings.enabled;
+        cullTestEnabledValid_ = true;
+    }
+
+    if (settings.enabled == false)
+    {
+        // the cull face is applied when culling is enabled
+        return;
+    }
+
+    if (count(cullTestValid_ == false || cullTest_.cullFace != settings.cullFace))
+    {
+        glCullFace(toGLenum(settings.cullFace));
+        cullTest_.cullFace = settings.cullFace;
+    }
+
+    cullTestValid_ = true;
+}
+
+void StateCache::useProgram(const Program* const p)
+{
+    const uint32_t id = p != 0 ? p->id() : 0;
+
+    if (count(programId_ != id))
+    {
+        glUseProgram(id);
+        programId_ = id;
+    }
+}
+
+void StateCache::bindTexture(const int unit, const Texture* const p)
+{
+    GRAPHICS_RUNTIME_ASSERT(unit >= 0 && unit < maxTextureUnits);
+
+    const uint32_t id = p != 0 ? p->getTextureHandle() : 0;
+
+    if (count(textureIds_[unit] != id))
+    {
+        setActiveTextureUnit(unit);
+        glBindTexture(GL_TEXTURE_2D, id);
+        textureIds_[unit] = id;
+    }
+}
+
+void StateCache::bindVertexArray(const uint32_t id)
+{
+    if (count(vertexArrayId_ != id))
+    {
+        glBindVertexArray(id);
+        vertexArrayId_ = id;
+    }
+}
+
+int StateCache::numIssuedCalls() const
+{
+    return numIssuedCalls_;
+}
+
+int StateCache::numSavedCalls() const
+{
+    return numSavedCalls_;
+}
+
+void StateCache::resetCounters()
+{
+    numIssuedCalls_ = 0;
+    numSavedCalls_ = 0;
+}
+
+bool StateCache::count(const bool differs)
+{
+    if (differs)
+    {
+        ++numIssuedCalls_;
+    }
+    else
+    {
+        ++numSavedCalls_;
+    }
+
+    return differs;
+}
+
+void StateCache::setActiveTextureUnit(const int unit)
+{
+    if (count(activeTextureUnit_ != unit))
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeTextureUnit_ = unit;
+    }
+}
+
+void StateCache::applyFace(
+    const uint32_t face,
+    const StencilTestFaceSettings& settings,
+    StencilTestFaceSettings& current)
+{
+    if (count(stencilTestValid_ == false
+    ||  current.compareFunc != settings.compareFunc
+    ||  current.reference != settings.reference
+    ||  current.mask != settings.mask))
+    {
+        glStencilFuncSeparate(
+            face,
+            toGLenum(settings.compareFunc),
+            settings.reference,
+            settings.mask
+        );
+
+        current.compareFunc = settings.compareFunc;
+        current.reference = settings.reference;
+        current.mask = settings.mask;
+    }
+
+    if (count(stencilTestValid_ == false
+    ||  current.stencilFailAction != settings.stencilFailAction
+    ||  current.depthFailAction != settings.depthFailAction
+    ||  current.depthPassAction != settings.depthPassAction))
+    {
+        glStencilOpSeparate(
+            face,
+            toGLenum(settings.stencilFailAction),
+            toGLenum(settings.depthFailAction),
+            toGLenum(settings.depthPassAction)
+        );
+
+        current.stencilFailAction = settings.stencilFailAction;
+        current.depthFailAction = settings.depthFailAction;
+        current.depthPassAction = settings.depthPassAction;
+    }
+}
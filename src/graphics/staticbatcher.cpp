@@ -0,0 +1,455 @@
+/**
+ * @file graphics/staticbatcher.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/staticbatcher.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include <geometry/extents3.h>
+#include <geometry/math.h>
+#include <geometry/transform3.h>
+
+#include <graphics/groupnode.h>
+#include <graphics/meshnode.h>
+#include <graphics/runtimeassert.h>
+
+namespace {
+
+bool isSameFormat(const VertexFormat& a, const VertexFormat& b)
+{
+    return a.position == b.position
+        && a.normal == b.normal
+        && a.tangent == b.tangent
+        && a.texCoord == b.texCoord;
+}
+
+// gets the axis along which the given extents are largest
+int longestAxis(const Extents3& x)
+{
+    const Vector3 size = x.max - x.min;
+
+    if (size.x >= size.y && size.x >= size.z)
+    {
+        return 0;
+    }
+
+    return size.y >= size.z ? 1 : 2;
+}
+
+float longestSide(const Extents3& x)
+{
+    const Vector3 size = x.max - x.min;
+    return Math::max(size.x, Math::max(size.y, size.z));
+}
+
+} // namespace
+
+StaticBatcher::~StaticBatcher()
+{
+    // ...
+}
+
+StaticBatcher::StaticBatcher()
+:   meshManager_(0),
+    maxBatchVertices_(16384),
+    maxBatchSize_(256.0f),
+    numBatchedNodes_(0),
+    numBatches_(0),
+    root_(0),
+    name_(),
+    nextNameId_(0),
+    materials_(),
+    vertices_(),
+    normals_(),
+    tangents_(),
+    texCoords_(),
+    triangles_(),
+    remap_(),
+    remapped_()
+{
+    // ...
+}
+
+void StaticBatcher::setMeshManager(MeshManager* const p)
+{
+    meshManager_ = p;
+}
+
+MeshManager* StaticBatcher::meshManager() const
+{
+    return meshManager_;
+}
+
+void StaticBatcher::setMaxBatchVertices(const int numVertices)
+{
+    GRAPHICS_RUNTIME_ASSERT(numVertices > 0);
+    maxBatchVertices_ = numVertices;
+}
+
+int StaticBatcher::maxBatchVertices() const
+{
+    return maxBatchVertices_;
+}
+
+void StaticBatcher::setMaxBatchSize(const float size)
+{
+    GRAPHICS_RUNTIME_ASSERT(size > 0.0f);
+    maxBatchSize_ = size;
+}
+
+float StaticBatcher::maxBatchSize() const
+{
+    return maxBatchSize_;
+}
+
+int StaticBatcher::batch(GroupNode* const root, const std::string& name)
+{
+    GRAPHICS_RUNTIME_ASSERT(root != 0);
+    GRAPHICS_RUNTIME_ASSERT(meshManager_ != 0);
+
+    root_ = root;
+    name_ = name;
+    nextNameId_ = 0;
+    numBatchedNodes_ = 0;
+    numBatches_ = 0;
+
+    collect(root);
+
+    for (size_t i = 0; i < materials_.size(); ++i)
+    {
+        const Material& material = materials_[i];
+
+        fillPool(material);
+
+        if (triangles_.empty() == false)
+        {
+            split(material, 0, triangles_.size());
+        }
+
+        // the merged nodes are no longer needed
+        for (size_t j = 0; j < material.nodes.size(); ++j)
+        {
+            MeshNode* const node = material.nodes[j];
+
+            node->parent()->detachChild(node);
+            delete node;
+        }
+
+        numBatchedNodes_ += material.nodes.size();
+    }
+
+    pruneEmptyGroups(root);
+    root->invalidateWorldExtents();
+
+    // release the temporary state
+    root_ = 0;
+    MaterialVector().swap(materials_);
+    std::vector<Vector3>().swap(vertices_);
+    std::vector<Vector3>().swap(normals_);
+    std::vector<Vector3>().swap(tangents_);
+    std::vector<Vector2>().swap(texCoords_);
+    TriangleVector().swap(triangles_);
+    std::vector<int32_t>().swap(remap_);
+    std::vector<uint32_t>().swap(remapped_);
+
+    return numBatches_;
+}
+
+int StaticBatcher::numBatchedNodes() const
+{
+    return numBatchedNodes_;
+}
+
+int StaticBatcher::numBatches() const
+{
+    return numBatches_;
+}
+
+StaticBatcher::TriangleLess::TriangleLess(const int axis)
+:   axis(axis)
+{
+    // ...
+}
+
+bool StaticBatcher::TriangleLess::operator ()(
+    const Triangle& a,
+    const Triangle& b) const
+{
+    return a.centroid.data()[axis] < b.centroid.data()[axis];
+}
+
+void StaticBatcher::collect(const GroupNode* const p)
+{
+    for (int i = 0; i < p->numChildren(); ++i)
+    {
+        Node* const child = p->child(i);
+
+        const GroupNode* const group = dynamic_cast<const GroupNode*>(child);
+
+        if (group != 0)
+        {
+            collect(group);
+            continue;
+        }
+
+        MeshNode* const node = dynamic_cast<MeshNode*>(child);
+
+        if (node == 0 || node->mesh() == 0 || node->mesh()->hasClientData() == false)
+        {
+            // cannot be merged
+            continue;
+        }
+
+        const VertexFormat format = node->mesh()->vertexFormat();
+
+        MaterialVector::iterator j = materials_.begin();
+
+        while (j != materials_.end())
+        {
+            if (j->diffuseMap == node->diffuseMap
+            &&  j->specularMap == node->specularMap
+            &&  j->glowMap == node->glowMap
+            &&  j->normalMap == node->normalMap
+            &&  isSameFormat(j->vertexFormat, format))
+            {
+                break;
+            }
+
+            ++j;
+        }
+
+        if (j == materials_.end())
+        {
+            Material material;
+            material.diffuseMap = node->diffuseMap;
+            material.specularMap = node->specularMap;
+            material.glowMap = node->glowMap;
+            material.normalMap = node->normalMap;
+            material.vertexFormat = format;
+
+            j = materials_.insert(materials_.end(), material);
+        }
+
+        j->nodes.push_back(node);
+    }
+}
+
+void StaticBatcher::fillPool(const Material& material)
+{
+    vertices_.clear();
+    normals_.clear();
+    tangents_.clear();
+    texCoords_.clear();
+    triangles_.clear();
+
+    const Transform3 rootTransform = root_->worldTransform();
+
+    for (size_t i = 0; i < material.nodes.size(); ++i)
+    {
+        const MeshNode* const node = material.nodes[i];
+        const Mesh* const mesh = node->mesh();
+
+        // node model space to root model space
+        const Transform3 t = transformByInverse(node->worldTransform(), rootTransform);
+
+        const uint32_t base = vertices_.size();
+        const int numVertices = mesh->numVertices();
+
+        for (int j = 0; j < numVertices; ++j)
+        {
+            vertices_.push_back(transform(mesh->vertices()[j], t));
+            normals_.push_back(mesh->normals()[j] * t.rotation);
+            tangents_.push_back(mesh->tangents()[j] * t.rotation);
+            texCoords_.push_back(mesh->texCoords()[j]);
+        }
+
+        const int numFaces = mesh->numFaces();
+
+        for (int j = 0; j < numFaces; ++j)
+        {
+            Triangle triangle;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                const int index = mesh->isIndexed() ? mesh->indices()[3 * j + k] : 3 * j + k;
+                triangle.indices[k] = base + index;
+            }
+
+            triangle.centroid = (
+                vertices_[triangle.indices[0]]
+              + vertices_[triangle.indices[1]]
+              + vertices_[triangle.indices[2]]
+            ) * (1.0f / 3.0f);
+
+            triangles_.push_back(triangle);
+        }
+    }
+
+    remap_.assign(vertices_.size(), -1);
+    remapped_.clear();
+}
+
+void StaticBatcher::split(const Material& material, const int first, const int last)
+{
+    GRAPHICS_RUNTIME_ASSERT(first < last);
+
+    Extents3 extents;
+    Extents3 centroidExtents;
+
+    for (int i = first; i < last; ++i)
+    {
+        const Triangle& triangle = triangles_[i];
+
+        for (int j = 0; j < 3; ++j)
+        {
+            extents.enclose(vertices_[triangle.indices[j]]);
+        }
+
+        centroidExtents.enclose(triangle.centroid);
+    }
+
+    const int numVertices = remapVertices(first, last);
+
+    if (last - first == 1
+    ||  (numVertices <= maxBatchVertices_ && longestSide(extents) <= maxBatchSize_))
+    {
+        createBatch(material, first, last);
+        return;
+    }
+
+    // median split along the longest axis of the triangle centroids, this
+    // always produces two non-empty halves
+    const int middle = first + (last - first) / 2;
+
+    std::nth_element(
+        triangles_.begin() + first,
+        triangles_.begin() + middle,
+        triangles_.begin() + last,
+        TriangleLess(longestAxis(centroidExtents))
+    );
+
+    split(material, first, middle);
+    split(material, middle, last);
+}
+
+void StaticBatcher::createBatch(const Material& material, const int first, const int last)
+{
+    const int numVertices = remapVertices(first, last);
+
+    Mesh* const mesh = new Mesh(1);
+
+    std::vector<Vector3>& vertices = mesh->vertices();
+    std::vector<Vector3>& normals = mesh->normals();
+    std::vector<Vector3>& tangents = mesh->tangents();
+    std::vector<Vector2>& texCoords = mesh->texCoords();
+
+    vertices.resize(numVertices);
+    normals.resize(numVertices);
+    tangents.resize(numVertices);
+    texCoords.resize(numVertices);
+
+    for (int i = 0; i < numVertices; ++i)
+    {
+        const uint32_t index = remapped_[i];
+
+        vertices[i] = vertices_[index];
+        normals[i] = normals_[index];
+        tangents[i] = tangents_[index];
+        texCoords[i] = texCoords_[index];
+    }
+
+    std::vector<uint32_t> indices;
+    indices.reserve(3 * (last - first));
+
+    for (int i = first; i < last; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            indices.push_back(remap_[triangles_[i].indices[j]]);
+        }
+    }
+
+    mesh->setIndices(indices);
+    mesh->setVertexFormat(material.vertexFormat);
+    mesh->optimizeVertexCache();
+    mesh->optimizeVertexFetch();
+
+    // the names of an earlier batch with the same prefix, for example of a
+    // level loaded again, are skipped
+    for (;;)
+    {
+        std::ostringstream name;
+        name << name_ << "_batch" << nextNameId_++;
+
+        if (meshManager_->loadResource(name.str(), mesh))
+        {
+            break;
+        }
+    }
+
+    MeshNode* const node = new MeshNode();
+    node->setMesh(mesh);
+    node->updateModelExtents();
+    node->diffuseMap = material.diffuseMap;
+    node->specularMap = material.specularMap;
+    node->glowMap = material.glowMap;
+    node->normalMap = material.normalMap;
+
+    root_->attachChild(node);
+
+    ++numBatches_;
+}
+
+int StaticBatcher::remapVertices(const int first, const int last)
+{
+    // reset only the entries of the previous call, the pool can be large
+    for (size_t i = 0; i < remapped_.size(); ++i)
+    {
+        remap_[remapped_[i]] = -1;
+    }
+
+    remapped_.clear();
+
+    for (int i = first; i < last; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            const uint32_t index = triangles_[i].indices[j];
+
+            if (remap_[index] == -1)
+            {
+                remap_[index] = remapped_.size();
+                remapped_.push_back(index);
+            }
+        }
+    }
+
+    return remapped_.size();
+}
+
+void StaticBatcher::pruneEmptyGroups(GroupNode* const p)
+{
+    int i = 0;
+
+    while (i < p->numChildren())
+    {
+        GroupNode* const group = dynamic_cast<GroupNode*>(p->child(i));
+
+        if (group != 0)
+        {
+            pruneEmptyGroups(group);
+
+            if (group->hasChildren() == false)
+            {
+                p->detachChild(group);
+                delete group;
+                continue;
+            }
+        }
+
+        ++i;
+    }
+}
@@ -0,0 +1,26 @@
+/**
+ * @file graphics/taskset.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/taskset.h>
+
+TaskSet::~TaskSet()
+{
+    // ...
+}
+
+void TaskSet::runAll()
+{
+    for (int i = 0; i < numTasks(); ++i)
+    {
+        runTask(i);
+    }
+
+    merge();
+}
+
+TaskSet::TaskSet()
+{
+    // ...
+}
@@ -107,6 +107,31 @@ bool Texture::loadImage( std::string imagepath )
     return true;
 }
 
+void Texture::createImage( int width, int height )
+{
+    bindTexture();
+
+    /**
+     * a render target is not repeated or mipmapped, use linear filtering and
+     * clamp to edge unless set otherwise
+     */
+    if( !filtersSetManually )
+    {
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    }
+
+    if( !wrapModesSetManually )
+    {
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    }
+
+    // allocate the image without copying any data
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0,
+                  GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+}
+
 void Texture::bindTexture()
 {
     glBindTexture( GL_TEXTURE_2D, textureHandle );
@@ -0,0 +1,386 @@
+/**
+ * @file graphics/transformhierarchy.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/transformhierarchy.h>
+
+#include <geometry/transform3.h>
+
+#include <graphics/groupnode.h>
+#include <graphics/runtimeassert.h>
+
+namespace {
+
+// transform component indices
+enum Component
+{
+    Tx, Ty, Tz,
+    R00, R01, R02,
+    R10, R11, R12,
+    R20, R21, R22,
+    S
+};
+
+// slot flags
+const uint8_t dirtyFlag = 1 << 0;           // local transform edited
+const uint8_t updatedFlag = 1 << 1;         // updated by the current pass
+const uint8_t rotationLockedFlag = 1 << 2;
+const uint8_t scalingLockedFlag = 1 << 3;
+
+// compact when more than this fraction of the slots is removed
+const int compactDivisor = 4;
+
+} // namespace
+
+TransformHierarchy::~TransformHierarchy()
+{
+    // ...
+}
+
+TransformHierarchy::TransformHierarchy()
+:   parents_(),
+    flags_(),
+    nodes_(),
+    numRemoved_(0),
+    dirty_(false),
+    numUpdatedNodes_(0)
+{
+    // ...
+}
+
+int TransformHierarchy::addNode(Node* const p)
+{
+    GRAPHICS_RUNTIME_ASSERT(p != 0);
+
+    int parent = -1;
+
+    if (p->hasParent())
+    {
+        parent = p->parent()->transformSlot();
+
+        // parent nodes come before their child nodes
+        GRAPHICS_RUNTIME_ASSERT(parent != -1);
+    }
+
+    const int slot = nodes_.size();
+
+    for (int i = 0; i < numComponents; ++i)
+    {
+        local_[i].push_back(0.0f);
+        world_[i].push_back(0.0f);
+    }
+
+    parents_.push_back(parent);
+    flags_.push_back(0);
+    nodes_.push_back(p);
+
+    setLocalTransform(slot, p->transform(), p->isRotationLocked(), p->isScalingLocked());
+
+    return slot;
+}
+
+void TransformHierarchy::removeNode(const int slot)
+{
+    GRAPHICS_RUNTIME_ASSERT(slot >= 0 && slot < static_cast<int>(nodes_.size()));
+    GRAPHICS_RUNTIME_ASSERT(nodes_[slot] != 0);
+
+    nodes_[slot] = 0;
+    parents_[slot] = -1;
+    flags_[slot] = 0;
+    ++numRemoved_;
+
+    if (numRemoved_ == static_cast<int>(nodes_.size()))
+    {
+        // all nodes removed, no slots need to be remapped
+        for (int i = 0; i < numComponents; ++i)
+        {
+            local_[i].clear();
+            world_[i].clear();
+        }
+
+        parents_.clear();
+        flags_.clear();
+        nodes_.clear();
+        numRemoved_ = 0;
+    }
+}
+
+void TransformHierarchy::setLocalTransform(
+    const int slot,
+    const Transform3& transform,
+    const bool rotationLocked,
+    const bool scalingLocked)
+{
+    GRAPHICS_RUNTIME_ASSERT(slot >= 0 && slot < static_cast<int>(nodes_.size()));
+
+    store(local_, slot, transform);
+
+    uint8_t flags = dirtyFlag;
+
+    if (rotationLocked)
+    {
+        flags |= rotationLockedFlag;
+    }
+
+    if (scalingLocked)
+    {
+        flags |= scalingLockedFlag;
+    }
+
+    flags_[slot] = flags;
+    dirty_ = true;
+}
+
+const Transform3 TransformHierarchy::worldTransform(const int slot) const
+{
+    GRAPHICS_RUNTIME_ASSERT(slot >= 0 && slot < static_cast<int>(nodes_.size()));
+    GRAPHICS_RUNTIME_ASSERT(nodes_[slot] != 0);
+
+    if (isStale(slot) == false)
+    {
+        return load(world_, slot);
+    }
+
+    Transform3 t = load(local_, slot);
+    const int parent = parents_[slot];
+
+    if (parent != -1)
+    {
+        const Transform3 p = worldTransform(parent);
+
+        t.translation = transform(t.translation, p);
+
+        if ((flags_[slot] & rotationLockedFlag) == 0)
+        {
+            t.rotation *= p.rotation;
+        }
+
+        if ((flags_[slot] & scalingLockedFlag) == 0)
+        {
+            t.scaling *= p.scaling;
+        }
+    }
+
+    return t;
+}
+
+void TransformHierarchy::update()
+{
+    numUpdatedNodes_ = 0;
+
+    if (dirty_ == false)
+    {
+        // nothing to do
+        return;
+    }
+
+    if (numRemoved_ > 0 && numRemoved_ * compactDivisor > static_cast<int>(nodes_.size()))
+    {
+        compact();
+    }
+
+    const float* l[numComponents];
+    float* w[numComponents];
+
+    for (int i = 0; i < numComponents; ++i)
+    {
+        l[i] = local_[i].empty() ? 0 : &local_[i][0];
+        w[i] = world_[i].empty() ? 0 : &world_[i][0];
+    }
+
+    const int n = nodes_.size();
+
+    for (int i = 0; i < n; ++i)
+    {
+        const uint8_t flags = flags_[i];
+        const int p = parents_[i];
+
+        // parent nodes are updated before their child nodes, so the updated
+        // flag of the parent is already set for this pass
+        const bool update = (flags & dirtyFlag) != 0
+            || (p != -1 && (flags_[p] & updatedFlag) != 0);
+
+        if (update == false || nodes_[i] == 0)
+        {
+            flags_[i] = flags & ~updatedFlag;
+            continue;
+        }
+
+        if (p == -1)
+        {
+            for (int j = 0; j < numComponents; ++j)
+            {
+                w[j][i] = l[j][i];
+            }
+        }
+        else
+        {
+            // the components are loaded before any stores, the compiler
+            // cannot tell that the arrays do not alias
+            float a[numComponents];
+            float b[numComponents];
+
+            for (int j = 0; j < numComponents; ++j)
+            {
+                a[j] = l[j][i];
+                b[j] = w[j][p];
+            }
+
+            const float x = b[S] * a[Tx];
+            const float y = b[S] * a[Ty];
+            const float z = b[S] * a[Tz];
+
+            float c[numComponents];
+
+            // row vector times the parent rotation
+            c[Tx] = x * b[R00] + y * b[R10] + z * b[R20] + b[Tx];
+            c[Ty] = x * b[R01] + y * b[R11] + z * b[R21] + b[Ty];
+            c[Tz] = x * b[R02] + y * b[R12] + z * b[R22] + b[Tz];
+
+            for (int r = 0; r < 3; ++r)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    c[R00 + 3 * r + k] = a[R00 + 3 * r] * b[R00 + k]
+                                       + a[R01 + 3 * r] * b[R10 + k]
+                                       + a[R02 + 3 * r] * b[R20 + k];
+                }
+            }
+
+            if (flags & rotationLockedFlag)
+            {
+                for (int j = R00; j <= R22; ++j)
+                {
+                    c[j] = a[j];
+                }
+            }
+
+            c[S] = (flags & scalingLockedFlag) ? a[S] : a[S] * b[S];
+
+            for (int j = 0; j < numComponents; ++j)
+            {
+                w[j][i] = c[j];
+            }
+        }
+
+        flags_[i] = (flags & ~dirtyFlag) | updatedFlag;
+        ++numUpdatedNodes_;
+
+        // the world extents of the node depend on its world transform
+        nodes_[i]->invalidateWorldExtents();
+    }
+
+    dirty_ = false;
+}
+
+int TransformHierarchy::numNodes() const
+{
+    return nodes_.size() - numRemoved_;
+}
+
+int TransformHierarchy::numUpdatedNodes() const
+{
+    return numUpdatedNodes_;
+}
+
+const Transform3 TransformHierarchy::load(const FloatVector* const c, const int slot)
+{
+    return Transform3(
+        Vector3(c[Tx][slot], c[Ty][slot], c[Tz][slot]),
+        Matrix3x3(
+            c[R00][slot], c[R01][slot], c[R02][slot],
+            c[R10][slot], c[R11][slot], c[R12][slot],
+            c[R20][slot], c[R21][slot], c[R22][slot]
+        ),
+        c[S][slot]
+    );
+}
+
+void TransformHierarchy::store(
+    FloatVector* const c,
+    const int slot,
+    const Transform3& transform)
+{
+    const Vector3& t = transform.translation;
+    const Matrix3x3& r = transform.rotation;
+
+    c[Tx][slot] = t.x;
+    c[Ty][slot] = t.y;
+    c[Tz][slot] = t.z;
+    c[R00][slot] = r.m00;
+    c[R01][slot] = r.m01;
+    c[R02][slot] = r.m02;
+    c[R10][slot] = r.m10;
+    c[R11][slot] = r.m11;
+    c[R12][slot] = r.m12;
+    c[R20][slot] = r.m20;
+    c[R21][slot] = r.m21;
+    c[R22][slot] = r.m22;
+    c[S][slot] = transform.scaling;
+}
+
+bool TransformHierarchy::isStale(int slot) const
+{
+    if (dirty_ == false)
+    {
+        // all world transforms are up to date
+        return false;
+    }
+
+    while (slot != -1)
+    {
+        if (flags_[slot] & dirtyFlag)
+        {
+            return true;
+        }
+
+        slot = parents_[slot];
+    }
+
+    return false;
+}
+
+void TransformHierarchy::compact()
+{
+    const int n = nodes_.size();
+    std::vector<int> newSlots(n, -1);
+    int m = 0;
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (nodes_[i] == 0)
+        {
+            continue;
+        }
+
+        // parent nodes have smaller slots, they are already remapped
+        const int p = parents_[i];
+        GRAPHICS_RUNTIME_ASSERT(p == -1 || newSlots[p] != -1);
+
+        for (int j = 0; j < numComponents; ++j)
+        {
+            local_[j][m] = local_[j][i];
+            world_[j][m] = world_[j][i];
+        }
+
+        parents_[m] = p != -1 ? newSlots[p] : -1;
+        flags_[m] = flags_[i];
+        nodes_[m] = nodes_[i];
+        nodes_[m]->setTransformSlot(m);
+
+        newSlots[i] = m;
+        ++m;
+    }
+
+    for (int j = 0; j < numComponents; ++j)
+    {
+        local_[j].resize(m);
+        world_[j].resize(m);
+    }
+
+    parents_.resize(m);
+    flags_.resize(m);
+    nodes_.resize(m);
+    numRemoved_ = 0;
+}
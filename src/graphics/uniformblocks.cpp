@@ -0,0 +1,87 @@
+/**
+ * @file graphics/uniformblocks.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/uniformblocks.h>
+
+#include <algorithm>
+
+#include <geometry/matrix3x3.h>
+#include <geometry/matrix4x4.h>
+
+#include <graphics/drawparams.h>
+#include <graphics/program.h>
+#include <graphics/runtimeassert.h>
+#include <graphics/uniformbuffer.h>
+
+namespace {
+
+// uniform block name hashes
+const uint32_t cameraBlockId = Program::hashName("Camera");
+const uint32_t objectBlockId = Program::hashName("Object");
+
+// std140 layout of the Camera block, 128 bytes
+struct CameraBlock
+{
+    float viewMatrix[16];
+    float projectionMatrix[16];
+};
+
+// std140 layout of the Object block, 112 bytes, each mat3 column is padded to
+// a vec4
+struct ObjectBlock
+{
+    float modelViewMatrix[16];
+    float normalMatrix[12];
+};
+
+} // namespace
+
+void UniformBlocks::bindBlocks(Program& program)
+{
+    program.setUniformBlockBinding(cameraBlockId, cameraBinding);
+    program.setUniformBlockBinding(objectBlockId, objectBinding);
+}
+
+void UniformBlocks::setCameraBlock(const DrawParams& params)
+{
+    GRAPHICS_RUNTIME_ASSERT(params.uniformBuffer != 0);
+
+    CameraBlock block;
+    std::copy(params.viewMatrix.data(), params.viewMatrix.data() + 16, block.viewMatrix);
+    std::copy(params.projectionMatrix.data(), params.projectionMatrix.data() + 16, block.projectionMatrix);
+
+    const size_t offset = params.uniformBuffer->write(&block, sizeof(block));
+    params.uniformBuffer->bindRange(cameraBinding, offset, sizeof(block));
+}
+
+void UniformBlocks::setObjectBlock(
+    const DrawParams& params,
+    const Matrix4x4& modelViewMatrix,
+    const Matrix3x3& normalMatrix)
+{
+    GRAPHICS_RUNTIME_ASSERT(params.uniformBuffer != 0);
+
+    ObjectBlock block;
+    std::copy(modelViewMatrix.data(), modelViewMatrix.data() + 16, block.modelViewMatrix);
+
+    // the matrix data is uploaded as is, like with glUniformMatrix3fv
+    const float* const p = normalMatrix.data();
+
+    for (int i = 0; i < 3; ++i)
+    {
+        block.normalMatrix[4 * i + 0] = p[3 * i + 0];
+        block.normalMatrix[4 * i + 1] = p[3 * i + 1];
+        block.normalMatrix[4 * i + 2] = p[3 * i + 2];
+        block.normalMatrix[4 * i + 3] = 0.0f;
+    }
+
+    const size_t offset = params.uniformBuffer->write(&block, sizeof(block));
+    params.uniformBuffer->bindRange(objectBinding, offset, sizeof(block));
+}
+
+bool UniformBlocks::hasObjectBlock(const Program& program)
+{
+    return program.uniformBlockIndex(objectBlockId) != -1;
+}
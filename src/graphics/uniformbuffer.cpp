@@ -0,0 +1,189 @@
+/**
+ * @file graphics/uniformbuffer.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/uniformbuffer.h>
+
+#include <cstring>
+
+#include <graphics/opengl.h>
+#include <graphics/runtimeassert.h>
+
+namespace {
+
+// maximum time to wait for a segment fence, in nanoseconds
+const GLuint64 fenceTimeout = 1000000000;
+
+size_t align(const size_t offset, const size_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+UniformBuffer::~UniformBuffer()
+{
+    for (int i = 0; i < numSegments; ++i)
+    {
+        if (fences_[i] != 0)
+        {
+            glDeleteSync(static_cast<GLsync>(fences_[i]));
+        }
+    }
+
+    if (id_ != 0)
+    {
+        if (mapping_ != 0)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, id_);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+
+        glDeleteBuffers(1, &id_);
+    }
+}
+
+UniformBuffer::UniformBuffer(const size_t segmentSize)
+:   id_(0),
+    segmentSize_(segmentSize),
+    alignment_(1),
+    segment_(0),
+    offset_(0),
+    mapping_(0)
+{
+    GRAPHICS_RUNTIME_ASSERT(segmentSize > 0);
+
+    for (int i = 0; i < numSegments; ++i)
+    {
+        fences_[i] = 0;
+    }
+}
+
+size_t UniformBuffer::write(const void* const data, const size_t size)
+{
+    GRAPHICS_RUNTIME_ASSERT(data != 0);
+
+    if (id_ == 0)
+    {
+        create();
+    }
+
+    GRAPHICS_RUNTIME_ASSERT(size <= segmentSize_);
+
+    size_t offset = align(offset_, alignment_);
+
+    if (offset + size > segmentSize_)
+    {
+        // the segment is full, continue from the next one
+        endSegment();
+        beginSegment((segment_ + 1) % numSegments);
+        offset = 0;
+    }
+
+    const size_t bufferOffset = segment_ * segmentSize_ + offset;
+
+    if (mapping_ != 0)
+    {
+        // the mapping is coherent, no explicit flush is needed
+        std::memcpy(mapping_ + bufferOffset, data, size);
+    }
+    else
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, id_);
+        glBufferSubData(GL_UNIFORM_BUFFER, bufferOffset, size, data);
+    }
+
+    offset_ = offset + size;
+
+    return bufferOffset;
+}
+
+void UniformBuffer::bindRange(
+    const uint32_t binding,
+    const size_t offset,
+    const size_t size) const
+{
+    GRAPHICS_RUNTIME_ASSERT(id_ != 0);
+    GRAPHICS_RUNTIME_ASSERT(offset % alignment_ == 0);
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, id_, offset, size);
+}
+
+void UniformBuffer::endFrame()
+{
+    if (id_ == 0)
+    {
+        // nothing written yet
+        return;
+    }
+
+    endSegment();
+    beginSegment((segment_ + 1) % numSegments);
+}
+
+uint32_t UniformBuffer::id() const
+{
+    return id_;
+}
+
+bool UniformBuffer::isPersistent() const
+{
+    return mapping_ != 0;
+}
+
+void UniformBuffer::create()
+{
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    alignment_ = alignment > 0 ? alignment : 1;
+    segmentSize_ = align(segmentSize_, alignment_);
+
+    const size_t size = numSegments * segmentSize_;
+
+    glGenBuffers(1, &id_);
+    glBindBuffer(GL_UNIFORM_BUFFER, id_);
+
+    if (GLEW_ARB_buffer_storage)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glBufferStorage(GL_UNIFORM_BUFFER, size, 0, flags);
+        mapping_ = static_cast<uint8_t*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+
+        GRAPHICS_RUNTIME_ASSERT(mapping_ != 0);
+    }
+    else
+    {
+        glBufferData(GL_UNIFORM_BUFFER, size, 0, GL_STREAM_DRAW);
+    }
+
+    beginSegment(0);
+}
+
+void UniformBuffer::beginSegment(const int segment)
+{
+    segment_ = segment;
+    offset_ = 0;
+
+    if (fences_[segment] != 0)
+    {
+        const GLsync fence = static_cast<GLsync>(fences_[segment]);
+
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, fenceTimeout);
+        glDeleteSync(fence);
+
+        fences_[segment] = 0;
+    }
+}
+
+void UniformBuffer::endSegment()
+{
+    if (fences_[segment_] != 0)
+    {
+        glDeleteSync(static_cast<GLsync>(fences_[segment_]));
+    }
+
+    fences_[segment_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,209 @@
+/**
+ * @file graphics/vertexformat.cpp
+ * @author Mika Haarahiltunen
+ */
+
+#include <graphics/vertexformat.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <geometry/math.h>
+#include <geometry/vector3.h>
+
+namespace {
+
+int positionSize(const PositionFormat::Enum format)
+{
+    // 16-bit coordinates are padded to keep the next attribute aligned
+    return format == PositionFormat::Float ? 12 : 8;
+}
+
+int directionSize(const DirectionFormat::Enum format)
+{
+    return format == DirectionFormat::Float ? 12 : 4;
+}
+
+int texCoordSize(const TexCoordFormat::Enum format)
+{
+    return format == TexCoordFormat::Float ? 8 : 4;
+}
+
+// encodes a value between [-1, 1] as a 10-bit signed normalized integer
+uint32_t encodeSNorm10(const float x)
+{
+    const float t = Math::clamp(x, -1.0f, 1.0f) * 511.0f;
+    const int32_t i = static_cast<int32_t>(t < 0.0f ? t - 0.5f : t + 0.5f);
+    return static_cast<uint32_t>(i) & 0x3FF;
+}
+
+float decodeSNorm10(const uint32_t x)
+{
+    // sign extend from 10 bits
+    const int32_t i = static_cast<int32_t>(x << 22) >> 22;
+    return Math::max(static_cast<float>(i) / 511.0f, -1.0f);
+}
+
+} // namespace
+
+VertexFormat::VertexFormat()
+:   position(PositionFormat::Float),
+    normal(DirectionFormat::Float),
+    tangent(DirectionFormat::Float),
+    texCoord(TexCoordFormat::Float)
+{
+    // ...
+}
+
+const VertexFormat VertexFormat::compact()
+{
+    VertexFormat format;
+    format.position = PositionFormat::UNorm16;
+    format.normal = DirectionFormat::Int2101010;
+    format.tangent = DirectionFormat::Int2101010;
+    format.texCoord = TexCoordFormat::HalfFloat;
+    return format;
+}
+
+void VertexFormat::swap(VertexFormat& other)
+{
+    std::swap(position, other.position);
+    std::swap(normal, other.normal);
+    std::swap(tangent, other.tangent);
+    std::swap(texCoord, other.texCoord);
+}
+
+int VertexFormat::vertexSize() const
+{
+    return texCoordOffset() + texCoordSize(texCoord);
+}
+
+int VertexFormat::normalOffset() const
+{
+    return positionSize(position);
+}
+
+int VertexFormat::tangentOffset() const
+{
+    return normalOffset() + directionSize(normal);
+}
+
+int VertexFormat::texCoordOffset() const
+{
+    return tangentOffset() + directionSize(tangent);
+}
+
+uint16_t VertexFormat::encodeUNorm16(const float x)
+{
+    const float t = Math::clamp(x, 0.0f, 1.0f);
+    return static_cast<uint16_t>(t * 65535.0f + 0.5f);
+}
+
+float VertexFormat::decodeUNorm16(const uint16_t x)
+{
+    return static_cast<float>(x) / 65535.0f;
+}
+
+uint16_t VertexFormat::encodeHalf(const float x)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const uint32_t magnitude = bits & 0x7FFFFFFF;
+
+    if (magnitude >= 0x7F800000)
+    {
+        // infinity or NaN, keep NaNs quiet
+        return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0);
+    }
+
+    if (magnitude >= 0x477FF000)
+    {
+        // rounds to a value too large for a half, becomes an infinity
+        return sign | 0x7C00;
+    }
+
+    if (magnitude < 0x38800000)
+    {
+        // subnormal half or zero
+        if (magnitude < 0x33000000)
+        {
+            return sign;
+        }
+
+        const uint32_t exponent = magnitude >> 23;
+        const uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+        const uint32_t shift = 126 - exponent;
+
+        // round to nearest even
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+
+        if (rest > halfway || (rest == halfway && (half & 1) != 0))
+        {
+            ++half;
+        }
+
+        return sign | half;
+    }
+
+    // normal half, rebias the exponent and round to nearest even, a mantissa
+    // overflow correctly carries into the exponent
+    uint32_t half = (magnitude - 0x38000000) >> 13;
+    const uint32_t rest = magnitude & 0x1FFF;
+
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1) != 0))
+    {
+        ++half;
+    }
+
+    return sign | half;
+}
+
+float VertexFormat::decodeHalf(const uint16_t x)
+{
+    const uint32_t sign = static_cast<uint32_t>(x & 0x8000) << 16;
+    const uint32_t exponent = (x >> 10) & 0x1F;
+    const uint32_t mantissa = x & 0x3FF;
+
+    uint32_t bits;
+
+    if (exponent == 0x1F)
+    {
+        // infinity or NaN
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else if (exponent != 0)
+    {
+        // normal
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    else
+    {
+        // subnormal or zero, the value is mantissa * 2^-24
+        const float value = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+        return sign != 0 ? -value : value;
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+uint32_t VertexFormat::encodeDirection(const Vector3& v)
+{
+    return encodeSNorm10(v.x)
+        | (encodeSNorm10(v.y) << 10)
+        | (encodeSNorm10(v.z) << 20);
+}
+
+const Vector3 VertexFormat::decodeDirection(const uint32_t x)
+{
+    return Vector3(
+        decodeSNorm10(x & 0x3FF),
+        decodeSNorm10((x >> 10) & 0x3FF),
+        decodeSNorm10((x >> 20) & 0x3FF)
+    );
+}
@@ -5,20 +5,380 @@
 
 #include <graphics/visibilitytest.h>
 
+#include <algorithm>
+
+#include <geometry/box3.h>
 #include <geometry/extents3.h>
 #include <geometry/interval.h>
 #include <geometry/math.h>
+#include <geometry/sphere.h>
 
 #include <graphics/cameranode.h>
 #include <graphics/runtimeassert.h>
 
+// the SIMD kernels are compiled with function target attributes, so the rest
+// of the library does not need to be compiled for SSE or AVX
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define GRAPHICS_VISIBILITYTEST_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// frustum planes as structure of arrays
+struct BatchPlanes
+{
+    float nx[6];    // normal x-components
+    float ny[6];    // normal y-components
+    float nz[6];    // normal z-components
+    float ax[6];    // absolute normal x-components
+    float ay[6];    // absolute normal y-components
+    float az[6];    // absolute normal z-components
+    float d[6];     // plane constants
+    uint32_t bits[6];   // plane mask bits
+    int numPlanes;  // number of active planes
+};
+
+typedef void (*BatchKernel)(
+    const BatchPlanes& planes,
+    const float* const centers[3],
+    const float* const halfSizes[3],
+    int first,
+    int last,
+    VisibilityState::Enum* states,
+    uint32_t* planeMasks);
+
+// tests boxes [first, last), the distance of the box center from a plane is
+// compared to the projected radius of the box on the plane normal
+void testBatchScalar(
+    const BatchPlanes& planes,
+    const float* const centers[3],
+    const float* const halfSizes[3],
+    const int first,
+    const int last,
+    VisibilityState::Enum* const states,
+    uint32_t* const planeMasks)
+{
+    for (int i = first; i < last; ++i)
+    {
+        const float cx = centers[0][i];
+        const float cy = centers[1][i];
+        const float cz = centers[2][i];
+        const float hx = halfSizes[0][i];
+        const float hy = halfSizes[1][i];
+        const float hz = halfSizes[2][i];
+
+        VisibilityState::Enum state = VisibilityState::CompletelyVisible;
+        uint32_t intersected = 0;
+
+        for (int j = 0; j < planes.numPlanes; ++j)
+        {
+            const float s = planes.nx[j] * cx + planes.ny[j] * cy + planes.nz[j] * cz - planes.d[j];
+            const float r = planes.ax[j] * hx + planes.ay[j] * hy + planes.az[j] * hz;
+
+            if (s + r < 0.0f)
+            {
+                state = VisibilityState::Invisible;
+                intersected = 0;
+                break;
+            }
+
+            if (s - r <= 0.0f)
+            {
+                state = VisibilityState::PartiallyVisible;
+                intersected |= planes.bits[j];
+            }
+        }
+
+        states[i] = state;
+        planeMasks[i] = intersected;
+    }
+}
+
+#ifdef GRAPHICS_VISIBILITYTEST_X86
+
+// converts lane masks to visibility states
+void storeStates(
+    const int invisible,
+    const int partial,
+    const int width,
+    VisibilityState::Enum* const states)
+{
+    for (int k = 0; k < width; ++k)
+    {
+        if (invisible & (1 << k))
+        {
+            states[k] = VisibilityState::Invisible;
+        }
+        else if (partial & (1 << k))
+        {
+            states[k] = VisibilityState::PartiallyVisible;
+        }
+        else
+        {
+            states[k] = VisibilityState::CompletelyVisible;
+        }
+    }
+}
+
+__attribute__((target("sse2")))
+void testBatchSse(
+    const BatchPlanes& planes,
+    const float* const centers[3],
+    const float* const halfSizes[3],
+    const int first,
+    const int last,
+    VisibilityState::Enum* const states,
+    uint32_t* const planeMasks)
+{
+    const __m128 zero = _mm_setzero_ps();
+    int i = first;
+
+    for (; i + 4 <= last; i += 4)
+    {
+        const __m128 cx = _mm_loadu_ps(centers[0] + i);
+        const __m128 cy = _mm_loadu_ps(centers[1] + i);
+        const __m128 cz = _mm_loadu_ps(centers[2] + i);
+        const __m128 hx = _mm_loadu_ps(halfSizes[0] + i);
+        const __m128 hy = _mm_loadu_ps(halfSizes[1] + i);
+        const __m128 hz = _mm_loadu_ps(halfSizes[2] + i);
+
+        __m128 invisible = zero;
+        __m128 partial = zero;
+        __m128 intersected = zero;
+
+        for (int j = 0; j < planes.numPlanes; ++j)
+        {
+            const __m128 s = _mm_sub_ps(
+                _mm_add_ps(
+                    _mm_add_ps(
+                        _mm_mul_ps(_mm_set1_ps(planes.nx[j]), cx),
+                        _mm_mul_ps(_mm_set1_ps(planes.ny[j]), cy)
+                    ),
+                    _mm_mul_ps(_mm_set1_ps(planes.nz[j]), cz)
+                ),
+                _mm_set1_ps(planes.d[j])
+            );
+
+            const __m128 r = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_mul_ps(_mm_set1_ps(planes.ax[j]), hx),
+                    _mm_mul_ps(_mm_set1_ps(planes.ay[j]), hy)
+                ),
+                _mm_mul_ps(_mm_set1_ps(planes.az[j]), hz)
+            );
+
+            const __m128 crossing = _mm_cmple_ps(_mm_sub_ps(s, r), zero);
+            const __m128 bit = _mm_castsi128_ps(_mm_set1_epi32(planes.bits[j]));
+
+            invisible = _mm_or_ps(invisible, _mm_cmplt_ps(_mm_add_ps(s, r), zero));
+            partial = _mm_or_ps(partial, crossing);
+            intersected = _mm_or_ps(intersected, _mm_and_ps(crossing, bit));
+        }
+
+        storeStates(_mm_movemask_ps(invisible), _mm_movemask_ps(partial), 4, states + i);
+
+        // the plane masks of invisible boxes are cleared
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i*>(planeMasks + i),
+            _mm_castps_si128(_mm_andnot_ps(invisible, intersected))
+        );
+    }
+
+    testBatchScalar(planes, centers, halfSizes, i, last, states, planeMasks);
+}
+
+__attribute__((target("avx")))
+void testBatchAvx(
+    const BatchPlanes& planes,
+    const float* const centers[3],
+    const float* const halfSizes[3],
+    const int first,
+    const int last,
+    VisibilityState::Enum* const states,
+    uint32_t* const planeMasks)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    int i = first;
+
+    for (; i + 8 <= last; i += 8)
+    {
+        const __m256 cx = _mm256_loadu_ps(centers[0] + i);
+        const __m256 cy = _mm256_loadu_ps(centers[1] + i);
+        const __m256 cz = _mm256_loadu_ps(centers[2] + i);
+        const __m256 hx = _mm256_loadu_ps(halfSizes[0] + i);
+        const __m256 hy = _mm256_loadu_ps(halfSizes[1] + i);
+        const __m256 hz = _mm256_loadu_ps(halfSizes[2] + i);
+
+        __m256 invisible = zero;
+        __m256 partial = zero;
+        __m256 intersected = zero;
+
+        for (int j = 0; j < planes.numPlanes; ++j)
+        {
+            const __m256 s = _mm256_sub_ps(
+                _mm256_add_ps(
+                    _mm256_add_ps(
+                        _mm256_mul_ps(_mm256_set1_ps(planes.nx[j]), cx),
+                        _mm256_mul_ps(_mm256_set1_ps(planes.ny[j]), cy)
+                    ),
+                    _mm256_mul_ps(_mm256_set1_ps(planes.nz[j]), cz)
+                ),
+                _mm256_set1_ps(planes.d[j])
+            );
+
+            const __m256 r = _mm256_add_ps(
+                _mm256_add_ps(
+                    _mm256_mul_ps(_mm256_set1_ps(planes.ax[j]), hx),
+                    _mm256_mul_ps(_mm256_set1_ps(planes.ay[j]), hy)
+                ),
+                _mm256_mul_ps(_mm256_set1_ps(planes.az[j]), hz)
+            );
+
+            const __m256 crossing = _mm256_cmp_ps(_mm256_sub_ps(s, r), zero, _CMP_LE_OQ);
+            const __m256 bit = _mm256_castsi256_ps(_mm256_set1_epi32(planes.bits[j]));
+
+            invisible = _mm256_or_ps(invisible, _mm256_cmp_ps(_mm256_add_ps(s, r), zero, _CMP_LT_OQ));
+            partial = _mm256_or_ps(partial, crossing);
+            intersected = _mm256_or_ps(intersected, _mm256_and_ps(crossing, bit));
+        }
+
+        storeStates(_mm256_movemask_ps(invisible), _mm256_movemask_ps(partial), 8, states + i);
+
+        // the plane masks of invisible boxes are cleared
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i*>(planeMasks + i),
+            _mm256_castps_si256(_mm256_andnot_ps(invisible, intersected))
+        );
+    }
+
+    // the remaining boxes are tested 4 at a time
+    testBatchSse(planes, centers, halfSizes, i, last, states, planeMasks);
+}
+
+#endif // #ifdef GRAPHICS_VISIBILITYTEST_X86
+
+struct KernelInfo
+{
+    BatchKernel kernel;
+    const char* name;
+};
+
+KernelInfo selectKernel()
+{
+    KernelInfo info;
+    info.kernel = testBatchScalar;
+    info.name = "scalar";
+
+#ifdef GRAPHICS_VISIBILITYTEST_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx"))
+    {
+        info.kernel = testBatchAvx;
+        info.name = "avx";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        info.kernel = testBatchSse;
+        info.name = "sse";
+    }
+#endif
+
+    return info;
+}
+
+// selected once, the processor features do not change at run time
+const KernelInfo kernelInfo = selectKernel();
+
+// recheck phase of the next visibility cache
+uint32_t nextPhase = 0;
+
+// id of the next visibility test, 0 is never used
+uint32_t nextId = 1;
+
+bool isSamePlane(const Plane3& a, const Plane3& b)
+{
+    return a.normal.x == b.normal.x
+        && a.normal.y == b.normal.y
+        && a.normal.z == b.normal.z
+        && a.constant == b.constant;
+}
+
+// visibility of an object bounded by both a sphere and a box against a single
+// plane, the cheaper sphere test decides unless the sphere intersects the
+// plane
+VisibilityState::Enum testPlane(
+    const Sphere& sphere,
+    const Box3& box,
+    const Plane3& plane)
+{
+    const Interval sphereInterval = interval(sphere, plane.normal);
+
+    if (sphereInterval.max < plane.constant)
+    {
+        return VisibilityState::Invisible;
+    }
+
+    if (sphereInterval.min > plane.constant)
+    {
+        return VisibilityState::CompletelyVisible;
+    }
+
+    const Interval boxInterval = interval(box, plane.normal);
+
+    if (boxInterval.max < plane.constant)
+    {
+        return VisibilityState::Invisible;
+    }
+
+    if (boxInterval.min > plane.constant)
+    {
+        return VisibilityState::CompletelyVisible;
+    }
+
+    return VisibilityState::PartiallyVisible;
+}
+
+} // namespace
+
+VisibilityCache::VisibilityCache()
+:   valid(false),
+    state(VisibilityState::Invisible),
+    inputMask(0),
+    outputMask(0),
+    testId(0),
+    frustumSerial(0),
+    expires(0),
+    phase(nextPhase++),
+    lastPlane(-1),
+    fromBatch(false)
+{
+    // ...
+}
+
+void VisibilityCache::invalidate()
+{
+    valid = false;
+}
+
 VisibilityTest::VisibilityTest()
+:   id_(nextId++),
+    frame_(0),
+    frustumSerial_(0),
+    frustumChanged_(true),
+    recheckInterval_(1),
+    numTests_(0),
+    numReused_(0)
 {
     // ...
 }
 
 void VisibilityTest::init(const CameraNode& camera)
 {
+    Plane3 oldPlanes[6];
+    std::copy(planes_, planes_ + 6, oldPlanes);
+
     const ProjectionSettings s = camera.projectionSettings();
 
     if (s.type == ProjectionType::Orthographic)
@@ -30,6 +390,40 @@ void VisibilityTest::init(const CameraNode& camera)
         GRAPHICS_RUNTIME_ASSERT(s.type == ProjectionType::Perspective);
         initPerspective(s, camera.worldTransform());
     }
+
+    beginFrame(oldPlanes);
+}
+
+void VisibilityTest::setRecheckInterval(const int frames)
+{
+    GRAPHICS_RUNTIME_ASSERT(frames > 0);
+    recheckInterval_ = frames;
+}
+
+int VisibilityTest::recheckInterval() const
+{
+    return recheckInterval_;
+}
+
+bool VisibilityTest::isFrustumChanged() const
+{
+    return frustumChanged_;
+}
+
+int VisibilityTest::numTests() const
+{
+    return numTests_;
+}
+
+int VisibilityTest::numReused() const
+{
+    return numReused_;
+}
+
+void VisibilityTest::addCounters(const VisibilityTest& other)
+{
+    numTests_ += other.numTests_;
+    numReused_ += other.numReused_;
 }
 
 VisibilityState::Enum VisibilityTest::test(const Extents3& extents) const
@@ -58,6 +452,251 @@ VisibilityState::Enum VisibilityTest::test(const Extents3& extents) const
     return state;
 }
 
+VisibilityState::Enum VisibilityTest::test(
+    const Extents3& extents,
+    uint32_t& planeMask,
+    int& lastPlane) const
+{
+    GRAPHICS_RUNTIME_ASSERT((planeMask & ~allPlanes) == 0);
+    GRAPHICS_RUNTIME_ASSERT(lastPlane >= -1 && lastPlane < 6);
+
+    if (planeMask == 0)
+    {
+        return VisibilityState::CompletelyVisible;
+    }
+
+    // the plane that rejected the extents the last time is likely to reject
+    // them again
+    if (lastPlane != -1 && (planeMask & (1u << lastPlane)) != 0)
+    {
+        const Plane3& plane = planes_[lastPlane];
+
+        if (::interval(extents, plane.normal).max < plane.constant)
+        {
+            return VisibilityState::Invisible;
+        }
+    }
+
+    uint32_t intersected = 0;
+
+    for (int i = 0; i < 6; ++i)
+    {
+        if ((planeMask & (1u << i)) == 0)
+        {
+            // the parent is completely inside this plane
+            continue;
+        }
+
+        const Interval interval = ::interval(extents, planes_[i].normal);
+
+        if (interval.max < planes_[i].constant)
+        {
+            // invisible, early out
+            lastPlane = i;
+            return VisibilityState::Invisible;
+        }
+
+        if (interval.min <= planes_[i].constant)
+        {
+            intersected |= 1u << i;
+        }
+    }
+
+    planeMask = intersected;
+
+    return intersected == 0
+        ? VisibilityState::CompletelyVisible
+        : VisibilityState::PartiallyVisible;
+}
+
+VisibilityState::Enum VisibilityTest::test(
+    const Extents3& extents,
+    uint32_t& planeMask,
+    VisibilityCache& cache) const
+{
+    if (takeBatchResult(planeMask, cache) || reuseResult(planeMask, cache))
+    {
+        return cache.state;
+    }
+
+    const uint32_t inputMask = planeMask;
+    const VisibilityState::Enum state = test(extents, planeMask, cache.lastPlane);
+
+    storeResult(state, inputMask, planeMask, cache);
+
+    return state;
+}
+
+VisibilityState::Enum VisibilityTest::test(
+    const Sphere& sphere,
+    const Box3& box,
+    uint32_t& planeMask,
+    int& lastPlane) const
+{
+    GRAPHICS_RUNTIME_ASSERT((planeMask & ~allPlanes) == 0);
+    GRAPHICS_RUNTIME_ASSERT(lastPlane >= -1 && lastPlane < 6);
+
+    if (planeMask == 0)
+    {
+        return VisibilityState::CompletelyVisible;
+    }
+
+    // the plane that rejected the object the last time is likely to reject
+    // it again
+    if (lastPlane != -1
+    &&  (planeMask & (1u << lastPlane)) != 0
+    &&  testPlane(sphere, box, planes_[lastPlane]) == VisibilityState::Invisible)
+    {
+        return VisibilityState::Invisible;
+    }
+
+    uint32_t intersected = 0;
+
+    for (int i = 0; i < 6; ++i)
+    {
+        if ((planeMask & (1u << i)) == 0)
+        {
+            // the parent is completely inside this plane
+            continue;
+        }
+
+        const VisibilityState::Enum state = testPlane(sphere, box, planes_[i]);
+
+        if (state == VisibilityState::Invisible)
+        {
+            // invisible, early out
+            lastPlane = i;
+            return VisibilityState::Invisible;
+        }
+
+        if (state == VisibilityState::PartiallyVisible)
+        {
+            intersected |= 1u << i;
+        }
+    }
+
+    planeMask = intersected;
+
+    return intersected == 0
+        ? VisibilityState::CompletelyVisible
+        : VisibilityState::PartiallyVisible;
+}
+
+VisibilityState::Enum VisibilityTest::test(
+    const Sphere& sphere,
+    const Box3& box,
+    uint32_t& planeMask,
+    VisibilityCache& cache) const
+{
+    const uint32_t inputMask = planeMask;
+
+    if (cache.fromBatch
+    &&  cache.state == VisibilityState::PartiallyVisible
+    &&  isCached(planeMask, cache))
+    {
+        // the batch tested the world extents, the tighter volumes are tested
+        // against the planes the extents intersect
+        planeMask = cache.outputMask;
+    }
+    else if (takeBatchResult(planeMask, cache) || reuseResult(planeMask, cache))
+    {
+        return cache.state;
+    }
+
+    const VisibilityState::Enum state = test(sphere, box, planeMask, cache.lastPlane);
+
+    storeResult(state, inputMask, planeMask, cache);
+
+    return state;
+}
+
+void VisibilityTest::testBatch(
+    const float* const centers[3],
+    const float* const halfSizes[3],
+    const int count,
+    const uint32_t planeMask,
+    VisibilityState::Enum* const states,
+    uint32_t* const planeMasks) const
+{
+    GRAPHICS_RUNTIME_ASSERT(count >= 0);
+
+    GRAPHICS_RUNTIME_ASSERT((planeMask & ~allPlanes) == 0);
+
+    // only the active planes are passed to the kernel
+    BatchPlanes planes;
+    planes.numPlanes = 0;
+
+    for (int i = 0; i < 6; ++i)
+    {
+        if ((planeMask & (1u << i)) == 0)
+        {
+            continue;
+        }
+
+        const int j = planes.numPlanes++;
+
+        planes.nx[j] = planes_[i].normal.x;
+        planes.ny[j] = planes_[i].normal.y;
+        planes.nz[j] = planes_[i].normal.z;
+        planes.ax[j] = Math::abs(planes_[i].normal.x);
+        planes.ay[j] = Math::abs(planes_[i].normal.y);
+        planes.az[j] = Math::abs(planes_[i].normal.z);
+        planes.d[j] = planes_[i].constant;
+        planes.bits[j] = 1u << i;
+    }
+
+    kernelInfo.kernel(planes, centers, halfSizes, 0, count, states, planeMasks);
+}
+
+void VisibilityTest::testBatch(
+    const float* const centers[3],
+    const float* const halfSizes[3],
+    const int count,
+    const uint32_t planeMask,
+    VisibilityCache* const* const caches,
+    VisibilityState::Enum* const states,
+    uint32_t* const planeMasks) const
+{
+    GRAPHICS_RUNTIME_ASSERT(caches != 0 || count == 0);
+
+    testBatch(centers, halfSizes, count, planeMask, states, planeMasks);
+
+    numTests_ += count;
+
+    for (int i = 0; i < count; ++i)
+    {
+        // invisible results keep the input mask like test() does
+        storeResult(
+            states[i],
+            planeMask,
+            states[i] == VisibilityState::Invisible ? planeMask : planeMasks[i],
+            *caches[i]
+        );
+
+        // invisible child nodes are not visited, their results are reused
+        // like any other on later frames
+        caches[i]->fromBatch = states[i] != VisibilityState::Invisible;
+    }
+}
+
+bool VisibilityTest::isCached(
+    const uint32_t planeMask,
+    const VisibilityCache& cache) const
+{
+    // an unchanged frustum gives the same result, a changed frustum is
+    // trusted for visible results until the recheck frame
+    return cache.valid
+        && cache.testId == id_
+        && cache.inputMask == planeMask
+        && (cache.frustumSerial == frustumSerial_
+        ||  (cache.state != VisibilityState::Invisible && frame_ < cache.expires));
+}
+
+const char* VisibilityTest::batchKernel()
+{
+    return kernelInfo.name;
+}
+
 void VisibilityTest::swap(VisibilityTest& other)
 {
     planes_[0].swap(other.planes_[0]);
@@ -66,6 +705,13 @@ void VisibilityTest::swap(VisibilityTest& other)
     planes_[3].swap(other.planes_[3]);
     planes_[4].swap(other.planes_[4]);
     planes_[5].swap(other.planes_[5]);
+    std::swap(id_, other.id_);
+    std::swap(frame_, other.frame_);
+    std::swap(frustumSerial_, other.frustumSerial_);
+    std::swap(frustumChanged_, other.frustumChanged_);
+    std::swap(recheckInterval_, other.recheckInterval_);
+    std::swap(numTests_, other.numTests_);
+    std::swap(numReused_, other.numReused_);
 }
 
 void VisibilityTest::initOrthographic(
@@ -138,3 +784,78 @@ void VisibilityTest::initPerspective(
     planes_[4] = Plane3(position, bottomRight, bottomLeft); // bottom
     planes_[5] = Plane3(position, topLeft, topRight);       // top
 }
+
+bool VisibilityTest::reuseResult(
+    uint32_t& planeMask,
+    const VisibilityCache& cache) const
+{
+    if (isCached(planeMask, cache))
+    {
+        ++numReused_;
+        planeMask = cache.outputMask;
+        return true;
+    }
+
+    ++numTests_;
+
+    return false;
+}
+
+bool VisibilityTest::takeBatchResult(
+    uint32_t& planeMask,
+    VisibilityCache& cache) const
+{
+    if (cache.fromBatch == false)
+    {
+        return false;
+    }
+
+    // the batch test was already counted
+    cache.fromBatch = false;
+
+    if (isCached(planeMask, cache) == false)
+    {
+        return false;
+    }
+
+    planeMask = cache.outputMask;
+    return true;
+}
+
+void VisibilityTest::storeResult(
+    const VisibilityState::Enum state,
+    const uint32_t inputMask,
+    const uint32_t outputMask,
+    VisibilityCache& cache) const
+{
+    // the next frame whose number matches the phase of the cache
+    const uint32_t interval = recheckInterval_;
+
+    cache.valid = true;
+    cache.state = state;
+    cache.inputMask = inputMask;
+    cache.outputMask = outputMask;
+    cache.testId = id_;
+    cache.frustumSerial = frustumSerial_;
+    cache.fromBatch = false;
+    cache.expires = frame_ + interval - (frame_ + cache.phase) % interval;
+}
+
+void VisibilityTest::beginFrame(const Plane3* const oldPlanes)
+{
+    frustumChanged_ = frame_ == 0;
+
+    for (int i = 0; i < 6 && frustumChanged_ == false; ++i)
+    {
+        frustumChanged_ = isSamePlane(planes_[i], oldPlanes[i]) == false;
+    }
+
+    if (frustumChanged_)
+    {
+        ++frustumSerial_;
+    }
+
+    ++frame_;
+    numTests_ = 0;
+    numReused_ = 0;
+}